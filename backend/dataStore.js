@@ -2,6 +2,8 @@
 const users = new Map();
 const attendanceRecords = new Map();
 const activeTokens = new Set();
+// Latest metrics summary per device (routes/esp32.js), read by the dashboard
+const deviceMetrics = new Map();
 
 // Sample data for development/testing
 const initializeSampleData = () => {
@@ -81,6 +83,7 @@ module.exports = {
     users,
     attendanceRecords,
     activeTokens,
+    deviceMetrics,
     initializeSampleData,
     findUserByEmail,
     findUserByRFID,
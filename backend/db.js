@@ -11,6 +11,7 @@ CREATE TABLE IF NOT EXISTS users (
   role TEXT NOT NULL CHECK(role IN ('student', 'teacher')),
   rfid_uid TEXT NOT NULL UNIQUE,
   fingerprint_data TEXT NOT NULL UNIQUE,
+  fingerprint_slot INTEGER,
   matric_number TEXT,
   faculty TEXT,
   department TEXT,
@@ -33,6 +34,87 @@ CREATE TABLE IF NOT EXISTS attendance (
   updated_at DATETIME DEFAULT CURRENT_TIMESTAMP,
   FOREIGN KEY(user_id) REFERENCES users(id)
 );
+
+-- Change log behind the versioned device allowlist (GET /api/allowlist).
+-- Triggers record every card change, so any writer to users is covered.
+CREATE TABLE IF NOT EXISTS card_changes (
+  version INTEGER PRIMARY KEY AUTOINCREMENT,
+  rfid_uid TEXT NOT NULL,
+  op TEXT NOT NULL CHECK(op IN ('UPSERT', 'REVOKE')),
+  changed_at DATETIME DEFAULT CURRENT_TIMESTAMP
+);
+
+CREATE TRIGGER IF NOT EXISTS users_card_insert AFTER INSERT ON users
+BEGIN
+  INSERT INTO card_changes (rfid_uid, op) VALUES (NEW.rfid_uid, 'UPSERT');
+END;
+
+CREATE TRIGGER IF NOT EXISTS users_card_update AFTER UPDATE OF rfid_uid, full_name, role ON users
+BEGIN
+  INSERT INTO card_changes (rfid_uid, op)
+    SELECT OLD.rfid_uid, 'REVOKE' WHERE OLD.rfid_uid <> NEW.rfid_uid;
+  INSERT INTO card_changes (rfid_uid, op) VALUES (NEW.rfid_uid, 'UPSERT');
+END;
+
+CREATE TRIGGER IF NOT EXISTS users_card_delete AFTER DELETE ON users
+BEGIN
+  INSERT INTO card_changes (rfid_uid, op) VALUES (OLD.rfid_uid, 'REVOKE');
+END;
+`);
+
+// Library slot of the user's enrolled finger in fingerprint_templates.
+// Devices verify 1:1 against it, loading the template into one of their
+// own sensor slots. Older databases predate the column.
+const userColumns = db.prepare(`PRAGMA table_info(users)`).all().map((c) => c.name);
+if (!userColumns.includes('fingerprint_slot')) {
+  db.exec(`ALTER TABLE users ADD COLUMN fingerprint_slot INTEGER`);
+}
+db.exec(`
+CREATE UNIQUE INDEX IF NOT EXISTS idx_users_fingerprint_slot ON users(fingerprint_slot);
+
+CREATE TRIGGER IF NOT EXISTS users_card_slot_update AFTER UPDATE OF fingerprint_slot ON users
+BEGIN
+  INSERT INTO card_changes (rfid_uid, op) VALUES (NEW.rfid_uid, 'UPSERT');
+END;
+
+-- Template library the doors load their sensors from. version increases
+-- on every upload across the library, so a device can tell a re-enrolled
+-- finger from the one it holds.
+CREATE TABLE IF NOT EXISTS fingerprint_templates (
+  fingerprint_slot INTEGER PRIMARY KEY,
+  template BLOB NOT NULL,
+  version INTEGER NOT NULL,
+  updated_at DATETIME DEFAULT CURRENT_TIMESTAMP
+);
+
+-- Doors and the key each was issued at /device/register, stored as its
+-- SHA-256. The key is what the device API trusts for location.
+CREATE TABLE IF NOT EXISTS devices (
+  device_id TEXT PRIMARY KEY,
+  device_type TEXT,
+  location TEXT NOT NULL,
+  key_hash TEXT NOT NULL UNIQUE,
+  registered_at DATETIME DEFAULT CURRENT_TIMESTAMP
+);
+`);
+
+// Devices key each journaled event by (device_id, boot_id, seq), so a batch
+// retried after a lost reply is not counted twice. clock says where the
+// timestamp came from: 'sntp' or 'estimated' on the device, or 'server'
+// when the device only knew its uptime. Older rows have NULL keys, which
+// never conflict.
+const attendanceColumns = db.prepare(`PRAGMA table_info(attendance)`).all().map((c) => c.name);
+if (!attendanceColumns.includes('boot_id')) {
+  db.exec(`ALTER TABLE attendance ADD COLUMN boot_id INTEGER`);
+}
+if (!attendanceColumns.includes('seq')) {
+  db.exec(`ALTER TABLE attendance ADD COLUMN seq INTEGER`);
+}
+if (!attendanceColumns.includes('clock')) {
+  db.exec(`ALTER TABLE attendance ADD COLUMN clock TEXT`);
+}
+db.exec(`
+CREATE UNIQUE INDEX IF NOT EXISTS idx_attendance_event ON attendance(device_id, boot_id, seq);
 `);
 
 module.exports = db;
\ No newline at end of file
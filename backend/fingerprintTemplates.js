@@ -0,0 +1,13 @@
+// fingerprintTemplates.js
+// Shared by the template routes: the dashboard uploads enrolled templates,
+// doors download them (see hardware/template_sync.cpp).
+
+// One R307 character file
+const TEMPLATE_BYTES = 512;
+
+function parseSlot(value) {
+  const slot = Number(value);
+  return Number.isInteger(slot) && slot >= 1 && slot <= 65535 ? slot : null;
+}
+
+module.exports = { TEMPLATE_BYTES, parseSlot };
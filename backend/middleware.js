@@ -1,4 +1,6 @@
+const crypto = require('crypto');
 const jwt = require('jsonwebtoken');
+const db = require('./db');
 const { activeTokens } = require('./dataStore');
 
 // Middleware for JWT authentication
@@ -20,13 +22,37 @@ const authenticateToken = (jwtSecret) => (req, res, next) => {
     });
 };
 
+// Device keys are random, so an unsalted hash is enough to look them up
+const hashDeviceKey = (key) => crypto.createHash('sha256').update(String(key)).digest('hex');
+
+// Middleware for the key a door was issued at /device/register, sent as
+// X-Device-Key. Sets req.device to its registration.
+const authenticateDevice = (req, res, next) => {
+    const key = req.headers['x-device-key'];
+    const device = key
+        ? db.prepare(`SELECT device_id, location FROM devices WHERE key_hash = ?`).get(hashDeviceKey(key))
+        : null;
+
+    if (!device) {
+        return res.status(401).json({ success: false, error: 'A registered device key is required' });
+    }
+    req.device = device;
+    next();
+};
+
 // Error handling middleware
 const errorHandler = (error, req, res, next) => {
+    // Client errors raised by the body parsers (too large, malformed)
+    if (error.expose && error.status >= 400 && error.status < 500) {
+        return res.status(error.status).json({ error: error.message });
+    }
     console.error('Unhandled error:', error);
     res.status(500).json({ error: 'Internal server error' });
 };
 
 module.exports = {
     authenticateToken,
+    authenticateDevice,
+    hashDeviceKey,
     errorHandler
 };
@@ -5,6 +5,9 @@ const { v4: uuidv4 } = require('uuid');
 const db = require('../db');
 const jwt = require('jsonwebtoken');
 
+// Size of the template library; each door holds a subset in its sensor
+const FINGERPRINT_SLOT_MAX = 65535;
+
 // =====================
 // Register
 // =====================
@@ -15,6 +18,7 @@ router.post('/register', (req, res) => {
     role,
     rfidUID,
     fingerprintData,
+    fingerprintSlot,
     matricNumber,
     faculty,
     department,
@@ -29,6 +33,14 @@ router.post('/register', (req, res) => {
     });
   }
 
+  // Library slot of the user's template, used for 1:1 verification
+  const slot = fingerprintSlot === undefined || fingerprintSlot === null ? null : Number(fingerprintSlot);
+  if (slot !== null && !(Number.isInteger(slot) && slot >= 1 && slot <= FINGERPRINT_SLOT_MAX)) {
+    return res.status(400).json({
+      error: `fingerprintSlot must be an integer from 1 to ${FINGERPRINT_SLOT_MAX}`
+    });
+  }
+
   // Role-specific validation
   if (role === 'student') {
     if (!matricNumber || !faculty || !department) {
@@ -48,9 +60,9 @@ router.post('/register', (req, res) => {
     // Check if user exists by email OR rfid_uid OR fingerprint_data
     const stmtCheck = db.prepare(`
       SELECT * FROM users 
-      WHERE email = ? OR rfid_uid = ? OR fingerprint_data = ?
+      WHERE email = ? OR rfid_uid = ? OR fingerprint_data = ? OR fingerprint_slot = ?
     `);
-    const existing = stmtCheck.get(email, rfidUID, fingerprintData);
+    const existing = stmtCheck.get(email, rfidUID, fingerprintData, slot);
     if (existing) {
       return res.status(400).json({
         error: 'User with same email, RFID, or fingerprint already exists'
@@ -62,9 +74,9 @@ router.post('/register', (req, res) => {
 
     const stmtInsert = db.prepare(`
       INSERT INTO users (
-        id, full_name, email, role, rfid_uid, fingerprint_data,
+        id, full_name, email, role, rfid_uid, fingerprint_data, fingerprint_slot,
         matric_number, faculty, department, staff_id, designation, created_at
-      ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+      ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
     `);
 
     stmtInsert.run(
@@ -74,6 +86,7 @@ router.post('/register', (req, res) => {
       role,
       rfidUID,
       fingerprintData,
+      slot,
       matricNumber || null,
       faculty || null,
       department || null,
@@ -2,6 +2,8 @@
 const express = require('express');
 const router = express.Router();
 const db = require('../db');
+const { TEMPLATE_BYTES, parseSlot } = require('../fingerprintTemplates');
+const { deviceMetrics } = require('../dataStore');
 
 // Dashboard stats (teachers only)
 router.get('/stats', (req, res) => {
@@ -118,4 +120,54 @@ router.get('/users', (req, res) => {
   }
 });
 
+// Latest metrics from every door (teachers only; doors post them to
+// /api/device/metrics)
+router.get('/device/metrics', (req, res) => {
+  if (!req.user || req.user.role !== 'teacher') {
+    return res.status(403).json({ error: 'Access denied. Teachers only.' });
+  }
+  res.json({ success: true, devices: Array.from(deviceMetrics.values()) });
+});
+
+// Store an enrolled template (base64) in the library slot of its user
+// (teachers only). Every upload gets a new version so doors replace the
+// copy they hold.
+router.put('/fingerprint/template/:slot', (req, res) => {
+  if (!req.user || req.user.role !== 'teacher') {
+    return res.status(403).json({ error: 'Access denied. Teachers only.' });
+  }
+
+  const slot = parseSlot(req.params.slot);
+  const data = typeof req.body.template === 'string' ? Buffer.from(req.body.template, 'base64') : null;
+  if (slot === null || !data || data.length !== TEMPLATE_BYTES) {
+    return res.status(400).json({
+      success: false,
+      error: `A slot from 1 to 65535 and a ${TEMPLATE_BYTES}-byte base64 template are required`
+    });
+  }
+
+  try {
+    const user = db.prepare(`SELECT id FROM users WHERE fingerprint_slot = ?`).get(slot);
+    if (!user) {
+      return res.status(404).json({ success: false, error: 'No user enrolled in this slot' });
+    }
+
+    const version = db.transaction(() => {
+      const { next } = db.prepare(`SELECT COALESCE(MAX(version), 0) + 1 AS next FROM fingerprint_templates`).get();
+      db.prepare(`
+        INSERT INTO fingerprint_templates (fingerprint_slot, template, version, updated_at)
+        VALUES (?, ?, ?, CURRENT_TIMESTAMP)
+        ON CONFLICT(fingerprint_slot) DO UPDATE SET
+          template = excluded.template, version = excluded.version, updated_at = excluded.updated_at
+      `).run(slot, data, next);
+      return next;
+    })();
+
+    res.json({ success: true, fingerprint_slot: slot, version });
+  } catch (err) {
+    console.error('Template upload error:', err);
+    res.status(500).json({ success: false, error: 'Internal server error' });
+  }
+});
+
 module.exports = router;
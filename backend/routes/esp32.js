@@ -1,77 +1,145 @@
 // routes/esp32.js
+const crypto = require('crypto');
 const express = require('express');
 const router = express.Router();
 const { v4: uuidv4 } = require('uuid');
 const db = require('../db');
+const wire = require('../wireProtocol');
+const { parseSlot } = require('../fingerprintTemplates');
+const { deviceMetrics } = require('../dataStore');
+const { authenticateDevice, hashDeviceKey } = require('../middleware');
 
-// Verify RFID
+const DEVICE_ID_PATTERN = /^[\w.:-]{1,64}$/;
+
+// Verify RFID. Binary requests (see wireProtocol.js) get a binary reply
+// with the same fields.
 router.post('/verify-rfid', (req, res) => {
-  const { rfid_uid } = req.body;
+  const binary = wire.isWire(req);
+  const fail = (httpStatus, status, error) => binary
+    ? wire.send(res, httpStatus, wire.encodeVerifyReply({ status }))
+    : res.status(httpStatus).json({ success: false, error });
+
+  let rfid_uid;
+  try {
+    ({ rfid_uid } = binary ? wire.decodeVerifyRequest(req.body) : req.body);
+  } catch (err) {
+    return fail(400, wire.STATUS.BAD_REQUEST, err.message);
+  }
   if (!rfid_uid) {
-    return res.status(400).json({ success: false, error: 'RFID UID is required' });
+    return fail(400, wire.STATUS.BAD_REQUEST, 'RFID UID is required');
   }
 
   try {
-    const stmt = db.prepare(`SELECT * FROM users WHERE rfidCardUID = ?`);
+    const stmt = db.prepare(`SELECT * FROM users WHERE rfid_uid = ?`);
     const user = stmt.get(rfid_uid);
     if (!user) {
-      return res.status(404).json({ success: false, error: 'RFID card not registered' });
+      return fail(404, wire.STATUS.NOT_FOUND, 'RFID card not registered');
+    }
+
+    if (binary) {
+      return wire.send(res, 200, wire.encodeVerifyReply({
+        status: wire.STATUS.OK,
+        role: user.role,
+        fingerprint_slot: user.fingerprint_slot,
+        student_name: user.full_name,
+        user_id: user.id
+      }));
     }
 
     res.json({
       success: true,
-      student_name: user.fullName,
+      student_name: user.full_name,
       user_id: user.id,
-      matricNumber: user.matricNumber || user.staffId,
+      matricNumber: user.matric_number || user.staff_id,
       role: user.role,
-      fingerprint_data: user.fingerprintData
+      // The device matches the presented finger against this slot only
+      fingerprint_slot: user.fingerprint_slot || 0
     });
 
   } catch (err) {
     console.error('Verify RFID error:', err);
-    res.status(500).json({ success: false, error: 'Internal server error' });
+    fail(500, wire.STATUS.ERROR, 'Internal server error');
   }
 });
 
-// Log attendance
+// Upper bound on events accepted by one batch request
+const MAX_BATCH_EVENTS = 500;
+
+const ACTIONS = ['ENTRY', 'EXIT'];
+
+// Device timestamps before this are uptime millis, not wall-clock time
+const EARLIEST_DEVICE_TIME = Date.UTC(2020, 0, 1);
+
+// Prepared once; batches run it hundreds of times per request. A retried
+// event hits idx_attendance_event and is skipped.
+const stmtInsertAttendance = db.prepare(`
+  INSERT INTO attendance (
+    id, user_id, rfid_uid, timestamp, action, location, device_id, verified, boot_id, seq, clock
+  ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+  ON CONFLICT(device_id, boot_id, seq) DO NOTHING
+`);
+
+// Integer key field, or null when the device didn't send one
+function keyField(value) {
+  const n = parseInt(value, 10);
+  return isNaN(n) ? null : n;
+}
+
+// Shared by the single and batch attendance endpoints. Events the device
+// could only stamp with its uptime are stamped with the arrival time.
+// Returns the stored timestamp and whether the event was new.
+function insertAttendance(user, event, device) {
+  const ms = parseInt(event.timestamp, 10);
+  const deviceTime = event.clock !== 'uptime' && ms >= EARLIEST_DEVICE_TIME;
+  const ts = deviceTime ? new Date(ms).toISOString() : new Date().toISOString();
+  const clock = deviceTime ? (event.clock || 'device') : 'server';
+  const action = ACTIONS.includes(event.action) ? event.action : 'ENTRY';
+
+  const info = stmtInsertAttendance.run(
+    uuidv4(),
+    user.id,
+    event.rfid_uid,
+    ts,
+    action,
+    device.location || 'Unknown Device',
+    device.device_id || null,
+    1,
+    keyField(event.boot_id),
+    keyField(event.seq),
+    clock
+  );
+  return { ts, inserted: info.changes > 0 };
+}
+
+// Log attendance. A binary request is a one-event attendance batch, which
+// carries no student name.
 router.post('/log-attendance', (req, res) => {
-  const { student_name, rfid_uid, timestamp, device_id } = req.body;
+  if (wire.isWire(req)) {
+    return logBinaryBatch(req, res, 1);
+  }
+
+  const { student_name, rfid_uid, timestamp, clock, boot_id, seq, device_id, location, action } = req.body;
   if (!student_name || !rfid_uid) {
     return res.status(400).json({ success: false, error: 'Student name and RFID UID are required' });
   }
 
   try {
-    const stmtUser = db.prepare(`SELECT * FROM users WHERE rfidCardUID = ?`);
+    const stmtUser = db.prepare(`SELECT * FROM users WHERE rfid_uid = ?`);
     const user = stmtUser.get(rfid_uid);
     if (!user) {
       return res.status(404).json({ success: false, error: 'User not found' });
     }
 
-    const id = uuidv4();
-    const ts = timestamp ? new Date(parseInt(timestamp)).toISOString() : new Date().toISOString();
-
-    const stmtInsert = db.prepare(`
-      INSERT INTO attendance (
-        id, userId, rfidCardUID, timestamp, action, location, deviceId, verified
-      ) VALUES (?, ?, ?, ?, ?, ?, ?, ?)
-    `);
-    stmtInsert.run(
-      id,
-      user.id,
-      rfid_uid,
-      ts,
-      'ENTRY',
-      device_id || 'Unknown Device',
-      device_id || null,
-      1
-    );
+    const { ts, inserted } = insertAttendance(user, { rfid_uid, timestamp, clock, boot_id, seq, action },
+      { device_id, location });
 
     res.json({
       success: true,
-      message: 'Attendance logged successfully',
+      message: inserted ? 'Attendance logged successfully' : 'Attendance already logged',
+      duplicate: !inserted,
       timestamp: ts,
       user_id: user.id,
-      student_name: user.fullName
+      student_name: user.full_name
     });
 
   } catch (err) {
@@ -80,16 +148,351 @@ router.post('/log-attendance', (req, res) => {
   }
 });
 
-// Device registration
-router.post('/device/register', (req, res) => {
-  const { device_id, device_type, location } = req.body;
-  res.json({
-    success: true,
-    device_id: device_id || 'ESP32_001',
-    registered: true,
-    server_time: new Date().toISOString(),
-    message: 'Device registered successfully'
+// Insert a batch of events in one transaction. Events for unknown cards are
+// rejected individually but still count as processed, so the device can
+// advance its cursor past them; acked_seq is the highest seq the device may
+// acknowledge. Events the server already has count as duplicates.
+function logBatch(device, events) {
+  const stmtUser = db.prepare(`SELECT * FROM users WHERE rfid_uid = ?`);
+  const insertAll = db.transaction((batch) => {
+    let accepted = 0;
+    let duplicates = 0;
+    const rejected = [];
+    for (const event of batch) {
+      const user = event.rfid_uid ? stmtUser.get(event.rfid_uid) : null;
+      if (!user) {
+        rejected.push({ seq: event.seq, rfid_uid: event.rfid_uid, error: 'User not found' });
+        continue;
+      }
+      if (insertAttendance(user, event, device).inserted) {
+        accepted++;
+      } else {
+        duplicates++;
+      }
+    }
+    return { accepted, duplicates, rejected };
   });
+
+  const result = insertAll(events);
+  const seqs = events.map((e) => parseInt(e.seq, 10)).filter((seq) => !isNaN(seq));
+  result.acked_seq = seqs.length > 0 ? Math.max(...seqs) : null;
+  return result;
+}
+
+// Binary batch, or a single event when maxEvents is 1
+function logBinaryBatch(req, res, maxEvents) {
+  const fail = (httpStatus, status) =>
+    wire.send(res, httpStatus, wire.encodeAttendanceReply({ status }));
+
+  let batch;
+  try {
+    batch = wire.decodeAttendance(req.body);
+  } catch (err) {
+    return fail(400, wire.STATUS.BAD_REQUEST);
+  }
+  if (batch.events.length === 0) {
+    return fail(400, wire.STATUS.BAD_REQUEST);
+  }
+  if (batch.events.length > maxEvents) {
+    return fail(413, wire.STATUS.BAD_REQUEST);
+  }
+
+  try {
+    const result = logBatch(batch, batch.events);
+    wire.send(res, 200, wire.encodeAttendanceReply({
+      status: wire.STATUS.OK,
+      accepted: result.accepted + result.duplicates,
+      rejected: result.rejected.length,
+      acked_seq: result.acked_seq
+    }));
+  } catch (err) {
+    console.error('Batch attendance error:', err);
+    fail(500, wire.STATUS.ERROR);
+  }
+}
+
+// Log a batch of attendance events in one transaction. Device fields are
+// sent once per batch.
+router.post('/log-attendance/batch', (req, res) => {
+  if (wire.isWire(req)) {
+    return logBinaryBatch(req, res, MAX_BATCH_EVENTS);
+  }
+
+  const { device_id, location, events } = req.body;
+  if (!Array.isArray(events) || events.length === 0) {
+    return res.status(400).json({ success: false, error: 'A non-empty events array is required' });
+  }
+  if (events.length > MAX_BATCH_EVENTS) {
+    return res.status(413).json({ success: false, error: `At most ${MAX_BATCH_EVENTS} events per batch` });
+  }
+
+  try {
+    const result = logBatch({ device_id, location }, events);
+    res.json({
+      success: true,
+      accepted: result.accepted,
+      duplicates: result.duplicates,
+      rejected: result.rejected,
+      acked_seq: result.acked_seq
+    });
+
+  } catch (err) {
+    console.error('Batch attendance error:', err);
+    res.status(500).json({ success: false, error: 'Internal server error' });
+  }
+});
+
+// Card allowlist for a location: full snapshot, or the changes since a
+// version the device already holds. Cards are sorted by UID so the device
+// can merge them into its index in one pass. There is no per-location
+// access table yet, so every location receives the campus-wide list.
+router.get('/allowlist', (req, res) => {
+  const since = parseInt(req.query.since, 10) || 0;
+  const location = req.query.location || 'Unknown';
+
+  try {
+    const { version } = db.prepare(`SELECT COALESCE(MAX(version), 0) AS version FROM card_changes`).get();
+    // A device ahead of us (e.g. after a database reset) needs a fresh snapshot
+    const snapshot = since <= 0 || since > version;
+
+    let cards;
+    let revoked;
+    if (snapshot) {
+      cards = db.prepare(`SELECT rfid_uid, full_name, id, role, fingerprint_slot FROM users`).all();
+      revoked = [];
+    } else {
+      // Latest change per card after the device's version
+      const changes = db.prepare(`
+        SELECT c.rfid_uid, c.op, u.full_name, u.id, u.role, u.fingerprint_slot
+        FROM card_changes c
+        LEFT JOIN users u ON u.rfid_uid = c.rfid_uid
+        WHERE c.version IN (
+          SELECT MAX(version) FROM card_changes WHERE version > ? GROUP BY rfid_uid
+        )
+      `).all(since);
+      cards = changes.filter((c) => c.op === 'UPSERT' && c.id);
+      revoked = changes.filter((c) => !(c.op === 'UPSERT' && c.id)).map((c) => c.rfid_uid.toUpperCase());
+    }
+
+    cards = cards.map((c) => ({
+      rfid_uid: c.rfid_uid.toUpperCase(),
+      student_name: c.full_name,
+      user_id: c.id,
+      role: c.role,
+      fingerprint_slot: c.fingerprint_slot || 0
+    }));
+
+    if (req.query.format === 'text') {
+      return res.type('text/plain').send(allowlistText(version, snapshot, cards, revoked));
+    }
+
+    res.json({
+      success: true,
+      location,
+      version,
+      mode: snapshot ? 'snapshot' : 'delta',
+      cards: cards.sort((a, b) => compareUid(a.rfid_uid, b.rfid_uid)),
+      revoked: revoked.sort(compareUid)
+    });
+
+  } catch (err) {
+    console.error('Allowlist error:', err);
+    res.status(500).json({ success: false, error: 'Internal server error' });
+  }
+});
+
+function compareUid(a, b) {
+  return a < b ? -1 : a > b ? 1 : 0;
+}
+
+// Line format read by the firmware (see hardware/allowlist_sync.cpp)
+function allowlistText(version, snapshot, cards, revoked) {
+  const clean = (value) => String(value || '').replace(/[,\r\n]/g, ' ').slice(0, 39);
+  const lines = cards.map((c) => ({
+    uid: c.rfid_uid,
+    line: `+${c.rfid_uid},${clean(c.student_name)},${clean(c.user_id)},${clean(c.role)},${c.fingerprint_slot}`
+  })).concat(revoked.map((uid) => ({ uid, line: `-${uid}` })));
+
+  lines.sort((a, b) => compareUid(a.uid, b.uid));
+
+  return [`ALLOWLIST ${version} ${snapshot ? 'SNAPSHOT' : 'DELTA'}`]
+    .concat(lines.map((l) => l.line), 'END')
+    .join('\n') + '\n';
+}
+
+// =====================
+// Fingerprint templates
+// =====================
+
+const TEMPLATE_MANIFEST_MAX = 1000;
+
+// Uploads go through the dashboard (routes/dashboard.js), which needs a
+// teacher's token; doors only read, with the key they were registered with.
+
+// Templates a door should hold: users seen at the location it registered
+// at, most recently first. limit is the door's sensor capacity; anyone
+// else's template is fetched by slot when their card is accepted there.
+// Line format read by hardware/template_sync.cpp:
+//   TEMPLATES <count>
+//   <slot>,<version>
+//   END
+router.get('/fingerprint/templates', authenticateDevice, (req, res) => {
+  const location = req.device.location;
+  const limit = Math.min(parseInt(req.query.limit, 10) || TEMPLATE_MANIFEST_MAX, TEMPLATE_MANIFEST_MAX);
+
+  try {
+    const rows = db.prepare(`
+      SELECT t.fingerprint_slot AS slot, t.version, MAX(a.timestamp) AS last_seen
+      FROM fingerprint_templates t
+      JOIN users u ON u.fingerprint_slot = t.fingerprint_slot
+      JOIN attendance a ON a.user_id = u.id AND a.location = ?
+      GROUP BY t.fingerprint_slot
+      ORDER BY last_seen DESC, t.fingerprint_slot
+      LIMIT ?
+    `).all(location, limit);
+
+    res.type('text/plain').send(
+      [`TEMPLATES ${rows.length}`].concat(rows.map((r) => `${r.slot},${r.version}`), 'END').join('\n') + '\n'
+    );
+  } catch (err) {
+    console.error('Template manifest error:', err);
+    res.status(500).json({ success: false, error: 'Internal server error' });
+  }
+});
+
+// One template as hex:
+//   TEMPLATE <slot> <version>
+//   <hex>
+//   END
+router.get('/fingerprint/template/:slot', authenticateDevice, (req, res) => {
+  const slot = parseSlot(req.params.slot);
+  if (slot === null) {
+    return res.status(400).json({ success: false, error: 'Invalid slot' });
+  }
+
+  try {
+    const row = db.prepare(`
+      SELECT t.template, t.version FROM fingerprint_templates t
+      JOIN users u ON u.fingerprint_slot = t.fingerprint_slot
+      WHERE t.fingerprint_slot = ?
+    `).get(slot);
+    if (!row) {
+      return res.status(404).json({ success: false, error: 'Template not found' });
+    }
+
+    res.type('text/plain').send(`TEMPLATE ${slot} ${row.version}\n${row.template.toString('hex').toUpperCase()}\nEND\n`);
+  } catch (err) {
+    console.error('Template download error:', err);
+    res.status(500).json({ success: false, error: 'Internal server error' });
+  }
+});
+
+function keysMatch(a, b) {
+  const x = Buffer.from(String(a));
+  const y = Buffer.from(String(b));
+  return x.length === y.length && crypto.timingSafeEqual(x, y);
+}
+
+// Device registration. Issues the key the door sends as X-Device-Key from
+// then on; only its hash is kept, so every registration issues a new one.
+// With ESP32_API_KEY set, a door needs it (enroll_key) or its current key
+// to register. Without it, a new device_id is trusted on first use and a
+// known one needs its current key.
+router.post('/device/register', (req, res) => {
+  const { device_id, device_type, location, enroll_key } = req.body;
+  if (typeof device_id !== 'string' || !DEVICE_ID_PATTERN.test(device_id)) {
+    return res.status(400).json({ success: false, error: 'A device_id of up to 64 characters is required' });
+  }
+
+  try {
+    const known = db.prepare(`SELECT key_hash FROM devices WHERE device_id = ?`).get(device_id);
+    const presented = req.headers['x-device-key'];
+    const ownKey = known && presented && keysMatch(hashDeviceKey(presented), known.key_hash);
+    const enrollKey = process.env.ESP32_API_KEY;
+    const enrolled = enrollKey ? enroll_key !== undefined && keysMatch(enroll_key, enrollKey) : !known;
+    if (!ownKey && !enrolled) {
+      return res.status(401).json({ success: false, error: 'Device key or enrolment key required' });
+    }
+
+    const deviceKey = crypto.randomBytes(32).toString('hex');
+    db.prepare(`
+      INSERT INTO devices (device_id, device_type, location, key_hash) VALUES (?, ?, ?, ?)
+      ON CONFLICT(device_id) DO UPDATE SET
+        device_type = excluded.device_type,
+        location = excluded.location,
+        key_hash = excluded.key_hash,
+        registered_at = CURRENT_TIMESTAMP
+    `).run(device_id, device_type || null, String(location || 'Unknown'), hashDeviceKey(deviceKey));
+
+    res.json({
+      success: true,
+      device_id,
+      device_key: deviceKey,
+      registered: true,
+      server_time: new Date().toISOString(),
+      message: 'Device registered successfully'
+    });
+  } catch (err) {
+    console.error('Device registration error:', err);
+    res.status(500).json({ success: false, error: 'Internal server error' });
+  }
+});
+
+// Latest metrics summary from each device, piggybacked on its periodic sync:
+// per-stage tap latency percentiles, card cache hit ratio, journal backlog,
+// free heap and RSSI. Kept in memory (dataStore.deviceMetrics) for the
+// dashboard; a restart clears it until the next sync. Only the fields below
+// are kept, and only for the METRICS_MAX_DEVICES devices heard from most
+// recently. server.js caps the body size.
+const METRICS_MAX_DEVICES = 256;
+const METRICS_NUMBERS = ['uptime_ms', 'free_heap', 'min_free_heap', 'rssi', 'journal_backlog', 'cache_hit_ratio'];
+const METRICS_GROUPS = {
+  card_lookups: ['cache', 'index', 'miss'],
+  verify_suppressed: ['rejected', 'rate_limited']
+};
+// Stage names from hardware/stage_metrics.cpp
+const METRICS_STAGES = [
+  'card_read', 'card_lookup', 'server_verify', 'http_verify', 'finger_capture', 'finger_match',
+  'tap_to_unlock', 'journal_append', 'http_upload', 'wifi_join', 'wifi_outage'
+];
+const METRICS_STAGE_FIELDS = ['count', 'p50_us', 'p95_us', 'p99_us', 'max_us'];
+
+function pickNumbers(source, fields) {
+  const out = {};
+  if (source && typeof source === 'object') {
+    for (const field of fields) {
+      if (Number.isFinite(source[field])) out[field] = source[field];
+    }
+  }
+  return out;
+}
+
+router.post('/device/metrics', (req, res) => {
+  const body = req.body || {};
+  const deviceId = body.device_id;
+  if (typeof deviceId !== 'string' || !DEVICE_ID_PATTERN.test(deviceId)) {
+    return res.status(400).json({ success: false, error: 'A device_id of up to 64 characters is required' });
+  }
+
+  const summary = { device_id: deviceId, ...pickNumbers(body, METRICS_NUMBERS) };
+  for (const [group, fields] of Object.entries(METRICS_GROUPS)) {
+    if (body[group]) summary[group] = pickNumbers(body[group], fields);
+  }
+  if (body.stages && typeof body.stages === 'object') {
+    summary.stages = {};
+    for (const stage of METRICS_STAGES) {
+      if (body.stages[stage]) summary.stages[stage] = pickNumbers(body.stages[stage], METRICS_STAGE_FIELDS);
+    }
+  }
+  summary.received_at = new Date().toISOString();
+
+  // Map order is insertion order: re-inserting keeps the oldest report first
+  deviceMetrics.delete(deviceId);
+  if (deviceMetrics.size >= METRICS_MAX_DEVICES) {
+    deviceMetrics.delete(deviceMetrics.keys().next().value);
+  }
+  deviceMetrics.set(deviceId, summary);
+  res.json({ success: true });
 });
 
 module.exports = router;
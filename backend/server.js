@@ -9,6 +9,7 @@ dotenv.config();
 
 // Import SQLite
 const db = require("./db");
+const wire = require("./wireProtocol");
 
 // Middleware
 const { authenticateToken, errorHandler } = require("./middleware");
@@ -26,7 +27,11 @@ const JWT_SECRET = process.env.JWT_SECRET;
 
 app.use(cors());
 
+// Door metrics are a few hundred bytes; don't let anyone post more
+app.use('/api/device/metrics', express.json({ limit: '8kb' }));
 app.use(express.json());
+// Binary device requests; routes answer them in the same format
+app.use(express.raw({ type: wire.CONTENT_TYPE }));
 
 // ✅ API routes first (backend only)
 app.use('/api', (req, res, next) => {
@@ -72,10 +77,16 @@ app.get('*', (req, res) => {
 
 
 // Start server
-app.listen(PORT, "0.0.0.0", () => {
+const server = app.listen(PORT, "0.0.0.0", () => {
   console.log(`🚀 Server running on http://0.0.0.0:${PORT}`);
 });
 
+// Devices keep one connection open between taps; Node's 5 s default would
+// close it between almost every request. headersTimeout must stay above it.
+const KEEP_ALIVE_TIMEOUT = parseInt(process.env.KEEP_ALIVE_TIMEOUT, 10) || 65000;
+server.keepAliveTimeout = KEEP_ALIVE_TIMEOUT;
+server.headersTimeout = KEEP_ALIVE_TIMEOUT + 1000;
+
 // Graceful shutdown
 process.on('SIGINT', () => {
   console.log('\n👋 Shutting down server gracefully...');
@@ -1,8 +1,8 @@
 #!/usr/bin/env node
 
 const { log, TEST_CARDS } = require('./test/testUtils');
-const { testHealthCheck, testRFIDVerification, testAttendanceLogging } = require('./test/apiTests');
-const { testDeviceRegistration, testSimulationEndpoints, performLoadTest } = require('./test/esp32Tests');
+const { testHealthCheck, testRFIDVerification, testAttendanceLogging, testBatchAttendanceLogging, testDeviceMetrics } = require('./test/apiTests');
+const { testDeviceRegistration, testAllowlistSync, testTemplateLibrary, testWireProtocol, testIdempotentAttendance, testSimulationEndpoints, performLoadTest } = require('./test/esp32Tests');
 const { testUserRegistration, testTeacherLogin, testAttendanceVerification } = require('./test/authTests');
 
 const BASE_URL = process.env.TEST_URL || 'http://localhost:3050';
@@ -16,7 +16,13 @@ async function generateTestReport() {
         healthCheck: false,
         rfidVerification: false,
         attendanceLogging: false,
+        batchAttendanceLogging: false,
         deviceRegistration: false,
+        deviceMetrics: false,
+        allowlistSync: false,
+        templateLibrary: false,
+        wireProtocol: false,
+        idempotentAttendance: false,
         teacherLogin: false,
         userRegistration: false,
         attendanceVerification: false,
@@ -30,7 +36,13 @@ async function generateTestReport() {
         testResults.healthCheck = await testHealthCheck();
         testResults.rfidVerification = await testRFIDVerification();
         testResults.attendanceLogging = await testAttendanceLogging();
+        testResults.batchAttendanceLogging = await testBatchAttendanceLogging();
         testResults.deviceRegistration = await testDeviceRegistration();
+        testResults.deviceMetrics = await testDeviceMetrics();
+        testResults.allowlistSync = await testAllowlistSync();
+        testResults.templateLibrary = await testTemplateLibrary();
+        testResults.wireProtocol = await testWireProtocol();
+        testResults.idempotentAttendance = await testIdempotentAttendance();
         testResults.teacherLogin = await testTeacherLogin();
         testResults.userRegistration = await testUserRegistration();
         testResults.attendanceVerification = await testAttendanceVerification();
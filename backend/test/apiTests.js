@@ -97,8 +97,102 @@ async function testAttendanceLogging() {
     return allPassed;
 }
 
+async function testBatchAttendanceLogging() {
+    logTest('Batch Attendance Logging (ESP32 Endpoint)');
+    
+    const validCards = TEST_CARDS.filter(card => card !== 'INVALID_CARD');
+    const events = validCards.slice(0, 3).map((cardId, i) => ({
+        seq: i + 1,
+        rfid_uid: cardId,
+        student_name: 'Batch Test',
+        timestamp: Date.now().toString(),
+        action: 'ENTRY'
+    }));
+    events.push({ seq: 4, rfid_uid: 'INVALID_CARD', student_name: 'Nobody', action: 'ENTRY' });
+    
+    try {
+        const response = await makeRequest(`${API_BASE}/log-attendance/batch`, 'POST', {
+            device_id: 'TEST_DEVICE_001',
+            location: 'Test Lab',
+            events
+        });
+        
+        if (response.statusCode === 200 && response.data.success && response.data.acked_seq === 4) {
+            logResult(true, `Batch logged: ${response.data.accepted} accepted, ${response.data.rejected.length} rejected`);
+            return true;
+        }
+        logResult(false, `Batch logging failed: ${JSON.stringify(response.data)}`);
+        return false;
+    } catch (error) {
+        logResult(false, `Batch logging error: ${error.message}`);
+        return false;
+    }
+}
+
+async function testDeviceMetrics() {
+    logTest('Device Metrics Upload (ESP32 Endpoint)');
+    
+    try {
+        const upload = await makeRequest(`${API_BASE}/device/metrics`, 'POST', {
+            device_id: 'TEST_DEVICE_001',
+            uptime_ms: 600000,
+            free_heap: 150000,
+            rssi: -61,
+            journal_backlog: 0,
+            card_lookups: { cache: 97, index: 1, miss: 2 },
+            cache_hit_ratio: 0.97,
+            stages: {
+                tap_to_unlock: { count: 40, p50_us: 980000, p95_us: 1300000, p99_us: 1400000, max_us: 1450000 },
+                not_a_stage: { count: 1 }
+            },
+            notes: 'not a metric'
+        });
+        if (upload.statusCode !== 200) {
+            logResult(false, `Metrics upload failed: ${JSON.stringify(upload.data)}`);
+            return false;
+        }
+        
+        const oversized = await makeRequest(`${API_BASE}/device/metrics`, 'POST', {
+            device_id: 'TEST_DEVICE_001',
+            padding: 'x'.repeat(16 * 1024)
+        });
+        if (oversized.statusCode !== 413) {
+            logResult(false, `Oversized metrics body returned ${oversized.statusCode}`);
+            return false;
+        }
+        
+        // Fleet data is for the dashboard only
+        const anonymous = await makeRequest(`${API_BASE}/dashboard/device/metrics`);
+        const deviceRoute = await makeRequest(`${API_BASE}/device/metrics`);
+        if (anonymous.statusCode !== 401 || deviceRoute.statusCode !== 404) {
+            logResult(false, `Metrics readable without a token: ${anonymous.statusCode}, ${deviceRoute.statusCode}`);
+            return false;
+        }
+        
+        const login = await makeRequest(`${API_BASE}/login`, 'POST', {
+            email: 'prof.smith@university.edu',
+            fingerprintData: 'teacher_fingerprint_1'
+        });
+        const listing = await makeRequest(`${API_BASE}/dashboard/device/metrics`, 'GET', null,
+                                          { 'Authorization': `Bearer ${login.data.token}` });
+        const device = listing.data.devices && listing.data.devices.find(d => d.device_id === 'TEST_DEVICE_001');
+        
+        if (device && device.stages.tap_to_unlock.count === 40 && !device.stages.not_a_stage && !('notes' in device)) {
+            logResult(true, `Metrics stored, cache hit ratio ${device.cache_hit_ratio}`);
+            return true;
+        }
+        logResult(false, `Metrics listing wrong: ${JSON.stringify(listing.data)}`);
+        return false;
+    } catch (error) {
+        logResult(false, `Metrics upload error: ${error.message}`);
+        return false;
+    }
+}
+
 module.exports = {
     testHealthCheck,
     testRFIDVerification,
-    testAttendanceLogging
+    testAttendanceLogging,
+    testBatchAttendanceLogging,
+    testDeviceMetrics
 };
@@ -82,13 +82,27 @@ async function testDashboardAccess(token, teacherName) {
             makeRequest(`${API_BASE}/attendance?limit=5`, 'GET', null, headers)
         ]);
         
-        if (statsResponse.statusCode === 200 && attendanceResponse.statusCode === 200) {
-            logResult(true, `Dashboard access successful for ${teacherName}`);
-            return true;
-        } else {
+        if (statsResponse.statusCode !== 200 || attendanceResponse.statusCode !== 200) {
             logResult(false, `Dashboard access failed`);
             return false;
         }
+        logResult(true, `Dashboard access successful for ${teacherName}`);
+        
+        // Template uploads: validated once past the token check
+        const upload = (slot, template) => makeRequest(`${API_BASE}/dashboard/fingerprint/template/${slot}`,
+                                                       'PUT', { template }, headers);
+        const badUpload = await upload(1, 'AAAA');
+        if (badUpload.statusCode !== 400) {
+            logResult(false, `Short template accepted: ${badUpload.statusCode}`);
+            return false;
+        }
+        const noUser = await upload(65535, Buffer.alloc(512, 0x5A).toString('base64'));
+        if (noUser.statusCode !== 404) {
+            logResult(false, `Template for an unused slot accepted: ${noUser.statusCode}`);
+            return false;
+        }
+        logResult(true, 'Template uploads are validated');
+        return true;
     } catch (error) {
         logResult(false, `Dashboard access error: ${error.message}`);
         return false;
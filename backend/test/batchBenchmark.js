@@ -0,0 +1,100 @@
+#!/usr/bin/env node
+
+// Backlog drain benchmark: single POST per event vs batched uploads
+// Run against a local server with: npm run bench:batch
+//
+// Environment:
+//   TEST_URL            server to hit (default http://localhost:3050)
+//   BENCH_EVENTS        backlog size (default 2000)
+//   BENCH_BATCH         events per batch request (default 32, matches firmware)
+//   BENCH_CARD          registered RFID UID to log against (default 04A1B2C3)
+//   BENCH_DEVICE_DELAY  pause between single requests in ms (firmware used 100)
+
+const { makeRequest, log, logTest, logResult } = require('./testUtils');
+
+const BASE_URL = process.env.TEST_URL || 'http://localhost:3050';
+const API_BASE = `${BASE_URL}/api`;
+const EVENTS = parseInt(process.env.BENCH_EVENTS, 10) || 2000;
+const BATCH = parseInt(process.env.BENCH_BATCH, 10) || 32;
+const CARD = process.env.BENCH_CARD || '04A1B2C3';
+const DEVICE_DELAY = parseInt(process.env.BENCH_DEVICE_DELAY, 10) || 0;
+
+function makeBacklog() {
+    const now = Date.now();
+    const events = [];
+    for (let i = 0; i < EVENTS; i++) {
+        events.push({
+            seq: i + 1,
+            rfid_uid: CARD,
+            student_name: 'Benchmark User',
+            timestamp: (now - (EVENTS - i) * 1000).toString(),
+            action: 'ENTRY'
+        });
+    }
+    return events;
+}
+
+async function drainSingle(events) {
+    let ok = 0;
+    const start = Date.now();
+    for (const event of events) {
+        const response = await makeRequest(`${API_BASE}/log-attendance`, 'POST', {
+            ...event,
+            device_id: 'BENCH_DEVICE',
+            location: 'Benchmark'
+        });
+        if (response.statusCode === 200) ok++;
+        if (DEVICE_DELAY > 0) {
+            await new Promise(resolve => setTimeout(resolve, DEVICE_DELAY));
+        }
+    }
+    return { ms: Date.now() - start, ok, requests: events.length };
+}
+
+async function drainBatched(events) {
+    let ok = 0;
+    let requests = 0;
+    const start = Date.now();
+    for (let i = 0; i < events.length; i += BATCH) {
+        const batch = events.slice(i, i + BATCH);
+        const response = await makeRequest(`${API_BASE}/log-attendance/batch`, 'POST', {
+            device_id: 'BENCH_DEVICE',
+            location: 'Benchmark',
+            events: batch
+        });
+        requests++;
+        if (response.statusCode === 200 && response.data.success) ok += response.data.accepted;
+    }
+    return { ms: Date.now() - start, ok, requests };
+}
+
+function report(name, result) {
+    const rate = result.ms > 0 ? Math.round((EVENTS / result.ms) * 1000) : EVENTS;
+    logResult(result.ok === EVENTS,
+        `${name}: ${EVENTS} events in ${result.ms} ms over ${result.requests} requests ` +
+        `(~${rate} events/s, ${result.ok} stored)`);
+}
+
+async function main() {
+    logTest(`Backlog Drain: ${EVENTS} events, batch size ${BATCH}`);
+    log(`Server: ${BASE_URL}  card: ${CARD}  device delay: ${DEVICE_DELAY} ms`, 'blue');
+
+    const events = makeBacklog();
+    const single = await drainSingle(events);
+    report('Single', single);
+    const batched = await drainBatched(events);
+    report('Batched', batched);
+
+    if (batched.ms > 0) {
+        log(`Speedup: ${(single.ms / batched.ms).toFixed(1)}x`, 'cyan');
+    }
+}
+
+if (require.main === module) {
+    main().catch(error => {
+        log(`Benchmark failed: ${error.message}`, 'red');
+        process.exit(1);
+    });
+}
+
+module.exports = { drainSingle, drainBatched };
@@ -1,31 +1,269 @@
-const { makeRequest, logTest, logResult } = require('./testUtils');
+const { makeRequest, makeBinaryRequest, logTest, logResult } = require('./testUtils');
+const wire = require('../wireProtocol');
 
 const BASE_URL = process.env.TEST_URL || 'http://localhost:3050';
 const API_BASE = `${BASE_URL}/api`;
 
+// A device ID of its own per run: a registered ID needs its key again.
+// The key is what the template endpoints check.
+const REGISTER_ID = `ESP32_TEST_${Date.now()}`;
+let deviceKey = null;
+
 async function testDeviceRegistration() {
     logTest('ESP32 Device Registration');
     
     try {
-        const response = await makeRequest(`${API_BASE}/device/register`, 'POST', {
-            device_id: 'ESP32_TEST_001',
+        const register = (headers) => makeRequest(`${API_BASE}/device/register`, 'POST', {
+            device_id: REGISTER_ID,
             device_type: 'ESP32',
-            location: 'Test Lab'
-        });
+            location: 'Test Lab',
+            enroll_key: process.env.ESP32_API_KEY
+        }, headers);
+        const response = await register();
         
-        if (response.statusCode === 200 && response.data.success) {
-            logResult(true, `Device registered: ${response.data.device_id}`);
-            return true;
-        } else {
+        if (response.statusCode !== 200 || !response.data.success || !response.data.device_key) {
             logResult(false, `Device registration failed: ${JSON.stringify(response.data)}`);
             return false;
         }
+        logResult(true, `Device registered: ${response.data.device_id}`);
+        
+        // Someone else claiming the ID needs the key it was given
+        const claim = await makeRequest(`${API_BASE}/device/register`, 'POST', {
+            device_id: REGISTER_ID,
+            location: 'Elsewhere'
+        });
+        if (claim.statusCode !== 401) {
+            logResult(false, `Registering a known device without its key returned ${claim.statusCode}`);
+            return false;
+        }
+        const again = await register({ 'X-Device-Key': response.data.device_key });
+        if (again.statusCode !== 200 || !again.data.device_key) {
+            logResult(false, `Re-registration with the device key failed: ${JSON.stringify(again.data)}`);
+            return false;
+        }
+        deviceKey = again.data.device_key;
+        logResult(true, 'A known device re-registers only with its key');
+        return true;
     } catch (error) {
         logResult(false, `Device registration error: ${error.message}`);
         return false;
     }
 }
 
+async function testAllowlistSync() {
+    logTest('Allowlist Snapshot and Delta (ESP32 Endpoint)');
+    
+    try {
+        const snapshot = await makeRequest(`${API_BASE}/allowlist?location=Test%20Lab`);
+        if (snapshot.statusCode !== 200 || snapshot.data.mode !== 'snapshot') {
+            logResult(false, `Allowlist snapshot failed: ${JSON.stringify(snapshot.data)}`);
+            return false;
+        }
+        logResult(true, `Snapshot v${snapshot.data.version}: ${snapshot.data.cards.length} cards`);
+        
+        if (!snapshot.data.cards.every((c) => Number.isInteger(c.fingerprint_slot))) {
+            logResult(false, 'Allowlist cards are missing fingerprint_slot');
+            return false;
+        }
+        
+        const delta = await makeRequest(`${API_BASE}/allowlist?since=${snapshot.data.version}`);
+        if (delta.statusCode !== 200 || (snapshot.data.version > 0 && delta.data.mode !== 'delta')) {
+            logResult(false, `Allowlist delta failed: ${JSON.stringify(delta.data)}`);
+            return false;
+        }
+        logResult(true, `Delta since v${snapshot.data.version}: ${delta.data.cards.length} upserts, ${delta.data.revoked.length} revokes`);
+        
+        const text = await makeRequest(`${API_BASE}/allowlist?format=text`);
+        const lines = String(text.data).trim().split('\n');
+        if (!lines[0].startsWith('ALLOWLIST ') || lines[lines.length - 1] !== 'END') {
+            logResult(false, `Allowlist text format invalid: ${lines[0]}`);
+            return false;
+        }
+        // +UID,name,user_id,role,fingerprint_slot
+        const badLine = lines.slice(1, -1).find((l) => l.startsWith('+') && l.split(',').length !== 5);
+        if (badLine) {
+            logResult(false, `Allowlist card line without fingerprint slot: ${badLine}`);
+            return false;
+        }
+        logResult(true, `Text format: ${lines.length - 2} card lines`);
+        return true;
+    } catch (error) {
+        logResult(false, `Allowlist error: ${error.message}`);
+        return false;
+    }
+}
+
+async function testTemplateLibrary() {
+    logTest('Fingerprint Template Library (ESP32 Endpoint)');
+    
+    try {
+        // Raw biometric templates: nothing without a device key
+        const unauthenticated = [
+            await makeRequest(`${API_BASE}/fingerprint/templates?location=Test%20Lab&limit=1000`),
+            await makeRequest(`${API_BASE}/fingerprint/template/1`),
+            await makeRequest(`${API_BASE}/fingerprint/template/1`, 'GET', null, { 'X-Device-Key': 'not-a-key' })
+        ];
+        const leaked = unauthenticated.find((r) => r.statusCode !== 401);
+        if (leaked) {
+            logResult(false, `Template read without a device key returned ${leaked.statusCode}`);
+            return false;
+        }
+        logResult(true, 'Template reads need a device key');
+        if (!deviceKey) {
+            logResult(false, 'No device key: registration failed');
+            return false;
+        }
+        const asDevice = { 'X-Device-Key': deviceKey };
+        
+        const manifest = await makeRequest(`${API_BASE}/fingerprint/templates?limit=1000`, 'GET', null, asDevice);
+        const lines = String(manifest.data).trim().split('\n');
+        if (manifest.statusCode !== 200 || !/^TEMPLATES \d+$/.test(lines[0]) || lines[lines.length - 1] !== 'END') {
+            logResult(false, `Template manifest invalid: ${lines[0]}`);
+            return false;
+        }
+        const badLine = lines.slice(1, -1).find((l) => !/^\d+,\d+$/.test(l));
+        if (badLine) {
+            logResult(false, `Template manifest line invalid: ${badLine}`);
+            return false;
+        }
+        logResult(true, `Manifest lists ${lines.length - 2} templates`);
+        
+        // Doors only read templates; nobody writes them that way
+        const template = Buffer.alloc(512, 0x5A).toString('base64');
+        const anonymous = await makeRequest(`${API_BASE}/dashboard/fingerprint/template/1`, 'PUT', { template });
+        if (anonymous.statusCode !== 401) {
+            logResult(false, `Unauthenticated template upload returned ${anonymous.statusCode}`);
+            return false;
+        }
+        const deviceRoute = await makeRequest(`${API_BASE}/fingerprint/template/1`, 'PUT', { template });
+        if (deviceRoute.statusCode !== 404) {
+            logResult(false, `Template upload on the device API returned ${deviceRoute.statusCode}`);
+            return false;
+        }
+        logResult(true, 'Template uploads need a dashboard token');
+        
+        const missing = await makeRequest(`${API_BASE}/fingerprint/template/65535`, 'GET', null, asDevice);
+        if (missing.statusCode !== 404) {
+            logResult(false, `Missing template returned ${missing.statusCode}`);
+            return false;
+        }
+        logResult(true, 'Missing templates are reported');
+        return true;
+    } catch (error) {
+        logResult(false, `Template library error: ${error.message}`);
+        return false;
+    }
+}
+
+async function testWireProtocol() {
+    logTest('Binary Wire Protocol (ESP32 Endpoints)');
+    
+    const post = (path, body) => makeBinaryRequest(`${API_BASE}${path}`, body, wire.CONTENT_TYPE);
+    try {
+        const verify = await post('/verify-rfid', wire.encodeVerifyRequest({ rfid_uid: '04A1B2C3' }));
+        const reply = wire.decodeVerifyReply(verify.body);
+        if (verify.statusCode !== 200 || reply.status !== wire.STATUS.OK || !reply.student_name) {
+            logResult(false, `Binary verify failed: ${verify.statusCode} ${JSON.stringify(reply)}`);
+            return false;
+        }
+        logResult(true, `Binary verify: ${reply.student_name}, slot ${reply.fingerprint_slot} (${verify.body.length} bytes)`);
+        
+        const unknown = await post('/verify-rfid', wire.encodeVerifyRequest({ rfid_uid: 'FFFFFFFF' }));
+        if (unknown.statusCode !== 404 || wire.decodeVerifyReply(unknown.body).status !== wire.STATUS.NOT_FOUND) {
+            logResult(false, `Unknown card returned ${unknown.statusCode}`);
+            return false;
+        }
+        
+        const now = Date.now();
+        const events = [
+            { seq: 9001, rfid_uid: '04A1B2C3', timestamp: String(now), action: 'ENTRY' },
+            { seq: 9002, rfid_uid: 'FFFFFFFF', timestamp: String(now), action: 'EXIT' }
+        ];
+        const body = wire.encodeAttendance({ device_id: 'ESP32_TEST_001', location: 'Test Lab', events });
+        const batch = await post('/log-attendance/batch', body);
+        const result = wire.decodeAttendanceReply(batch.body);
+        if (batch.statusCode !== 200 || result.accepted !== 1 || result.rejected !== 1 || result.acked_seq !== 9002) {
+            logResult(false, `Binary batch failed: ${batch.statusCode} ${JSON.stringify(result)}`);
+            return false;
+        }
+        const json = JSON.stringify({ device_id: 'ESP32_TEST_001', location: 'Test Lab', events });
+        logResult(true, `Binary batch: ${body.length} bytes vs ${json.length} as JSON`);
+        
+        const single = await post('/log-attendance', wire.encodeAttendance({
+            device_id: 'ESP32_TEST_001', location: 'Test Lab', events: events.slice(0, 1)
+        }));
+        if (single.statusCode !== 200 || wire.decodeAttendanceReply(single.body).accepted !== 1) {
+            logResult(false, `Binary single attendance returned ${single.statusCode}`);
+            return false;
+        }
+        
+        const garbage = await post('/log-attendance/batch', Buffer.from('not a message'));
+        if (garbage.statusCode !== 400 || wire.decodeAttendanceReply(garbage.body).status !== wire.STATUS.BAD_REQUEST) {
+            logResult(false, `Malformed batch returned ${garbage.statusCode}`);
+            return false;
+        }
+        logResult(true, 'Single events and malformed bodies handled');
+        return true;
+    } catch (error) {
+        logResult(false, `Wire protocol error: ${error.message}`);
+        return false;
+    }
+}
+
+async function testIdempotentAttendance() {
+    logTest('Idempotent Attendance Retries (ESP32 Endpoints)');
+    
+    // A fresh boot id per run, so earlier runs don't count as duplicates
+    const bootId = Math.floor(Math.random() * 0xFFFFFFFF);
+    const batch = {
+        device_id: 'ESP32_TEST_001',
+        location: 'Test Lab',
+        events: [
+            { seq: 1, boot_id: bootId, rfid_uid: '04A1B2C3', timestamp: String(Date.now()), clock: 'sntp', action: 'ENTRY' },
+            { seq: 2, boot_id: bootId, rfid_uid: '04A1B2C3', clock: 'uptime', action: 'EXIT' }
+        ]
+    };
+    try {
+        const first = await makeRequest(`${API_BASE}/log-attendance/batch`, 'POST', batch);
+        const retry = await makeRequest(`${API_BASE}/log-attendance/batch`, 'POST', batch);
+        if (first.statusCode !== 200 || first.data.accepted !== 2 || first.data.duplicates !== 0) {
+            logResult(false, `First upload: ${first.statusCode} ${JSON.stringify(first.data)}`);
+            return false;
+        }
+        if (retry.statusCode !== 200 || retry.data.accepted !== 0 || retry.data.duplicates !== 2 ||
+            retry.data.acked_seq !== 2) {
+            logResult(false, `Retried upload: ${retry.statusCode} ${JSON.stringify(retry.data)}`);
+            return false;
+        }
+        logResult(true, 'Retried batch acknowledged without new rows');
+        
+        // The binary reply counts duplicates as accepted so the device advances
+        const body = wire.encodeAttendance(batch);
+        const binary = await makeBinaryRequest(`${API_BASE}/log-attendance/batch`, body, wire.CONTENT_TYPE);
+        const reply = wire.decodeAttendanceReply(binary.body);
+        if (binary.statusCode !== 200 || reply.accepted !== 2 || reply.acked_seq !== 2) {
+            logResult(false, `Binary retry: ${binary.statusCode} ${JSON.stringify(reply)}`);
+            return false;
+        }
+        
+        // Uptime millis from a device without wall time get the arrival time,
+        // not a date in 1970
+        const single = await makeRequest(`${API_BASE}/log-attendance`, 'POST', {
+            student_name: 'Test', rfid_uid: '04A1B2C3', timestamp: '5000', device_id: 'ESP32_TEST_001'
+        });
+        const year = single.data.timestamp ? new Date(single.data.timestamp).getUTCFullYear() : 0;
+        if (single.statusCode !== 200 || year < 2020) {
+            logResult(false, `Uptime timestamp stored as ${single.data.timestamp}`);
+            return false;
+        }
+        logResult(true, `Uptime-only event stamped ${single.data.timestamp}`);
+        return true;
+    } catch (error) {
+        logResult(false, `Idempotent attendance error: ${error.message}`);
+        return false;
+    }
+}
+
 async function testSimulationEndpoints() {
     logTest('Simulation Endpoints');
     
@@ -109,6 +347,10 @@ async function performLoadTest() {
 
 module.exports = {
     testDeviceRegistration,
+    testAllowlistSync,
+    testTemplateLibrary,
+    testWireProtocol,
+    testIdempotentAttendance,
     testSimulationEndpoints,
     performLoadTest
 };
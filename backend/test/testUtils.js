@@ -71,6 +71,38 @@ function makeRequest(url, method = 'GET', data = null, headers = {}) {
     });
 }
 
+// POST a raw body; the response body comes back as a Buffer
+function makeBinaryRequest(url, body, contentType) {
+    return new Promise((resolve, reject) => {
+        const urlObj = new URL(url);
+        const options = {
+            hostname: urlObj.hostname,
+            port: urlObj.port,
+            path: urlObj.pathname + urlObj.search,
+            method: 'POST',
+            headers: {
+                'Content-Type': contentType,
+                'Content-Length': body.length
+            }
+        };
+
+        const req = http.request(options, (res) => {
+            const chunks = [];
+            res.on('data', (chunk) => chunks.push(chunk));
+            res.on('end', () => {
+                resolve({
+                    statusCode: res.statusCode,
+                    headers: res.headers,
+                    body: Buffer.concat(chunks)
+                });
+            });
+        });
+
+        req.on('error', reject);
+        req.end(body);
+    });
+}
+
 // Logging functions
 function log(message, color = 'reset') {
     console.log(`${colors[color]}${message}${colors.reset}`);
@@ -101,6 +133,7 @@ const TEST_CARDS = [
 module.exports = {
     colors,
     makeRequest,
+    makeBinaryRequest,
     log,
     logTest,
     logResult,
@@ -0,0 +1,74 @@
+#!/usr/bin/env node
+
+// Attendance batch encoding: JSON vs the binary wire protocol
+// Runs offline (no server needed) with: npm run bench:wire
+//
+// Reports body bytes per event and server-side decode/encode CPU per event
+// for batches shaped like the firmware's.
+//
+// Environment:
+//   BENCH_BATCH    events per batch (default 32, matches firmware)
+//   BENCH_ROUNDS   batches timed per format (default 20000)
+
+const wire = require('../wireProtocol');
+const { log, logTest, logResult } = require('./testUtils');
+
+const BATCH = parseInt(process.env.BENCH_BATCH, 10) || 32;
+const ROUNDS = parseInt(process.env.BENCH_ROUNDS, 10) || 20000;
+
+function makeBatch() {
+    const now = 3600000;
+    const events = [];
+    for (let i = 0; i < BATCH; i++) {
+        events.push({
+            seq: 100000 + i,
+            rfid_uid: '04A1B2C3',
+            student_name: 'Adaeze Okonkwo-Bello',
+            timestamp: String(now + i * 997),
+            action: 'ENTRY'
+        });
+    }
+    return { device_id: 'ESP32_001', location: 'Main Entrance', events };
+}
+
+// Nanoseconds per event for fn run over ROUNDS batches
+function time(fn) {
+    for (let i = 0; i < 1000; i++) fn();
+    const start = process.hrtime.bigint();
+    for (let i = 0; i < ROUNDS; i++) fn();
+    return Number(process.hrtime.bigint() - start) / (ROUNDS * BATCH);
+}
+
+function main() {
+    logTest(`Wire Format: ${BATCH}-event batches, ${ROUNDS} rounds`);
+
+    const batch = makeBatch();
+    const json = Buffer.from(JSON.stringify(batch));
+    const binary = wire.encodeAttendance(batch);
+
+    const decoded = wire.decodeAttendance(binary);
+    const same = decoded.events.every((e, i) =>
+        e.seq === batch.events[i].seq && e.rfid_uid === batch.events[i].rfid_uid &&
+        e.timestamp === batch.events[i].timestamp && e.action === batch.events[i].action);
+    logResult(same, 'Binary batch decodes to the JSON batch (less student_name)');
+
+    log(`Body: JSON ${json.length} bytes (${(json.length / BATCH).toFixed(1)}/event), ` +
+        `binary ${binary.length} bytes (${(binary.length / BATCH).toFixed(1)}/event)`, 'cyan');
+
+    const jsonDecode = time(() => JSON.parse(json.toString('utf8')));
+    const binaryDecode = time(() => wire.decodeAttendance(binary));
+    log(`Decode: JSON ${jsonDecode.toFixed(0)} ns/event, binary ${binaryDecode.toFixed(0)} ns/event`, 'cyan');
+
+    const reply = { success: true, accepted: BATCH, rejected: [], acked_seq: 100000 + BATCH - 1 };
+    const jsonReply = time(() => JSON.stringify(reply));
+    const binaryReply = time(() => wire.encodeAttendanceReply({
+        status: wire.STATUS.OK, accepted: BATCH, rejected: 0, acked_seq: reply.acked_seq
+    }));
+    log(`Reply encode: JSON ${jsonReply.toFixed(0)} ns/event, binary ${binaryReply.toFixed(0)} ns/event`, 'cyan');
+
+    return same;
+}
+
+if (require.main === module) {
+    process.exit(main() ? 0 : 1);
+}
@@ -0,0 +1,238 @@
+// wireProtocol.js
+// Compact binary encoding of the requests a door makes on every tap:
+// card verification and attendance upload. Mirrors hardware/wire_protocol.h,
+// which documents the layout. Requests sent with CONTENT_TYPE are answered
+// in the same format; everything else stays JSON.
+
+const CONTENT_TYPE = 'application/vnd.attendance.v1';
+
+const MAGIC_0 = 0x41; // 'A'
+const MAGIC_1 = 0x57; // 'W'
+const VERSION = 1;
+const HEADER_SIZE = 4;
+
+const TYPE = {
+  VERIFY_REQUEST: 1,
+  VERIFY_REPLY: 2,
+  ATTENDANCE: 3,
+  ATTENDANCE_REPLY: 4,
+  ATTENDANCE_KEYED: 5
+};
+
+const STATUS = {
+  OK: 0,
+  NOT_FOUND: 1,
+  BAD_REQUEST: 2,
+  ERROR: 3
+};
+
+// Same numbering as CARD_ROLE_* and JOURNAL_ACTION_* on the device
+const ROLES = ['unknown', 'student', 'teacher'];
+const ACTIONS = ['ENTRY', 'EXIT'];
+// WALL_CLOCK_* on the device: how the event's time is known
+const CLOCKS = ['uptime', 'estimated', 'sntp'];
+
+const UID_MAX_LEN = 10;
+const STRING_MAX = 255;
+
+class WireError extends Error {}
+
+class Reader {
+  constructor(buf, type) {
+    if (!Buffer.isBuffer(buf) || buf.length < HEADER_SIZE ||
+        buf[0] !== MAGIC_0 || buf[1] !== MAGIC_1 || buf[2] !== VERSION || buf[3] !== type) {
+      throw new WireError(`Not a version ${VERSION} message of type ${type}`);
+    }
+    this.buf = buf;
+    this.pos = HEADER_SIZE;
+  }
+
+  need(n) {
+    if (this.buf.length - this.pos < n) throw new WireError('Truncated message');
+  }
+
+  u8() { this.need(1); return this.buf.readUInt8(this.pos++); }
+  u16() { this.need(2); const v = this.buf.readUInt16LE(this.pos); this.pos += 2; return v; }
+  u32() { this.need(4); const v = this.buf.readUInt32LE(this.pos); this.pos += 4; return v; }
+  // Unix ms fits a double exactly until the year 287396
+  u64() { this.need(8); const v = Number(this.buf.readBigUInt64LE(this.pos)); this.pos += 8; return v; }
+
+  text(n, encoding) {
+    this.need(n);
+    const v = this.buf.toString(encoding, this.pos, this.pos + n);
+    this.pos += n;
+    return v;
+  }
+
+  string() { return this.text(this.u8(), 'utf8'); }
+
+  uid() {
+    const len = this.u8();
+    if (len === 0 || len > UID_MAX_LEN) throw new WireError(`Bad UID length ${len}`);
+    return this.text(len, 'hex').toUpperCase();
+  }
+}
+
+function header(buf, type) {
+  buf[0] = MAGIC_0;
+  buf[1] = MAGIC_1;
+  buf[2] = VERSION;
+  buf[3] = type;
+  return HEADER_SIZE;
+}
+
+// UTF-8 bytes, truncated to fit the u8 length prefix
+function stringBytes(value) {
+  const bytes = Buffer.from(value == null ? '' : String(value), 'utf8');
+  return bytes.length > STRING_MAX ? bytes.subarray(0, STRING_MAX) : bytes;
+}
+
+function uidBytes(hex) {
+  const bytes = Buffer.from(String(hex || ''), 'hex');
+  if (bytes.length === 0 || bytes.length > UID_MAX_LEN) throw new WireError(`Bad UID ${hex}`);
+  return bytes;
+}
+
+function decodeVerifyRequest(buf) {
+  const r = new Reader(buf, TYPE.VERIFY_REQUEST);
+  return { rfid_uid: r.uid() };
+}
+
+function encodeVerifyRequest({ rfid_uid }) {
+  const uid = uidBytes(rfid_uid);
+  const buf = Buffer.alloc(HEADER_SIZE + 1 + uid.length);
+  let pos = header(buf, TYPE.VERIFY_REQUEST);
+  buf[pos++] = uid.length;
+  uid.copy(buf, pos);
+  return buf;
+}
+
+function encodeVerifyReply({ status, role, fingerprint_slot, student_name, user_id }) {
+  const name = stringBytes(student_name);
+  const userId = stringBytes(user_id);
+  const buf = Buffer.alloc(HEADER_SIZE + 4 + 1 + name.length + 1 + userId.length);
+  let pos = header(buf, TYPE.VERIFY_REPLY);
+  buf[pos++] = status;
+  buf[pos++] = Math.max(0, ROLES.indexOf(role));
+  pos = buf.writeUInt16LE(fingerprint_slot || 0, pos);
+  buf[pos++] = name.length;
+  pos += name.copy(buf, pos);
+  buf[pos++] = userId.length;
+  userId.copy(buf, pos);
+  return buf;
+}
+
+function decodeVerifyReply(buf) {
+  const r = new Reader(buf, TYPE.VERIFY_REPLY);
+  const status = r.u8();
+  const role = ROLES[r.u8()] || 'unknown';
+  return {
+    status,
+    role,
+    fingerprint_slot: r.u16(),
+    student_name: r.string(),
+    user_id: r.string()
+  };
+}
+
+// Events come out shaped like the JSON batch so both formats share a
+// handler. Firmware before ATTENDANCE_KEYED sends ATTENDANCE, whose
+// timestamp is uptime millis.
+function decodeAttendance(buf) {
+  const keyed = Buffer.isBuffer(buf) && buf.length >= HEADER_SIZE && buf[3] === TYPE.ATTENDANCE_KEYED;
+  const r = new Reader(buf, keyed ? TYPE.ATTENDANCE_KEYED : TYPE.ATTENDANCE);
+  const device_id = r.string();
+  const location = r.string();
+  const count = r.u16();
+  const events = new Array(count);
+  for (let i = 0; i < count; i++) {
+    const seq = r.u32();
+    if (keyed) {
+      const boot_id = r.u32();
+      const time = r.u64();
+      const clock = CLOCKS[r.u8()] || 'uptime';
+      const action = ACTIONS[r.u8()] || 'ENTRY';
+      events[i] = { seq, boot_id, rfid_uid: r.uid(), timestamp: time ? time.toString() : undefined, clock, action };
+    } else {
+      const timestamp = r.u32();
+      const action = ACTIONS[r.u8()] || 'ENTRY';
+      events[i] = { seq, rfid_uid: r.uid(), timestamp: timestamp.toString(), action };
+    }
+  }
+  return { device_id, location, events };
+}
+
+// Encodes ATTENDANCE_KEYED unless asked for the older layout
+function encodeAttendance({ device_id, location, events }, type = TYPE.ATTENDANCE_KEYED) {
+  const keyed = type === TYPE.ATTENDANCE_KEYED;
+  const device = stringBytes(device_id);
+  const loc = stringBytes(location);
+  const uids = events.map((e) => uidBytes(e.rfid_uid));
+  const fixed = keyed ? 19 : 10;
+  const size = HEADER_SIZE + 1 + device.length + 1 + loc.length + 2 +
+    uids.reduce((sum, uid) => sum + fixed + uid.length, 0);
+
+  const buf = Buffer.alloc(size);
+  let pos = header(buf, keyed ? TYPE.ATTENDANCE_KEYED : TYPE.ATTENDANCE);
+  buf[pos++] = device.length;
+  pos += device.copy(buf, pos);
+  buf[pos++] = loc.length;
+  pos += loc.copy(buf, pos);
+  pos = buf.writeUInt16LE(events.length, pos);
+  events.forEach((e, i) => {
+    pos = buf.writeUInt32LE(e.seq >>> 0, pos);
+    if (keyed) {
+      pos = buf.writeUInt32LE((e.boot_id || 0) >>> 0, pos);
+      pos = buf.writeBigUInt64LE(BigInt(parseInt(e.timestamp, 10) || 0), pos);
+      buf[pos++] = Math.max(0, CLOCKS.indexOf(e.clock));
+    } else {
+      pos = buf.writeUInt32LE(parseInt(e.timestamp, 10) >>> 0, pos);
+    }
+    buf[pos++] = Math.max(0, ACTIONS.indexOf(e.action));
+    buf[pos++] = uids[i].length;
+    pos += uids[i].copy(buf, pos);
+  });
+  return buf;
+}
+
+// accepted includes events the server already had (retries)
+function encodeAttendanceReply({ status, accepted, rejected, acked_seq }) {
+  const buf = Buffer.alloc(HEADER_SIZE + 9);
+  let pos = header(buf, TYPE.ATTENDANCE_REPLY);
+  buf[pos++] = status;
+  pos = buf.writeUInt16LE(Math.min(accepted || 0, 0xFFFF), pos);
+  pos = buf.writeUInt16LE(Math.min(rejected || 0, 0xFFFF), pos);
+  buf.writeUInt32LE((acked_seq || 0) >>> 0, pos);
+  return buf;
+}
+
+function decodeAttendanceReply(buf) {
+  const r = new Reader(buf, TYPE.ATTENDANCE_REPLY);
+  return { status: r.u8(), accepted: r.u16(), rejected: r.u16(), acked_seq: r.u32() };
+}
+
+// True if the request body was sent in the binary format
+function isWire(req) {
+  return Buffer.isBuffer(req.body) && !!req.is(CONTENT_TYPE);
+}
+
+function send(res, httpStatus, buf) {
+  res.status(httpStatus).type(CONTENT_TYPE).send(buf);
+}
+
+module.exports = {
+  CONTENT_TYPE,
+  TYPE,
+  STATUS,
+  WireError,
+  decodeVerifyRequest,
+  encodeVerifyRequest,
+  encodeVerifyReply,
+  decodeVerifyReply,
+  decodeAttendance,
+  encodeAttendance,
+  encodeAttendanceReply,
+  decodeAttendanceReply,
+  isWire,
+  send
+};
@@ -21,7 +21,8 @@ JWT_EXPIRE=7d
 # Security Configuration
 SESSION_SECRET=your_session_secret
 
-# ESP32 Configuration
+# ESP32 Configuration (enrolment key a door needs to register; unset,
+# a new device ID registers without one)
 ESP32_API_KEY=your_esp32_api_key
 
 # File Upload Configuration
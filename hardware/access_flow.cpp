@@ -0,0 +1,267 @@
+/*
+ * Access Flow - tick-driven state machine for one tap at the door
+ *
+ * Every wait is a deadline compared against the millis() value passed in,
+ * using signed differences so it survives the 49-day wrap.
+ */
+
+#include "access_flow.h"
+#include <stdio.h>
+#include <string.h>
+
+static bool reached(uint32_t now, uint32_t at) {
+  return (int32_t)(now - at) >= 0;
+}
+
+static void copyLine(char* dst, const char* src) {
+  strncpy(dst, src != NULL ? src : "", ACCESS_LCD_COLS);
+  dst[ACCESS_LCD_COLS] = '\0';
+}
+
+AccessFlow::AccessFlow()
+    : hw_(NULL), state_(ACCESS_READY), relayOpen_(false), relayCloseAt_(0),
+      hasNext_(false), screenTimed_(false), doorScreen_(false), screenUntil_(0),
+      attempt_(0), attemptUntil_(0), nextPollAt_(0), fingerSlot_(0),
+      speculative_(ACCESS_SPECULATIVE_CAPTURE != 0), captured_(false), denyReason_("") {
+  memset(patterns_, 0, sizeof(patterns_));
+  memset(&next_, 0, sizeof(next_));
+}
+
+void AccessFlow::begin(AccessHardware* hw, uint32_t now) {
+  hw_ = hw;
+  state_ = ACCESS_READY;
+  memset(patterns_, 0, sizeof(patterns_));
+  for (uint8_t i = 0; i < ACCESS_OUT_COUNT; i++) {
+    hw_->setOutput(i, false);
+  }
+  relayOpen_ = false;
+  relayCloseAt_ = now;
+  hasNext_ = false;
+  screenTimed_ = false;
+  doorScreen_ = false;
+}
+
+// Start count pulses on output, the first one immediately
+void AccessFlow::pulse(uint8_t output, uint16_t onMs, uint16_t offMs, uint8_t count, uint32_t now) {
+  if (count == 0) return;
+  Pattern& p = patterns_[output];
+  p.onMs = onMs;
+  p.offMs = offMs;
+  p.remaining = count - 1;
+  p.on = true;
+  p.nextAt = now + onMs;
+  hw_->setOutput(output, true);
+}
+
+void AccessFlow::tickPatterns(uint32_t now) {
+  for (uint8_t i = 0; i < ACCESS_OUT_RELAY; i++) {
+    Pattern& p = patterns_[i];
+    if (!reached(now, p.nextAt)) continue;
+
+    if (p.on) {
+      p.on = false;
+      p.nextAt += p.offMs;
+      hw_->setOutput(i, false);
+    } else if (p.remaining > 0) {
+      p.remaining--;
+      p.on = true;
+      p.nextAt += p.onMs;
+      hw_->setOutput(i, true);
+    }
+  }
+}
+
+// holdMs == 0 keeps the screen until something else replaces it
+void AccessFlow::show(const char* line1, const char* line2, uint32_t holdMs, uint32_t now) {
+  hw_->display(line1, line2);
+  screenTimed_ = holdMs > 0;
+  screenUntil_ = now + holdMs;
+  hasNext_ = false;
+  doorScreen_ = false;
+}
+
+void AccessFlow::showMessage(const char* line1, const char* line2, uint32_t holdMs, uint32_t now) {
+  show(line1, line2, holdMs, now);
+}
+
+void AccessFlow::queueMessage(const char* line1, const char* line2, uint32_t holdMs) {
+  copyLine(next_.line1, line1);
+  copyLine(next_.line2, line2);
+  next_.holdMs = holdMs;
+  hasNext_ = true;
+}
+
+void AccessFlow::tickScreen(uint32_t now) {
+  if (!screenTimed_ || !reached(now, screenUntil_)) return;
+
+  if (hasNext_) {
+    Screen next = next_;
+    show(next.line1, next.line2, next.holdMs, now);
+    return;
+  }
+
+  screenTimed_ = false;
+  if (state_ == ACCESS_READY) {
+    hw_->display("System Ready", "Present Card");
+  }
+}
+
+void AccessFlow::cardDetected(const char* cardUID, uint32_t now) {
+  char line2[ACCESS_LCD_COLS + 1];
+  if (strlen(cardUID) > 12) {
+    snprintf(line2, sizeof(line2), "%.12s...", cardUID);
+  } else {
+    copyLine(line2, cardUID);
+  }
+  show("Card Detected", line2, 0, now);
+  pulse(ACCESS_OUT_BUZZER, 100, 0, 1, now);
+}
+
+void AccessFlow::cardPending(uint32_t now) {
+  attempt_ = 0;
+  captured_ = false;
+  state_ = ACCESS_CARD_VERIFY;
+  nextPollAt_ = now;
+  if (speculative_) {
+    show("Place Finger", "Checking card", 0, now);
+  } else {
+    show("Checking Card", "Please wait", 0, now);
+  }
+}
+
+void AccessFlow::cardAccepted(uint16_t slot, uint32_t now) {
+  attempt_ = 0;
+  fingerSlot_ = slot;
+
+  // The finger prompt is already up, so skip "Card Valid"
+  if (state_ == ACCESS_CARD_VERIFY && speculative_) {
+    if (!captured_) {
+      startAttempt(now);
+      return;
+    }
+    // The next tick matches what was captured as the first attempt
+    attempt_ = 1;
+    state_ = ACCESS_FINGER_WAIT;
+    attemptUntil_ = now + ACCESS_FINGER_TIMEOUT_MS;
+    nextPollAt_ = now;
+    return;
+  }
+
+  captured_ = false;
+  state_ = ACCESS_FINGER_PAUSE;
+  attemptUntil_ = now + ACCESS_CARD_VALID_MS;
+  show("Card Valid", "Scan Fingerprint", 0, now);
+  pulse(ACCESS_OUT_GREEN, ACCESS_CARD_VALID_MS, 0, 1, now);
+}
+
+void AccessFlow::deny(const char* reason, uint32_t now) {
+  fail(reason, now);
+}
+
+void AccessFlow::startAttempt(uint32_t now) {
+  attempt_++;
+  captured_ = false;
+  state_ = ACCESS_FINGER_WAIT;
+  attemptUntil_ = now + ACCESS_FINGER_TIMEOUT_MS;
+  nextPollAt_ = now;
+
+  char line2[ACCESS_LCD_COLS + 1];
+  snprintf(line2, sizeof(line2), "Try %u/%u", (unsigned)attempt_, (unsigned)ACCESS_FINGER_ATTEMPTS);
+  show("Place Finger", line2, 0, now);
+  pulse(ACCESS_OUT_BUZZER, 100, 0, 1, now);
+}
+
+void AccessFlow::grant(uint32_t now) {
+  state_ = ACCESS_READY;
+  captured_ = false;
+
+  // A second grant while the door is still open just extends the hold
+  relayOpen_ = true;
+  relayCloseAt_ = now + ACCESS_RELAY_HOLD_MS;
+  hw_->setOutput(ACCESS_OUT_RELAY, true);
+
+  pulse(ACCESS_OUT_GREEN, ACCESS_RELAY_HOLD_MS, 0, 1, now);
+  pulse(ACCESS_OUT_BUZZER, 200, 100, 3, now);
+  show("Door Unlocked", "Enter now", 0, now);
+  doorScreen_ = true;
+}
+
+void AccessFlow::fail(const char* reason, uint32_t now) {
+  state_ = ACCESS_READY;
+  captured_ = false;
+  denyReason_ = reason;
+
+  pulse(ACCESS_OUT_RED, 100, 100, 5, now);
+  pulse(ACCESS_OUT_BUZZER, 100, 100, 5, now);
+  show("Access Denied", reason, ACCESS_DENIED_SHOW_MS, now);
+}
+
+AccessEvent AccessFlow::tick(uint32_t now) {
+  AccessEvent event = ACCESS_EVENT_NONE;
+
+  tickPatterns(now);
+
+  if (relayOpen_ && reached(now, relayCloseAt_)) {
+    relayOpen_ = false;
+    hw_->setOutput(ACCESS_OUT_RELAY, false);
+    // Only if nobody else has taken the display since the grant
+    if (doorScreen_) {
+      show("Access Complete", "Door locked", ACCESS_COMPLETE_SHOW_MS, now);
+    }
+  }
+
+  switch (state_) {
+    case ACCESS_CARD_VERIFY:
+      // One capture at most; it is held until the verdict arrives
+      if (speculative_ && !captured_ && reached(now, nextPollAt_)) {
+        nextPollAt_ = now + ACCESS_FINGER_POLL_MS;
+        if (hw_->captureFingerprint()) {
+          captured_ = true;
+          show("Finger Read", "Checking card", 0, now);
+          pulse(ACCESS_OUT_BUZZER, 100, 0, 1, now);
+        }
+      }
+      break;
+
+    case ACCESS_FINGER_PAUSE:
+      if (reached(now, attemptUntil_)) startAttempt(now);
+      break;
+
+    case ACCESS_FINGER_WAIT:
+      if (reached(now, nextPollAt_)) {
+        nextPollAt_ = now + ACCESS_FINGER_POLL_MS;
+        if (!captured_) captured_ = hw_->captureFingerprint();
+        if (captured_) {
+          int match = hw_->matchCaptured(fingerSlot_);
+          if (match > 0) {
+            grant(now);
+            event = ACCESS_EVENT_GRANTED;
+            break;
+          }
+          // A finger that isn't the card owner's uses up the attempt; a
+          // template still loading is retried with the same features
+          if (match == 0) {
+            captured_ = false;
+            attemptUntil_ = now;
+          }
+        }
+      }
+      if (reached(now, attemptUntil_)) {
+        if (attempt_ < ACCESS_FINGER_ATTEMPTS) {
+          state_ = ACCESS_FINGER_PAUSE;
+          attemptUntil_ = now + ACCESS_FINGER_RETRY_MS;
+          show("Try Again", "Place finger", 0, now);
+        } else {
+          fail("Fingerprint Failed", now);
+          event = ACCESS_EVENT_DENIED;
+        }
+      }
+      break;
+
+    case ACCESS_READY:
+      break;
+  }
+
+  tickScreen(now);
+  return event;
+}
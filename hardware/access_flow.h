@@ -0,0 +1,165 @@
+/*
+ * Access Flow - tick-driven state machine for one tap at the door
+ *
+ * The sketch hands a looked-up card to the flow and then calls tick() on
+ * every pass of loop(). Fingerprint polling, buzzer and LED patterns, the
+ * relay hold and LCD messages all run on deadlines instead of delay(), so
+ * the loop keeps servicing Wi-Fi and sync. A grant or denial returns the
+ * flow to ready straight away: the next card can be read while the relay
+ * is still open and the previous person's feedback is still playing.
+ *
+ * A card that has to be verified by the server puts the flow in
+ * ACCESS_CARD_VERIFY. With speculative capture on, the finger prompt goes
+ * up straight away and the sensor captures and extracts features while
+ * the request is in flight. An accepted card matches those features
+ * against its slot at once; a rejected card discards them.
+ */
+
+#ifndef ACCESS_FLOW_H
+#define ACCESS_FLOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef ACCESS_RELAY_HOLD_MS
+#define ACCESS_RELAY_HOLD_MS      3000  // Door unlocked after a grant
+#endif
+#ifndef ACCESS_FINGER_TIMEOUT_MS
+#define ACCESS_FINGER_TIMEOUT_MS  5000  // Per fingerprint attempt
+#endif
+#ifndef ACCESS_FINGER_RETRY_MS
+#define ACCESS_FINGER_RETRY_MS    1500  // "Try Again" pause between attempts
+#endif
+#ifndef ACCESS_FINGER_POLL_MS
+#define ACCESS_FINGER_POLL_MS     100   // Sensor poll interval
+#endif
+#ifndef ACCESS_FINGER_ATTEMPTS
+#define ACCESS_FINGER_ATTEMPTS    3
+#endif
+#ifndef ACCESS_CARD_VALID_MS
+#define ACCESS_CARD_VALID_MS      500   // "Card Valid" before the first prompt
+#endif
+#ifndef ACCESS_COMPLETE_SHOW_MS
+#define ACCESS_COMPLETE_SHOW_MS   2000  // "Access Complete" after the door locks
+#endif
+#ifndef ACCESS_DENIED_SHOW_MS
+#define ACCESS_DENIED_SHOW_MS     3000  // "Access Denied" before reverting
+#endif
+#ifndef ACCESS_SPECULATIVE_CAPTURE
+#define ACCESS_SPECULATIVE_CAPTURE 1    // Capture the finger during server verify
+#endif
+
+// Outputs driven by the flow
+#define ACCESS_OUT_BUZZER  0
+#define ACCESS_OUT_GREEN   1
+#define ACCESS_OUT_RED     2
+#define ACCESS_OUT_RELAY   3
+#define ACCESS_OUT_COUNT   4
+
+#define ACCESS_LCD_COLS    16
+
+enum AccessState {
+  ACCESS_READY,         // Waiting for a card
+  ACCESS_CARD_VERIFY,   // Card sent to the server; finger captured meanwhile
+  ACCESS_FINGER_WAIT,   // Polling the sensor for the current attempt
+  ACCESS_FINGER_PAUSE   // "Card Valid" / "Try Again" before the next prompt
+};
+
+enum AccessEvent {
+  ACCESS_EVENT_NONE,
+  ACCESS_EVENT_GRANTED,
+  ACCESS_EVENT_DENIED
+};
+
+// Pins, LCD and sensor as seen by the flow
+class AccessHardware {
+public:
+  virtual ~AccessHardware() {}
+  virtual void setOutput(uint8_t output, bool on) = 0;
+  virtual void display(const char* line1, const char* line2) = 0;
+  // Capture a finger and extract its features; false if no finger
+  virtual bool captureFingerprint() = 0;
+  // Match the last captured features 1:1 against the template in slot.
+  // Returns 1 on a match, 0 on a mismatch, -1 if the template isn't on
+  // the sensor yet; the features are kept and retried on the next poll.
+  virtual int matchCaptured(uint16_t slot) = 0;
+};
+
+class AccessFlow {
+public:
+  AccessFlow();
+
+  void begin(AccessHardware* hw, uint32_t now);
+
+  // Card read: beep and show the UID while it is looked up
+  void cardDetected(const char* cardUID, uint32_t now);
+  // Card not stored locally and sent to the server for a verdict
+  void cardPending(uint32_t now);
+  // Card looked up and valid: prompt for the finger enrolled in slot
+  void cardAccepted(uint16_t slot, uint32_t now);
+  // Card rejected before the fingerprint stage
+  void deny(const char* reason, uint32_t now);
+  // Show a status message for holdMs, then return to the ready screen
+  void showMessage(const char* line1, const char* line2, uint32_t holdMs, uint32_t now);
+  // Show a message for holdMs once the current timed message expires
+  void queueMessage(const char* line1, const char* line2, uint32_t holdMs);
+
+  // Capture the finger while a card is pending, or wait for the verdict
+  void setSpeculativeCapture(bool on) { speculative_ = on; }
+
+  // Advance all timers; returns the outcome of the tap if it ended this tick
+  AccessEvent tick(uint32_t now);
+
+  AccessState state() const { return state_; }
+  bool ready() const { return state_ == ACCESS_READY; }
+  bool doorOpen() const { return relayOpen_; }
+  bool fingerCaptured() const { return captured_; }
+  uint16_t fingerSlot() const { return fingerSlot_; }
+  const char* denyReason() const { return denyReason_; }
+
+private:
+  // Repeating on/off pattern on one output
+  struct Pattern {
+    uint16_t onMs;
+    uint16_t offMs;
+    uint8_t remaining;  // Pulses still to start
+    bool on;
+    uint32_t nextAt;
+  };
+
+  struct Screen {
+    char line1[ACCESS_LCD_COLS + 1];
+    char line2[ACCESS_LCD_COLS + 1];
+    uint32_t holdMs;
+  };
+
+  void pulse(uint8_t output, uint16_t onMs, uint16_t offMs, uint8_t count, uint32_t now);
+  void tickPatterns(uint32_t now);
+  void show(const char* line1, const char* line2, uint32_t holdMs, uint32_t now);
+  void tickScreen(uint32_t now);
+  void startAttempt(uint32_t now);
+  void grant(uint32_t now);
+  void fail(const char* reason, uint32_t now);
+
+  AccessHardware* hw_;
+  AccessState state_;
+  Pattern patterns_[ACCESS_OUT_RELAY];
+  bool relayOpen_;
+  uint32_t relayCloseAt_;
+
+  Screen next_;              // Shown when the current screen expires
+  bool hasNext_;
+  bool screenTimed_;         // Current screen reverts at screenUntil_
+  bool doorScreen_;          // "Door Unlocked" is showing; swap on lock
+  uint32_t screenUntil_;
+
+  uint8_t attempt_;
+  uint32_t attemptUntil_;
+  uint32_t nextPollAt_;
+  uint16_t fingerSlot_;
+  bool speculative_;
+  bool captured_;            // Features waiting in the sensor for a verdict
+  const char* denyReason_;
+};
+
+#endif // ACCESS_FLOW_H
@@ -0,0 +1,159 @@
+/*
+ * Allowlist Sync - versioned bulk card sync from the server
+ *
+ * Wire format (GET allowlist?format=text), one record per line, sorted by UID:
+ *   ALLOWLIST <version> SNAPSHOT|DELTA
+ *   +<UID>,<name>,<user_id>,<role>,<slot>   add or replace a card
+ *   -<UID>                                  revoke a card
+ * <slot> is the card owner's fingerprint template slot (0 = none); older
+ * servers omit it.
+ *   END
+ * A response without the END line was cut off and is discarded.
+ */
+
+#include "allowlist_sync.h"
+#include "card_store.h"
+#include "server_client.h"
+#include "log_ring.h"
+#include <SPIFFS.h>
+
+#define ALLOWLIST_LINE_MAX 160
+
+static uint32_t appliedVersion = 0;
+
+// Reads change lines straight off the HTTP response
+class HttpChangeSource : public CardChangeSource {
+public:
+  explicit HttpChangeSource(Stream& stream) : stream_(stream), ended_(false), received_(0) {}
+
+  bool readLine(char* line, size_t size) {
+    size_t len = stream_.readBytesUntil('\n', line, size - 1);
+    if (len == 0 && !stream_.available()) return false;
+    if (len > 0 && line[len - 1] == '\r') len--;
+    line[len] = '\0';
+    return true;
+  }
+
+  bool next(CardRecord* rec, bool* revoke) override {
+    char line[ALLOWLIST_LINE_MAX];
+    while (!ended_ && readLine(line, sizeof(line))) {
+      if (strcmp(line, "END") == 0) {
+        ended_ = true;
+        return false;
+      }
+      if (parse(line, rec, revoke)) {
+        received_++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ok() override { return ended_; }
+  size_t received() const { return received_; }
+
+private:
+  // Cards whose UID is not hex (e.g. simulator test cards) are skipped
+  static bool parse(char* line, CardRecord* rec, bool* revoke) {
+    if (line[0] != '+' && line[0] != '-') return false;
+    *revoke = line[0] == '-';
+
+    char* fields[5] = { line + 1, (char*)"", (char*)"", (char*)"", (char*)"" };
+    for (int f = 1; f < 5; f++) {
+      char* comma = strchr(fields[f - 1], ',');
+      if (comma == NULL) break;
+      *comma = '\0';
+      fields[f] = comma + 1;
+    }
+
+    uint8_t uid[CARD_UID_MAX_LEN];
+    uint8_t uidLen = 0;
+    if (!cardUidFromHex(fields[0], uid, &uidLen)) return false;
+    if (!cardRecordSet(rec, uid, uidLen, fields[1], fields[2], cardRoleFromString(fields[3]))) return false;
+    // Servers without fingerprint slots send four fields
+    rec->fingerSlot = (uint16_t)strtoul(fields[4], NULL, 10);
+    return true;
+  }
+
+  Stream& stream_;
+  bool ended_;
+  size_t received_;
+};
+
+static void saveVersion(uint32_t version) {
+  File file = SPIFFS.open(ALLOWLIST_VERSION_TMP, "w");
+  if (!file) return;
+  file.print(version);
+  file.close();
+  SPIFFS.remove(ALLOWLIST_VERSION_FILE);
+  SPIFFS.rename(ALLOWLIST_VERSION_TMP, ALLOWLIST_VERSION_FILE);
+}
+
+void allowlistSyncBegin() {
+  appliedVersion = 0;
+
+  // Without an index the saved version is meaningless; start from a snapshot
+  if (!SPIFFS.exists(CARD_INDEX_FILE)) return;
+
+  File file = SPIFFS.open(ALLOWLIST_VERSION_FILE, "r");
+  if (file) {
+    appliedVersion = (uint32_t)file.readString().toInt();
+    file.close();
+  }
+  LOG_INFO("Allowlist version: %lu", (unsigned long)appliedVersion);
+}
+
+uint32_t allowlistVersion() {
+  return appliedVersion;
+}
+
+bool allowlistSync(const String& location) {
+  // The server sends the text with a Content-Length, so the raw stream is
+  // the body and the connection stays reusable afterwards
+  String path = "allowlist?format=text&since=" + String(appliedVersion) +
+                "&location=" + serverUrlEncode(location);
+
+  int httpResponseCode = serverGet(path.c_str(), ALLOWLIST_HTTP_TIMEOUT);
+  if (httpResponseCode != 200) {
+    LOG_WARN("Allowlist sync failed: %d", httpResponseCode);
+    serverEnd();
+    return false;
+  }
+
+  Stream& stream = *serverStream();
+  stream.setTimeout(ALLOWLIST_HTTP_TIMEOUT);
+  HttpChangeSource changes(stream);
+
+  char header[ALLOWLIST_LINE_MAX];
+  char mode[16];
+  unsigned long version = 0;
+  if (!changes.readLine(header, sizeof(header)) ||
+      sscanf(header, "ALLOWLIST %lu %15s", &version, mode) != 2) {
+    LOG_WARN("Allowlist sync: bad response header");
+    serverEnd();
+    return false;
+  }
+
+  bool snapshot = strcmp(mode, "SNAPSHOT") == 0;
+  if (!snapshot && version == appliedVersion) {
+    serverEnd();
+    return true;  // Already current; only the END line follows
+  }
+
+  unsigned long start = millis();
+  bool applied = cardStoreApply(changes, snapshot);
+  serverEnd();
+
+  if (!applied) {
+    LOG_WARN("Allowlist sync: update not applied");
+    return false;
+  }
+
+  appliedVersion = (uint32_t)version;
+  saveVersion(appliedVersion);
+  LOG_INFO("Allowlist %s v%lu: %lu changes, %lu cards, applied in %lu ms",
+           snapshot ? "snapshot" : "delta", (unsigned long)appliedVersion,
+           (unsigned long)changes.received(), (unsigned long)cardStoreCount(),
+           (unsigned long)(millis() - start));
+  return true;
+}
@@ -0,0 +1,30 @@
+/*
+ * Allowlist Sync - versioned bulk card sync from the server
+ *
+ * Pulls the location's allowlist from GET /api/allowlist as a full snapshot
+ * the first time, then as deltas since the last applied version. Each pull
+ * is merged into the card index and swapped in atomically, so the first tap
+ * of the day is answered locally and revocations reach the device.
+ */
+
+#ifndef ALLOWLIST_SYNC_H
+#define ALLOWLIST_SYNC_H
+
+#include <Arduino.h>
+
+#define ALLOWLIST_VERSION_FILE  "/allowlist.ver"
+#define ALLOWLIST_VERSION_TMP   "/allowlist.tmp"
+
+#ifndef ALLOWLIST_SYNC_INTERVAL
+#define ALLOWLIST_SYNC_INTERVAL 600000  // Pull changes every 10 minutes (ms)
+#endif
+#ifndef ALLOWLIST_HTTP_TIMEOUT
+#define ALLOWLIST_HTTP_TIMEOUT  15000
+#endif
+
+// Function declarations
+void allowlistSyncBegin();
+bool allowlistSync(const String& location);
+uint32_t allowlistVersion();
+
+#endif // ALLOWLIST_SYNC_H
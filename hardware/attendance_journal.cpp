@@ -0,0 +1,291 @@
+/*
+ * Attendance Journal - sequenced write-ahead log of attendance events
+ *
+ * Events are JOURNAL_EVENT records and the acknowledged cursor is a
+ * JOURNAL_ACK record, rewritten as a new record on every ack; mount
+ * replays both. For each segment the journal keeps the range of sequence
+ * numbers in it, so reading the oldest unacknowledged events touches only
+ * the segments that hold them, and a segment whose events are all
+ * acknowledged is retired in one step.
+ *
+ * Compaction copies live events to the head, so a segment's sequence
+ * numbers aren't in order and a power cut mid-compaction can leave an
+ * event twice; journalRead sorts and drops the duplicate.
+ */
+
+#include "attendance_journal.h"
+#include "log_store.h"
+#include "partition_flash.h"
+#include "log_ring.h"
+#include <SPIFFS.h>
+
+#define JOURNAL_EVENT    1  // A JournalRecord
+#define JOURNAL_ACK      2  // The acknowledged cursor, uint32_t
+#define JOURNAL_NO_ADDR  0xFFFFFFFF
+
+// Unacknowledged events in one segment
+struct SegmentSpan {
+  uint32_t minSeq;
+  uint32_t maxSeq;
+  uint32_t bytes;  // On flash, not yet retired
+};
+
+class JournalLog : public LogStoreClient {
+public:
+  void replay(const LogEntry& entry) override;
+  bool live(const LogEntry& entry) override;
+  void moved(const LogEntry& entry, uint32_t to) override;
+  void erased(uint16_t segment) override;
+};
+
+static PartitionFlash journalFlash;
+static JournalLog journalLog;
+static LogStore store;
+static SegmentSpan spans[LOG_STORE_MAX_SEGMENTS];
+static uint32_t nextSeq = 1;
+static uint32_t ackedSeq = 0;
+static uint32_t ackAddr = JOURNAL_NO_ADDR;  // The newest cursor record
+
+static void noteEvent(uint32_t addr, uint32_t seq) {
+  SegmentSpan& span = spans[LogStore::segmentOf(addr)];
+  if (span.bytes == 0 || seq < span.minSeq) span.minSeq = seq;
+  if (span.bytes == 0 || seq > span.maxSeq) span.maxSeq = seq;
+  span.bytes += LogStore::recordBytes(sizeof(JournalRecord));
+}
+
+// Segments whose events the server has all seen hold nothing live
+static void retireAcked() {
+  for (uint16_t i = 0; i < store.segmentCount(); i++) {
+    if (spans[i].bytes == 0 || spans[i].maxSeq > ackedSeq) continue;
+    store.retire((uint32_t)i * LOG_STORE_SEGMENT_BYTES, spans[i].bytes);
+    spans[i].bytes = 0;
+  }
+}
+
+static void saveAckedSeq() {
+  uint32_t addr;
+  if (!store.append(JOURNAL_ACK, &ackedSeq, sizeof(ackedSeq), &addr)) {
+    LOG_WARN("Journal cursor not saved - events may be sent again");
+    return;
+  }
+  if (ackAddr != JOURNAL_NO_ADDR) store.retire(ackAddr, LogStore::recordBytes(sizeof(ackedSeq)));
+  ackAddr = addr;
+}
+
+void JournalLog::replay(const LogEntry& entry) {
+  if (entry.type == JOURNAL_EVENT && entry.len == sizeof(JournalRecord)) {
+    uint32_t seq;
+    memcpy(&seq, entry.payload, sizeof(seq));
+    noteEvent(entry.addr, seq);
+    if (seq >= nextSeq) nextSeq = seq + 1;
+    return;
+  }
+
+  uint32_t acked = 0;
+  if (entry.type == JOURNAL_ACK && entry.len == sizeof(acked)) memcpy(&acked, entry.payload, sizeof(acked));
+  if (entry.type == JOURNAL_ACK && acked > ackedSeq) {
+    if (ackAddr != JOURNAL_NO_ADDR) store.retire(ackAddr, LogStore::recordBytes(sizeof(acked)));
+    ackedSeq = acked;
+    ackAddr = entry.addr;
+  } else {
+    store.retire(entry.addr, LogStore::recordBytes(entry.len));
+  }
+}
+
+bool JournalLog::live(const LogEntry& entry) {
+  if (entry.type == JOURNAL_ACK) return entry.addr == ackAddr;
+  uint32_t seq;
+  memcpy(&seq, entry.payload, sizeof(seq));
+  return entry.type == JOURNAL_EVENT && seq > ackedSeq;
+}
+
+void JournalLog::moved(const LogEntry& entry, uint32_t to) {
+  if (entry.type == JOURNAL_ACK) {
+    ackAddr = to;
+    return;
+  }
+  uint32_t seq;
+  memcpy(&seq, entry.payload, sizeof(seq));
+  noteEvent(to, seq);
+}
+
+void JournalLog::erased(uint16_t segment) {
+  memset(&spans[segment], 0, sizeof(spans[segment]));
+}
+
+// Out of room: give up the oldest segment's events though the server
+// never saw them
+static bool dropOldestSegment() {
+  int oldest = -1;
+  for (uint16_t i = 0; i < store.segmentCount(); i++) {
+    if (spans[i].bytes == 0) continue;
+    if (oldest < 0 || spans[i].minSeq < spans[oldest].minSeq) oldest = i;
+  }
+  if (oldest < 0) return false;
+
+  uint32_t last = spans[oldest].maxSeq;
+  LOG_ERROR("Journal full - dropped %lu unsynced records", (unsigned long)(last - ackedSeq));
+  journalAck(last);
+  return true;
+}
+
+// Replay the old comma-separated log once so unsynced events are kept
+static void importLegacyAttendance() {
+  File legacy = SPIFFS.open(LEGACY_ATTENDANCE_FILE, "r");
+  if (!legacy) return;
+
+  int imported = 0;
+  while (legacy.available()) {
+    String line = legacy.readStringUntil('\n');
+    line.trim();
+
+    // timestamp,cardUID,userName,action,deviceId
+    int firstComma = line.indexOf(',');
+    int secondComma = line.indexOf(',', firstComma + 1);
+    int thirdComma = line.indexOf(',', secondComma + 1);
+    int fourthComma = line.indexOf(',', thirdComma + 1);
+    if (firstComma == -1 || secondComma == -1 || thirdComma == -1) continue;
+
+    uint8_t uid[CARD_UID_MAX_LEN];
+    uint8_t uidLen = 0;
+    if (!cardUidFromHex(line.substring(firstComma + 1, secondComma).c_str(), uid, &uidLen)) continue;
+
+    String action = line.substring(thirdComma + 1, fourthComma);
+    if (journalAppend(uid, uidLen, line.substring(secondComma + 1, thirdComma).c_str(),
+                      action == "EXIT" ? JOURNAL_ACTION_EXIT : JOURNAL_ACTION_ENTRY,
+                      0, (uint32_t)line.substring(0, firstComma).toInt(), NULL)) {
+      imported++;
+    }
+  }
+  legacy.close();
+
+  SPIFFS.remove(LEGACY_ATTENDANCE_FILE);
+  LOG_INFO("Imported %d records from " LEGACY_ATTENDANCE_FILE, imported);
+}
+
+bool journalBegin() {
+  memset(spans, 0, sizeof(spans));
+  nextSeq = 1;
+  ackedSeq = 0;
+  ackAddr = JOURNAL_NO_ADDR;
+
+  if (!journalFlash.begin(JOURNAL_PARTITION) || !store.begin(&journalFlash, &journalLog)) {
+    LOG_ERROR("No \"" JOURNAL_PARTITION "\" partition - flash with partitions.csv");
+    return false;
+  }
+  retireAcked();
+  if (nextSeq <= ackedSeq) nextSeq = ackedSeq + 1;
+  if (store.stats().tornRecords > 0) {
+    LOG_WARN("Journal record torn by a partial write - sealed its segment");
+  }
+
+  if (SPIFFS.exists(LEGACY_ATTENDANCE_FILE)) {
+    importLegacyAttendance();
+  }
+
+  LOG_INFO("Journal: %lu/%lu KB live, next seq %lu, %lu unsynced",
+           (unsigned long)(store.liveBytes() / 1024), (unsigned long)(store.capacityBytes() / 1024),
+           (unsigned long)nextSeq, (unsigned long)journalPending());
+  return true;
+}
+
+bool journalAppend(const uint8_t* uid, uint8_t uidLen, const char* name,
+                   uint8_t action, uint32_t bootId, uint32_t timestamp, JournalRecord* out) {
+  if (uidLen == 0 || uidLen > CARD_UID_MAX_LEN || !store.mounted()) return false;
+
+  JournalRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.seq = nextSeq;
+  rec.timestamp = timestamp;
+  rec.bootId = bootId;
+  memcpy(rec.uid, uid, uidLen);
+  rec.uidLen = uidLen;
+  rec.action = action;
+  strncpy(rec.name, name, sizeof(rec.name) - 1);
+
+  uint32_t addr;
+  for (;;) {
+    uint32_t full = store.stats().full;
+    if (store.append(JOURNAL_EVENT, &rec, sizeof(rec), &addr)) break;
+    if (store.stats().full == full || !dropOldestSegment()) {
+      LOG_ERROR("Failed to write journal record");
+      return false;
+    }
+  }
+
+  noteEvent(addr, rec.seq);
+  nextSeq++;
+  if (out != NULL) *out = rec;
+  return true;
+}
+
+// Read up to max records from fromSeq on, in sequence order. Segments are
+// visited lowest sequence number first and the walk stops once no later
+// segment can hold anything lower than what was found.
+size_t journalRead(uint32_t fromSeq, JournalRecord* out, size_t max) {
+  uint16_t order[LOG_STORE_MAX_SEGMENTS];
+  uint16_t segments = 0;
+  for (uint16_t i = 0; i < store.segmentCount(); i++) {
+    if (spans[i].bytes == 0 || spans[i].maxSeq < fromSeq) continue;
+    uint16_t at = segments++;
+    while (at > 0 && spans[order[at - 1]].minSeq > spans[i].minSeq) {
+      order[at] = order[at - 1];
+      at--;
+    }
+    order[at] = i;
+  }
+
+  size_t count = 0;
+  LogEntry entry;
+  for (uint16_t i = 0; i < segments && max > 0; i++) {
+    if (count == max && spans[order[i]].minSeq > out[count - 1].seq) break;
+    uint32_t offset = 0;
+    while (store.next(order[i], &offset, &entry)) {
+      if (entry.type != JOURNAL_EVENT || entry.len != sizeof(JournalRecord)) continue;
+      JournalRecord rec;
+      memcpy(&rec, entry.payload, sizeof(rec));
+      if (rec.seq < fromSeq) continue;
+
+      size_t at = count;
+      while (at > 0 && out[at - 1].seq > rec.seq) at--;
+      if ((at > 0 && out[at - 1].seq == rec.seq) || at == max) continue;
+      if (count < max) count++;
+      memmove(&out[at + 1], &out[at], (count - 1 - at) * sizeof(JournalRecord));
+      out[at] = rec;
+    }
+  }
+  return count;
+}
+
+// Move the cursor forward; segments it has fully passed are reclaimed by
+// compaction
+bool journalAck(uint32_t seq) {
+  if (seq >= nextSeq) seq = nextSeq - 1;
+  if (seq <= ackedSeq) return true;
+
+  ackedSeq = seq;
+  retireAcked();
+  saveAckedSeq();
+  return true;
+}
+
+uint32_t journalAckedSeq() {
+  return ackedSeq;
+}
+
+uint32_t journalNextSeq() {
+  return nextSeq;
+}
+
+uint32_t journalPending() {
+  return nextSeq - 1 - ackedSeq;
+}
+
+// One step of background compaction, from the network task between requests
+void journalCompact() {
+  store.compact();
+}
+
+const char* journalActionName(uint8_t action) {
+  return action == JOURNAL_ACTION_EXIT ? "EXIT" : "ENTRY";
+}
@@ -0,0 +1,49 @@
+/*
+ * Attendance Journal - sequenced write-ahead log of attendance events
+ *
+ * Every event gets a monotonic sequence number and is appended as one
+ * record to a log store on the "journal" flash partition. A cursor record
+ * holds the highest sequence number the server has acknowledged, so sync
+ * only sends what is still outstanding. Acknowledged events stay on flash
+ * until compaction reclaims their segment; when the partition fills with
+ * unacknowledged events the oldest segment's are dropped.
+ */
+
+#ifndef ATTENDANCE_JOURNAL_H
+#define ATTENDANCE_JOURNAL_H
+
+#include <Arduino.h>
+#include "card_index.h"
+
+#define JOURNAL_PARTITION     "journal"  // Data partition in partitions.csv
+#define LEGACY_ATTENDANCE_FILE "/attendance.txt"
+
+#define JOURNAL_ACTION_ENTRY  0
+#define JOURNAL_ACTION_EXIT   1
+
+// One fixed-width journal record (64 bytes). (device, bootId, seq) is the
+// event's key on the server; WallClock turns bootId and timestamp into
+// wall-clock time at upload.
+struct JournalRecord {
+  uint32_t seq;
+  uint32_t timestamp;  // millis() at the time of the event
+  uint8_t uid[CARD_UID_MAX_LEN];
+  uint8_t uidLen;
+  uint8_t action;
+  uint32_t bootId;     // WallClock boot id; 0 in records from before boot ids
+  char name[40];
+};
+
+// Function declarations
+bool journalBegin();
+bool journalAppend(const uint8_t* uid, uint8_t uidLen, const char* name,
+                   uint8_t action, uint32_t bootId, uint32_t timestamp, JournalRecord* out);
+size_t journalRead(uint32_t fromSeq, JournalRecord* out, size_t max);
+bool journalAck(uint32_t seq);
+uint32_t journalAckedSeq();
+uint32_t journalNextSeq();
+uint32_t journalPending();
+void journalCompact();
+const char* journalActionName(uint8_t action);
+
+#endif // ATTENDANCE_JOURNAL_H
@@ -0,0 +1,128 @@
+/*
+ * Card Cache - in-RAM open-addressing hash table of known cards
+ */
+
+#include "card_cache.h"
+#include <string.h>
+
+// FNV-1a over the UID bytes
+static uint32_t hashUid(const uint8_t* uid, uint8_t uidLen) {
+  uint32_t h = 2166136261u;
+  for (uint8_t i = 0; i < uidLen; i++) {
+    h ^= uid[i];
+    h *= 16777619u;
+  }
+  return h ^ uidLen;
+}
+
+// Returns true if src didn't fit
+static bool copyShort(char* dst, size_t dstSize, const char* src) {
+  size_t len = strnlen(src, dstSize);
+  bool cut = len == dstSize;
+  if (cut) len--;
+  memcpy(dst, src, len);
+  memset(dst + len, 0, dstSize - len);
+  return cut;
+}
+
+CardCache::CardCache()
+  : entries_(NULL), capacity_(0), count_(0), used_(0), complete_(false) {}
+
+bool CardCache::begin(void* storage, size_t bytes) {
+  size_t slots = bytes / sizeof(CardCacheEntry);
+  if (storage == NULL || slots < 2) return false;
+
+  capacity_ = 1;
+  while (capacity_ * 2 <= slots) capacity_ *= 2;
+  entries_ = (CardCacheEntry*)storage;
+  clear();
+  return true;
+}
+
+void CardCache::clear() {
+  if (entries_ != NULL) memset(entries_, 0, memoryBytes());
+  count_ = 0;
+  used_ = 0;
+  complete_ = false;
+}
+
+// Returns the slot holding uid (found = true) or the slot it should be
+// inserted into (found = false). Returns capacity_ if there is no room.
+size_t CardCache::probe(const uint8_t* uid, uint8_t uidLen, bool* found) const {
+  *found = false;
+  if (capacity_ == 0) return 0;
+
+  size_t mask = capacity_ - 1;
+  size_t slot = hashUid(uid, uidLen) & mask;
+  size_t firstFree = capacity_;
+
+  for (size_t i = 0; i < capacity_; i++, slot = (slot + 1) & mask) {
+    const CardCacheEntry& e = entries_[slot];
+    if (e.uidLen == 0) {
+      return firstFree != capacity_ ? firstFree : slot;
+    }
+    if (e.uidLen == CARD_CACHE_TOMBSTONE) {
+      if (firstFree == capacity_) firstFree = slot;
+      continue;
+    }
+    if (e.uidLen == uidLen && memcmp(e.uid, uid, uidLen) == 0) {
+      *found = true;
+      return slot;
+    }
+  }
+  return firstFree;
+}
+
+bool CardCache::get(const uint8_t* uid, uint8_t uidLen, CardRecord* out) const {
+  bool found;
+  size_t slot = probe(uid, uidLen, &found);
+  if (!found) return false;
+
+  if (out != NULL) {
+    const CardCacheEntry& e = entries_[slot];
+    cardRecordSet(out, e.uid, e.uidLen, e.name, e.userId, e.role & ~CARD_CACHE_SHORTENED);
+    out->fingerSlot = e.fingerSlot;
+    if (e.role & CARD_CACHE_SHORTENED) out->flags = CARD_FLAG_SHORTENED;
+  }
+  return true;
+}
+
+bool CardCache::put(const CardRecord& rec) {
+  if (rec.uidLen == 0 || rec.uidLen > CARD_UID_MAX_LEN) return false;
+
+  bool found;
+  size_t slot = probe(rec.uid, rec.uidLen, &found);
+  if (slot == capacity_) return false;
+
+  CardCacheEntry& e = entries_[slot];
+  if (!found) {
+    bool reusesTombstone = e.uidLen == CARD_CACHE_TOMBSTONE;
+    // Keep the load factor at or below 3/4 so probes stay short
+    if (!reusesTombstone && (used_ + 1) * 4 > capacity_ * 3) return false;
+    if (!reusesTombstone) used_++;
+    count_++;
+  }
+
+  memset(e.uid, 0, sizeof(e.uid));
+  memcpy(e.uid, rec.uid, rec.uidLen);
+  e.uidLen = rec.uidLen;
+  e.role = rec.role;
+  e.fingerSlot = rec.fingerSlot;
+  // Long names and IDs are cut and the entry marked, so get() can tell
+  // the caller the full values are only on flash
+  bool cut = copyShort(e.name, sizeof(e.name), rec.name);
+  cut |= copyShort(e.userId, sizeof(e.userId), rec.userId);
+  if (cut) e.role |= CARD_CACHE_SHORTENED;
+  return true;
+}
+
+bool CardCache::remove(const uint8_t* uid, uint8_t uidLen) {
+  bool found;
+  size_t slot = probe(uid, uidLen, &found);
+  if (!found) return false;
+
+  memset(&entries_[slot], 0, sizeof(CardCacheEntry));
+  entries_[slot].uidLen = CARD_CACHE_TOMBSTONE;
+  count_--;
+  return true;
+}
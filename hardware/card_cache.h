@@ -0,0 +1,66 @@
+/*
+ * Card Cache - in-RAM open-addressing hash table of known cards
+ *
+ * Keyed by the raw UID bytes with role and a short name/ID stored inline,
+ * so a cache hit never touches the filesystem. Longer names and IDs are
+ * cut; a hit returns them with CARD_FLAG_SHORTENED set and the full values
+ * have to be read from flash. The table lives in a single
+ * caller-provided block (heap or PSRAM) and uses linear probing with
+ * tombstones so cards can be removed in place.
+ */
+
+#ifndef CARD_CACHE_H
+#define CARD_CACHE_H
+
+#include "card_index.h"
+
+#define CARD_CACHE_NAME_LEN  22
+#define CARD_CACHE_ID_LEN    12
+
+// 48 bytes per slot
+struct CardCacheEntry {
+  uint8_t uid[CARD_UID_MAX_LEN];
+  uint8_t uidLen;  // 0 = empty slot, CARD_CACHE_TOMBSTONE = removed
+  uint8_t role;
+  uint16_t fingerSlot;
+  char name[CARD_CACHE_NAME_LEN];
+  char userId[CARD_CACHE_ID_LEN];
+};
+
+#define CARD_CACHE_TOMBSTONE 0xFF
+#define CARD_CACHE_SHORTENED 0x80  // In role: name or user ID was cut
+
+class CardCache {
+public:
+  CardCache();
+
+  // Capacity is the largest power of two that fits in bytes
+  bool begin(void* storage, size_t bytes);
+  void clear();
+
+  bool get(const uint8_t* uid, uint8_t uidLen, CardRecord* out) const;
+  bool put(const CardRecord& rec);
+  bool remove(const uint8_t* uid, uint8_t uidLen);
+
+  size_t count() const { return count_; }
+  size_t capacity() const { return capacity_; }
+  size_t memoryBytes() const { return capacity_ * sizeof(CardCacheEntry); }
+
+  // True while every card in persistent storage is resident, so a miss is
+  // authoritative and the caller can skip the index on disk.
+  bool complete() const { return complete_; }
+  void setComplete(bool complete) { complete_ = complete; }
+
+  static size_t entrySize() { return sizeof(CardCacheEntry); }
+
+private:
+  size_t probe(const uint8_t* uid, uint8_t uidLen, bool* found) const;
+
+  CardCacheEntry* entries_;
+  size_t capacity_;
+  size_t count_;
+  size_t used_;  // Live entries plus tombstones
+  bool complete_;
+};
+
+#endif // CARD_CACHE_H
@@ -0,0 +1,82 @@
+/*
+ * Card Detect - polling or IRQ-driven card detection for the MFRC522
+ */
+
+#include "card_detect.h"
+#include <string.h>
+
+static bool reached(uint32_t now, uint32_t at) {
+  return (int32_t)(now - at) >= 0;
+}
+
+CardDetector::CardDetector()
+    : radio_(NULL), mode_(CARD_DETECT_POLL), nextArmAt_(0), nextSafetyPollAt_(0) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+void CardDetector::begin(CardDetectRadio* radio, uint8_t mode, uint32_t now) {
+  radio_ = radio;
+  mode_ = mode;
+  memset(&stats_, 0, sizeof(stats_));
+  nextSafetyPollAt_ = now + CARD_IRQ_SAFETY_POLL_MS;
+  if (mode_ != CARD_DETECT_POLL) arm(now);
+}
+
+const char* CardDetector::modeName(uint8_t mode) {
+  switch (mode) {
+    case CARD_DETECT_IRQ:
+      return "irq";
+    case CARD_DETECT_STATUS:
+      return "status";
+    default:
+      return "poll";
+  }
+}
+
+bool CardDetector::poll() {
+  stats_.polls++;
+  return radio_->isNewCardPresent() && radio_->readCardSerial();
+}
+
+void CardDetector::arm(uint32_t now) {
+  radio_->armIrq();
+  stats_.arms++;
+  nextArmAt_ = now + CARD_IRQ_REARM_MS;
+}
+
+bool CardDetector::check(uint32_t now, bool irqFired) {
+  if (mode_ == CARD_DETECT_POLL) {
+    if (!poll()) return false;
+    stats_.detected++;
+    return true;
+  }
+
+  if (mode_ == CARD_DETECT_STATUS) irqFired = radio_->irqPending();
+  if (irqFired) {
+    stats_.irqs++;
+    radio_->clearIrq();
+    // The card answered our REQA and is waiting to be selected
+    if (radio_->readCardSerial()) {
+      stats_.detected++;
+      nextArmAt_ = now;  // Re-arm on the next pass, after the card is halted
+      return true;
+    }
+    stats_.spuriousIrqs++;
+    arm(now);
+    return false;
+  }
+
+  if (mode_ == CARD_DETECT_IRQ && reached(now, nextSafetyPollAt_)) {
+    nextSafetyPollAt_ = now + CARD_IRQ_SAFETY_POLL_MS;
+    if (poll()) {
+      stats_.detected++;
+      nextArmAt_ = now;
+      return true;
+    }
+    arm(now);  // The poll replaced the pending REQA
+    return false;
+  }
+
+  if (reached(now, nextArmAt_)) arm(now);
+  return false;
+}
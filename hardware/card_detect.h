@@ -0,0 +1,80 @@
+/*
+ * Card Detect - polling or IRQ-driven card detection for the MFRC522
+ *
+ * Polling runs a full REQA round trip on every check; with no card in the
+ * field each one waits out the reader's 25 ms receive timeout. IRQ mode
+ * enables RxIRq in ComIEnReg and only queues a REQA (three register
+ * writes) every CARD_IRQ_REARM_MS. A card answering it pulls the IRQ line
+ * and the RFID task wakes straight away to select it. A full poll still
+ * runs every CARD_IRQ_SAFETY_POLL_MS in case an edge is missed.
+ *
+ * Status mode queues the same REQAs but reads RxIRq back from ComIrqReg
+ * on every check instead of trusting an edge, so it needs no line of its
+ * own: readers sharing one open-drain IRQ line (or none) are told apart
+ * by their status register, and no edge can be missed, so there is no
+ * safety poll either.
+ */
+
+#ifndef CARD_DETECT_H
+#define CARD_DETECT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CARD_DETECT_POLL    0
+#define CARD_DETECT_IRQ     1
+#define CARD_DETECT_STATUS  2
+
+#ifndef CARD_IRQ_REARM_MS
+#define CARD_IRQ_REARM_MS        20    // REQA re-sent this often while idle
+#endif
+#ifndef CARD_IRQ_SAFETY_POLL_MS
+#define CARD_IRQ_SAFETY_POLL_MS  1000  // Full poll in IRQ mode, for missed edges
+#endif
+
+// The reader as seen by the detector
+class CardDetectRadio {
+public:
+  virtual ~CardDetectRadio() {}
+  virtual bool isNewCardPresent() = 0;  // Blocking REQA round trip
+  virtual bool readCardSerial() = 0;    // Anticollision and select
+  virtual void armIrq() = 0;            // Clear ComIrqReg, enable RxIRq, send one REQA
+  virtual void clearIrq() = 0;
+  virtual bool irqPending() = 0;        // RxIRq set in ComIrqReg
+};
+
+struct CardDetectStats {
+  uint32_t polls;        // Blocking REQA round trips
+  uint32_t arms;         // Non-blocking REQAs queued in IRQ and status mode
+  uint32_t irqs;
+  uint32_t spuriousIrqs; // IRQ without a card that could be selected
+  uint32_t detected;
+};
+
+class CardDetector {
+public:
+  CardDetector();
+
+  void begin(CardDetectRadio* radio, uint8_t mode, uint32_t now);
+
+  // Call on every pass of the RFID task with whether the IRQ line fired
+  // since the last call; status mode reads the radio instead. Returns true
+  // once a card has been selected and its UID can be read from the radio.
+  bool check(uint32_t now, bool irqFired);
+
+  uint8_t mode() const { return mode_; }
+  const CardDetectStats& stats() const { return stats_; }
+  static const char* modeName(uint8_t mode);
+
+private:
+  bool poll();
+  void arm(uint32_t now);
+
+  CardDetectRadio* radio_;
+  uint8_t mode_;
+  uint32_t nextArmAt_;
+  uint32_t nextSafetyPollAt_;
+  CardDetectStats stats_;
+};
+
+#endif // CARD_DETECT_H
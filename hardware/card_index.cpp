@@ -0,0 +1,243 @@
+/*
+ * Card Index - sorted, fixed-width binary card store
+ */
+
+#include "card_index.h"
+#include <string.h>
+#include <stdlib.h>
+
+struct CardIndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t epoch;  // Card log epoch folded up to
+  uint8_t reserved[4];
+};
+
+static void copyField(char* dst, size_t dstSize, const char* src) {
+  if (src == NULL) src = "";
+  size_t len = strlen(src);
+  if (len >= dstSize) len = dstSize - 1;
+  memcpy(dst, src, len);
+  memset(dst + len, 0, dstSize - len);
+}
+
+bool cardRecordSet(CardRecord* rec, const uint8_t* uid, uint8_t uidLen,
+                   const char* name, const char* userId, uint8_t role) {
+  if (uidLen == 0 || uidLen > CARD_UID_MAX_LEN) return false;
+
+  memset(rec, 0, sizeof(CardRecord));
+  memcpy(rec->uid, uid, uidLen);
+  rec->uidLen = uidLen;
+  rec->role = role;
+  copyField(rec->name, sizeof(rec->name), name);
+  copyField(rec->userId, sizeof(rec->userId), userId);
+  return true;
+}
+
+// Order by zero-padded UID bytes, then by length. For upper-case hex strings
+// this matches plain string ordering, so a server can pre-sort by rfid_uid.
+int cardRecordCompare(const uint8_t* uid, uint8_t uidLen, const CardRecord& rec) {
+  uint8_t key[CARD_UID_MAX_LEN];
+  memset(key, 0, sizeof(key));
+  memcpy(key, uid, uidLen > CARD_UID_MAX_LEN ? CARD_UID_MAX_LEN : uidLen);
+
+  int cmp = memcmp(key, rec.uid, CARD_UID_MAX_LEN);
+  if (cmp != 0) return cmp;
+  return (int)uidLen - (int)rec.uidLen;
+}
+
+int cardRecordOrder(const CardRecord& a, const CardRecord& b) {
+  return cardRecordCompare(a.uid, a.uidLen, b);
+}
+
+static int sortCompare(const void* a, const void* b) {
+  return cardRecordOrder(*(const CardRecord*)a, *(const CardRecord*)b);
+}
+
+void cardRecordSort(CardRecord* records, size_t count) {
+  qsort(records, count, sizeof(CardRecord), sortCompare);
+}
+
+static int hexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+bool cardUidFromHex(const char* hex, uint8_t* uid, uint8_t* uidLen) {
+  size_t len = strlen(hex);
+  if (len == 0 || (len % 2) != 0 || len / 2 > CARD_UID_MAX_LEN) return false;
+
+  for (size_t i = 0; i < len / 2; i++) {
+    int hi = hexNibble(hex[2 * i]);
+    int lo = hexNibble(hex[2 * i + 1]);
+    if (hi < 0 || lo < 0) return false;
+    uid[i] = (uint8_t)((hi << 4) | lo);
+  }
+  *uidLen = (uint8_t)(len / 2);
+  return true;
+}
+
+void cardUidToHex(const uint8_t* uid, uint8_t uidLen, char* out, size_t outSize) {
+  static const char digits[] = "0123456789ABCDEF";
+  size_t pos = 0;
+  for (uint8_t i = 0; i < uidLen && pos + 2 < outSize; i++) {
+    out[pos++] = digits[uid[i] >> 4];
+    out[pos++] = digits[uid[i] & 0x0F];
+  }
+  if (outSize > 0) out[pos] = '\0';
+}
+
+uint8_t cardRoleFromString(const char* role) {
+  if (role == NULL) return CARD_ROLE_UNKNOWN;
+  if (strcmp(role, "student") == 0) return CARD_ROLE_STUDENT;
+  if (strcmp(role, "teacher") == 0) return CARD_ROLE_TEACHER;
+  return CARD_ROLE_UNKNOWN;
+}
+
+const char* cardRoleName(uint8_t role) {
+  switch (role) {
+    case CARD_ROLE_STUDENT: return "student";
+    case CARD_ROLE_TEACHER: return "teacher";
+    default:                return "unknown";
+  }
+}
+
+static bool readHeader(CardIndexSource& src, CardIndexHeader* out = NULL) {
+  CardIndexHeader local;
+  CardIndexHeader& header = out != NULL ? *out : local;
+  if (src.size() < CARD_INDEX_HEADER_SIZE) return false;
+  if (!src.readAt(0, &header, sizeof(header))) return false;
+  return header.magic == CARD_INDEX_MAGIC &&
+         header.version == CARD_INDEX_VERSION &&
+         header.recordSize == CARD_RECORD_SIZE;
+}
+
+// False for files written with another record format
+bool cardIndexValid(CardIndexSource& src) {
+  return readHeader(src);
+}
+
+uint32_t cardIndexEpoch(CardIndexSource& src) {
+  CardIndexHeader header;
+  return readHeader(src, &header) ? header.epoch : 0;
+}
+
+size_t cardIndexCount(CardIndexSource& src) {
+  if (!readHeader(src)) return 0;
+  return (src.size() - CARD_INDEX_HEADER_SIZE) / CARD_RECORD_SIZE;
+}
+
+bool cardIndexRecordAt(CardIndexSource& src, size_t i, CardRecord* out) {
+  return src.readAt(CARD_INDEX_HEADER_SIZE + i * CARD_RECORD_SIZE, out, sizeof(CardRecord));
+}
+
+bool cardIndexFind(CardIndexSource& src, const uint8_t* uid, uint8_t uidLen, CardRecord* out) {
+  size_t count = cardIndexCount(src);
+  size_t lo = 0;
+  size_t hi = count;
+  CardRecord rec;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (!cardIndexRecordAt(src, mid, &rec)) return false;
+
+    int cmp = cardRecordCompare(uid, uidLen, rec);
+    if (cmp == 0) {
+      if (out != NULL) *out = rec;
+      return true;
+    }
+    if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return false;
+}
+
+bool cardIndexWriteHeader(CardIndexSink& dst, uint32_t epoch) {
+  CardIndexHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = CARD_INDEX_MAGIC;
+  header.version = CARD_INDEX_VERSION;
+  header.recordSize = CARD_RECORD_SIZE;
+  header.epoch = epoch;
+  return dst.write(&header, sizeof(header));
+}
+
+bool cardIndexWrite(CardIndexSink& dst, const CardRecord* sorted, size_t count, uint32_t epoch) {
+  if (!cardIndexWriteHeader(dst, epoch)) return false;
+  for (size_t i = 0; i < count; i++) {
+    if (!dst.write(&sorted[i], sizeof(CardRecord))) return false;
+  }
+  return true;
+}
+
+// Single-change source used by cardIndexUpsert()
+class SingleChange : public CardChangeSource {
+public:
+  explicit SingleChange(const CardRecord& rec) : rec_(rec), done_(false) {}
+  bool next(CardRecord* rec, bool* revoke) override {
+    if (done_) return false;
+    *rec = rec_;
+    *revoke = false;
+    done_ = true;
+    return true;
+  }
+private:
+  const CardRecord& rec_;
+  bool done_;
+};
+
+// Stream src into dst with rec inserted at its sorted position, replacing
+// any record with the same UID. A missing or invalid src counts as empty;
+// src's epoch is kept.
+bool cardIndexUpsert(CardIndexSource& src, CardIndexSink& dst, const CardRecord& rec) {
+  SingleChange change(rec);
+  return cardIndexMerge(src, dst, change, cardIndexEpoch(src));
+}
+
+// Merge two sorted streams into dst in one pass: the existing index and an
+// ordered change list. Upserts replace or insert, revokes drop the record.
+// Fails without a usable dst if the changes are out of order. dst's header
+// gets epoch.
+bool cardIndexMerge(CardIndexSource& src, CardIndexSink& dst, CardChangeSource& changes,
+                    uint32_t epoch) {
+  if (!cardIndexWriteHeader(dst, epoch)) return false;
+
+  size_t count = cardIndexCount(src);
+  size_t i = 0;
+  CardRecord current;
+  CardRecord change;
+  CardRecord previous;
+  bool revoke = false;
+  bool haveCurrent = count > 0 && cardIndexRecordAt(src, 0, &current);
+  bool haveChange = changes.next(&change, &revoke);
+  bool havePrevious = false;
+
+  if (count > 0 && !haveCurrent) return false;
+
+  while (haveCurrent || haveChange) {
+    int cmp = !haveChange ? 1 : (!haveCurrent ? -1 : cardRecordOrder(change, current));
+
+    if (cmp <= 0) {
+      if (havePrevious && cardRecordOrder(previous, change) >= 0) return false;
+      if (!revoke && !dst.write(&change, sizeof(change))) return false;
+      previous = change;
+      havePrevious = true;
+      haveChange = changes.next(&change, &revoke);
+      if (cmp < 0) continue;  // Existing record (if any) not consumed yet
+    } else if (!dst.write(&current, sizeof(current))) {
+      return false;
+    }
+
+    // Advance the existing index, skipping a record that was just replaced
+    i++;
+    haveCurrent = i < count;
+    if (haveCurrent && !cardIndexRecordAt(src, i, &current)) return false;
+  }
+  return changes.ok();
+}
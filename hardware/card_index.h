@@ -0,0 +1,107 @@
+/*
+ * Card Index - sorted, fixed-width binary card store
+ *
+ * Replaces the line-oriented /cards.txt cache. Every record has the same
+ * size and is keyed by the raw UID bytes, and records are kept sorted so a
+ * lookup is a binary search: log2(N) record reads instead of a full scan.
+ * One lookup returns name, user ID and role together.
+ *
+ * File layout:
+ *   [header: 16 bytes][record 0][record 1]...[record N-1]
+ * The record count is derived from the file size, so a file never needs
+ * its header patched after records are appended. The header also carries
+ * the card log epoch the index was folded up to (see card_store.cpp).
+ *
+ * This module has no Arduino dependencies; storage is reached through the
+ * CardIndexSource / CardIndexSink interfaces so it can be tested on a host.
+ */
+
+#ifndef CARD_INDEX_H
+#define CARD_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CARD_INDEX_MAGIC        0x58444943UL  // "CIDX" little-endian
+#define CARD_INDEX_VERSION      2  // 2: fingerSlot
+#define CARD_INDEX_HEADER_SIZE  16
+
+#define CARD_UID_MAX_LEN        10  // MFRC522 supports 4, 7 and 10 byte UIDs
+#define CARD_NAME_LEN           40
+#define CARD_USER_ID_LEN        40  // Fits a UUID plus terminator
+
+#define CARD_FINGER_NONE        0   // No fingerprint template for the card
+
+// Roles as stored in the index
+#define CARD_ROLE_UNKNOWN       0
+#define CARD_ROLE_STUDENT       1
+#define CARD_ROLE_TEACHER       2
+
+// Record flags, set in RAM only and always zero on flash
+#define CARD_FLAG_SHORTENED     0x01  // Name or user ID cut to fit the card cache
+
+// One fixed-width record (96 bytes). Strings are NUL terminated.
+struct CardRecord {
+  uint8_t uid[CARD_UID_MAX_LEN];  // Zero padded after uidLen
+  uint8_t uidLen;
+  uint8_t role;
+  uint16_t fingerSlot;  // Sensor template slot of the owner's finger
+  uint8_t flags;  // CARD_FLAG_*
+  uint8_t reserved;
+  char name[CARD_NAME_LEN];
+  char userId[CARD_USER_ID_LEN];
+};
+
+#define CARD_RECORD_SIZE ((uint16_t)sizeof(CardRecord))
+
+// Random-access read side of an index file
+class CardIndexSource {
+public:
+  virtual ~CardIndexSource() {}
+  virtual size_t size() = 0;
+  virtual bool readAt(size_t offset, void* buf, size_t len) = 0;
+};
+
+// Sequential write side of an index file
+class CardIndexSink {
+public:
+  virtual ~CardIndexSink() {}
+  virtual bool write(const void* buf, size_t len) = 0;
+};
+
+// Ordered stream of card changes consumed by cardIndexMerge(). Changes must
+// arrive in strictly ascending UID order; revoke = true removes the card.
+// ok() reports whether the stream ended cleanly rather than being cut off.
+class CardChangeSource {
+public:
+  virtual ~CardChangeSource() {}
+  virtual bool next(CardRecord* rec, bool* revoke) = 0;
+  virtual bool ok() { return true; }
+};
+
+// Record helpers
+bool cardRecordSet(CardRecord* rec, const uint8_t* uid, uint8_t uidLen,
+                   const char* name, const char* userId, uint8_t role);
+int cardRecordCompare(const uint8_t* uid, uint8_t uidLen, const CardRecord& rec);
+int cardRecordOrder(const CardRecord& a, const CardRecord& b);
+void cardRecordSort(CardRecord* records, size_t count);
+
+// UID and role conversions
+bool cardUidFromHex(const char* hex, uint8_t* uid, uint8_t* uidLen);
+void cardUidToHex(const uint8_t* uid, uint8_t uidLen, char* out, size_t outSize);
+uint8_t cardRoleFromString(const char* role);
+const char* cardRoleName(uint8_t role);
+
+// Index file operations
+bool cardIndexValid(CardIndexSource& src);
+uint32_t cardIndexEpoch(CardIndexSource& src);  // 0 for a missing or invalid index
+size_t cardIndexCount(CardIndexSource& src);
+bool cardIndexRecordAt(CardIndexSource& src, size_t i, CardRecord* out);
+bool cardIndexFind(CardIndexSource& src, const uint8_t* uid, uint8_t uidLen, CardRecord* out);
+bool cardIndexWriteHeader(CardIndexSink& dst, uint32_t epoch = 0);
+bool cardIndexWrite(CardIndexSink& dst, const CardRecord* sorted, size_t count, uint32_t epoch = 0);
+bool cardIndexUpsert(CardIndexSource& src, CardIndexSink& dst, const CardRecord& rec);
+bool cardIndexMerge(CardIndexSource& src, CardIndexSink& dst, CardChangeSource& changes,
+                    uint32_t epoch = 0);
+
+#endif // CARD_INDEX_H
@@ -0,0 +1,719 @@
+/*
+ * Card Store - SPIFFS-backed card index for the access controller
+ *
+ * Lookups run on the RFID task while saves and allowlist merges run on the
+ * network task. Writers build the new index in a temp file without the
+ * lock; storeLock only covers the swap and the cache update, so a long
+ * sync never stalls a tap. A cache rebuilt from scratch is filled one card
+ * per lock, with lookups falling back to the index until it is done.
+ *
+ * A learned card is one CARD_LOG_PUT record in the card log, found through
+ * a small table in RAM. Folding the log into the index starts a new epoch:
+ * the new index carries it in its header, so the swap itself retires every
+ * earlier put, and boot skips them even if nothing else was written. The
+ * CARD_LOG_EPOCH record appended after the swap only lets compaction and
+ * replay catch up sooner. Until the swap the old index and the puts stay
+ * as they were, so a failure or a crash loses nothing.
+ */
+
+#include "card_store.h"
+#include "task_sync.h"
+#include "log_ring.h"
+#include "log_store.h"
+#include "partition_flash.h"
+#include <SPIFFS.h>
+
+#define CARD_LOG_PUT      1  // CardLogPut: a card the server taught us
+#define CARD_LOG_EPOCH    2  // uint32_t: the index holds every put from earlier epochs
+#define CARD_LOG_NO_ADDR  0xFFFFFFFF
+
+struct CardLogPut {
+  uint32_t epoch;
+  CardRecord rec;
+};
+
+// Where a learned card's newest record is
+struct LearnedCard {
+  uint8_t uid[CARD_UID_MAX_LEN];
+  uint8_t uidLen;
+  uint32_t addr;
+};
+
+class CardLog : public LogStoreClient {
+public:
+  void replay(const LogEntry& entry) override;
+  bool live(const LogEntry& entry) override;
+  void moved(const LogEntry& entry, uint32_t to) override;
+};
+
+static CardCache cardCache;
+static TaskMutex storeLock;
+static File lookupFile;  // Index kept open for misses; opening a file allocates
+static CardStoreStats stats;
+
+static PartitionFlash cardLogFlash;
+static CardLog cardLogClient;
+static LogStore cardLog;
+// Written by the network task under storeLock; lookups read them under it
+static LearnedCard learned[CARD_LOG_MAX];
+static size_t learnedCount = 0;
+static uint32_t logEpoch = 0;
+static uint32_t epochAddr = CARD_LOG_NO_ADDR;
+
+static int findLearned(const uint8_t* uid, uint8_t uidLen) {
+  for (size_t i = 0; i < learnedCount; i++) {
+    if (learned[i].uidLen == uidLen && memcmp(learned[i].uid, uid, uidLen) == 0) return (int)i;
+  }
+  return -1;
+}
+
+static void setLearned(const uint8_t* uid, uint8_t uidLen, uint32_t addr) {
+  int i = findLearned(uid, uidLen);
+  if (i >= 0) {
+    cardLog.retire(learned[i].addr, LogStore::recordBytes(sizeof(CardLogPut)));
+  } else if (learnedCount < CARD_LOG_MAX && uidLen <= CARD_UID_MAX_LEN) {
+    i = (int)learnedCount++;
+    memcpy(learned[i].uid, uid, uidLen);
+    learned[i].uidLen = uidLen;
+  } else {
+    cardLog.retire(addr, LogStore::recordBytes(sizeof(CardLogPut)));
+    return;
+  }
+  learned[i].addr = addr;
+}
+
+// The index holds every learned card from before epoch
+static void dropLearned(uint32_t epoch) {
+  for (size_t i = 0; i < learnedCount; i++) {
+    cardLog.retire(learned[i].addr, LogStore::recordBytes(sizeof(CardLogPut)));
+  }
+  learnedCount = 0;
+  logEpoch = epoch;
+}
+
+static bool readLearned(size_t i, CardRecord* out) {
+  LogEntry entry;
+  CardLogPut put;
+  if (!cardLog.read(learned[i].addr, &entry) || entry.type != CARD_LOG_PUT || entry.len != sizeof(put)) {
+    return false;
+  }
+  memcpy(&put, entry.payload, sizeof(put));
+  *out = put.rec;
+  return true;
+}
+
+void CardLog::replay(const LogEntry& entry) {
+  uint32_t epoch = 0;
+  if (entry.len >= sizeof(epoch)) memcpy(&epoch, entry.payload, sizeof(epoch));
+  bool put = entry.type == CARD_LOG_PUT && entry.len == sizeof(CardLogPut);
+  bool mark = entry.type == CARD_LOG_EPOCH && entry.len == sizeof(epoch);
+  if ((!put && !mark) || epoch < logEpoch) {
+    cardLog.retire(entry.addr, LogStore::recordBytes(entry.len));
+    return;
+  }
+
+  // Compaction may have copied the epoch mark after puts made under it
+  if (epoch > logEpoch) dropLearned(epoch);
+  if (mark) {
+    if (epochAddr != CARD_LOG_NO_ADDR) cardLog.retire(epochAddr, LogStore::recordBytes(sizeof(epoch)));
+    epochAddr = entry.addr;
+    return;
+  }
+  CardLogPut rec;
+  memcpy(&rec, entry.payload, sizeof(rec));
+  setLearned(rec.rec.uid, rec.rec.uidLen, entry.addr);
+}
+
+bool CardLog::live(const LogEntry& entry) {
+  if (entry.type == CARD_LOG_EPOCH) return entry.addr == epochAddr;
+  if (entry.type != CARD_LOG_PUT || entry.len != sizeof(CardLogPut)) return false;
+  CardLogPut put;
+  memcpy(&put, entry.payload, sizeof(put));
+  int i = findLearned(put.rec.uid, put.rec.uidLen);
+  return put.epoch == logEpoch && i >= 0 && learned[i].addr == entry.addr;
+}
+
+void CardLog::moved(const LogEntry& entry, uint32_t to) {
+  if (entry.type == CARD_LOG_EPOCH) {
+    epochAddr = to;
+    return;
+  }
+  CardLogPut put;
+  memcpy(&put, entry.payload, sizeof(put));
+  TaskLock lock(storeLock);
+  int i = findLearned(put.rec.uid, put.rec.uidLen);
+  if (i >= 0) learned[i].addr = to;
+}
+
+// Adapters from SPIFFS files to the card index interfaces
+class SpiffsIndexSource : public CardIndexSource {
+public:
+  explicit SpiffsIndexSource(File& file) : file_(file) {}
+  size_t size() override { return file_ ? file_.size() : 0; }
+  bool readAt(size_t offset, void* buf, size_t len) override {
+    return file_.seek(offset) && file_.read((uint8_t*)buf, len) == len;
+  }
+private:
+  File& file_;
+};
+
+class SpiffsIndexSink : public CardIndexSink {
+public:
+  explicit SpiffsIndexSink(File& file) : file_(file) {}
+  bool write(const void* buf, size_t len) override {
+    return file_.write((const uint8_t*)buf, len) == len;
+  }
+private:
+  File& file_;
+};
+
+// Empty index used as the base of a full snapshot
+class EmptyIndexSource : public CardIndexSource {
+public:
+  size_t size() override { return 0; }
+  bool readAt(size_t, void*, size_t) override { return false; }
+};
+
+// Nothing from the server: folds the learned cards on their own
+class NoChanges : public CardChangeSource {
+public:
+  bool next(CardRecord*, bool*) override { return false; }
+};
+
+// The server's changes with the learned cards merged in, in UID order.
+// On the same UID the server's record or revocation wins.
+class LearnedChanges : public CardChangeSource {
+public:
+  LearnedChanges(CardChangeSource& server, const CardRecord* sorted, size_t count)
+      : server_(server), learned_(sorted), count_(count), next_(0), pending_(false), done_(false),
+        pendingRevoke_(false) {}
+
+  bool next(CardRecord* rec, bool* revoke) override {
+    if (!pending_ && !done_) {
+      pending_ = server_.next(&pendingRec_, &pendingRevoke_);
+      done_ = !pending_;
+    }
+    if (next_ < count_ && (!pending_ || cardRecordOrder(learned_[next_], pendingRec_) < 0)) {
+      *rec = learned_[next_++];
+      *revoke = false;
+      return true;
+    }
+    if (!pending_) return false;
+    if (next_ < count_ && cardRecordOrder(learned_[next_], pendingRec_) == 0) next_++;
+    *rec = pendingRec_;
+    *revoke = pendingRevoke_;
+    pending_ = false;
+    return true;
+  }
+  bool ok() override { return server_.ok(); }
+
+private:
+  CardChangeSource& server_;
+  const CardRecord* learned_;
+  size_t count_;
+  size_t next_;
+  bool pending_;
+  bool done_;
+  CardRecord pendingRec_;
+  bool pendingRevoke_;
+};
+
+// Passes changes through to the merge and remembers the first few so the
+// cache can be patched in place once the new index is committed
+class RecordingChanges : public CardChangeSource {
+public:
+  explicit RecordingChanges(CardChangeSource& inner) : inner_(inner), count_(0), overflow_(false) {}
+
+  bool next(CardRecord* rec, bool* revoke) override {
+    if (!inner_.next(rec, revoke)) return false;
+    if (count_ < CARD_CACHE_INPLACE_MAX) {
+      records_[count_] = *rec;
+      revokes_[count_] = *revoke;
+      count_++;
+    } else {
+      overflow_ = true;
+    }
+    return true;
+  }
+  bool ok() override { return inner_.ok(); }
+
+  // Returns false if there were too many changes to replay
+  bool replay(CardCache& cache) {
+    if (overflow_) return false;
+    for (size_t i = 0; i < count_; i++) {
+      if (revokes_[i]) {
+        cache.remove(records_[i].uid, records_[i].uidLen);
+      } else if (!cache.put(records_[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  CardChangeSource& inner_;
+  CardRecord records_[CARD_CACHE_INPLACE_MAX];
+  bool revokes_[CARD_CACHE_INPLACE_MAX];
+  size_t count_;
+  bool overflow_;
+};
+
+// A legacy card and the line it came from; a later line for the same UID wins
+struct LegacyCard {
+  CardRecord rec;
+  uint32_t line;
+};
+
+static int legacyOrder(const void* a, const void* b) {
+  const LegacyCard& x = *(const LegacyCard*)a;
+  const LegacyCard& y = *(const LegacyCard*)b;
+  int cmp = cardRecordOrder(x.rec, y.rec);
+  if (cmp != 0) return cmp;
+  return x.line > y.line ? -1 : x.line < y.line ? 1 : 0;
+}
+
+// A sorted batch, newest line first per UID, as a change stream
+class LegacyChanges : public CardChangeSource {
+public:
+  LegacyChanges(const LegacyCard* cards, size_t count) : cards_(cards), count_(count), next_(0) {}
+  bool next(CardRecord* rec, bool* revoke) override {
+    while (next_ < count_ && next_ > 0 && cardRecordOrder(cards_[next_].rec, cards_[next_ - 1].rec) == 0) {
+      next_++;
+    }
+    if (next_ >= count_) return false;
+    *rec = cards_[next_++].rec;
+    *revoke = false;
+    return true;
+  }
+private:
+  const LegacyCard* cards_;
+  size_t count_;
+  size_t next_;
+};
+
+static bool commitIndex();
+
+// Sort a batch and merge it into the index in one rewrite
+static bool migrateBatch(LegacyCard* batch, size_t count) {
+  qsort(batch, count, sizeof(LegacyCard), legacyOrder);
+  File src = SPIFFS.open(CARD_INDEX_FILE, "r");
+  File dst = SPIFFS.open(CARD_INDEX_TMP, "w");
+  if (!dst) {
+    if (src) src.close();
+    return false;
+  }
+  SpiffsIndexSource existing(src);
+  SpiffsIndexSink sink(dst);
+  LegacyChanges changes(batch, count);
+  bool ok = cardIndexMerge(existing, sink, changes, logEpoch);
+  if (src) src.close();
+  dst.close();
+
+  TaskLock lock(storeLock);
+  if (!ok || !commitIndex()) {
+    SPIFFS.remove(CARD_INDEX_TMP);
+    return false;
+  }
+  return true;
+}
+
+// Import the old "UID,name,userID,role" lines so cached users survive the
+// format change. Only runs when no binary index exists yet. Cards are
+// sorted in batches as large as memory allows, each one index rewrite:
+// usually the whole file at once.
+static void migrateLegacyCards() {
+  File legacy = SPIFFS.open(LEGACY_CARDS_FILE, "r");
+  if (!legacy) return;
+
+  // The shortest line is a 4-byte UID and three commas; leave memory to spare
+  size_t spare = psramFound() ? (size_t)ESP.getFreePsram() / 2 : (size_t)ESP.getFreeHeap() / 3;
+  size_t want = min((size_t)CARD_MIGRATE_BATCH, (size_t)legacy.size() / 12 + 1);
+  want = min(want, spare / sizeof(LegacyCard));
+  LegacyCard* batch = NULL;
+  for (size_t cap = want; batch == NULL && cap >= 16; cap /= 2) {
+    batch = (LegacyCard*)(psramFound() ? ps_malloc(cap * sizeof(LegacyCard))
+                                       : malloc(cap * sizeof(LegacyCard)));
+    want = cap;
+  }
+  if (batch == NULL) {
+    legacy.close();
+    LOG_ERROR("No memory to migrate " LEGACY_CARDS_FILE);
+    return;
+  }
+
+  size_t count = 0;
+  uint32_t lineNo = 0;
+  int imported = 0;
+  int batches = 0;
+  bool ok = true;
+  while (ok && legacy.available()) {
+    String line = legacy.readStringUntil('\n');
+    line.trim();
+    lineNo++;
+
+    int firstComma = line.indexOf(',');
+    int secondComma = line.indexOf(',', firstComma + 1);
+    int thirdComma = line.indexOf(',', secondComma + 1);
+    if (firstComma == -1 || secondComma == -1 || thirdComma == -1) continue;
+
+    uint8_t uid[CARD_UID_MAX_LEN];
+    uint8_t uidLen = 0;
+    if (!cardUidFromHex(line.substring(0, firstComma).c_str(), uid, &uidLen)) continue;
+
+    LegacyCard& card = batch[count];
+    if (!cardRecordSet(&card.rec, uid, uidLen,
+                       line.substring(firstComma + 1, secondComma).c_str(),
+                       line.substring(secondComma + 1, thirdComma).c_str(),
+                       cardRoleFromString(line.substring(thirdComma + 1).c_str()))) {
+      continue;
+    }
+    card.line = lineNo;
+    imported++;
+    if (++count == want) {
+      ok = migrateBatch(batch, count);
+      batches++;
+      count = 0;
+    }
+  }
+  if (ok && count > 0) {
+    ok = migrateBatch(batch, count);
+    batches++;
+  }
+  legacy.close();
+  free(batch);
+
+  // Start over next boot
+  if (!ok) {
+    SPIFFS.remove(CARD_INDEX_FILE);
+    LOG_ERROR("Failed to migrate " LEGACY_CARDS_FILE);
+    return;
+  }
+  SPIFFS.remove(LEGACY_CARDS_FILE);
+  LOG_INFO("Migrated %d cards from " LEGACY_CARDS_FILE " in %d index writes", imported, batches);
+}
+
+// Allocate the cache from PSRAM when available, otherwise from heap
+static bool allocateCache() {
+  size_t budget;
+  void* storage;
+
+  if (psramFound()) {
+    budget = min((size_t)ESP.getFreePsram() / 2, (size_t)CARD_CACHE_MAX_PSRAM_BYTES);
+    storage = ps_malloc(budget);
+  } else {
+    budget = min((size_t)ESP.getFreeHeap() / 3, (size_t)CARD_CACHE_MAX_HEAP_BYTES);
+    storage = malloc(budget);
+  }
+
+  if (!cardCache.begin(storage, budget)) {
+    free(storage);
+    return false;
+  }
+  return true;
+}
+
+static bool cachePut(const CardRecord& rec) {
+  TaskLock lock(storeLock);
+  return cardCache.put(rec);
+}
+
+// Fill an empty cache from the index with one sequential pass. Flash is
+// read without storeLock; the cache stays incomplete until the end, so
+// lookups meanwhile go on to the index.
+static void loadCache() {
+  unsigned long start = millis();
+  File file = SPIFFS.open(CARD_INDEX_FILE, "r");
+  size_t total = 0;
+  bool complete = true;
+
+  if (file) {
+    SpiffsIndexSource src(file);
+    total = cardIndexCount(src);
+    CardRecord rec;
+    for (size_t i = 0; i < total; i++) {
+      if (!cardIndexRecordAt(src, i, &rec) || !cachePut(rec)) {
+        complete = false;
+        break;
+      }
+    }
+    file.close();
+  }
+
+  // Learned cards aren't in the index until the next fold
+  for (size_t i = 0; i < learnedCount && complete; i++) {
+    CardRecord rec;
+    if (!readLearned(i, &rec) || !cachePut(rec)) complete = false;
+  }
+  {
+    TaskLock lock(storeLock);
+    cardCache.setComplete(complete);
+  }
+
+  LOG_INFO("Card cache: %lu/%lu cards, %lu slots, %lu bytes (%s), loaded in %lu ms%s",
+           (unsigned long)cardCache.count(), (unsigned long)total,
+           (unsigned long)cardCache.capacity(), (unsigned long)cardCache.memoryBytes(),
+           psramFound() ? "PSRAM" : "heap", (unsigned long)(millis() - start),
+           complete ? "" : " - partial");
+}
+
+bool cardStoreBegin() {
+  // A leftover temp file is an update that never committed
+  if (SPIFFS.exists(CARD_INDEX_TMP)) {
+    SPIFFS.remove(CARD_INDEX_TMP);
+  }
+
+  // A crash mid-swap leaves the old index aside; back it goes unless the
+  // new one made it in
+  if (SPIFFS.exists(CARD_INDEX_OLD)) {
+    if (SPIFFS.exists(CARD_INDEX_FILE)) {
+      SPIFFS.remove(CARD_INDEX_OLD);
+    } else {
+      LOG_WARN("Card index swap interrupted - restoring previous index");
+      SPIFFS.rename(CARD_INDEX_OLD, CARD_INDEX_FILE);
+    }
+  }
+
+  // An index in an older record format is rebuilt from an allowlist
+  // snapshot. Learned cards from before its epoch are in it already.
+  File existing = SPIFFS.open(CARD_INDEX_FILE, "r");
+  if (existing) {
+    SpiffsIndexSource src(existing);
+    bool valid = cardIndexValid(src);
+    logEpoch = cardIndexEpoch(src);
+    existing.close();
+    if (!valid) {
+      LOG_WARN("Card index format changed - discarding it");
+      SPIFFS.remove(CARD_INDEX_FILE);
+    }
+  }
+
+  // Cards learned since the last fold
+  if (!cardLogFlash.begin(CARD_LOG_PARTITION) || !cardLog.begin(&cardLogFlash, &cardLogClient)) {
+    LOG_WARN("No \"" CARD_LOG_PARTITION "\" partition - learned cards rewrite the index");
+  } else {
+    LOG_INFO("Card log: %lu learned cards, %lu/%lu KB live", (unsigned long)learnedCount,
+             (unsigned long)(cardLog.liveBytes() / 1024), (unsigned long)(cardLog.capacityBytes() / 1024));
+  }
+
+  if (!SPIFFS.exists(CARD_INDEX_FILE)) {
+    if (SPIFFS.exists(LEGACY_CARDS_FILE)) {
+      migrateLegacyCards();
+    }
+  }
+
+  if (!allocateCache()) {
+    LOG_WARN("Card cache allocation failed - using index only");
+    return false;
+  }
+  loadCache();
+  return true;
+}
+
+const CardCache& cardStoreCache() {
+  return cardCache;
+}
+
+// Index plus learned cards; a learned card the index also holds counts twice
+// until the next fold
+size_t cardStoreCount() {
+  TaskLock lock(storeLock);
+  File file = SPIFFS.open(CARD_INDEX_FILE, "r");
+  if (!file) return learnedCount;
+
+  SpiffsIndexSource src(file);
+  size_t count = cardIndexCount(src);
+  file.close();
+  return count + learnedCount;
+}
+
+// Learned cards first, then the index. Called with storeLock held.
+static bool lookupFlash(const uint8_t* uid, uint8_t uidLen, CardRecord* out) {
+  int i = findLearned(uid, uidLen);
+  if (i >= 0 && readLearned(i, out)) return true;
+
+  if (!lookupFile) lookupFile = SPIFFS.open(CARD_INDEX_FILE, "r");
+  if (!lookupFile) return false;
+  SpiffsIndexSource src(lookupFile);
+  return cardIndexFind(src, uid, uidLen, out);
+}
+
+bool cardStoreLookup(const uint8_t* uid, uint8_t uidLen, CardRecord* out) {
+  TaskLock lock(storeLock);
+
+  // A hit, or a miss while every stored card is resident, stays in RAM
+  if (cardCache.get(uid, uidLen, out)) {
+    stats.cacheHits++;
+    return true;
+  }
+  if (!cardCache.complete() && lookupFlash(uid, uidLen, out)) {
+    stats.indexHits++;
+    return true;
+  }
+  stats.misses++;
+  return false;
+}
+
+bool cardStoreLookupFull(const uint8_t* uid, uint8_t uidLen, CardRecord* out) {
+  TaskLock lock(storeLock);
+  return lookupFlash(uid, uidLen, out);
+}
+
+const CardStoreStats& cardStoreStats() {
+  return stats;
+}
+
+// Swap a fully written temp index into place. SPIFFS won't rename over a
+// file, so the old index is moved aside and only removed once the new one
+// is in; cardStoreBegin() puts it back after a crash in between. Called
+// with storeLock held.
+static bool commitIndex() {
+  if (lookupFile) lookupFile.close();
+  bool hadIndex = SPIFFS.exists(CARD_INDEX_FILE);
+  if (hadIndex && !SPIFFS.rename(CARD_INDEX_FILE, CARD_INDEX_OLD)) return false;
+  if (!SPIFFS.rename(CARD_INDEX_TMP, CARD_INDEX_FILE)) {
+    if (hadIndex) SPIFFS.rename(CARD_INDEX_OLD, CARD_INDEX_FILE);
+    return false;
+  }
+  if (hadIndex) SPIFFS.remove(CARD_INDEX_OLD);
+  return true;
+}
+
+// Record the epoch in the card log so replay and compaction drop the
+// folded puts without consulting the index. Best effort: the index header
+// already says the same. Runs without storeLock, since appending may
+// compact and moved() takes it.
+static void markEpoch() {
+  uint32_t mark;
+  if (!cardLog.append(CARD_LOG_EPOCH, &logEpoch, sizeof(logEpoch), &mark)) {
+    LOG_WARN("Failed to write card log epoch %lu", (unsigned long)logEpoch);
+    return;
+  }
+  if (epochAddr != CARD_LOG_NO_ADDR) cardLog.retire(epochAddr, LogStore::recordBytes(sizeof(logEpoch)));
+  epochAddr = mark;
+}
+
+// Merge a sorted change stream (or a full snapshot when replaceAll is set)
+// into a new index and swap it in only if the whole stream arrived. The
+// old index, the learned cards and the cache stay untouched on any
+// failure. Learned cards are folded into a delta and replaced by a
+// snapshot.
+bool cardStoreApply(CardChangeSource& changes, bool replaceAll) {
+  File src = replaceAll ? File() : SPIFFS.open(CARD_INDEX_FILE, "r");
+  File dst = SPIFFS.open(CARD_INDEX_TMP, "w");
+  if (!dst) {
+    if (src) src.close();
+    LOG_ERROR("Failed to open card index for writing");
+    return false;
+  }
+
+  CardRecord* folded = NULL;
+  size_t foldCount = 0;
+  if (!replaceAll && learnedCount > 0) {
+    folded = new CardRecord[learnedCount];
+    for (size_t i = 0; i < learnedCount; i++) {
+      if (readLearned(i, &folded[foldCount])) foldCount++;
+    }
+    cardRecordSort(folded, foldCount);
+  }
+
+  // An index holding the learned cards starts a new epoch
+  uint32_t epoch = learnedCount > 0 ? logEpoch + 1 : logEpoch;
+  SpiffsIndexSource existing(src);
+  EmptyIndexSource empty;
+  SpiffsIndexSink sink(dst);
+  LearnedChanges merged(changes, folded, foldCount);
+  RecordingChanges* recorded = new RecordingChanges(merged);
+  bool ok = cardIndexMerge(replaceAll ? (CardIndexSource&)empty : (CardIndexSource&)existing,
+                           sink, *recorded, epoch);
+
+  if (src) src.close();
+  dst.close();
+  delete[] folded;
+
+  bool newEpoch = epoch != logEpoch;
+  bool reload = replaceAll;
+  {
+    TaskLock lock(storeLock);
+    if (!ok || !commitIndex()) {
+      SPIFFS.remove(CARD_INDEX_TMP);
+      delete recorded;
+      LOG_WARN("Card index update aborted - keeping previous index");
+      return false;
+    }
+
+    // The index holds the learned cards now
+    if (newEpoch) dropLearned(epoch);
+
+    // Emptied here, refilled after the lock is let go
+    if (!reload) reload = !recorded->replay(cardCache);
+    if (reload) cardCache.clear();
+  }
+  delete recorded;
+  if (reload) loadCache();
+  if (newEpoch) markEpoch();
+  return true;
+}
+
+// Rewrite the index with rec in sorted position, then swap it into place.
+// Without the card log partition every learned card takes this path.
+static bool rewriteIndex(const CardRecord& rec) {
+  File src = SPIFFS.open(CARD_INDEX_FILE, "r");
+  File dst = SPIFFS.open(CARD_INDEX_TMP, "w");
+  if (!dst) {
+    if (src) src.close();
+    LOG_ERROR("Failed to open card index for writing");
+    return false;
+  }
+
+  SpiffsIndexSource source(src);
+  SpiffsIndexSink sink(dst);
+  bool ok = cardIndexUpsert(source, sink, rec);
+
+  if (src) src.close();
+  dst.close();
+
+  if (!ok) {
+    SPIFFS.remove(CARD_INDEX_TMP);
+    LOG_ERROR("Failed to update card index");
+    return false;
+  }
+
+  TaskLock lock(storeLock);
+  if (!commitIndex()) return false;
+
+  // Keep the cache in step; if it is full it stops being authoritative
+  if (!cardCache.put(rec)) cardCache.setComplete(false);
+  return true;
+}
+
+// Append a card the server taught us to the card log. Only runs on the
+// network task, never on the tap path.
+bool cardStoreSave(const CardRecord& rec) {
+  if (!cardLog.mounted()) return rewriteIndex(rec);
+
+  if (learnedCount >= CARD_LOG_MAX && findLearned(rec.uid, rec.uidLen) < 0) {
+    LOG_INFO("Folding %lu learned cards into the card index", (unsigned long)learnedCount);
+    NoChanges none;
+    cardStoreApply(none, false);
+    if (learnedCount >= CARD_LOG_MAX) return rewriteIndex(rec);
+  }
+
+  CardLogPut put;
+  put.epoch = logEpoch;
+  put.rec = rec;
+  uint32_t addr;
+  if (!cardLog.append(CARD_LOG_PUT, &put, sizeof(put), &addr)) {
+    LOG_ERROR("Failed to write card log");
+    return false;
+  }
+
+  TaskLock lock(storeLock);
+  setLearned(rec.uid, rec.uidLen, addr);
+  if (!cardCache.put(rec)) cardCache.setComplete(false);
+  return true;
+}
+
+// One step of background compaction, from the network task between requests
+void cardStoreCompact() {
+  cardLog.compact();
+}
@@ -0,0 +1,62 @@
+/*
+ * Card Store - SPIFFS-backed card index for the access controller
+ *
+ * Cards the allowlist sync delivers are merged into a sorted index file.
+ * Cards the server teaches us one at a time are appended to a log on the
+ * "cardlog" flash partition instead, and folded into the index at the
+ * next sync or once CARD_LOG_MAX of them have piled up.
+ */
+
+#ifndef CARD_STORE_H
+#define CARD_STORE_H
+
+#include "card_index.h"
+#include "card_cache.h"
+
+#define CARD_INDEX_FILE   "/cards.idx"
+#define CARD_INDEX_TMP    "/cards.tmp"
+#define CARD_INDEX_OLD    "/cards.old"  // The index being replaced, until the swap is done
+
+// Changes applied to the cache in place; larger batches reload it
+#ifndef CARD_CACHE_INPLACE_MAX
+#define CARD_CACHE_INPLACE_MAX  64
+#endif
+#define LEGACY_CARDS_FILE "/cards.txt"
+#ifndef CARD_MIGRATE_BATCH
+#define CARD_MIGRATE_BATCH  8192  // Legacy cards sorted per index rewrite
+#endif
+
+#define CARD_LOG_PARTITION  "cardlog"  // Data partition in partitions.csv
+#ifndef CARD_LOG_MAX
+#define CARD_LOG_MAX        128        // Learned cards held in the log between folds
+#endif
+
+// RAM budget for the card cache: a share of free PSRAM when present,
+// otherwise a share of free heap, capped by these limits
+#ifndef CARD_CACHE_MAX_HEAP_BYTES
+#define CARD_CACHE_MAX_HEAP_BYTES   (96 * 1024)
+#endif
+#ifndef CARD_CACHE_MAX_PSRAM_BYTES
+#define CARD_CACHE_MAX_PSRAM_BYTES  (1024 * 1024)
+#endif
+
+// Updated under the store lock; read by the metrics without it
+struct CardStoreStats {
+  uint32_t cacheHits;  // Answered from the RAM cache
+  uint32_t indexHits;  // Answered from the index or the card log on flash
+  uint32_t misses;
+};
+
+// Function declarations
+bool cardStoreBegin();
+size_t cardStoreCount();
+bool cardStoreLookup(const uint8_t* uid, uint8_t uidLen, CardRecord* out);
+// Skips the cache, for when a hit came back with CARD_FLAG_SHORTENED
+bool cardStoreLookupFull(const uint8_t* uid, uint8_t uidLen, CardRecord* out);
+bool cardStoreSave(const CardRecord& rec);
+bool cardStoreApply(CardChangeSource& changes, bool replaceAll);
+void cardStoreCompact();
+const CardCache& cardStoreCache();
+const CardStoreStats& cardStoreStats();
+
+#endif // CARD_STORE_H
@@ -1,5 +1,4 @@
 #include <WiFi.h>
-#include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include <SPI.h>
 #include <MFRC522.h>
@@ -7,10 +6,30 @@
 #include <LiquidCrystal_I2C.h>
 #include <SPIFFS.h>
 #include <Wire.h>  // Added missing Wire library
+#include "card_store.h"
+#include "allowlist_sync.h"
+#include "attendance_journal.h"
+#include "server_client.h"
+#include "access_flow.h"
+#include "task_sync.h"
+#include "card_detect.h"
+#include "reader_mux.h"
+#include "template_sync.h"
+#include "wire_protocol.h"
+#include "lcd_shadow.h"
+#include "log_ring.h"
+#include "wall_clock.h"
+#include "stage_metrics.h"
+#include "link_manager.h"
+#include "reject_cache.h"
+#include <esp_sntp.h>
+#include <sys/time.h>
+#include <atomic>
 
 // Pin Definitions (Corrected according to your PCB wiring)
-#define RST_PIN         27  // MFRC522 RST
-#define SS_PIN          5   // MFRC522 SDA
+#define RST_PIN         27  // MFRC522 RST, wired to both readers
+#define SS_PIN          5   // Entry MFRC522 SDA
+#define EXIT_SS_PIN     33  // Exit MFRC522 SDA
 #define FINGERPRINT_RX  16  // R307 TX
 #define FINGERPRINT_TX  17  // R307 RX
 #define BUZZER_PIN      26  // Active Buzzer
@@ -18,8 +37,14 @@
 #define RED_LED         13  // Red LED
 #define RELAY_PIN       32  // Relay control
 #define BUTTON_PIN      0   // Push button (GPIO0)
+#define RFID_IRQ_PIN    4   // MFRC522 IRQ, every reader's on one line (-1 if not wired)
 
-// SPI pins for MFRC522 (ESP32 default SPI)
+// Card detection with one reader: CARD_DETECT_IRQ wakes the RFID task from
+// the reader's IRQ line, CARD_DETECT_POLL runs a REQA round trip on every
+// task tick. Several readers always use status mode (see reader_mux.h).
+#define CARD_DETECT_MODE CARD_DETECT_IRQ
+
+// SPI pins for the MFRC522s (ESP32 default SPI), shared by all readers
 #define SCK_PIN         18
 #define MOSI_PIN        23
 #define MISO_PIN        19
@@ -31,44 +56,393 @@
 // Network Credentials - CHANGE THESE!
 const char* ssid = "Virus 🦠☣️👾👾";
 const char* password = "just'419";
-const char* serverURL = "http://192.168.104.201:3050/api";// Change to your server IP
+const char* serverURL = "http://192.168.104.201:3050/api/";// Change to your server IP
+const char* ntpServer1 = "pool.ntp.org";
+const char* ntpServer2 = "time.nist.gov";
+
+// Static address for the door; leave at 0.0.0.0 for DHCP. Either way a
+// reconnect skips the scan and, with DHCP, reuses the last lease.
+const IPAddress staticIP(0, 0, 0, 0);
+const IPAddress staticGateway(192, 168, 104, 1);
+const IPAddress staticSubnet(255, 255, 255, 0);
+const IPAddress staticDns(192, 168, 104, 1);
 
 // Device Configuration
 const String DEVICE_ID = "ESP32_001";
 const String DEVICE_LOCATION = "Main Entrance";
+// The server's ESP32_API_KEY, if it sets one; needed to register the first time
+const char* DEVICE_ENROLL_KEY = "";
 
 // Component Initialization
-MFRC522 mfrc522(SS_PIN, RST_PIN);
 HardwareSerial fingerSerial(2); // Use Hardware Serial 2
 Adafruit_Fingerprint finger = Adafruit_Fingerprint(&fingerSerial);
 LiquidCrystal_I2C lcd(0x27, 16, 2); // Try 0x3F if 0x27 doesn't work
 
+void displayMessage(const char* line1, const char* line2);
+void postDisplay(const char* line1, const char* line2);
+bool captureFingerprint();
+int matchCapturedFingerprint(uint16_t libSlot);
+bool fingerDownChar(uint8_t buffer, const uint8_t* data, size_t len);
+void IRAM_ATTR onCardIrq();
+
+// The I2C panel as drawn by the LCD shadow
+class LcdPanel : public LcdDevice {
+public:
+  void clear() override { lcd.clear(); }
+  void setCursor(uint8_t col, uint8_t row) override { lcd.setCursor(col, row); }
+  void write(const uint8_t* data, size_t len) override { lcd.write(data, len); }
+};
+
+LcdPanel lcdPanel;
+LcdShadow lcdShadow;
+
+// Boot table of the wall clock, replaced whole on every save
+class SpiffsClockStore : public WallClockStore {
+public:
+  bool load(void* buf, size_t len) override {
+    File file = SPIFFS.open(WALL_CLOCK_FILE, "r");
+    if (!file) return false;
+    bool ok = file.read((uint8_t*)buf, len) == len;
+    file.close();
+    return ok;
+  }
+  bool save(const void* buf, size_t len) override {
+    File file = SPIFFS.open(WALL_CLOCK_FILE ".tmp", "w");
+    if (!file) return false;
+    bool ok = file.write((const uint8_t*)buf, len) == len;
+    file.close();
+    if (!ok) return false;
+    SPIFFS.remove(WALL_CLOCK_FILE);
+    return SPIFFS.rename(WALL_CLOCK_FILE ".tmp", WALL_CLOCK_FILE);
+  }
+};
+
+SpiffsClockStore clockStore;
+WallClock wallClock;
+
+// The station as the link manager drives it. Auto-reconnect is off, so
+// only the manager decides when to rejoin and with what.
+class WiFiLinkRadio : public LinkRadio {
+public:
+  void join(const LinkCache* ap, const LinkAddress* address) override {
+    if (address != NULL) {
+      WiFi.config(IPAddress(address->ip), IPAddress(address->gateway), IPAddress(address->subnet),
+                  IPAddress(address->dns));
+    } else {
+      WiFi.config(IPAddress(), IPAddress(), IPAddress());  // DHCP
+    }
+    if (ap != NULL) {
+      WiFi.begin(ssid, password, ap->channel, ap->bssid);
+    } else {
+      WiFi.begin(ssid, password);
+    }
+  }
+  void drop() override { WiFi.disconnect(); }
+  uint8_t status() override {
+    switch (WiFi.status()) {
+      case WL_CONNECTED:
+        return LINK_RADIO_UP;
+      case WL_NO_SSID_AVAIL:
+      case WL_CONNECT_FAILED:
+        return LINK_RADIO_FAILED;
+      default:
+        return LINK_RADIO_JOINING;
+    }
+  }
+  void read(uint8_t* bssid, uint8_t* channel, LinkAddress* address) override {
+    const uint8_t* joined = WiFi.BSSID();
+    if (joined != NULL) memcpy(bssid, joined, 6);
+    *channel = joined != NULL ? (uint8_t)WiFi.channel() : 0;
+    address->ip = WiFi.localIP();
+    address->gateway = WiFi.gatewayIP();
+    address->subnet = WiFi.subnetMask();
+    address->dns = WiFi.dnsIP();
+  }
+};
+
+// The link cache as saved. millis() restarts with every boot, so the
+// lease's age is carried over in wall time.
+#define LINK_CACHE_MAGIC 0x4C4E4B31
+struct SavedLink {
+  uint32_t magic;
+  LinkCache cache;
+  int64_t leaseUnixMs;  // 0: unknown, the lease isn't reused
+};
+
+WiFiLinkRadio linkRadio;
+LinkManager linkManager;
+
+// Drained log lines go to the serial console
+class SerialLogSink : public LogSink {
+public:
+  void write(const uint8_t* data, size_t len) override { Serial.write(data, len); }
+};
+
+// Pins, LCD and sensor as driven by the access flow
+class DoorHardware : public AccessHardware {
+public:
+  void setOutput(uint8_t output, bool on) {
+    static const uint8_t pins[ACCESS_OUT_COUNT] = {BUZZER_PIN, GREEN_LED, RED_LED, RELAY_PIN};
+    digitalWrite(pins[output], on ? HIGH : LOW);
+  }
+  void display(const char* line1, const char* line2) {
+    postDisplay(line1, line2);
+  }
+  bool captureFingerprint() {
+    StageStamp start = stageMetrics.now();
+    bool captured = ::captureFingerprint();
+    if (captured) stageMetrics.record(STAGE_FINGER_CAPTURE, start);
+    return captured;
+  }
+  int matchCaptured(uint16_t slot) {
+    StageStamp start = stageMetrics.now();
+    int matched = matchCapturedFingerprint(slot);
+    if (matched >= 0) stageMetrics.record(STAGE_FINGER_MATCH, start);
+    return matched;
+  }
+};
+
+// R307 template library as loaded by the template sync
+class R307Templates : public TemplateSensor {
+public:
+  bool storeTemplate(uint16_t sensorSlot, const uint8_t* tpl, size_t len) {
+    return fingerDownChar(1, tpl, len) && finger.storeModel(sensorSlot) == FINGERPRINT_OK;
+  }
+};
+
+R307Templates sensorTemplates;
+
+DoorHardware doorHardware;
+AccessFlow accessFlow;
+
+// One MFRC522 on the shared SPI bus, as driven by its card detector
+class Mfrc522Radio : public CardDetectRadio {
+public:
+  Mfrc522Radio(byte ssPin, byte rstPin, uint8_t direction)
+      : reader(ssPin, rstPin), direction(direction) {}
+  
+  bool isNewCardPresent() {
+    return reader.PICC_IsNewCardPresent();
+  }
+  bool readCardSerial() {
+    return reader.PICC_ReadCardSerial();
+  }
+  void armIrq() {
+    reader.PCD_WriteRegister(MFRC522::ComIrqReg, 0x7F);     // Clear pending IRQ bits
+    reader.PCD_WriteRegister(MFRC522::ComIEnReg, 0xA0);     // IRqInv | RxIEn: pull IRQ low on receive
+    reader.PCD_WriteRegister(MFRC522::FIFOLevelReg, 0x80);  // Flush FIFO
+    reader.PCD_WriteRegister(MFRC522::FIFODataReg, MFRC522::PICC_CMD_REQA);
+    reader.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Transceive);
+    reader.PCD_WriteRegister(MFRC522::BitFramingReg, 0x87); // StartSend, 7-bit frame
+  }
+  void clearIrq() {
+    reader.PCD_WriteRegister(MFRC522::ComIrqReg, 0x7F);
+  }
+  bool irqPending() {
+    return reader.PCD_ReadRegister(MFRC522::ComIrqReg) & 0x20;  // RxIRq
+  }
+  
+  MFRC522 reader;
+  uint8_t direction;  // JOURNAL_ACTION_* for its taps
+};
+
+// The door's readers; drop the exit reader for a one-reader door. Only the
+// entry reader drives the shared RST line, so initializing the exit reader
+// doesn't reset the entry reader again.
+Mfrc522Radio cardRadios[] = {
+  Mfrc522Radio(SS_PIN, RST_PIN, JOURNAL_ACTION_ENTRY),
+  Mfrc522Radio(EXIT_SS_PIN, MFRC522::UNUSED_PIN, JOURNAL_ACTION_EXIT),
+};
+#define READER_COUNT (sizeof(cardRadios) / sizeof(cardRadios[0]))
+
+ReaderMux readerMux;
+std::atomic<bool> cardIrqPending(false);
+TaskHandle_t rfidTaskHandle = NULL;
+
+// Task layout: card reading and fingerprint matching on core 1, network
+// I/O, journal writes, LCD updates and the sensor's bring-up on core 0
+#define RFID_TASK_CORE         1
+#define NETWORK_TASK_CORE      0
+#define FINGER_TASK_CORE       0
+#define UI_TASK_CORE           0
+#define LOG_TASK_CORE          0
+#define METRICS_TASK_CORE      0
+#define RFID_TASK_PRIORITY     3
+#define UI_TASK_PRIORITY       2
+#define NETWORK_TASK_PRIORITY  1
+#define FINGER_TASK_PRIORITY   1
+#define LOG_TASK_PRIORITY      0     // Shares the idle time
+#define METRICS_TASK_PRIORITY  0
+#define RFID_TASK_STACK        8192
+#define NETWORK_TASK_STACK     12288
+#define FINGER_TASK_STACK      4096
+#define UI_TASK_STACK          4096
+#define LOG_TASK_STACK         3072
+#define METRICS_TASK_STACK     4096
+#define RFID_TASK_TICK_MS      10    // Access flow tick; the card IRQ wakes it sooner
+#define FINGER_POWER_UP_MS     500   // The R307 ignores commands until it has booted
+#define NET_QUEUE_DEPTH        32
+#define NET_TASK_IDLE_MS       100   // Periodic work runs at least this often
+#define TAP_QUEUE_WAIT_MS      1000  // RFID task wait for room in the queue
+#define VERIFY_HTTP_TIMEOUT_MS 10000 // Network task verify-rfid request
+#define VERIFY_QUEUE_SLACK_MS  2000  // Queue hand-off, net task wake-up, reply
+// RFID task wait for a server answer. Outlasts the HTTP request so a slow
+// but successful verify isn't denied just before its reply arrives.
+#define VERIFY_TIMEOUT_MS      (VERIFY_HTTP_TIMEOUT_MS + VERIFY_QUEUE_SLACK_MS)
+#define LOG_DRAIN_BATCH        8     // Lines written per pass of the log task
+#define LOG_TASK_IDLE_MS       20    // Log task sleep once the ring is empty
+#define METRICS_TASK_IDLE_MS   50    // Metrics task sleep between accept() polls
+
+// Requests from the RFID task to the network task
+#define NET_REQUEST_TAP       0  // Journal and upload a granted tap
+#define NET_REQUEST_VERIFY    1  // Look up a card that isn't stored locally
+#define NET_REQUEST_TEMPLATE  2  // Load a card owner's template onto the sensor
+
+struct NetRequest {
+  uint8_t type;
+  uint8_t uid[CARD_UID_MAX_LEN];
+  uint8_t uidLen;
+  uint8_t action;
+  uint32_t timestamp;
+  uint16_t fingerSlot;  // NET_REQUEST_TEMPLATE
+  bool nameShortened;   // NET_REQUEST_TAP: name came from the cache, cut
+  char name[CARD_NAME_LEN];
+};
+
+struct VerifyReply {
+  uint8_t uid[CARD_UID_MAX_LEN];  // Card the reply is for
+  uint8_t uidLen;
+  bool valid;
+  bool rejected;  // The server answered that it doesn't know the card
+  CardRecord card;
+};
+
+struct UiMessage {
+  char line1[ACCESS_LCD_COLS + 1];
+  char line2[ACCESS_LCD_COLS + 1];
+};
+
+TaskQueue<NetRequest> netQueue;          // RFID -> network
+TaskQueue<VerifyReply> verifyReplyQueue; // network -> RFID, latest reply only
+TaskQueue<UiMessage> uiQueue;            // any task -> UI, latest screen wins
+std::atomic<bool> storageReady(false);  // SPIFFS mounted
+std::atomic<bool> fingerReady(false);   // Set by the finger task once the sensor answers
+
+// Stage histograms and device gauges: scraped from GET /metrics on this
+// port, and uploaded as a summary with every periodic sync
+#define METRICS_PORT               80
+#define METRICS_REQUEST_TIMEOUT_MS 1000
+#define METRICS_HEADER_LINES_MAX   32
+#define METRICS_WRITE_CHUNK        512   // Bytes per TCP write
+#define METRICS_DOC_SIZE           2048
+WiFiServer metricsServer(METRICS_PORT);
+std::atomic<bool> metricsListening(false);  // Set by the network task once TCP/IP is up
+
 // Global Variables
-String currentCardUID = "";
+// Owned by the RFID task: the current and last card, the current card's reader direction,
+// currentCard, currentFingerprintID, lastCardRead and the pending server verify.
+// Owned by the network task: the sync timers.
+// Shared: networkAvailable, which is atomic.
+// Nothing on the tap path allocates or waits on the UART: cards and names
+// live in fixed buffers, log lines in the log ring.
+uint8_t currentUid[CARD_UID_MAX_LEN];
+uint8_t currentUidLen = 0;
+char currentCardUID[2 * CARD_UID_MAX_LEN + 1] = "";  // Hex, for the log
+uint8_t currentDirection = JOURNAL_ACTION_ENTRY;    // Of the reader it was tapped on
+uint8_t lastUid[CARD_UID_MAX_LEN];
+uint8_t lastUidLen = 0;
+CardRecord currentCard;  // Filled by the card lookup, reused by grantAccess()
 int currentFingerprintID = -1;
-bool networkAvailable = false;
-unsigned long lastCardRead = 0;
-const unsigned long CARD_READ_DELAY = 2000; // Prevent multiple reads
-unsigned long lastWiFiCheck = 0;
+std::atomic<bool> networkAvailable(false);
+unsigned long lastCardRead = 0;   // Also the tap time for tap-to-unlock
+StageStamp tapStartedAt;          // Same, for the tap-to-unlock histogram
+NetRequest pendingVerify;         // Card waiting for a server verdict
+bool verifyPending = false;
+unsigned long verifyStartedAt = 0;
+StageStamp verifyStamp;
+RejectCache rejectCache;          // Unknown cards the server isn't asked about again
+const unsigned long CARD_READ_DELAY = 2000; // Ignore the same card re-presented within this
+bool deviceRegistered = false;  // Done on the first link up
 unsigned long lastSync = 0;
+unsigned long lastAllowlistSync = 0;
+unsigned long lastTemplateSync = 0;
+int templatesMissing = 1;  // Sync soon after boot
+const uint32_t JOURNAL_TAP_UPLOAD_MAX = 4; // Records sent inline with a tap
+
+// Attendance batch upload limits
+#define JOURNAL_BATCH_MAX_RECORDS 32
+#define JOURNAL_BATCH_MAX_BYTES   6144
+#define JOURNAL_BATCH_DOC_SIZE    8192
+
+// Card checks and attendance go out in the compact binary format unless the
+// server answers a binary request with something else; then the device
+// falls back to JSON until the next reboot
+#define WIRE_FORMAT_BINARY        1
+#define WIRE_BATCH_MAX_BYTES      (128 + JOURNAL_BATCH_MAX_RECORDS * WIRE_EVENT_MAX_SIZE)
+#define WIRE_REPLY_MAX_BYTES      128
+bool wireBinary = WIRE_FORMAT_BINARY;
+
+// The Arduino builder generates these; spelled out so the sketch also
+// builds as plain C++ for the host (see host/host_hal.h)
+void startTasks();
+void rfidTask(void* param);
+void fingerTask(void* param);
+void networkTask(void* param);
+void uiTask(void* param);
+void logTask(void* param);
+void metricsTask(void* param);
+uint32_t logClock();
+uint32_t stageCycles();
+void clockBegin();
+void clockPoll();
+void checkButton();
+void showSystemInfo();
+void linkBegin();
+void linkPoll();
+bool linkLoad(LinkCache* cache);
+void linkSave();
+void registerDevice();
+void handleRFIDCard(Mfrc522Radio& radio);
+void cardVerdict(bool registered);
+void requestTemplate(uint16_t libSlot);
+bool checkLocalCard(const uint8_t* uid, uint8_t uidLen);
+bool requestServerVerify(const uint8_t* uid, uint8_t uidLen);
+void pollServerVerify();
+void answerVerifyRequest(const NetRequest& request);
+bool wireFallback(int httpResponseCode);
+bool checkServerCardBinary(const uint8_t* uid, uint8_t uidLen, CardRecord* card, bool* valid,
+                           bool* rejected);
+bool checkServerCard(String cardUID, CardRecord* card, bool* rejected);
+uint8_t fingerMatch(uint16_t* score);
+void grantAccess();
+void denyAccess(const char* reason);
+const char* getUserName();
+void logAttendance(const uint8_t* uid, uint8_t uidLen, uint8_t action, const char* userName);
+void journalTap(const NetRequest& request);
+bool sendAttendanceBatch(const JournalRecord* recs, size_t count, size_t* packed, uint32_t* ackedSeq);
+bool sendAttendanceBatchBinary(const JournalRecord* recs, size_t count, size_t* packed,
+                               uint32_t* ackedSeq, bool* ok);
+uint32_t uploadJournal(uint32_t maxRecords);
+void syncAttendanceData();
+void collectGauges(MetricsGauges* gauges);
+void serveMetrics(WiFiClient& client);
+void uploadMetrics();
 
 void setup() {
   Serial.begin(115200);
-  delay(1000);
   
-  Serial.println("=================================");
-  Serial.println("ESP32 RFID Access Control System");
-  Serial.println("=================================");
+  // Everything below logs through the ring; start draining it first
+  logRing.begin(logClock);
+  stageMetrics.begin(stageCycles, ESP.getCpuFreqMHz(), logClock);
+  xTaskCreatePinnedToCore(logTask, "log", LOG_TASK_STACK, NULL,
+                          LOG_TASK_PRIORITY, NULL, LOG_TASK_CORE);
   
-  // Initialize I2C for LCD
-  Wire.begin(SDA_PIN, SCL_PIN);
+  LOG_INFO("=================================");
+  LOG_INFO("ESP32 RFID Access Control System");
+  LOG_INFO("=================================");
   
-  // Initialize LCD
-  lcd.init();
-  lcd.backlight();
-  displayMessage("Initializing...", "Please wait");
-  
-  // Initialize pins first
+  // The door first: the relay locked, then what a tap needs (the readers,
+  // the card store and the journal). Nothing here waits on a fixed delay.
   pinMode(BUZZER_PIN, OUTPUT);
   pinMode(GREEN_LED, OUTPUT);
   pinMode(RED_LED, OUTPUT);
@@ -81,111 +455,310 @@ void setup() {
   digitalWrite(RED_LED, LOW);
   digitalWrite(BUZZER_PIN, LOW);
   
-  // Brief startup indication
-  digitalWrite(GREEN_LED, HIGH);
-  delay(200);
-  digitalWrite(GREEN_LED, LOW);
+  // The UI task brings the LCD up and draws the latest screen posted
+  uiQueue.begin(1);
+  xTaskCreatePinnedToCore(uiTask, "ui", UI_TASK_STACK, NULL,
+                          UI_TASK_PRIORITY, NULL, UI_TASK_CORE);
+  accessFlow.begin(&doorHardware, millis());
   
-  // Initialize SPI for RFID
+  // Initialize SPI for RFID; every reader has its own chip select.
+  // PCD_Init() waits for the oscillator to start.
   SPI.begin(SCK_PIN, MISO_PIN, MOSI_PIN, SS_PIN);
-  mfrc522.PCD_Init();
-  delay(100);
-  
-  // Check RFID module (skip self-test for reliability)
-  byte version = mfrc522.PCD_ReadRegister(mfrc522.VersionReg);
-  if (version == 0x00 || version == 0xFF) {
-    Serial.println("RFID module not detected");
-    displayMessage("RFID Error", "Check wiring");
-    // Don't halt - continue with other components
-  } else {
-    Serial.println("RFID module detected successfully (v" + String(version, HEX) + ")");
-    displayMessage("RFID Ready", "Version: " + String(version, HEX));
+  for (uint8_t i = 0; i < READER_COUNT; i++) {
+    cardRadios[i].reader.PCD_Init();
   }
-  delay(1000);
   
-  // Initialize fingerprint sensor
-  fingerSerial.begin(57600, SERIAL_8N1, FINGERPRINT_RX, FINGERPRINT_TX);
-  delay(500);
+  // Check RFID modules (skip self-test for reliability)
+  for (uint8_t i = 0; i < READER_COUNT; i++) {
+    Mfrc522Radio& radio = cardRadios[i];
+    const char* side = journalActionName(radio.direction);
+    byte version = radio.reader.PCD_ReadRegister(MFRC522::VersionReg);
+    if (version == 0x00 || version == 0xFF) {
+      LOG_ERROR("RFID module not detected (%s)", side);
+      // Don't halt - continue with other components
+    } else {
+      LOG_INFO("RFID module detected successfully (%s, v%X)", side, version);
+    }
+    readerMux.add(&radio, radio.direction);
+  }
   
-  displayMessage("Checking", "Fingerprint...");
-  if (finger.verifyPassword()) {
-    Serial.println("Fingerprint sensor ready");
-    displayMessage("Fingerprint OK", "Ready");
-  } else {
-    Serial.println("Fingerprint sensor not found or wrong password");
-    displayMessage("Finger Warning", "Check sensor");
+  // Wake on the readers' IRQ line when it is wired, otherwise poll
+  uint8_t detectMode = CARD_DETECT_POLL;
+  if (CARD_DETECT_MODE == CARD_DETECT_IRQ && RFID_IRQ_PIN >= 0) {
+    pinMode(RFID_IRQ_PIN, INPUT_PULLUP);  // IRQ pins are open drain
+    attachInterrupt(digitalPinToInterrupt(RFID_IRQ_PIN), onCardIrq, FALLING);
+    detectMode = CARD_DETECT_IRQ;
   }
-  delay(1000);
+  readerMux.begin(detectMode, millis());
+  LOG_INFO("Card detection: %s, %u readers", CardDetector::modeName(readerMux.mode()),
+           (unsigned)readerMux.count());
   
   // Initialize SPIFFS for local storage
-  displayMessage("Initializing", "Storage...");
   if (!SPIFFS.begin(true)) {
-    Serial.println("SPIFFS initialization failed");
-    displayMessage("Storage Error", "Check memory");
+    LOG_ERROR("SPIFFS initialization failed");
+    postDisplay("Storage Error", "Check memory");
   } else {
-    Serial.println("SPIFFS initialized successfully");
-    displayMessage("Storage OK", "Ready");
-  }
-  delay(1000);
-  
-  // Connect to WiFi
-  connectToWiFi();
-  
-  // Register device with server
-  if (networkAvailable) {
-    registerDevice();
+    LOG_INFO("SPIFFS initialized successfully");
+    storageReady = true;
+    cardStoreBegin();
+    allowlistSyncBegin();
+    journalBegin();
   }
+  clockBegin();
+  serverClientBegin(serverURL);
   
   // System ready
-  Serial.println("=================================");
-  Serial.println("System initialization complete");
-  Serial.println("Device ID: " + DEVICE_ID);
-  Serial.println("Location: " + DEVICE_LOCATION);
-  Serial.println("=================================");
-  
-  displayMessage("System Ready", "Present Card");
-  
-  // Brief LED test
-  digitalWrite(GREEN_LED, HIGH);
-  delay(200);
-  digitalWrite(GREEN_LED, LOW);
-  digitalWrite(RED_LED, HIGH);
-  delay(200);
-  digitalWrite(RED_LED, LOW);
-  
-  // Startup beep
-  digitalWrite(BUZZER_PIN, HIGH);
-  delay(100);
-  digitalWrite(BUZZER_PIN, LOW);
+  LOG_INFO("=================================");
+  LOG_INFO("System initialization complete");
+  LOG_INFO("Device ID: %s", DEVICE_ID.c_str());
+  LOG_INFO("Location: %s", DEVICE_LOCATION.c_str());
+  LOG_INFO("=================================");
+  
+  if (storageReady) postDisplay("System Ready", "Present Card");
+  
+  // The rest comes up while taps are already being taken: the fingerprint
+  // sensor on its own task, WiFi and device registration on the network
+  // task
+  startTasks();
 }
 
 void loop() {
-  // Check WiFi connection periodically
-  if (millis() - lastWiFiCheck > 30000) { // Every 30 seconds
-    checkWiFiConnection();
-    lastWiFiCheck = millis();
+  // All work runs in the tasks started by setup()
+  vTaskDelete(NULL);
+}
+
+void startTasks() {
+  netQueue.begin(NET_QUEUE_DEPTH);
+  verifyReplyQueue.begin(1);
+  
+  xTaskCreatePinnedToCore(rfidTask, "rfid", RFID_TASK_STACK, NULL,
+                          RFID_TASK_PRIORITY, &rfidTaskHandle, RFID_TASK_CORE);
+  xTaskCreatePinnedToCore(fingerTask, "finger", FINGER_TASK_STACK, NULL,
+                          FINGER_TASK_PRIORITY, NULL, FINGER_TASK_CORE);
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, NULL,
+                          NETWORK_TASK_PRIORITY, NULL, NETWORK_TASK_CORE);
+  xTaskCreatePinnedToCore(metricsTask, "metrics", METRICS_TASK_STACK, NULL,
+                          METRICS_TASK_PRIORITY, NULL, METRICS_TASK_CORE);
+}
+
+// Card reads, fingerprint matching and door feedback. Never touches the
+// network directly, so a slow server can't delay the next card.
+void rfidTask(void* param) {
+  LOG_INFO("Boot: taking taps %lu ms after start", (unsigned long)millis());
+  for (;;) {
+    // Check button press
+    checkButton();
+    
+    // Hand a server verdict to the flow before it ticks, so a finger
+    // captured while waiting is matched on this pass
+    pollServerVerify();
+    
+    // Fingerprint polling, relay hold, LEDs, buzzer and LCD all run off timers
+    switch (accessFlow.tick(millis())) {
+      case ACCESS_EVENT_GRANTED:
+        grantAccess();
+        break;
+      case ACCESS_EVENT_DENIED:
+        denyAccess(accessFlow.denyReason());
+        break;
+      default:
+        break;
+    }
+    
+    // The next card is read as soon as the previous tap is decided, even while
+    // the door is still open and the last person's feedback is playing
+    StageStamp readStart = stageMetrics.now();
+    int reader = accessFlow.ready() ? readerMux.check(millis(), cardIrqPending.exchange(false))
+                                    : READER_NONE;
+    if (reader != READER_NONE) {
+      stageMetrics.record(STAGE_CARD_READ, readStart);
+      handleRFIDCard(cardRadios[reader]);
+      // Our own select and halt also raise RxIRq; don't count them as a card
+      cardRadios[reader].clearIrq();
+      cardIrqPending = false;
+    }
+    
+    // Sleep until the next tick, or until the card IRQ wakes us
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RFID_TASK_TICK_MS));
   }
+}
+
+// MFRC522 IRQ: a card answered the REQA queued by a reader's detector
+void IRAM_ATTR onCardIrq() {
+  cardIrqPending = true;
+  BaseType_t woken = pdFALSE;
+  if (rfidTaskHandle != NULL) {
+    vTaskNotifyGiveFromISR(rfidTaskHandle, &woken);
+  }
+  if (woken) portYIELD_FROM_ISR();
+}
+
+// Brings the fingerprint sensor up, then exits. Until it has, the access
+// flow sees no finger on the glass, so a card tapped meanwhile just waits
+// at "Place Finger".
+void fingerTask(void* param) {
+  fingerSerial.begin(57600, SERIAL_8N1, FINGERPRINT_RX, FINGERPRINT_TX);
+  delay(FINGER_POWER_UP_MS);
   
-  // Check button press
-  checkButton();
-  
-  // Prevent rapid card reads
-  if (millis() - lastCardRead > CARD_READ_DELAY) {
-    if (mfrc522.PICC_IsNewCardPresent() && mfrc522.PICC_ReadCardSerial()) {
-      lastCardRead = millis();
-      handleRFIDCard();
+  if (finger.verifyPassword()) {
+    // Templates are downloaded in 64-byte data packets; see fingerDownChar()
+    finger.setPacketSize(FINGERPRINT_PACKET_SIZE_64);
+    finger.getParameters();
+    if (storageReady) {
+      templateSyncBegin(&sensorTemplates, finger.capacity);
     }
+    fingerReady = true;
+    LOG_INFO("Boot: fingerprint sensor ready at %lu ms, capacity %u", (unsigned long)millis(),
+             finger.capacity);
+  } else {
+    LOG_WARN("Fingerprint sensor not found or wrong password");
   }
-  
-  // Sync attendance data periodically if connected
-  if (networkAvailable && WiFi.status() == WL_CONNECTED) {
-    if (millis() - lastSync > 300000) { // Sync every 5 minutes
-      syncAttendanceData();
-      lastSync = millis();
+  vTaskDelete(NULL);
+}
+
+// Journal writes, uploads, card verification and periodic sync
+void networkTask(void* param) {
+  linkBegin();
+  for (;;) {
+    NetRequest request;
+    if (netQueue.receive(&request, NET_TASK_IDLE_MS)) {
+      if (request.type == NET_REQUEST_VERIFY) {
+        answerVerifyRequest(request);
+      } else if (request.type == NET_REQUEST_TEMPLATE) {
+        templateFetch(request.fingerSlot);
+      } else {
+        journalTap(request);
+      }
+    }
+    
+    // Keep the link up, and catch up whenever it comes back
+    linkPoll();
+    
+    // Sync attendance data periodically if connected
+    if (networkAvailable && WiFi.status() == WL_CONNECTED) {
+      if (millis() - lastSync > 300000) { // Sync every 5 minutes
+        syncAttendanceData();
+        uploadMetrics();
+        lastSync = millis();
+      }
+      
+      // Pull card changes so taps are answered locally
+      if (millis() - lastAllowlistSync > ALLOWLIST_SYNC_INTERVAL) {
+        allowlistSync(DEVICE_LOCATION);
+        lastAllowlistSync = millis();
+      }
+      
+      // Load the location's fingerprint templates a batch at a time, but
+      // never ahead of queued taps
+      unsigned long templateInterval = templatesMissing > 0 ? TEMPLATE_SYNC_RETRY_MS : TEMPLATE_SYNC_INTERVAL;
+      if (fingerReady && netQueue.waiting() == 0 && millis() - lastTemplateSync > templateInterval) {
+        if (!serverHasDeviceKey()) registerDevice();
+        templatesMissing = templateSync(DEVICE_LOCATION, TEMPLATE_SYNC_BATCH);
+        lastTemplateSync = millis();
+      }
     }
+    
+    // Persist template use recorded by matches since the last pass
+    templateFlush();
+    
+    // Reclaim flash from acknowledged events and folded cards, a segment
+    // (one sector erase) at a time and never ahead of queued taps
+    if (netQueue.waiting() == 0) {
+      journalCompact();
+      cardStoreCompact();
+    }
+    
+    clockPoll();
   }
-  
-  delay(100);
+}
+
+// The only writer of the LCD; brings it up first
+void uiTask(void* param) {
+  Wire.begin(SDA_PIN, SCL_PIN);
+  lcd.init();
+  lcd.backlight();
+  lcdShadow.begin(&lcdPanel);
+  LOG_INFO("Boot: LCD ready at %lu ms", (unsigned long)millis());
+  for (;;) {
+    UiMessage message;
+    if (uiQueue.receive(&message, TASK_WAIT_FOREVER)) {
+      displayMessage(message.line1, message.line2);
+    }
+  }
+}
+
+// Lowest priority: writes queued log lines to the serial console, where
+// a full UART blocks this task rather than the one that logged
+void logTask(void* param) {
+  SerialLogSink sink;
+  for (;;) {
+    if (logRing.drain(&sink, LOG_DRAIN_BATCH) == 0) {
+      vTaskDelay(pdMS_TO_TICKS(LOG_TASK_IDLE_MS));
+    }
+  }
+}
+
+uint32_t logClock() {
+  return millis();
+}
+
+// Per core; stages are stamped and recorded on one pinned task
+uint32_t stageCycles() {
+  return ESP.getCycleCount();
+}
+
+// Lowest priority: answers scrapes of /metrics, one connection at a time.
+// The network task opens the listening socket; lwIP doesn't exist before
+// WiFi.mode().
+void metricsTask(void* param) {
+  while (!metricsListening) {
+    vTaskDelay(pdMS_TO_TICKS(METRICS_TASK_IDLE_MS));
+  }
+  for (;;) {
+    WiFiClient client = metricsServer.available();
+    if (client) {
+      serveMetrics(client);
+      client.stop();
+    } else {
+      vTaskDelay(pdMS_TO_TICKS(METRICS_TASK_IDLE_MS));
+    }
+  }
+}
+
+// New boot id for the journal, before the first tap. The RTC keeps
+// running through a software reset, so its time beats the saved estimate.
+void clockBegin() {
+  wallClock.begin(&clockStore, millis(), esp_random());
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  wallClock.estimated((int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000, millis());
+  LOG_INFO("Boot %lu, clock %s", (unsigned long)wallClock.bootId(),
+           wallClockSourceName(wallClock.source()));
+}
+
+// Hand each SNTP answer to the wall clock; the status reads as completed
+// once per sync
+void clockPoll() {
+  if (sntp_get_sync_status() == SNTP_SYNC_STATUS_COMPLETED) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    bool first = wallClock.source() != WALL_CLOCK_SYNCED;
+    wallClock.synced((int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000, millis());
+    if (first) {
+      LOG_INFO("Clock synced by SNTP");
+    }
+  }
+  wallClock.tick(millis());
+}
+
+// Hand a screen to the UI task
+void postDisplay(const char* line1, const char* line2) {
+  UiMessage message;
+  strncpy(message.line1, line1, ACCESS_LCD_COLS);
+  message.line1[ACCESS_LCD_COLS] = '\0';
+  strncpy(message.line2, line2, ACCESS_LCD_COLS);
+  message.line2[ACCESS_LCD_COLS] = '\0';
+  uiQueue.overwrite(message);
 }
 
 void checkButton() {
@@ -210,222 +783,386 @@ void checkButton() {
 }
 
 void showSystemInfo() {
-  lcd.clear();
-  lcd.print("WiFi: ");
-  lcd.print(WiFi.status() == WL_CONNECTED ? "OK" : "OFF");
-  lcd.setCursor(0, 1);
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    String ip = WiFi.localIP().toString();
-    if (ip.length() > 16) {
-      lcd.print(ip.substring(0, 16));
-    } else {
-      lcd.print(ip);
-    }
-  } else {
-    lcd.print("No Connection");
-  }
-  
-  delay(3000);
+  // Don't cover a tap in progress
+  if (!accessFlow.ready()) return;
   
-  // Show device info
-  lcd.clear();
-  lcd.print("Device: ");
-  lcd.print(DEVICE_ID.substring(0, 8));
-  lcd.setCursor(0, 1);
-  lcd.print("Location: Main");
+  bool connected = WiFi.status() == WL_CONNECTED;
+  String wifiLine = String("WiFi: ") + (connected ? "OK" : "OFF");
+  String ipLine = connected ? WiFi.localIP().toString() : String("No Connection");
+  String deviceLine = "Device: " + DEVICE_ID.substring(0, 8);
   
-  delay(3000);
-  displayMessage("System Ready", "Present Card");
+  // WiFi page, then device page, 3 seconds each
+  accessFlow.showMessage(wifiLine.c_str(), ipLine.c_str(), 3000, millis());
+  accessFlow.queueMessage(deviceLine.c_str(), "Location: Main", 3000);
 }
 
-void connectToWiFi() {
-  displayMessage("WiFi Connect", "Starting...");
+// Start joining from what the last boot learned; linkPoll() does the rest
+void linkBegin() {
   WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, password);
-  
-  Serial.print("Connecting to WiFi: ");
-  Serial.println(ssid);
-  
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(1000);
-    Serial.print(".");
-    attempts++;
-    
-    // Update display with progress
-    lcd.setCursor(0, 1);
-    String dots = "";
-    for (int i = 0; i < attempts && i < 16; i++) {
-      dots += ".";
-    }
-    lcd.print(dots);
-  }
-  Serial.println();
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    networkAvailable = true;
-    Serial.println("WiFi connected successfully!");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-    Serial.print("Signal strength: ");
-    Serial.println(WiFi.RSSI());
-    
-    displayMessage("WiFi Connected", WiFi.localIP().toString());
-    delay(2000);
-  } else {
-    networkAvailable = false;
-    Serial.println("WiFi connection failed - running in offline mode");
-    displayMessage("WiFi Failed", "Offline Mode");
-    delay(2000);
-  }
+  WiFi.setAutoReconnect(false);
+  metricsServer.begin();
+  metricsListening = true;
+  // SNTP retries on its own until the link is up, and resyncs hourly
+  configTime(0, 0, ntpServer1, ntpServer2);
+  
+  LinkCache cache;
+  bool cached = linkLoad(&cache);
+  LinkAddress fixed = {staticIP, staticGateway, staticSubnet, staticDns};
+  linkManager.begin(&linkRadio, cached ? &cache : NULL,
+                    (uint32_t)staticIP != 0 ? &fixed : NULL, esp_random(), millis());
+  LOG_INFO("Connecting to WiFi: %s (%s, %s)", ssid, cached ? "cached AP" : "scan",
+           (uint32_t)staticIP != 0 ? "static IP" : cached && cache.leaseValid ? "cached lease" : "DHCP");
 }
 
-void checkWiFiConnection() {
-  if (WiFi.status() == WL_CONNECTED) {
-    if (!networkAvailable) {
+// The network task's side of the link: joins, drops and what follows them
+void linkPoll() {
+  switch (linkManager.tick(millis())) {
+    case LINK_EVENT_UP: {
+      const LinkStats& link = linkManager.stats();
       networkAvailable = true;
-      Serial.println("WiFi reconnected");
-      // Try to sync any pending data
+      stageMetrics.recordUs(STAGE_WIFI_JOIN, link.lastJoinMs * 1000);
+      const char* how = link.lastJoinFast ? "cached AP" : "scan";
+      if (link.outages == 0) {
+        LOG_INFO("WiFi connected in %lu ms (%s), IP address %s, signal %d dBm",
+                 (unsigned long)link.lastJoinMs, how, WiFi.localIP().toString().c_str(), WiFi.RSSI());
+      } else {
+        uint32_t outageMs = link.lastOutageMs;
+        stageMetrics.recordUs(STAGE_WIFI_OUTAGE,
+                              outageMs < UINT32_MAX / 1000 ? outageMs * 1000 : UINT32_MAX);
+        LOG_INFO("WiFi reconnected in %lu ms (%s) after %lu ms offline; %lu outages, %lu ms offline in all",
+                 (unsigned long)link.lastJoinMs, how, (unsigned long)outageMs,
+                 (unsigned long)link.outages, (unsigned long)link.offlineMs);
+      }
+      if (linkManager.cacheDirty()) linkSave();
+      
+      if (!deviceRegistered) {
+        registerDevice();
+        allowlistSync(DEVICE_LOCATION);
+        lastAllowlistSync = millis();
+        deviceRegistered = true;
+      }
+      // Taps journaled while offline go up now rather than at the next sync
       syncAttendanceData();
+      break;
     }
-  } else {
-    if (networkAvailable) {
+    case LINK_EVENT_DOWN:
       networkAvailable = false;
-      Serial.println("WiFi disconnected - switching to offline mode");
-    }
+      LOG_WARN("WiFi disconnected - switching to offline mode");
+      break;
+    default:
+      break;
+  }
+}
+
+bool linkLoad(LinkCache* cache) {
+  SavedLink saved;
+  File file = SPIFFS.open(LINK_CACHE_FILE, "r");
+  if (!file) return false;
+  bool ok = file.read((uint8_t*)&saved, sizeof(saved)) == sizeof(saved) &&
+            saved.magic == LINK_CACHE_MAGIC;
+  file.close();
+  if (!ok) return false;
+  
+  // An estimated clock is a lower bound, so after a power cut the age is
+  // short by however long the door was off; LINK_LEASE_MAX_AGE_MS allows
+  // for that against the usual day-long leases
+  *cache = saved.cache;
+  int64_t nowUnixMs = 0;
+  wallClock.resolve(wallClock.bootId(), millis(), &nowUnixMs);
+  int64_t age = nowUnixMs - saved.leaseUnixMs;
+  if (saved.leaseUnixMs == 0 || nowUnixMs == 0 || age < 0 || age >= LINK_LEASE_MAX_AGE_MS) {
+    cache->leaseValid = 0;
+  } else {
+    cache->leaseAt = millis() - (uint32_t)age;
+  }
+  return true;
+}
+
+void linkSave() {
+  SavedLink saved;
+  memset(&saved, 0, sizeof(saved));
+  saved.magic = LINK_CACHE_MAGIC;
+  saved.cache = linkManager.cache();
+  if (saved.cache.leaseValid) {
+    wallClock.resolve(wallClock.bootId(), saved.cache.leaseAt, &saved.leaseUnixMs);
+  }
+  File file = SPIFFS.open(LINK_CACHE_FILE ".tmp", "w");
+  if (!file) return;
+  bool ok = file.write((const uint8_t*)&saved, sizeof(saved)) == sizeof(saved);
+  file.close();
+  if (ok) {
+    SPIFFS.remove(LINK_CACHE_FILE);
+    ok = SPIFFS.rename(LINK_CACHE_FILE ".tmp", LINK_CACHE_FILE);
   }
+  if (ok) linkManager.cacheSaved();
 }
 
 void registerDevice() {
   if (!networkAvailable) return;
   
-  HTTPClient http;
-  http.setTimeout(5000);
-  http.begin(String(serverURL) + "device/register");
-  http.addHeader("Content-Type", "application/json");
-  
   DynamicJsonDocument doc(512);
   doc["device_id"] = DEVICE_ID;
   doc["device_type"] = "ESP32_RFID_READER";
   doc["location"] = DEVICE_LOCATION;
   doc["firmware_version"] = "1.0.0";
   doc["features"] = "RFID,FINGERPRINT,LCD,BUZZER,RELAY";
+  if (DEVICE_ENROLL_KEY[0] != '\0') doc["enroll_key"] = DEVICE_ENROLL_KEY;
   
   String jsonString;
   serializeJson(doc, jsonString);
   
-  Serial.println("Registering device with server...");
-  int httpResponseCode = http.POST(jsonString);
+  LOG_INFO("Registering device with server...");
+  String response;
+  int httpResponseCode = serverPost("device/register", jsonString, &response, 5000);
   
   if (httpResponseCode == 200) {
-    String response = http.getString();
-    Serial.println("Device registered successfully");
-    Serial.println("Server response: " + response);
+    LOG_INFO("Device registered successfully");
+    
+    // A new key every time; the template endpoints want it
+    DynamicJsonDocument responseDoc(512);
+    const char* key = NULL;
+    if (!deserializeJson(responseDoc, response)) key = responseDoc["device_key"];
+    if (key == NULL || !serverSetDeviceKey(key)) LOG_WARN("Device key not saved");
   } else {
-    Serial.println("Device registration failed: " + String(httpResponseCode));
+    LOG_WARN("Device registration failed: %d", httpResponseCode);
   }
-  
-  http.end();
 }
 
-void handleRFIDCard() {
-  // Clear the UID string
-  currentCardUID = "";
-  
-  // Build UID string from the card
-  for (byte i = 0; i < mfrc522.uid.size; i++) {
-    if (mfrc522.uid.uidByte[i] < 0x10) {
-      currentCardUID += "0";
-    }
-    currentCardUID += String(mfrc522.uid.uidByte[i], HEX);
-  }
-  currentCardUID.toUpperCase();
+void handleRFIDCard(Mfrc522Radio& radio) {
+  MFRC522& mfrc522 = radio.reader;
+  uint8_t uidLen = min((uint8_t)mfrc522.uid.size, (uint8_t)CARD_UID_MAX_LEN);
   
-  Serial.println("RFID Card detected: " + currentCardUID);
-  Serial.println("Card size: " + String(mfrc522.uid.size) + " bytes");
-  
-  // Show card detected message
-  displayMessage("Card Detected", currentCardUID.length() > 12 ? 
-                 currentCardUID.substring(0, 12) + "..." : currentCardUID);
-  
-  // Brief feedback
-  digitalWrite(BUZZER_PIN, HIGH);
-  delay(100);
-  digitalWrite(BUZZER_PIN, LOW);
+  // Halt PICC and stop encryption
+  mfrc522.PICC_HaltA();
+  mfrc522.PCD_StopCrypto1();
   
-  delay(1000);
+  // Prevent the same card from being handled twice in a row, on either reader
+  if (uidLen == lastUidLen && memcmp(mfrc522.uid.uidByte, lastUid, uidLen) == 0 &&
+      millis() - lastCardRead < CARD_READ_DELAY) {
+    return;
+  }
+  memcpy(currentUid, mfrc522.uid.uidByte, uidLen);
+  currentUidLen = uidLen;
+  currentDirection = radio.direction;
+  memcpy(lastUid, currentUid, uidLen);
+  lastUidLen = uidLen;
+  lastCardRead = millis();
+  tapStartedAt = stageMetrics.now();
+  cardUidToHex(currentUid, currentUidLen, currentCardUID, sizeof(currentCardUID));
+  
+  LOG_INFO("RFID Card detected: %s (%u bytes, %s)", currentCardUID, uidLen,
+           journalActionName(currentDirection));
+  
+  // Show card detected message and beep while the card is looked up
+  accessFlow.cardDetected(currentCardUID, millis());
+  
+  // Check if card is registered; the fingerprint stage runs from the task loop
+  if (checkLocalCard(currentUid, currentUidLen)) {
+    cardVerdict(true);
+    return;
+  }
   
-  // Check if card is registered
-  if (isCardRegistered(currentCardUID)) {
-    displayMessage("Card Valid", "Scan Fingerprint");
-    digitalWrite(GREEN_LED, HIGH);
-    delay(500);
-    digitalWrite(GREEN_LED, LOW);
-    
-    if (handleFingerprintVerification()) {
-      grantAccess();
-    } else {
-      denyAccess("Fingerprint Failed");
+  // If online, ask the server; the finger is captured while we wait.
+  // Cards it has just turned down, or asked about too often, aren't sent.
+  if (networkAvailable && WiFi.status() == WL_CONNECTED) {
+    uint8_t decision = rejectCache.check(currentUid, currentUidLen, millis());
+    if (decision == REJECT_CACHED) {
+      LOG_INFO("Card rejected by the server recently, not asking again");
+      cardVerdict(false);
+      return;
+    }
+    if (decision == REJECT_LIMITED) {
+      LOG_WARN("Card checked too often, not asking the server");
+      accessFlow.deny("Try Again Later", millis());
+      denyAccess("Too many server checks for card");
+      return;
+    }
+    LOG_DEBUG("Checking card on server...");
+    if (requestServerVerify(currentUid, currentUidLen)) {
+      accessFlow.cardPending(millis());
+      return;
     }
   } else {
+    LOG_INFO("Card not found and system offline");
+  }
+  cardVerdict(false);
+}
+
+// Hand the lookup result for currentCardUID to the access flow
+void cardVerdict(bool registered) {
+  if (!registered) {
+    accessFlow.deny("Invalid Card", millis());
     denyAccess("Invalid Card");
+  } else if (currentCard.fingerSlot == CARD_FINGER_NONE) {
+    accessFlow.deny("No Fingerprint", millis());
+    denyAccess("No fingerprint enrolled for card");
+  } else {
+    requestTemplate(currentCard.fingerSlot);
+    accessFlow.cardAccepted(currentCard.fingerSlot, millis());
   }
-  
-  // Halt PICC and stop encryption
-  mfrc522.PICC_HaltA();
-  mfrc522.PCD_StopCrypto1();
 }
 
-bool isCardRegistered(String cardUID) {
-  Serial.println("Checking card registration for: " + cardUID);
-  
-  // First check local cache
-  if (checkLocalCard(cardUID)) {
-    Serial.println("Card found in local cache");
+// Have the network task load the card owner's template if the sensor
+// doesn't hold it, while the finger is being captured
+void requestTemplate(uint16_t libSlot) {
+  NetRequest request;
+  memset(&request, 0, sizeof(request));
+  request.type = NET_REQUEST_TEMPLATE;
+  request.fingerSlot = libSlot;
+  netQueue.sendToFront(request, 0);
+}
+
+bool checkLocalCard(const uint8_t* uid, uint8_t uidLen) {
+  // Binary search of the sorted index; fills name, user ID and role at once
+  StageStamp start = stageMetrics.now();
+  bool found = cardStoreLookup(uid, uidLen, &currentCard);
+  stageMetrics.record(STAGE_CARD_LOOKUP, start);
+  if (found) {
+    LOG_DEBUG("Card found in local cache: %s (%s)", currentCard.name, cardRoleName(currentCard.role));
     return true;
   }
+  return false;
+}
+
+// Ask the network task to verify a card; pollServerVerify() picks up the
+// answer. Runs on the RFID task; the request jumps ahead of queued
+// journal writes.
+bool requestServerVerify(const uint8_t* uid, uint8_t uidLen) {
+  NetRequest request;
+  memset(&request, 0, sizeof(request));
+  request.type = NET_REQUEST_VERIFY;
+  memcpy(request.uid, uid, uidLen);
+  request.uidLen = uidLen;
+  
+  // Discard any late answer to an earlier request that timed out
+  VerifyReply reply;
+  verifyReplyQueue.receive(&reply, 0);
+  
+  if (!netQueue.sendToFront(request, 0)) {
+    LOG_WARN("Network queue full - cannot verify card");
+    return false;
+  }
   
-  // If online, check server database
-  if (networkAvailable && WiFi.status() == WL_CONNECTED) {
-    Serial.println("Checking card on server...");
-    return checkServerCard(cardUID);
+  pendingVerify = request;
+  verifyPending = true;
+  verifyStartedAt = millis();
+  verifyStamp = stageMetrics.now();
+  return true;
+}
+
+// Deliver the server's answer for the pending card, or give up after
+// VERIFY_TIMEOUT_MS. Never blocks: the access flow keeps capturing the
+// finger in the meantime.
+void pollServerVerify() {
+  if (!verifyPending) return;
+  
+  VerifyReply reply;
+  while (verifyReplyQueue.receive(&reply, 0)) {
+    if (reply.uidLen == pendingVerify.uidLen &&
+        memcmp(reply.uid, pendingVerify.uid, pendingVerify.uidLen) == 0) {
+      verifyPending = false;
+      stageMetrics.record(STAGE_SERVER_VERIFY, verifyStamp);
+      LOG_DEBUG("Server verdict after %lu ms%s", millis() - verifyStartedAt,
+                accessFlow.fingerCaptured() ? ", finger already captured" : "");
+      if (reply.valid) {
+        currentCard = reply.card;
+        rejectCache.accepted(reply.uid, reply.uidLen);
+      } else if (reply.rejected) {
+        rejectCache.rejected(reply.uid, reply.uidLen, millis());
+      }
+      cardVerdict(reply.valid);
+      return;
+    }
   }
   
-  Serial.println("Card not found and system offline");
-  return false;
+  if (millis() - verifyStartedAt >= VERIFY_TIMEOUT_MS) {
+    verifyPending = false;
+    LOG_WARN("Server verification timed out");
+    accessFlow.deny("Server Timeout", millis());
+    denyAccess("Server verification timed out");
+  }
+}
+
+// Network task side of requestServerVerify()
+void answerVerifyRequest(const NetRequest& request) {
+  VerifyReply reply;
+  memset(&reply, 0, sizeof(reply));
+  memcpy(reply.uid, request.uid, request.uidLen);
+  reply.uidLen = request.uidLen;
+  
+  char cardUID[2 * CARD_UID_MAX_LEN + 1];
+  cardUidToHex(request.uid, request.uidLen, cardUID, sizeof(cardUID));
+  if (networkAvailable && WiFi.status() == WL_CONNECTED) {
+    StageStamp start = stageMetrics.now();
+    reply.valid = checkServerCard(cardUID, &reply.card, &reply.rejected);
+    stageMetrics.record(STAGE_HTTP_VERIFY, start);
+  }
+  verifyReplyQueue.overwrite(reply);
 }
 
-bool checkLocalCard(String cardUID) {
-  if (!SPIFFS.exists("/cards.txt")) {
-    Serial.println("Local cards file not found");
+// A binary request got a reply that isn't binary. A 4xx means the server
+// predates the format, so fall back to JSON; anything else (a proxy error
+// page, say) is just a failed request. Returns true on fallback.
+bool wireFallback(int httpResponseCode) {
+  if (httpResponseCode < 400 || httpResponseCode >= 500) {
+    LOG_WARN("Unreadable server reply: HTTP %d", httpResponseCode);
     return false;
   }
+  LOG_WARN("Server did not answer in binary (HTTP %d) - using JSON", httpResponseCode);
+  wireBinary = false;
+  return true;
+}
+
+// Binary verify-rfid. Returns false if the server doesn't speak the format
+// and the request should go again as JSON, otherwise sets valid.
+bool checkServerCardBinary(const uint8_t* uid, uint8_t uidLen, CardRecord* card, bool* valid,
+                           bool* rejected) {
+  uint8_t request[WIRE_HEADER_SIZE + 1 + CARD_UID_MAX_LEN];
+  uint8_t reply[WIRE_REPLY_MAX_BYTES];
+  size_t len = wireEncodeVerifyRequest(uid, uidLen, request, sizeof(request));
+  size_t received = 0;
+  
+  int httpResponseCode = serverPostBinary("verify-rfid", WIRE_CONTENT_TYPE, request, len,
+                                          reply, sizeof(reply), &received,
+                                          VERIFY_HTTP_TIMEOUT_MS);
+  *valid = false;
+  *rejected = false;
+  if (httpResponseCode <= 0) {
+    LOG_WARN("HTTP request failed: %d", httpResponseCode);
+    return true;
+  }
   
-  File file = SPIFFS.open("/cards.txt", "r");
-  if (!file) {
-    Serial.println("Failed to open local cards file");
-    return false;
+  WireVerifyReply verify;
+  if (!wireDecodeVerifyReply(reply, received, &verify)) {
+    return !wireFallback(httpResponseCode);
   }
+  LOG_DEBUG("Server response code: %d (%u/%u bytes)", httpResponseCode, (unsigned)len,
+            (unsigned)received);
   
-  while (file.available()) {
-    String line = file.readStringUntil('\n');
-    line.trim();
-    if (line.indexOf(cardUID) == 0) { // Card UID should be at start of line
-      Serial.println("Card found in local cache: " + line);
-      file.close();
-      return true;
-    }
+  if (httpResponseCode != 200 || verify.status != WIRE_STATUS_OK) {
+    *rejected = verify.status == WIRE_STATUS_NOT_FOUND;
+    return true;
   }
-  file.close();
-  return false;
+  *valid = true;
+  if (cardRecordSet(card, uid, uidLen, verify.name, verify.userId, verify.role)) {
+    card->fingerSlot = verify.fingerSlot;
+    cardStoreSave(*card);
+    LOG_DEBUG("User info cached locally: %s", verify.name);
+  }
+  return true;
 }
 
-bool checkServerCard(String cardUID) {
-  HTTPClient http;
-  http.setTimeout(10000); // 10 second timeout for server requests
-  http.begin(String(serverURL) + "verify-rfid");
-  http.addHeader("Content-Type", "application/json");
+bool checkServerCard(String cardUID, CardRecord* card, bool* rejected) {
+  *rejected = false;
+  if (wireBinary) {
+    uint8_t uid[CARD_UID_MAX_LEN];
+    uint8_t uidLen = 0;
+    bool valid = false;
+    if (cardUidFromHex(cardUID.c_str(), uid, &uidLen) &&
+        checkServerCardBinary(uid, uidLen, card, &valid, rejected)) {
+      return valid;
+    }
+  }
   
   DynamicJsonDocument doc(512);
   doc["rfid_uid"] = cardUID;
@@ -433,328 +1170,518 @@ bool checkServerCard(String cardUID) {
   String jsonString;
   serializeJson(doc, jsonString);
   
-  Serial.println("Sending RFID verification request: " + jsonString);
+  LOG_DEBUG("Sending RFID verification request: %s", jsonString.c_str());
   
-  int httpResponseCode = http.POST(jsonString);
-  Serial.println("Server response code: " + String(httpResponseCode));
+  String response;
+  int httpResponseCode = serverPost("verify-rfid", jsonString, &response, VERIFY_HTTP_TIMEOUT_MS);
+  LOG_DEBUG("Server response code: %d", httpResponseCode);
   
   if (httpResponseCode == 200) {
-    String response = http.getString();
-    Serial.println("Server response: " + response);
+    LOG_DEBUG("Server response: %s", response.c_str());
     
     DynamicJsonDocument responseDoc(1024);
-    deserializeJson(responseDoc, response);
+    DeserializationError error = deserializeJson(responseDoc, response);
     
     bool isValid = responseDoc["success"];
+    *rejected = !error && !responseDoc["success"].isNull() && !isValid;
     if (isValid) {
       // Cache user info locally
       String userName = responseDoc["student_name"].as<String>();
       String userID = responseDoc["user_id"].as<String>();
       String role = responseDoc["role"].as<String>();
       
-      String userInfo = cardUID + "," + userName + "," + userID + "," + role + "\n";
-      appendToFile("/cards.txt", userInfo);
-      Serial.println("User info cached locally: " + userName);
+      uint8_t uid[CARD_UID_MAX_LEN];
+      uint8_t uidLen = 0;
+      if (cardUidFromHex(cardUID.c_str(), uid, &uidLen) &&
+          cardRecordSet(card, uid, uidLen, userName.c_str(), userID.c_str(),
+                        cardRoleFromString(role.c_str()))) {
+        card->fingerSlot = responseDoc["fingerprint_slot"] | 0;
+        cardStoreSave(*card);
+        LOG_DEBUG("User info cached locally: %s", userName.c_str());
+      }
     }
     
-    http.end();
     return isValid;
+  } else if (httpResponseCode == 404) {
+    // The card isn't registered, as long as it's the API saying so
+    DynamicJsonDocument responseDoc(256);
+    *rejected = !deserializeJson(responseDoc, response) && !responseDoc["success"].isNull() &&
+                !responseDoc["success"].as<bool>();
+    LOG_DEBUG("Server response: %s", response.c_str());
   } else if (httpResponseCode > 0) {
-    String response = http.getString();
-    Serial.println("Server error response: " + response);
+    LOG_WARN("Server error response: %s", response.c_str());
   } else {
-    Serial.println("HTTP request failed: " + String(httpResponseCode));
+    LOG_WARN("HTTP request failed: %d", httpResponseCode);
   }
   
-  http.end();
   return false;
 }
 
-bool handleFingerprintVerification() {
-  int attempts = 0;
-  const int maxAttempts = 3;
-  
-  while (attempts < maxAttempts) {
-    displayMessage("Place Finger", "Try " + String(attempts + 1) + "/" + String(maxAttempts));
-    
-    // Brief beep to indicate ready
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(100);
-    digitalWrite(BUZZER_PIN, LOW);
-    
-    // Wait for finger placement
-    unsigned long startTime = millis();
-    while (millis() - startTime < 5000) { // 5 second timeout
-      int fingerprintID = getFingerprintID();
-      if (fingerprintID >= 0) {
-        Serial.println("Fingerprint verified: ID " + String(fingerprintID));
-        currentFingerprintID = fingerprintID;
-        displayMessage("Finger OK", "ID: " + String(fingerprintID));
-        delay(1000);
-        return true;
-      }
-      delay(100);
-    }
-    
-    attempts++;
-    if (attempts < maxAttempts) {
-      displayMessage("Try Again", "Place finger");
-      delay(1500);
-    }
+// R307 Match command: compare CharBuffer1 with CharBuffer2
+#define R307_CMD_MATCH 0x03
+
+uint8_t fingerMatch(uint16_t* score) {
+  uint8_t data[] = {R307_CMD_MATCH};
+  Adafruit_Fingerprint_Packet packet(FINGERPRINT_COMMANDPACKET, sizeof(data), data);
+  finger.writeStructuredPacket(packet);
+  if (finger.getStructuredPacket(&packet) != FINGERPRINT_OK || packet.type != FINGERPRINT_ACKPACKET) {
+    return FINGERPRINT_PACKETRECIEVEERR;
+  }
+  *score = ((uint16_t)packet.data[1] << 8) | packet.data[2];
+  return packet.data[0];
+}
+
+// R307 DownChar command: receive a template into a character buffer
+#define R307_CMD_DOWNCHAR 0x09
+#define R307_DATA_CHUNK   64  // FINGERPRINT_PACKET_SIZE_64, set in setup()
+
+// Send a template to the sensor's character buffer; Store follows
+bool fingerDownChar(uint8_t buffer, const uint8_t* data, size_t len) {
+  uint8_t cmd[] = {R307_CMD_DOWNCHAR, buffer};
+  Adafruit_Fingerprint_Packet packet(FINGERPRINT_COMMANDPACKET, sizeof(cmd), cmd);
+  finger.writeStructuredPacket(packet);
+  if (finger.getStructuredPacket(&packet) != FINGERPRINT_OK ||
+      packet.type != FINGERPRINT_ACKPACKET || packet.data[0] != FINGERPRINT_OK) {
+    return false;
   }
   
-  Serial.println("Fingerprint verification failed after " + String(maxAttempts) + " attempts");
-  return false;
+  for (size_t offset = 0; offset < len; offset += R307_DATA_CHUNK) {
+    size_t chunk = len - offset < R307_DATA_CHUNK ? len - offset : R307_DATA_CHUNK;
+    uint8_t type = offset + chunk >= len ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET;
+    Adafruit_Fingerprint_Packet dataPacket(type, chunk, (uint8_t*)data + offset);
+    finger.writeStructuredPacket(dataPacket);
+  }
+  return true;
 }
 
-int getFingerprintID() {
-  uint8_t p = finger.getImage();
-  if (p != FINGERPRINT_OK) return -1;
+// Capture a finger and extract its features into buffer 2, where they
+// stay until the next capture. Runs before the card's slot may be known.
+bool captureFingerprint() {
+  if (!fingerReady) return false;
+  TaskLock lock(templateSensorLock());
+  if (finger.getImage() != FINGERPRINT_OK) return false;
+  return finger.image2Tz(2) == FINGERPRINT_OK;
+}
 
-  p = finger.image2Tz();
-  if (p != FINGERPRINT_OK) return -1;
+// Compare the captured features with the card owner's template only, so
+// just their finger opens the door and the cost doesn't grow with the
+// library. The template sync maps the library slot to the sensor slot
+// holding it; loadModel() fills buffer 1. Returns 1 on a match, 0 on a
+// mismatch, -1 while the template is still being loaded.
+int matchCapturedFingerprint(uint16_t libSlot) {
+  TaskLock lock(templateSensorLock());
+  int32_t slot = templateSensorSlot(libSlot);
+  if (slot < 0) {
+    // requestTemplate() is loading it; the flow retries with the same features
+    return -1;
+  }
+  
+  uint8_t p = finger.loadModel(slot);
+  if (p != FINGERPRINT_OK) {
+    LOG_WARN("Failed to load fingerprint slot %ld: %u", (long)slot, p);
+    return 0;
+  }
 
-  p = finger.fingerSearch();
+  uint16_t score = 0;
+  p = fingerMatch(&score);
   if (p == FINGERPRINT_OK) {
-    Serial.println("Fingerprint match found! ID: " + String(finger.fingerID) + 
-                  ", Confidence: " + String(finger.confidence));
-    return finger.fingerID;
-  } else if (p == FINGERPRINT_NOTFOUND) {
-    Serial.println("No fingerprint match found");
-    return -1;
+    LOG_DEBUG("Fingerprint matches template %u, score %u", libSlot, score);
+    templateUsed(libSlot);
+    return 1;
+  } else if (p == FINGERPRINT_NOMATCH) {
+    LOG_INFO("Fingerprint does not match the card owner");
   } else {
-    Serial.println("Fingerprint search error: " + String(p));
-    return -1;
+    LOG_WARN("Fingerprint match error: %u", p);
   }
+  return 0;
 }
 
+// Called once the access flow has opened the door
 void grantAccess() {
-  String userName = getUserName(currentCardUID);
-  displayMessage("Access Granted", "Welcome!");
-  
-  Serial.println("ACCESS GRANTED");
-  Serial.println("User: " + userName);
-  Serial.println("Card: " + currentCardUID);
-  Serial.println("Fingerprint ID: " + String(currentFingerprintID));
+  const char* userName = getUserName();
+  currentFingerprintID = accessFlow.fingerSlot();
   
-  // Visual and audio feedback
-  digitalWrite(GREEN_LED, HIGH);
-  for (int i = 0; i < 3; i++) {
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(200);
-    digitalWrite(BUZZER_PIN, LOW);
-    delay(100);
-  }
-  
-  // Open door lock
-  digitalWrite(RELAY_PIN, HIGH);
-  displayMessage("Door Unlocked", "Enter now");
-  delay(3000); // Keep door open for 3 seconds
-  digitalWrite(RELAY_PIN, LOW);
-  
-  digitalWrite(GREEN_LED, LOW);
+  LOG_INFO("ACCESS GRANTED: %s, card %s, fingerprint slot %d", userName, currentCardUID,
+           currentFingerprintID);
+  uint32_t unlockUs = stageMetrics.record(STAGE_TAP_TO_UNLOCK, tapStartedAt);
+  LOG_DEBUG("Tap to unlock: %lu ms", (unsigned long)(unlockUs / 1000));
   
   // Log attendance
-  logAttendance(currentCardUID, userName);
-  
-  displayMessage("Access Complete", "Door locked");
-  delay(2000);
-  displayMessage("System Ready", "Present Card");
+  logAttendance(currentUid, currentUidLen, currentDirection, userName);
 }
 
-void denyAccess(String reason) {
-  displayMessage("Access Denied", reason);
-  
-  Serial.println("ACCESS DENIED: " + reason);
-  Serial.println("Card: " + currentCardUID);
-  
-  // Visual and audio feedback
-  for (int i = 0; i < 5; i++) {
-    digitalWrite(RED_LED, HIGH);
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(100);
-    digitalWrite(RED_LED, LOW);
-    digitalWrite(BUZZER_PIN, LOW);
-    delay(100);
-  }
-  
-  delay(2000);
-  displayMessage("System Ready", "Present Card");
+// Called once the access flow has started the denial feedback
+void denyAccess(const char* reason) {
+  LOG_INFO("ACCESS DENIED: %s, card %s", reason, currentCardUID);
 }
 
-String getUserName(String cardUID) {
-  if (!SPIFFS.exists("/cards.txt")) {
-    return "Unknown User";
+const char* getUserName() {
+  // currentCard was filled by checkLocalCard()/checkServerCard() for this tap
+  if (cardRecordCompare(currentUid, currentUidLen, currentCard) == 0) {
+    return currentCard.name;
   }
   
-  File file = SPIFFS.open("/cards.txt", "r");
-  if (file) {
-    while (file.available()) {
-      String line = file.readStringUntil('\n');
-      line.trim();
-      if (line.indexOf(cardUID) == 0) {
-        int firstComma = line.indexOf(',');
-        int secondComma = line.indexOf(',', firstComma + 1);
-        if (firstComma != -1 && secondComma != -1) {
-          String name = line.substring(firstComma + 1, secondComma);
-          file.close();
-          return name;
-        }
-      }
-    }
-    file.close();
+  static CardRecord rec;
+  if (cardStoreLookup(currentUid, currentUidLen, &rec)) {
+    return rec.name;
   }
   return "Unknown User";
 }
 
-void logAttendance(String cardUID, String userName) {
-  // Create timestamp (milliseconds since boot - in production use RTC)
-  unsigned long currentTime = millis();
-  String timestamp = String(currentTime);
-  
-  String logEntry = timestamp + "," + cardUID + "," + userName + ",ENTRY," + DEVICE_ID + "\n";
-  
-  // Log to local storage
-  appendToFile("/attendance.txt", logEntry);
-  Serial.println("Attendance logged locally: " + userName);
+// Hand a granted tap to the network task. Runs on the RFID task.
+void logAttendance(const uint8_t* uid, uint8_t uidLen, uint8_t action, const char* userName) {
+  NetRequest request;
+  memset(&request, 0, sizeof(request));
+  request.type = NET_REQUEST_TAP;
+  memcpy(request.uid, uid, uidLen);
+  request.uidLen = uidLen;
+  request.action = action;
+  request.timestamp = millis(); // Time of the tap, not of the journal write
+  strncpy(request.name, userName, sizeof(request.name) - 1);
+  request.nameShortened = cardRecordCompare(uid, uidLen, currentCard) == 0 &&
+                          (currentCard.flags & CARD_FLAG_SHORTENED);
+  
+  if (!netQueue.send(request, TAP_QUEUE_WAIT_MS)) {
+    LOG_ERROR("Network queue full - attendance for %s not recorded", userName);
+  }
+}
+
+// Network task side of logAttendance(): journal the tap, then upload it
+void journalTap(const NetRequest& request) {
+  // Single append to the journal. The tap keeps its uptime and boot id;
+  // it gets its wall-clock time when uploaded, once SNTP has answered.
+  JournalRecord rec;
+  StageStamp start = stageMetrics.now();
+  const char* name = request.name;
+  // The RFID task only had the cache's cut copy; the journal gets the full name
+  CardRecord full;
+  if (request.nameShortened && cardStoreLookupFull(request.uid, request.uidLen, &full)) {
+    name = full.name;
+  }
+  if (!journalAppend(request.uid, request.uidLen, name, request.action,
+                     wallClock.bootId(), request.timestamp, &rec)) {
+    LOG_ERROR("Failed to journal attendance for %s", name);
+    return;
+  }
+  stageMetrics.record(STAGE_JOURNAL_APPEND, start);
+  LOG_INFO("Attendance logged locally: %s (seq %lu)", name, (unsigned long)rec.seq);
   
-  // If online, send to server immediately
+  // If online, push it (and any small backlog ahead of it) right away
   if (networkAvailable && WiFi.status() == WL_CONNECTED) {
-    sendAttendanceToServer(timestamp, cardUID, userName, "ENTRY");
+    uploadJournal(JOURNAL_TAP_UPLOAD_MAX);
   } else {
-    Serial.println("Offline - attendance will be synced when online");
+    LOG_DEBUG("Offline - attendance will be synced when online");
   }
 }
 
-void sendAttendanceToServer(String timestamp, String cardUID, String userName, String action) {
-  HTTPClient http;
-  http.setTimeout(10000);
-  http.begin(String(serverURL) + "log-attendance");
-  http.addHeader("Content-Type", "application/json");
+// Upload journal records as one batch. Device fields go once per request
+// and records are packed until the body would exceed JOURNAL_BATCH_MAX_BYTES.
+// On success, packed is the number of records sent and ackedSeq the highest
+// sequence number the server accepted.
+bool sendAttendanceBatch(const JournalRecord* recs, size_t count, size_t* packed, uint32_t* ackedSeq) {
+  if (wireBinary) {
+    bool ok = false;
+    if (sendAttendanceBatchBinary(recs, count, packed, ackedSeq, &ok)) {
+      return ok;
+    }
+  }
   
-  DynamicJsonDocument doc(512);
-  doc["student_name"] = userName;
-  doc["rfid_uid"] = cardUID;
-  doc["timestamp"] = timestamp;
+  DynamicJsonDocument doc(JOURNAL_BATCH_DOC_SIZE);
   doc["device_id"] = DEVICE_ID;
-  doc["action"] = action;
   doc["location"] = DEVICE_LOCATION;
+  JsonArray events = doc.createNestedArray("events");
+  
+  *packed = 0;
+  for (size_t i = 0; i < count; i++) {
+    char cardUID[2 * CARD_UID_MAX_LEN + 1];
+    cardUidToHex(recs[i].uid, recs[i].uidLen, cardUID, sizeof(cardUID));
+    
+    // Unix ms as a string, left out when only the uptime is known
+    int64_t unixMs;
+    uint8_t clock = wallClock.resolve(recs[i].bootId, recs[i].timestamp, &unixMs);
+    char timestamp[21];
+    snprintf(timestamp, sizeof(timestamp), "%lld", (long long)unixMs);
+    
+    JsonObject event = events.createNestedObject();
+    event["seq"] = recs[i].seq;
+    event["boot_id"] = recs[i].bootId;
+    event["rfid_uid"] = cardUID;
+    event["student_name"] = recs[i].name;
+    if (clock != WALL_CLOCK_UNKNOWN) {
+      event["timestamp"] = timestamp;
+    }
+    event["clock"] = wallClockSourceName(clock);
+    event["action"] = journalActionName(recs[i].action);
+    
+    if (doc.overflowed() || (*packed > 0 && measureJson(doc) > JOURNAL_BATCH_MAX_BYTES)) {
+      events.remove(i);
+      break;
+    }
+    (*packed)++;
+  }
+  if (*packed == 0) {
+    return false;
+  }
   
   String jsonString;
   serializeJson(doc, jsonString);
   
-  Serial.println("Sending attendance to server: " + jsonString);
+  LOG_DEBUG("Sending %u attendance records (%u bytes)", (unsigned)*packed,
+            (unsigned)jsonString.length());
   
-  int httpResponseCode = http.POST(jsonString);
+  String response;
+  int httpResponseCode = serverPost("log-attendance/batch", jsonString, &response, 10000);
+  bool ok = false;
   if (httpResponseCode == 200) {
-    String response = http.getString();
-    Serial.println("Attendance sent successfully: " + response);
+    StaticJsonDocument<64> filter;
+    filter["success"] = true;
+    filter["acked_seq"] = true;
+    
+    DynamicJsonDocument responseDoc(256);
+    deserializeJson(responseDoc, response, DeserializationOption::Filter(filter));
+    ok = responseDoc["success"];
+    // Older servers may omit acked_seq; everything sent counts as accepted
+    *ackedSeq = responseDoc["acked_seq"] | recs[*packed - 1].seq;
+    LOG_DEBUG("Attendance batch accepted up to seq %lu", (unsigned long)*ackedSeq);
   } else {
-    Serial.println("Failed to send attendance: " + String(httpResponseCode));
+    LOG_WARN("Failed to send attendance batch: %d", httpResponseCode);
     if (httpResponseCode > 0) {
-      Serial.println("Server response: " + http.getString());
+      LOG_DEBUG("Server response: %s", response.c_str());
     }
   }
   
-  http.end();
+  return ok;
 }
 
-void syncAttendanceData() {
-  if (!SPIFFS.exists("/attendance.txt")) {
-    return;
+// Binary log-attendance/batch. The name stays on the device: the server
+// looks the card up anyway. Returns false if the server doesn't speak the
+// format and the batch should go again as JSON, otherwise sets ok.
+bool sendAttendanceBatchBinary(const JournalRecord* recs, size_t count, size_t* packed,
+                               uint32_t* ackedSeq, bool* ok) {
+  static uint8_t body[WIRE_BATCH_MAX_BYTES];
+  uint8_t reply[WIRE_REPLY_MAX_BYTES];
+  
+  *ok = false;
+  *packed = 0;
+  WireBatch batch;
+  if (!wireBatchBegin(&batch, body, sizeof(body), DEVICE_ID.c_str(), DEVICE_LOCATION.c_str())) {
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    WireEvent event;
+    event.seq = recs[i].seq;
+    event.bootId = recs[i].bootId;
+    event.clock = wallClock.resolve(recs[i].bootId, recs[i].timestamp, &event.time);
+    event.action = recs[i].action;
+    event.uidLen = recs[i].uidLen;
+    memcpy(event.uid, recs[i].uid, sizeof(event.uid));
+    if (!wireBatchAdd(&batch, event)) break;
+    (*packed)++;
+  }
+  size_t len = wireBatchEnd(&batch);
+  if (len == 0) {
+    return false;
   }
   
-  Serial.println("Syncing offline attendance data...");
+  LOG_DEBUG("Sending %u attendance records (%u bytes, binary)", (unsigned)*packed, (unsigned)len);
   
-  File file = SPIFFS.open("/attendance.txt", "r");
-  if (!file) {
-    Serial.println("Failed to open attendance file for sync");
-    return;
+  size_t received = 0;
+  int httpResponseCode = serverPostBinary("log-attendance/batch", WIRE_CONTENT_TYPE, body, len,
+                                          reply, sizeof(reply), &received, 10000);
+  if (httpResponseCode <= 0) {
+    LOG_WARN("Failed to send attendance batch: %d", httpResponseCode);
+    return true;
   }
   
-  int recordCount = 0;
-  int syncedCount = 0;
-  
-  while (file.available()) {
-    String line = file.readStringUntil('\n');
-    line.trim();
+  WireAttendanceReply result;
+  if (!wireDecodeAttendanceReply(reply, received, &result)) {
+    return !wireFallback(httpResponseCode);
+  }
+  if (httpResponseCode == 200 && result.status == WIRE_STATUS_OK) {
+    *ackedSeq = result.ackedSeq;
+    *ok = true;
+    LOG_DEBUG("Attendance batch accepted up to seq %lu", (unsigned long)*ackedSeq);
+  } else {
+    LOG_WARN("Failed to send attendance batch: %d (status %u)", httpResponseCode, result.status);
+  }
+  return true;
+}
+
+// Send unacknowledged journal records in sequence order, batched, advancing
+// the cursor as the server accepts them. Stops at the first failure so the
+// cursor never skips a record. Returns the number of records sent.
+uint32_t uploadJournal(uint32_t maxRecords) {
+  static JournalRecord batch[JOURNAL_BATCH_MAX_RECORDS];
+  uint32_t sent = 0;
+  
+  while (sent < maxRecords) {
+    // Queued taps and verifications go first; the rest waits for the next sync
+    if (sent > 0 && netQueue.waiting() > 0) break;
     
-    if (line.length() > 0) {
-      recordCount++;
-      
-      // Parse the line: timestamp,cardUID,userName,action,deviceId
-      int firstComma = line.indexOf(',');
-      int secondComma = line.indexOf(',', firstComma + 1);
-      int thirdComma = line.indexOf(',', secondComma + 1);
-      int fourthComma = line.indexOf(',', thirdComma + 1);
-      
-      if (firstComma != -1 && secondComma != -1 && thirdComma != -1) {
-        String timestamp = line.substring(0, firstComma);
-        String cardUID = line.substring(firstComma + 1, secondComma);
-        String userName = line.substring(secondComma + 1, thirdComma);
-        String action = line.substring(thirdComma + 1, fourthComma);
-        
-        // Try to send to server
-        HTTPClient http;
-        http.setTimeout(5000);
-        http.begin(String(serverURL) + "log-attendance");
-        http.addHeader("Content-Type", "application/json");
-        
-        DynamicJsonDocument doc(512);
-        doc["student_name"] = userName;
-        doc["rfid_uid"] = cardUID;
-        doc["timestamp"] = timestamp;
-        doc["device_id"] = DEVICE_ID;
-        doc["action"] = action;
-        doc["location"] = DEVICE_LOCATION;
-        doc["synced"] = true;
-        
-        String jsonString;
-        serializeJson(doc, jsonString);
-        
-        int httpResponseCode = http.POST(jsonString);
-        if (httpResponseCode == 200) {
-          syncedCount++;
-        }
-        
-        http.end();
-        delay(100); // Small delay between requests
-      }
-    }
+    size_t want = min((size_t)(maxRecords - sent), (size_t)JOURNAL_BATCH_MAX_RECORDS);
+    size_t count = journalRead(journalAckedSeq() + 1, batch, want);
+    if (count == 0) break;
+    
+    size_t packed = 0;
+    uint32_t ackedSeq = 0;
+    StageStamp start = stageMetrics.now();
+    if (!sendAttendanceBatch(batch, count, &packed, &ackedSeq) || packed == 0) break;
+    stageMetrics.record(STAGE_HTTP_UPLOAD, start);
+    
+    journalAck(min(ackedSeq, batch[packed - 1].seq));
+    sent += packed;
   }
-  file.close();
-  
-  Serial.println("Sync complete: " + String(syncedCount) + "/" + String(recordCount) + " records synced");
-  
-  // In production, you might want to mark synced records or clear them
+  return sent;
 }
 
-void displayMessage(String line1, String line2) {
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  if (line1.length() > 16) {
-    lcd.print(line1.substring(0, 16));
-  } else {
-    lcd.print(line1);
+void syncAttendanceData() {
+  uint32_t pending = journalPending();
+  if (pending == 0) {
+    return;
   }
   
-  if (line2.length() > 0) {
-    lcd.setCursor(0, 1);
-    if (line2.length() > 16) {
-      lcd.print(line2.substring(0, 16));
-    } else {
-      lcd.print(line2);
+  LOG_INFO("Syncing offline attendance data...");
+  uint32_t syncedCount = uploadJournal(pending);
+  LOG_INFO("Sync complete: %lu/%lu records synced, acked up to seq %lu",
+           (unsigned long)syncedCount, (unsigned long)pending, (unsigned long)journalAckedSeq());
+  
+  const ServerClientStats& stats = serverClientStats();
+  LOG_INFO("HTTP: %lu requests over %lu connections, %lu retries", (unsigned long)stats.requests,
+           (unsigned long)stats.connectionsOpened, (unsigned long)stats.retries);
+  for (uint8_t i = 0; i < readerMux.count(); i++) {
+    const CardDetectStats& detect = readerMux.stats(i);
+    LOG_INFO("Card detect (%s, %s): %lu cards, %lu IRQs (%lu spurious), %lu polls, %lu arms",
+             journalActionName(readerMux.direction(i)), CardDetector::modeName(readerMux.mode()),
+             (unsigned long)detect.detected, (unsigned long)detect.irqs,
+             (unsigned long)detect.spuriousIrqs, (unsigned long)detect.polls,
+             (unsigned long)detect.arms);
+  }
+  LOG_INFO("Network queue: high water %u/%u, %lu dropped", (unsigned)netQueue.highWater(),
+           (unsigned)netQueue.depth(), (unsigned long)netQueue.dropped());
+  const LcdShadowStats& screen = lcdShadow.stats();
+  LOG_INFO("LCD: %lu updates (%lu unchanged), %lu cells, %lu cursor moves, %lu clears",
+           (unsigned long)screen.updates, (unsigned long)screen.unchanged,
+           (unsigned long)screen.cellsWritten, (unsigned long)screen.cursorMoves,
+           (unsigned long)screen.clears);
+  int64_t now;
+  LOG_INFO("Clock: boot %lu, %s, %lld ms", (unsigned long)wallClock.bootId(),
+           wallClockSourceName(wallClock.resolve(wallClock.bootId(), millis(), &now)),
+           (long long)now);
+  LogStats logs = logRing.stats();
+  LOG_INFO("Log: %lu lines, %lu dropped, %lu truncated", (unsigned long)logs.written,
+           (unsigned long)logs.dropped, (unsigned long)logs.truncated);
+}
+
+// Gauges read from other tasks' state; each is a single word, so a
+// scrape never waits on a lock the tap path holds
+void collectGauges(MetricsGauges* gauges) {
+  const CardStoreStats& lookups = cardStoreStats();
+  gauges->uptimeMs = millis();
+  gauges->cacheHits = lookups.cacheHits;
+  gauges->indexHits = lookups.indexHits;
+  gauges->lookupMisses = lookups.misses;
+  gauges->rejectsCached = rejectCache.stats().cached;
+  gauges->rejectsLimited = rejectCache.stats().limited;
+  gauges->journalBacklog = journalPending();
+  gauges->freeHeap = ESP.getFreeHeap();
+  gauges->minFreeHeap = ESP.getMinFreeHeap();
+  gauges->online = networkAvailable && WiFi.status() == WL_CONNECTED;
+  gauges->rssi = gauges->online ? WiFi.RSSI() : 0;
+}
+
+// Rendered text goes out in METRICS_WRITE_CHUNK writes, not one per line
+class ClientMetricsSink : public MetricsSink {
+public:
+  explicit ClientMetricsSink(WiFiClient& client) : client_(client), len_(0) {}
+  void write(const char* text, size_t len) override {
+    if (len_ + len > sizeof(buf_)) flush();
+    if (len > sizeof(buf_)) {
+      client_.write((const uint8_t*)text, len);
+      return;
     }
+    memcpy(buf_ + len_, text, len);
+    len_ += len;
   }
+  void flush() {
+    if (len_ > 0) client_.write((const uint8_t*)buf_, len_);
+    len_ = 0;
+  }
+
+private:
+  WiFiClient& client_;
+  char buf_[METRICS_WRITE_CHUNK];
+  size_t len_;
+};
+
+// One scrape: GET /metrics gets the Prometheus text, anything else a 404.
+// The connection closes after the reply.
+void serveMetrics(WiFiClient& client) {
+  client.setTimeout(METRICS_REQUEST_TIMEOUT_MS);
+  String requestLine = client.readStringUntil('\n');
+  for (int i = 0; i < METRICS_HEADER_LINES_MAX; i++) {
+    String header = client.readStringUntil('\n');
+    if (header.length() <= 1) break;  // "\r" alone ends the headers
+  }
+  
+  if (!requestLine.startsWith("GET /metrics ") && !requestLine.startsWith("GET /metrics?")) {
+    client.print("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    return;
+  }
+  client.print("HTTP/1.1 200 OK\r\n"
+               "Content-Type: text/plain; version=0.0.4\r\n"
+               "Connection: close\r\n\r\n");
+  MetricsGauges gauges;
+  collectGauges(&gauges);
+  ClientMetricsSink sink(client);
+  stageMetrics.render(gauges, &sink);
+  sink.flush();
 }
 
-void appendToFile(String filename, String content) {
-  File file = SPIFFS.open(filename, "a");
-  if (file) {
-    file.print(content);
-    file.close();
-    Serial.println("Saved to " + filename + ": " + content.substring(0, 50) + "...");
-  } else {
-    Serial.println("Failed to open file for writing: " + filename);
+// Ride along with the periodic sync, on the same keep-alive connection:
+// the gauges and, for each stage seen so far, its count and percentiles
+void uploadMetrics() {
+  MetricsGauges gauges;
+  collectGauges(&gauges);
+  
+  DynamicJsonDocument doc(METRICS_DOC_SIZE);
+  doc["device_id"] = DEVICE_ID;
+  doc["uptime_ms"] = gauges.uptimeMs;
+  doc["free_heap"] = gauges.freeHeap;
+  doc["min_free_heap"] = gauges.minFreeHeap;
+  doc["rssi"] = gauges.rssi;
+  doc["journal_backlog"] = gauges.journalBacklog;
+  JsonObject lookups = doc.createNestedObject("card_lookups");
+  lookups["cache"] = gauges.cacheHits;
+  lookups["index"] = gauges.indexHits;
+  lookups["miss"] = gauges.lookupMisses;
+  doc["cache_hit_ratio"] = metricsCacheHitRatio(gauges);
+  JsonObject suppressed = doc.createNestedObject("verify_suppressed");
+  suppressed["rejected"] = gauges.rejectsCached;
+  suppressed["rate_limited"] = gauges.rejectsLimited;
+  
+  JsonObject stages = doc.createNestedObject("stages");
+  for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+    StageSummary summary;
+    stageMetrics.read(stage, &summary);
+    if (summary.count == 0) continue;
+    JsonObject entry = stages.createNestedObject(StageMetrics::stageName(stage));
+    entry["count"] = summary.count;
+    entry["p50_us"] = summary.percentileUs(50);
+    entry["p95_us"] = summary.percentileUs(95);
+    entry["p99_us"] = summary.percentileUs(99);
+    entry["max_us"] = summary.maxUs;
+  }
+  
+  String jsonString;
+  serializeJson(doc, jsonString);
+  String response;
+  int httpResponseCode = serverPost("device/metrics", jsonString, &response, 5000);
+  if (httpResponseCode != 200) {
+    LOG_WARN("Metrics upload failed: %d", httpResponseCode);
   }
-}
\ No newline at end of file
+}
+
+// Only the cells that differ from what the panel shows go over I2C
+void displayMessage(const char* line1, const char* line2) {
+  lcdShadow.show(line1, line2);
+}
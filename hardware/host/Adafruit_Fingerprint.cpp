@@ -0,0 +1,158 @@
+/*
+ * Host stand-in for the Adafruit_Fingerprint library driving an R307
+ */
+
+#include "Adafruit_Fingerprint.h"
+#include "host_hal.h"
+#include <chrono>
+#include <thread>
+
+#define R307_CAPACITY      1000
+#define R307_CMD_MATCH     0x03
+#define R307_CMD_DOWNCHAR  0x09
+#define R307_PACKET_BYTES  11    // Header, address, type, length and checksum
+#define R307_MATCH_SCORE   180
+#define R307_UART_MS       10    // Round trip of a short command
+
+Adafruit_Fingerprint::Adafruit_Fingerprint(HardwareSerial* serial, uint32_t password)
+    : fingerID(0),
+      confidence(0),
+      templateCount(0),
+      status_reg(0),
+      system_id(0),
+      capacity(0),
+      security_level(0),
+      device_addr(0xFFFFFFFF),
+      packet_len(32),
+      baud_rate(57600),
+      serial_(serial),
+      image_(HOST_FINGER_NONE),
+      pendingCommand_(0),
+      downloadBuffer_(0) {
+  (void)password;
+  memset(buffers_, 0, sizeof(buffers_));
+  memset(ack_, 0, sizeof(ack_));
+}
+
+void Adafruit_Fingerprint::uartTime(size_t bytes) {
+  // 10 bits a byte
+  std::this_thread::sleep_for(std::chrono::microseconds(bytes * 10 * 1000000 / HOST_FINGER_BAUD));
+}
+
+bool Adafruit_Fingerprint::verifyPassword() {
+  hostHal.sleep(R307_UART_MS);
+  return hostHal.fingerSensorPresent;
+}
+
+uint8_t Adafruit_Fingerprint::getParameters() {
+  if (!hostHal.fingerSensorPresent) return FINGERPRINT_PACKETRECIEVEERR;
+  hostHal.sleep(R307_UART_MS);
+  capacity = R307_CAPACITY;
+  security_level = 3;
+  return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::setPacketSize(uint8_t size) {
+  hostHal.sleep(R307_UART_MS);
+  packet_len = (uint16_t)(32 << size);
+  return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::getImage() {
+  int finger = hostHal.fingerOnGlass();
+  if (finger == HOST_FINGER_NONE) {
+    hostHal.sleep(HOST_FINGER_NO_IMAGE_MS);
+    return FINGERPRINT_NOFINGER;
+  }
+  hostHal.sleep(HOST_FINGER_IMAGE_MS);
+  image_ = finger;
+  return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::image2Tz(uint8_t slot) {
+  if (slot < 1 || slot > 2) return FINGERPRINT_PACKETRECIEVEERR;
+  hostHal.sleep(HOST_FINGER_TZ_MS);
+  if (image_ == HOST_FINGER_NONE) return FINGERPRINT_IMAGEMESS;
+  buffers_[slot - 1].valid = true;
+  buffers_[slot - 1].owner = image_;
+  return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::loadModel(uint16_t id) {
+  hostHal.sleep(HOST_FINGER_LOAD_MS);
+  std::map<uint16_t, int>::const_iterator it = library_.find(id);
+  if (it == library_.end()) return FINGERPRINT_DBREADFAIL;
+  buffers_[0].valid = true;
+  buffers_[0].owner = it->second;
+  return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::storeModel(uint16_t id, uint8_t slot) {
+  if (slot < 1 || slot > 2 || id >= R307_CAPACITY) return FINGERPRINT_BADLOCATION;
+  hostHal.sleep(HOST_FINGER_STORE_MS);
+  if (!buffers_[slot - 1].valid) return FINGERPRINT_FLASHERR;
+  library_[id] = buffers_[slot - 1].owner;
+  return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::deleteModel(uint16_t id) {
+  hostHal.sleep(R307_UART_MS);
+  library_.erase(id);
+  return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::emptyDatabase() {
+  hostHal.sleep(R307_UART_MS);
+  library_.clear();
+  return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::getTemplateCount() {
+  hostHal.sleep(R307_UART_MS);
+  templateCount = (uint16_t)library_.size();
+  return FINGERPRINT_OK;
+}
+
+void Adafruit_Fingerprint::writeStructuredPacket(const Adafruit_Fingerprint_Packet& packet) {
+  uartTime(R307_PACKET_BYTES + packet.length);
+
+  if (packet.type == FINGERPRINT_COMMANDPACKET) {
+    pendingCommand_ = packet.data[0];
+    memset(ack_, 0, sizeof(ack_));
+    if (pendingCommand_ == R307_CMD_MATCH) {
+      hostHal.sleep(HOST_FINGER_MATCH_MS);
+      bool match = buffers_[0].valid && buffers_[1].valid && buffers_[0].owner == buffers_[1].owner &&
+                   buffers_[1].owner != HOST_FINGER_STRANGER;
+      ack_[0] = match ? FINGERPRINT_OK : FINGERPRINT_NOMATCH;
+      ack_[2] = match ? R307_MATCH_SCORE : 0;
+    } else if (pendingCommand_ == R307_CMD_DOWNCHAR) {
+      downloadBuffer_ = packet.data[1];
+      download_.clear();
+      ack_[0] = downloadBuffer_ == 1 || downloadBuffer_ == 2 ? FINGERPRINT_OK : FINGERPRINT_PACKETRECIEVEERR;
+    } else {
+      ack_[0] = FINGERPRINT_PACKETRECIEVEERR;
+    }
+    return;
+  }
+
+  // Template data following DownChar
+  if (pendingCommand_ != R307_CMD_DOWNCHAR) return;
+  size_t len = packet.length < sizeof(packet.data) ? packet.length : sizeof(packet.data);
+  download_.insert(download_.end(), packet.data, packet.data + len);
+  if (packet.type == FINGERPRINT_ENDDATAPACKET) {
+    CharBuffer& buffer = buffers_[downloadBuffer_ - 1];
+    buffer.valid = true;
+    buffer.owner = hostTemplateOwner(download_.data(), download_.size());
+    pendingCommand_ = 0;
+  }
+}
+
+uint8_t Adafruit_Fingerprint::getStructuredPacket(Adafruit_Fingerprint_Packet* packet, uint16_t timeout) {
+  (void)timeout;
+  if (!hostHal.fingerSensorPresent) return FINGERPRINT_TIMEOUT;
+  uartTime(R307_PACKET_BYTES + sizeof(ack_));
+  packet->type = FINGERPRINT_ACKPACKET;
+  packet->length = sizeof(ack_);
+  memcpy(packet->data, ack_, sizeof(ack_));
+  return FINGERPRINT_OK;
+}
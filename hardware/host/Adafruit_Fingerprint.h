@@ -0,0 +1,113 @@
+/*
+ * Host stand-in for the Adafruit_Fingerprint library driving an R307
+ *
+ * Models the sensor's two character buffers and its template library.
+ * A buffer holds whose finger it describes: a capture takes it from the
+ * finger host_hal.h has on the glass, a template takes it from the owner
+ * tag hostTemplateFor() writes (see host_hal.h). Match compares the two.
+ * Commands cost the R307's typical times and template downloads the
+ * UART time at 57600 baud.
+ */
+
+#ifndef HOST_ADAFRUIT_FINGERPRINT_H
+#define HOST_ADAFRUIT_FINGERPRINT_H
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+#define FINGERPRINT_OK                0x00
+#define FINGERPRINT_PACKETRECIEVEERR  0x01
+#define FINGERPRINT_NOFINGER          0x02
+#define FINGERPRINT_IMAGEFAIL         0x03
+#define FINGERPRINT_IMAGEMESS         0x06
+#define FINGERPRINT_FEATUREFAIL       0x07
+#define FINGERPRINT_NOMATCH           0x08
+#define FINGERPRINT_NOTFOUND          0x09
+#define FINGERPRINT_BADLOCATION       0x0B
+#define FINGERPRINT_DBREADFAIL        0x0C
+#define FINGERPRINT_FLASHERR          0x18
+#define FINGERPRINT_TIMEOUT           0xFF
+
+#define FINGERPRINT_STARTCODE         0xEF01
+#define FINGERPRINT_COMMANDPACKET     0x1
+#define FINGERPRINT_DATAPACKET        0x2
+#define FINGERPRINT_ACKPACKET         0x7
+#define FINGERPRINT_ENDDATAPACKET     0x8
+
+#define FINGERPRINT_DEFAULTTIMEOUT    1000
+
+enum {
+  FINGERPRINT_PACKET_SIZE_32 = 0,
+  FINGERPRINT_PACKET_SIZE_64 = 1,
+  FINGERPRINT_PACKET_SIZE_128 = 2,
+  FINGERPRINT_PACKET_SIZE_256 = 3
+};
+
+struct Adafruit_Fingerprint_Packet {
+  Adafruit_Fingerprint_Packet(uint8_t type, uint16_t length, uint8_t* data) {
+    this->start_code = FINGERPRINT_STARTCODE;
+    this->type = type;
+    this->length = length;
+    memset(address, 0xFF, sizeof(address));
+    memset(this->data, 0, sizeof(this->data));
+    memcpy(this->data, data, length < sizeof(this->data) ? length : sizeof(this->data));
+  }
+  uint16_t start_code;
+  uint8_t address[4];
+  uint8_t type;
+  uint16_t length;
+  uint8_t data[64];
+};
+
+class Adafruit_Fingerprint {
+public:
+  explicit Adafruit_Fingerprint(HardwareSerial* serial, uint32_t password = 0);
+
+  bool verifyPassword();
+  uint8_t getParameters();
+  uint8_t setPacketSize(uint8_t size);
+
+  uint8_t getImage();
+  uint8_t image2Tz(uint8_t slot = 1);
+  uint8_t loadModel(uint16_t id);
+  uint8_t storeModel(uint16_t id, uint8_t slot = 1);
+  uint8_t deleteModel(uint16_t id);
+  uint8_t emptyDatabase();
+  uint8_t getTemplateCount();
+
+  void writeStructuredPacket(const Adafruit_Fingerprint_Packet& packet);
+  uint8_t getStructuredPacket(Adafruit_Fingerprint_Packet* packet,
+                              uint16_t timeout = FINGERPRINT_DEFAULTTIMEOUT);
+
+  uint16_t fingerID;
+  uint16_t confidence;
+  uint16_t templateCount;
+  uint16_t status_reg;
+  uint16_t system_id;
+  uint16_t capacity;
+  uint16_t security_level;
+  uint32_t device_addr;
+  uint16_t packet_len;
+  uint16_t baud_rate;
+
+private:
+  // Whose finger a character buffer describes
+  struct CharBuffer {
+    bool valid;
+    int owner;
+  };
+
+  void uartTime(size_t bytes);
+
+  HardwareSerial* serial_;
+  int image_;              // Finger in the image buffer, HOST_FINGER_NONE if none
+  CharBuffer buffers_[2];
+  std::map<uint16_t, int> library_;  // Sensor slot -> owner
+  uint8_t pendingCommand_;
+  uint8_t ack_[3];         // Confirmation code and score of the last command
+  uint8_t downloadBuffer_;
+  std::vector<uint8_t> download_;
+};
+
+#endif // HOST_ADAFRUIT_FINGERPRINT_H
@@ -0,0 +1,105 @@
+/*
+ * Host stand-in for the ESP32 Arduino core
+ */
+
+#include "Arduino.h"
+#include "host_hal.h"
+#include <chrono>
+#include <random>
+#include <thread>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// What an ESP32 without PSRAM has left once the WiFi stack is up; the
+// host reports this less what the firmware has allocated since start
+#define HOST_HEAP_BYTES 200000
+
+EspClass ESP;
+
+uint32_t millis() {
+  return hostHal.millis();
+}
+
+uint32_t micros() {
+  return (uint32_t)hostHal.micros();
+}
+
+void delay(uint32_t ms) {
+  hostHal.delay(ms);
+}
+
+void delayMicroseconds(uint32_t us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  hostHal.pinMode(pin, mode);
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  hostHal.digitalWrite(pin, level);
+}
+
+int digitalRead(uint8_t pin) {
+  return hostHal.digitalRead(pin);
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {
+  hostHal.attachInterrupt(pin, isr, mode);
+}
+
+void detachInterrupt(uint8_t pin) {
+  hostHal.detachInterrupt(pin);
+}
+
+uint32_t esp_random() {
+  static std::random_device device;
+  return device();
+}
+
+bool psramFound() {
+  return false;
+}
+
+void* ps_malloc(size_t size) {
+  (void)size;
+  return NULL;
+}
+
+static size_t heapInUse() {
+#ifdef __GLIBC__
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+static const size_t heapAtStart = heapInUse();
+static uint32_t minFreeHeap = HOST_HEAP_BYTES;
+
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t)(hostHal.micros() * HOST_CPU_MHZ);
+}
+
+uint32_t EspClass::getFreeHeap() {
+  size_t used = heapInUse();
+  used = used > heapAtStart ? used - heapAtStart : 0;
+  uint32_t free = used < HOST_HEAP_BYTES ? (uint32_t)(HOST_HEAP_BYTES - used) : 0;
+  if (free < minFreeHeap) minFreeHeap = free;
+  return free;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  getFreeHeap();
+  return minFreeHeap;
+}
+
+void EspClass::restart() {
+  fflush(stdout);
+  abort();
+}
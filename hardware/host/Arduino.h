@@ -0,0 +1,85 @@
+/*
+ * Host stand-in for the ESP32 Arduino core
+ *
+ * Enough of Arduino.h for the firmware to build and run as a Linux
+ * process. Time, pins and the other hardware behind these calls are
+ * driven by host_hal.h, which a test or benchmark scripts.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "WString.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define ARDUINO_HOST 1
+
+#define LOW           0x0
+#define HIGH          0x1
+
+// ESP32 pin modes and interrupt edges
+#define INPUT         0x01
+#define OUTPUT        0x03
+#define INPUT_PULLUP  0x05
+#define RISING        0x01
+#define FALLING       0x02
+#define CHANGE        0x03
+
+#define IRAM_ATTR
+
+#define digitalPinToInterrupt(p) (p)
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode);
+void detachInterrupt(uint8_t pin);
+
+uint32_t esp_random();
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char* server1,
+                const char* server2 = NULL, const char* server3 = NULL);
+
+// No PSRAM on the host: the card cache takes the heap budget
+bool psramFound();
+void* ps_malloc(size_t size);
+
+// The host's clock stands in for the cycle counter, to the microsecond
+#define HOST_CPU_MHZ 240
+
+class EspClass {
+public:
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz() { return HOST_CPU_MHZ; }
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getFreePsram() { return 0; }
+  void restart();
+};
+
+extern EspClass ESP;
+
+#endif // HOST_ARDUINO_H
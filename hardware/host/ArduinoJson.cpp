@@ -0,0 +1,561 @@
+/*
+ * Host stand-in for the parts of ArduinoJson 6 the firmware uses
+ */
+
+#include "ArduinoJson.h"
+#include <stdlib.h>
+
+#define JSON_NESTING_LIMIT 10
+
+JsonVariant::JsonVariant(JsonDocument* doc, JsonNode* parent, const char* key)
+    : doc_(doc), node_(NULL), parent_(parent), key_(key != NULL ? key : "") {
+  if (parent_ == NULL || parent_->type != JsonNode::Object) return;
+  for (size_t i = 0; i < parent_->members.size(); i++) {
+    if (parent_->members[i].first == key_) {
+      node_ = parent_->members[i].second;
+      break;
+    }
+  }
+}
+
+JsonNode* JsonVariant::target() {
+  if (node_ != NULL) return node_;
+  if (doc_ == NULL || parent_ == NULL) return NULL;
+  if (parent_->type == JsonNode::Null) parent_->type = JsonNode::Object;
+  if (parent_->type != JsonNode::Object) return NULL;
+  node_ = doc_->allocate();
+  if (node_ != NULL) parent_->members.push_back(std::make_pair(key_, node_));
+  return node_;
+}
+
+JsonVariant& JsonVariant::operator=(bool value) {
+  JsonNode* node = target();
+  if (node != NULL) {
+    *node = JsonNode();
+    node->type = JsonNode::Bool;
+    node->b = value;
+  }
+  return *this;
+}
+
+JsonVariant& JsonVariant::operator=(double value) {
+  JsonNode* node = target();
+  if (node != NULL) {
+    *node = JsonNode();
+    node->type = JsonNode::Float;
+    node->d = value;
+  }
+  return *this;
+}
+
+JsonVariant& JsonVariant::operator=(const char* value) {
+  JsonNode* node = target();
+  if (node != NULL) {
+    *node = JsonNode();
+    if (value != NULL) {
+      node->type = JsonNode::Str;
+      node->literal = value;
+    }
+  }
+  return *this;
+}
+
+JsonVariant& JsonVariant::operator=(char* value) {
+  return *this = String(value);
+}
+
+JsonVariant& JsonVariant::operator=(const String& value) {
+  JsonNode* node = target();
+  if (node != NULL && doc_->reserve(value.length() + 1)) {
+    *node = JsonNode();
+    node->type = JsonNode::Str;
+    node->s = value.str();
+  }
+  return *this;
+}
+
+void JsonVariant::setInt(int64_t value) {
+  JsonNode* node = target();
+  if (node != NULL) {
+    *node = JsonNode();
+    node->type = JsonNode::Int;
+    node->i = value;
+  }
+}
+
+int64_t JsonVariant::asInt() const {
+  if (node_ == NULL) return 0;
+  if (node_->type == JsonNode::Int) return node_->i;
+  if (node_->type == JsonNode::Float) return (int64_t)node_->d;
+  if (node_->type == JsonNode::Bool) return node_->b ? 1 : 0;
+  return 0;
+}
+
+bool JsonVariant::asBool() const {
+  if (node_ == NULL) return false;
+  if (node_->type == JsonNode::Bool) return node_->b;
+  if (node_->type == JsonNode::Int) return node_->i != 0;
+  return false;
+}
+
+double JsonVariant::asDouble() const {
+  if (node_ == NULL) return 0;
+  if (node_->type == JsonNode::Float) return node_->d;
+  if (node_->type == JsonNode::Int) return (double)node_->i;
+  return 0;
+}
+
+static void writeNode(const JsonNode* node, std::string* out);
+
+String JsonVariant::asString() const {
+  if (node_ != NULL && node_->type == JsonNode::Str) return String(node_->str());
+  std::string out;
+  writeNode(node_, &out);
+  return String(out);
+}
+
+const char* JsonVariant::asCString() const {
+  return node_ != NULL && node_->type == JsonNode::Str ? node_->str() : NULL;
+}
+
+bool JsonVariant::operator|(bool fallback) const {
+  return node_ != NULL && node_->type == JsonNode::Bool ? node_->b : fallback;
+}
+
+const char* JsonVariant::operator|(const char* fallback) const {
+  return node_ != NULL && node_->type == JsonNode::Str ? node_->str() : fallback;
+}
+
+JsonVariant JsonVariant::operator[](const char* key) const {
+  if (node_ == NULL || node_->type != JsonNode::Object) return JsonVariant();
+  return JsonVariant(doc_, node_, key);
+}
+
+JsonVariant JsonVariant::operator[](size_t index) const {
+  if (node_ == NULL || node_->type != JsonNode::Array || index >= node_->items.size()) return JsonVariant();
+  return JsonVariant(doc_, node_->items[index]);
+}
+
+JsonArray JsonObject::createNestedArray(const char* key) const {
+  JsonVariant member(doc_, node_, key);
+  JsonNode* node = member.node();
+  if (node == NULL) {
+    member = (const char*)NULL;  // Creates the member as null
+    node = JsonVariant(doc_, node_, key).node();
+  }
+  if (node == NULL) return JsonArray();
+  *node = JsonNode();
+  node->type = JsonNode::Array;
+  return JsonArray(doc_, node);
+}
+
+JsonObject JsonObject::createNestedObject(const char* key) const {
+  JsonVariant member(doc_, node_, key);
+  JsonNode* node = member.node();
+  if (node == NULL) {
+    member = (const char*)NULL;
+    node = JsonVariant(doc_, node_, key).node();
+  }
+  if (node == NULL) return JsonObject();
+  *node = JsonNode();
+  node->type = JsonNode::Object;
+  return JsonObject(doc_, node);
+}
+
+JsonObject JsonArray::createNestedObject() const {
+  if (node_ == NULL) return JsonObject();
+  JsonNode* node = doc_->allocate();
+  if (node == NULL) return JsonObject();
+  node->type = JsonNode::Object;
+  node_->items.push_back(node);
+  return JsonObject(doc_, node);
+}
+
+JsonArray JsonArray::createNestedArray() const {
+  if (node_ == NULL) return JsonArray();
+  JsonNode* node = doc_->allocate();
+  if (node == NULL) return JsonArray();
+  node->type = JsonNode::Array;
+  node_->items.push_back(node);
+  return JsonArray(doc_, node);
+}
+
+// Like ArduinoJson, the removed value's memory is not reclaimed
+void JsonArray::remove(size_t index) const {
+  if (node_ == NULL || index >= node_->items.size()) return;
+  node_->items.erase(node_->items.begin() + index);
+}
+
+JsonDocument::JsonDocument(size_t capacity) : capacity_(capacity), used_(0), overflowed_(false) {
+  nodes_.push_back(JsonNode());
+}
+
+void JsonDocument::clear() {
+  nodes_.clear();
+  nodes_.push_back(JsonNode());
+  used_ = 0;
+  overflowed_ = false;
+}
+
+bool JsonDocument::reserve(size_t bytes) {
+  if (used_ + bytes > capacity_) {
+    overflowed_ = true;
+    return false;
+  }
+  used_ += bytes;
+  return true;
+}
+
+JsonNode* JsonDocument::allocate(size_t extraBytes) {
+  if (!reserve(ARDUINOJSON_SLOT_SIZE + extraBytes)) return NULL;
+  nodes_.push_back(JsonNode());
+  return &nodes_.back();
+}
+
+JsonNode* JsonDocument::root() {
+  JsonNode* top = &nodes_.front();
+  if (top->type == JsonNode::Null) top->type = JsonNode::Object;
+  return top;
+}
+
+const char* DeserializationError::c_str() const {
+  static const char* const names[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput",
+                                      "NoMemory", "TooDeep"};
+  return names[code_];
+}
+
+static void writeString(const char* s, std::string* out) {
+  *out += '"';
+  for (; *s != '\0'; s++) {
+    unsigned char c = (unsigned char)*s;
+    switch (c) {
+      case '"': *out += "\\\""; break;
+      case '\\': *out += "\\\\"; break;
+      case '\n': *out += "\\n"; break;
+      case '\r': *out += "\\r"; break;
+      case '\t': *out += "\\t"; break;
+      case '\b': *out += "\\b"; break;
+      case '\f': *out += "\\f"; break;
+      default:
+        if (c < 0x20) {
+          char esc[8];
+          snprintf(esc, sizeof(esc), "\\u%04x", c);
+          *out += esc;
+        } else {
+          *out += (char)c;
+        }
+    }
+  }
+  *out += '"';
+}
+
+static void writeNode(const JsonNode* node, std::string* out) {
+  if (node == NULL) {
+    *out += "null";
+    return;
+  }
+  char num[32];
+  switch (node->type) {
+    case JsonNode::Null:
+      *out += "null";
+      break;
+    case JsonNode::Bool:
+      *out += node->b ? "true" : "false";
+      break;
+    case JsonNode::Int:
+      snprintf(num, sizeof(num), "%lld", (long long)node->i);
+      *out += num;
+      break;
+    case JsonNode::Float:
+      snprintf(num, sizeof(num), "%.9g", node->d);
+      *out += num;
+      break;
+    case JsonNode::Str:
+      writeString(node->str(), out);
+      break;
+    case JsonNode::Array:
+      *out += '[';
+      for (size_t i = 0; i < node->items.size(); i++) {
+        if (i > 0) *out += ',';
+        writeNode(node->items[i], out);
+      }
+      *out += ']';
+      break;
+    case JsonNode::Object:
+      *out += '{';
+      for (size_t i = 0; i < node->members.size(); i++) {
+        if (i > 0) *out += ',';
+        writeString(node->members[i].first.c_str(), out);
+        *out += ':';
+        writeNode(node->members[i].second, out);
+      }
+      *out += '}';
+      break;
+  }
+}
+
+size_t serializeJson(const JsonDocument& doc, String& output) {
+  std::string out;
+  writeNode(doc.top(), &out);
+  output = String(out);
+  return out.size();
+}
+
+size_t serializeJson(const JsonDocument& doc, char* output, size_t size) {
+  std::string out;
+  writeNode(doc.top(), &out);
+  if (size == 0) return 0;
+  size_t n = out.size() < size - 1 ? out.size() : size - 1;
+  memcpy(output, out.data(), n);
+  output[n] = '\0';
+  return n;
+}
+
+size_t measureJson(const JsonDocument& doc) {
+  std::string out;
+  writeNode(doc.top(), &out);
+  return out.size();
+}
+
+// Recursive descent over the input. A NULL filter drops the value after
+// checking its syntax; keep marks a filter of true, which keeps it all.
+class JsonParser {
+public:
+  JsonParser(JsonDocument* doc, const char* p) : doc_(doc), p_(p), error_(DeserializationError::Ok) {}
+
+  DeserializationError parse(const JsonNode* filter, bool keep) {
+    skipSpace();
+    if (*p_ == '\0') return DeserializationError::EmptyInput;
+    JsonNode* top = const_cast<JsonNode*>(doc_->top());
+    value(top, filter, keep, 0);
+    return error_;
+  }
+
+private:
+  static const JsonNode* member(const JsonNode* filter, const std::string& key) {
+    if (filter == NULL || filter->type != JsonNode::Object) return NULL;
+    const JsonNode* wildcard = NULL;
+    for (size_t i = 0; i < filter->members.size(); i++) {
+      if (filter->members[i].first == key) return filter->members[i].second;
+      if (filter->members[i].first == "*") wildcard = filter->members[i].second;
+    }
+    return wildcard;
+  }
+
+  static bool keeps(const JsonNode* filter) {
+    return filter != NULL && filter->type == JsonNode::Bool && filter->b;
+  }
+
+  void fail(DeserializationError::Code code) {
+    if (!error_) error_ = code;
+  }
+
+  void skipSpace() {
+    while (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r') p_++;
+  }
+
+  // out is NULL when the value is filtered out
+  void value(JsonNode* out, const JsonNode* filter, bool keep, int depth) {
+    if (error_) return;
+    if (depth > JSON_NESTING_LIMIT) return fail(DeserializationError::TooDeep);
+    skipSpace();
+    bool wanted = out != NULL && (keep || filter != NULL);
+    if (!wanted) out = NULL;
+
+    if (*p_ == '{') {
+      object(out, filter, keep, depth);
+    } else if (*p_ == '[') {
+      array(out, filter, keep, depth);
+    } else if (*p_ == '"') {
+      std::string s;
+      if (!string(&s)) return;
+      if (out != NULL && doc_->reserve(s.size() + 1)) {
+        out->type = JsonNode::Str;
+        out->s = s;
+      } else if (out != NULL) {
+        fail(DeserializationError::NoMemory);
+      }
+    } else if (strncmp(p_, "true", 4) == 0 || strncmp(p_, "false", 5) == 0) {
+      bool b = *p_ == 't';
+      p_ += b ? 4 : 5;
+      if (out != NULL) {
+        out->type = JsonNode::Bool;
+        out->b = b;
+      }
+    } else if (strncmp(p_, "null", 4) == 0) {
+      p_ += 4;
+    } else if (*p_ == '-' || (*p_ >= '0' && *p_ <= '9')) {
+      number(out);
+    } else {
+      fail(*p_ == '\0' ? DeserializationError::IncompleteInput : DeserializationError::InvalidInput);
+    }
+  }
+
+  void object(JsonNode* out, const JsonNode* filter, bool keep, int depth) {
+    p_++;
+    if (out != NULL) out->type = JsonNode::Object;
+    skipSpace();
+    if (*p_ == '}') {
+      p_++;
+      return;
+    }
+    for (;;) {
+      skipSpace();
+      std::string key;
+      if (*p_ != '"') return fail(*p_ == '\0' ? DeserializationError::IncompleteInput
+                                              : DeserializationError::InvalidInput);
+      if (!string(&key)) return;
+      skipSpace();
+      if (*p_ != ':') return fail(DeserializationError::InvalidInput);
+      p_++;
+
+      const JsonNode* childFilter = keep ? NULL : member(filter, key);
+      bool childKeep = keep || keeps(childFilter);
+      JsonNode* child = NULL;
+      if (out != NULL && (childKeep || childFilter != NULL)) {
+        child = doc_->allocate(key.size() + 1);
+        if (child == NULL) return fail(DeserializationError::NoMemory);
+        out->members.push_back(std::make_pair(key, child));
+      }
+      value(child, childFilter, childKeep, depth + 1);
+      if (error_) return;
+
+      skipSpace();
+      if (*p_ == ',') {
+        p_++;
+      } else if (*p_ == '}') {
+        p_++;
+        return;
+      } else {
+        return fail(*p_ == '\0' ? DeserializationError::IncompleteInput : DeserializationError::InvalidInput);
+      }
+    }
+  }
+
+  void array(JsonNode* out, const JsonNode* filter, bool keep, int depth) {
+    p_++;
+    if (out != NULL) out->type = JsonNode::Array;
+    const JsonNode* childFilter = NULL;
+    if (!keep && filter != NULL && filter->type == JsonNode::Array && !filter->items.empty()) {
+      childFilter = filter->items[0];
+    }
+    bool childKeep = keep || keeps(childFilter);
+    skipSpace();
+    if (*p_ == ']') {
+      p_++;
+      return;
+    }
+    for (;;) {
+      JsonNode* child = NULL;
+      if (out != NULL && (childKeep || childFilter != NULL)) {
+        child = doc_->allocate();
+        if (child == NULL) return fail(DeserializationError::NoMemory);
+        out->items.push_back(child);
+      }
+      value(child, childFilter, childKeep, depth + 1);
+      if (error_) return;
+
+      skipSpace();
+      if (*p_ == ',') {
+        p_++;
+      } else if (*p_ == ']') {
+        p_++;
+        return;
+      } else {
+        return fail(*p_ == '\0' ? DeserializationError::IncompleteInput : DeserializationError::InvalidInput);
+      }
+    }
+  }
+
+  bool string(std::string* s) {
+    p_++;
+    while (*p_ != '"') {
+      if (*p_ == '\0') {
+        fail(DeserializationError::IncompleteInput);
+        return false;
+      }
+      if (*p_ != '\\') {
+        *s += *p_++;
+        continue;
+      }
+      p_++;
+      switch (*p_) {
+        case 'n': *s += '\n'; break;
+        case 'r': *s += '\r'; break;
+        case 't': *s += '\t'; break;
+        case 'b': *s += '\b'; break;
+        case 'f': *s += '\f'; break;
+        case 'u': {
+          unsigned long code = strtoul(std::string(p_ + 1, 4).c_str(), NULL, 16);
+          if (code < 0x80) {
+            *s += (char)code;
+          } else if (code < 0x800) {
+            *s += (char)(0xC0 | (code >> 6));
+            *s += (char)(0x80 | (code & 0x3F));
+          } else {
+            *s += (char)(0xE0 | (code >> 12));
+            *s += (char)(0x80 | ((code >> 6) & 0x3F));
+            *s += (char)(0x80 | (code & 0x3F));
+          }
+          for (int i = 0; i < 4 && p_[1] != '\0'; i++) p_++;
+          break;
+        }
+        case '\0':
+          fail(DeserializationError::IncompleteInput);
+          return false;
+        default: *s += *p_; break;
+      }
+      p_++;
+    }
+    p_++;
+    return true;
+  }
+
+  void number(JsonNode* out) {
+    const char* start = p_;
+    bool isFloat = false;
+    if (*p_ == '-') p_++;
+    while ((*p_ >= '0' && *p_ <= '9') || *p_ == '.' || *p_ == 'e' || *p_ == 'E' || *p_ == '+' ||
+           (*p_ == '-' && (p_[-1] == 'e' || p_[-1] == 'E'))) {
+      if (*p_ == '.' || *p_ == 'e' || *p_ == 'E') isFloat = true;
+      p_++;
+    }
+    if (out == NULL) return;
+    std::string text(start, p_ - start);
+    if (isFloat) {
+      out->type = JsonNode::Float;
+      out->d = strtod(text.c_str(), NULL);
+    } else {
+      out->type = JsonNode::Int;
+      out->i = strtoll(text.c_str(), NULL, 10);
+    }
+  }
+
+  JsonDocument* doc_;
+  const char* p_;
+  DeserializationError error_;
+};
+
+DeserializationError deserializeJson(JsonDocument& doc, const char* input) {
+  doc.clear();
+  if (input == NULL) return DeserializationError::EmptyInput;
+  return JsonParser(&doc, input).parse(NULL, true);
+}
+
+DeserializationError deserializeJson(JsonDocument& doc, const String& input) {
+  return deserializeJson(doc, input.c_str());
+}
+
+DeserializationError deserializeJson(JsonDocument& doc, const char* input,
+                                     DeserializationOption::Filter filter) {
+  doc.clear();
+  if (input == NULL) return DeserializationError::EmptyInput;
+  const JsonNode* f = filter.node();
+  bool keep = f != NULL && f->type == JsonNode::Bool && f->b;
+  return JsonParser(&doc, input).parse(f, keep);
+}
+
+DeserializationError deserializeJson(JsonDocument& doc, const String& input,
+                                     DeserializationOption::Filter filter) {
+  return deserializeJson(doc, input.c_str(), filter);
+}
@@ -0,0 +1,224 @@
+/*
+ * Host stand-in for the parts of ArduinoJson 6 the firmware uses
+ *
+ * Documents have a fixed capacity as on the device: every value takes a
+ * 16-byte slot and copied strings their length plus one. String literals
+ * (const char*) are kept by pointer and char arrays and Strings copied,
+ * so overflowed() trips where ArduinoJson's would. Output is compact
+ * JSON; deserializeJson() supports ArduinoJson's filters.
+ */
+
+#ifndef HOST_ARDUINO_JSON_H
+#define HOST_ARDUINO_JSON_H
+
+#include <Arduino.h>
+#include <deque>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#define ARDUINOJSON_SLOT_SIZE 16
+
+struct JsonNode {
+  enum Type { Null, Bool, Int, Float, Str, Array, Object };
+
+  JsonNode() : type(Null), b(false), i(0), d(0), literal(NULL) {}
+
+  Type type;
+  bool b;
+  int64_t i;
+  double d;
+  const char* literal;  // Str kept by pointer
+  std::string s;        // Str copied
+  std::vector<std::pair<std::string, JsonNode*> > members;
+  std::vector<JsonNode*> items;
+
+  const char* str() const { return literal != NULL ? literal : s.c_str(); }
+};
+
+class JsonDocument;
+class JsonArray;
+class JsonObject;
+
+// A value in a document, or a member not yet created that assignment adds
+class JsonVariant {
+public:
+  JsonVariant() : doc_(NULL), node_(NULL), parent_(NULL) {}
+  JsonVariant(JsonDocument* doc, JsonNode* node) : doc_(doc), node_(node), parent_(NULL) {}
+  JsonVariant(JsonDocument* doc, JsonNode* parent, const char* key);
+
+  bool isNull() const { return node_ == NULL || node_->type == JsonNode::Null; }
+
+  JsonVariant& operator=(bool value);
+  JsonVariant& operator=(double value);
+  JsonVariant& operator=(float value) { return *this = (double)value; }
+  JsonVariant& operator=(const char* value);  // Kept by pointer
+  JsonVariant& operator=(char* value);        // Copied
+  JsonVariant& operator=(const String& value);
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value, JsonVariant&>::type operator=(T value) {
+    setInt((int64_t)value);
+    return *this;
+  }
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, T>::type
+  as() const {
+    return (T)asInt();
+  }
+  template <typename T>
+  typename std::enable_if<std::is_same<T, bool>::value, T>::type as() const { return asBool(); }
+  template <typename T>
+  typename std::enable_if<std::is_floating_point<T>::value, T>::type as() const { return (T)asDouble(); }
+  template <typename T>
+  typename std::enable_if<std::is_same<T, String>::value, T>::type as() const { return asString(); }
+  template <typename T>
+  typename std::enable_if<std::is_same<T, const char*>::value, T>::type as() const { return asCString(); }
+
+  template <typename T>
+  operator T() const { return as<T>(); }
+
+  // The value if it has T's type, else the default
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, T>::type
+  operator|(T fallback) const {
+    return node_ != NULL && node_->type == JsonNode::Int ? (T)node_->i : fallback;
+  }
+  bool operator|(bool fallback) const;
+  const char* operator|(const char* fallback) const;
+
+  JsonVariant operator[](const char* key) const;
+  JsonVariant operator[](size_t index) const;
+
+  JsonNode* node() const { return node_; }
+
+private:
+  JsonVariant& operator=(const JsonVariant&);
+
+  JsonNode* target();  // Creates the member if needed; NULL on overflow
+  void setInt(int64_t value);
+  int64_t asInt() const;
+  bool asBool() const;
+  double asDouble() const;
+  String asString() const;
+  const char* asCString() const;
+
+  JsonDocument* doc_;
+  JsonNode* node_;
+  JsonNode* parent_;
+  std::string key_;
+};
+
+class JsonObject {
+public:
+  JsonObject() : doc_(NULL), node_(NULL) {}
+  JsonObject(JsonDocument* doc, JsonNode* node) : doc_(doc), node_(node) {}
+
+  JsonVariant operator[](const char* key) const { return JsonVariant(doc_, node_, key); }
+  JsonArray createNestedArray(const char* key) const;
+  JsonObject createNestedObject(const char* key) const;
+  size_t size() const { return node_ != NULL ? node_->members.size() : 0; }
+  bool isNull() const { return node_ == NULL; }
+
+private:
+  JsonDocument* doc_;
+  JsonNode* node_;
+};
+
+class JsonArray {
+public:
+  JsonArray() : doc_(NULL), node_(NULL) {}
+  JsonArray(JsonDocument* doc, JsonNode* node) : doc_(doc), node_(node) {}
+
+  JsonObject createNestedObject() const;
+  JsonArray createNestedArray() const;
+  JsonVariant operator[](size_t index) const { return JsonVariant(doc_, node_).operator[](index); }
+  void remove(size_t index) const;
+  size_t size() const { return node_ != NULL ? node_->items.size() : 0; }
+  bool isNull() const { return node_ == NULL; }
+
+private:
+  JsonDocument* doc_;
+  JsonNode* node_;
+};
+
+class JsonDocument {
+public:
+  explicit JsonDocument(size_t capacity);
+  virtual ~JsonDocument() {}
+
+  JsonVariant operator[](const char* key) { return JsonVariant(this, root(), key); }
+  JsonArray createNestedArray(const char* key) { return JsonObject(this, root()).createNestedArray(key); }
+  JsonObject createNestedObject(const char* key) { return JsonObject(this, root()).createNestedObject(key); }
+  JsonVariant as() { return JsonVariant(this, &nodes_.front()); }
+
+  void clear();
+  bool overflowed() const { return overflowed_; }
+  size_t memoryUsage() const { return used_; }
+  size_t capacity() const { return capacity_; }
+
+  // Allocation within the capacity; NULL once it is used up
+  JsonNode* allocate(size_t extraBytes = 0);
+  bool reserve(size_t bytes);
+  JsonNode* root();  // The top-level object, created on first use
+  const JsonNode* top() const { return &nodes_.front(); }
+
+private:
+  JsonDocument(const JsonDocument&);
+  JsonDocument& operator=(const JsonDocument&);
+
+  size_t capacity_;
+  size_t used_;
+  bool overflowed_;
+  std::deque<JsonNode> nodes_;  // front() is the root
+};
+
+class DynamicJsonDocument : public JsonDocument {
+public:
+  explicit DynamicJsonDocument(size_t capacity) : JsonDocument(capacity) {}
+};
+
+template <size_t N>
+class StaticJsonDocument : public JsonDocument {
+public:
+  StaticJsonDocument() : JsonDocument(N) {}
+};
+
+class DeserializationError {
+public:
+  enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+
+  DeserializationError(Code code = Ok) : code_(code) {}
+  operator bool() const { return code_ != Ok; }
+  bool operator==(Code code) const { return code_ == code; }
+  bool operator!=(Code code) const { return code_ != code; }
+  Code code() const { return code_; }
+  const char* c_str() const;
+
+private:
+  Code code_;
+};
+
+namespace DeserializationOption {
+class Filter {
+public:
+  explicit Filter(JsonDocument& filter) : node_(filter.top()) {}
+  const JsonNode* node() const { return node_; }
+
+private:
+  const JsonNode* node_;
+};
+} // namespace DeserializationOption
+
+DeserializationError deserializeJson(JsonDocument& doc, const String& input);
+DeserializationError deserializeJson(JsonDocument& doc, const char* input);
+DeserializationError deserializeJson(JsonDocument& doc, const String& input,
+                                     DeserializationOption::Filter filter);
+DeserializationError deserializeJson(JsonDocument& doc, const char* input,
+                                     DeserializationOption::Filter filter);
+
+size_t serializeJson(const JsonDocument& doc, String& output);
+size_t serializeJson(const JsonDocument& doc, char* output, size_t size);
+size_t measureJson(const JsonDocument& doc);
+
+#endif // HOST_ARDUINO_JSON_H
@@ -0,0 +1,289 @@
+/*
+ * Host stand-in for the ESP32 fs::FS and fs::File
+ */
+
+#include "FS.h"
+#include "SPIFFS.h"
+#include "host_hal.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+fs::FS SPIFFS;
+
+namespace fs {
+
+static std::mutex statsLock;
+static FSStats fsStats = {0, 0, 0, 0, 0};
+
+static void countRead(size_t n) {
+  std::lock_guard<std::mutex> lock(statsLock);
+  fsStats.bytesRead += n;
+}
+
+static void countWrite(size_t n) {
+  std::lock_guard<std::mutex> lock(statsLock);
+  fsStats.bytesWritten += n;
+}
+
+class FileImpl {
+public:
+  FileImpl() : fp(NULL), directory(false), nextEntry(0) {}
+  ~FileImpl() { close(); }
+
+  void close() {
+    if (fp != NULL) fclose(fp);
+    fp = NULL;
+    directory = false;
+  }
+
+  FILE* fp;
+  bool directory;
+  std::string path;      // As the firmware names it: "/journal/00000001.log"
+  std::string name;      // Base name, as newer cores report it
+  std::vector<std::string> entries;
+  size_t nextEntry;
+};
+
+// Where a SPIFFS path lives on the host; empty if it tries to escape
+static std::string hostPath(const char* path) {
+  std::string p = path != NULL ? path : "";
+  if (p.empty() || p[0] != '/' || p.find("..") != std::string::npos) return std::string();
+  return hostHal.fsRoot + p;
+}
+
+static bool isDirectory(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static bool makeParents(const std::string& path) {
+  for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+    std::string dir = path.substr(0, slash);
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return false;
+  }
+  return true;
+}
+
+// Visit every regular file under dir
+template <typename Fn>
+static void walk(const std::string& dir, Fn fn) {
+  DIR* d = opendir(dir.c_str());
+  if (d == NULL) return;
+  struct dirent* entry;
+  while ((entry = readdir(d)) != NULL) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..") continue;
+    std::string path = dir + "/" + name;
+    if (isDirectory(path)) {
+      walk(path, fn);
+    } else {
+      fn(path);
+    }
+  }
+  closedir(d);
+}
+
+size_t File::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buf, size_t size) {
+  if (!impl_ || impl_->fp == NULL) return 0;
+  size_t n = fwrite(buf, 1, size, impl_->fp);
+  countWrite(n);
+  return n;
+}
+
+int File::available() {
+  if (!impl_ || impl_->fp == NULL) return 0;
+  return (int)(size() - position());
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek() {
+  if (!impl_ || impl_->fp == NULL) return -1;
+  int c = fgetc(impl_->fp);
+  if (c != EOF) ungetc(c, impl_->fp);
+  return c == EOF ? -1 : c;
+}
+
+void File::flush() {
+  if (impl_ && impl_->fp != NULL) fflush(impl_->fp);
+}
+
+size_t File::read(uint8_t* buf, size_t size) {
+  if (!impl_ || impl_->fp == NULL) return 0;
+  size_t n = fread(buf, 1, size, impl_->fp);
+  countRead(n);
+  return n;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!impl_ || impl_->fp == NULL) return false;
+  long offset = (long)pos;
+  if (mode == SeekCur) offset += (long)position();
+  if (mode == SeekEnd) offset = (long)size() - (long)pos;
+  // Like SPIFFS, no seeking past the end
+  if (offset < 0 || (size_t)offset > size()) return false;
+  return fseek(impl_->fp, offset, SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+  if (!impl_ || impl_->fp == NULL) return 0;
+  long pos = ftell(impl_->fp);
+  return pos < 0 ? 0 : (size_t)pos;
+}
+
+size_t File::size() const {
+  if (!impl_ || impl_->fp == NULL) return 0;
+  fflush(impl_->fp);
+  struct stat st;
+  return fstat(fileno(impl_->fp), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+void File::close() {
+  if (impl_) impl_->close();
+  impl_.reset();
+}
+
+const char* File::name() const {
+  return impl_ ? impl_->name.c_str() : "";
+}
+
+const char* File::path() const {
+  return impl_ ? impl_->path.c_str() : "";
+}
+
+bool File::isDirectory() const {
+  return impl_ && impl_->directory;
+}
+
+File File::openNextFile(const char* mode) {
+  if (!impl_ || !impl_->directory || impl_->nextEntry >= impl_->entries.size()) return File();
+  std::string path = impl_->path + "/" + impl_->entries[impl_->nextEntry++];
+  return SPIFFS.open(path.c_str(), mode);
+}
+
+File::operator bool() const {
+  return impl_ && (impl_->fp != NULL || impl_->directory);
+}
+
+bool FS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles,
+               const char* partitionLabel) {
+  (void)formatOnFail;
+  (void)basePath;
+  (void)maxOpenFiles;
+  (void)partitionLabel;
+  if (mkdir(hostHal.fsRoot.c_str(), 0755) != 0 && errno != EEXIST) return false;
+  mounted_ = isDirectory(hostHal.fsRoot);
+  return mounted_;
+}
+
+bool FS::format() {
+  std::vector<std::string> files;
+  walk(hostHal.fsRoot, [&files](const std::string& path) { files.push_back(path); });
+  for (size_t i = 0; i < files.size(); i++) {
+    unlink(files[i].c_str());
+  }
+  return true;
+}
+
+File FS::open(const char* path, const char* mode) {
+  std::string host = hostPath(path);
+  if (!mounted_ || host.empty()) return File();
+  {
+    std::lock_guard<std::mutex> lock(statsLock);
+    fsStats.opens++;
+  }
+
+  std::shared_ptr<FileImpl> impl(new FileImpl());
+  impl->path = path;
+  impl->name = impl->path.substr(impl->path.rfind('/') + 1);
+
+  if (isDirectory(host)) {
+    DIR* d = opendir(host.c_str());
+    if (d == NULL) return File();
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+      if (!isDirectory(host + "/" + entry->d_name)) impl->entries.push_back(entry->d_name);
+    }
+    closedir(d);
+    std::sort(impl->entries.begin(), impl->entries.end());
+    impl->directory = true;
+    return File(impl);
+  }
+
+  std::string m = mode != NULL ? mode : FILE_READ;
+  const char* hostMode = NULL;
+  if (m == "r") hostMode = "rb";
+  else if (m == "r+") hostMode = "r+b";
+  else if (m == "w") hostMode = "wb";
+  else if (m == "w+") hostMode = "w+b";
+  else if (m == "a") hostMode = "ab";
+  else if (m == "a+") hostMode = "a+b";
+  if (hostMode == NULL) return File();
+
+  if (m[0] != 'r' && !makeParents(host)) return File();
+  impl->fp = fopen(host.c_str(), hostMode);
+  if (impl->fp == NULL) return File();
+  return File(impl);
+}
+
+bool FS::exists(const char* path) {
+  std::string host = hostPath(path);
+  struct stat st;
+  return mounted_ && !host.empty() && stat(host.c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path) {
+  std::string host = hostPath(path);
+  if (!mounted_ || host.empty() || unlink(host.c_str()) != 0) return false;
+  std::lock_guard<std::mutex> lock(statsLock);
+  fsStats.removes++;
+  return true;
+}
+
+bool FS::rename(const char* from, const char* to) {
+  std::string hostFrom = hostPath(from);
+  std::string hostTo = hostPath(to);
+  if (!mounted_ || hostFrom.empty() || hostTo.empty() || !makeParents(hostTo)) return false;
+  if (::rename(hostFrom.c_str(), hostTo.c_str()) != 0) return false;
+  std::lock_guard<std::mutex> lock(statsLock);
+  fsStats.renames++;
+  return true;
+}
+
+size_t FS::totalBytes() {
+  return HOST_SPIFFS_BYTES;
+}
+
+size_t FS::usedBytes() {
+  size_t used = 0;
+  walk(hostHal.fsRoot, [&used](const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) used += (size_t)st.st_size;
+  });
+  return used;
+}
+
+const FSStats& FS::stats() const {
+  return fsStats;
+}
+
+void FS::resetStats() {
+  std::lock_guard<std::mutex> lock(statsLock);
+  fsStats = FSStats();
+}
+
+} // namespace fs
@@ -0,0 +1,117 @@
+/*
+ * Host stand-in for the ESP32 fs::FS and fs::File
+ *
+ * Files live under host_hal.h's fsRoot, so a run can be inspected,
+ * replayed or carried over to the next boot. SPIFFS has no directories,
+ * only names containing '/'; here the parent directories are created as
+ * files are written, and opening one lists the files inside it, as
+ * openNextFile() does on the device.
+ *
+ * Every byte read and written is counted, so storage changes can be
+ * compared by what they cost the flash.
+ */
+
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <Arduino.h>
+#include <memory>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+struct FSStats {
+  uint32_t opens;
+  uint32_t removes;
+  uint32_t renames;
+  uint64_t bytesRead;
+  uint64_t bytesWritten;
+};
+
+class FileImpl;
+
+class File : public Stream {
+public:
+  File() {}
+  explicit File(std::shared_ptr<FileImpl> impl) : impl_(impl) {}
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  void flush() override;
+  size_t read(uint8_t* buf, size_t size);
+  using Stream::readBytes;
+  size_t readBytes(char* buf, size_t size) { return read((uint8_t*)buf, size); }
+
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void close();
+  const char* name() const;
+  const char* path() const;
+  bool isDirectory() const;
+  File openNextFile(const char* mode = FILE_READ);
+
+  operator bool() const;
+
+protected:
+  bool waitForData(unsigned long timeoutMs) override {
+    (void)timeoutMs;
+    return available() > 0;
+  }
+
+private:
+  std::shared_ptr<FileImpl> impl_;
+};
+
+class FS {
+public:
+  FS() : mounted_(false) {}
+
+  bool begin(bool formatOnFail = false, const char* basePath = "/spiffs",
+             uint8_t maxOpenFiles = 10, const char* partitionLabel = NULL);
+  void end() { mounted_ = false; }
+  bool format();
+
+  File open(const char* path, const char* mode = FILE_READ);
+  File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+  bool exists(const char* path);
+  bool exists(const String& path) { return exists(path.c_str()); }
+  bool remove(const char* path);
+  bool remove(const String& path) { return remove(path.c_str()); }
+  bool rename(const char* from, const char* to);
+  bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+
+  size_t totalBytes();
+  size_t usedBytes();
+
+  const FSStats& stats() const;
+  void resetStats();
+
+private:
+  bool mounted_;
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif // HOST_FS_H
@@ -0,0 +1,240 @@
+/*
+ * Host stand-in for the ESP32 HTTPClient
+ */
+
+#include "HTTPClient.h"
+#include "host_hal.h"
+#include <strings.h>
+
+HTTPClient::HTTPClient()
+    : stream_(&client_),
+      reuse_(true),
+      canReuse_(false),
+      connectTimeout_(5000),
+      timeout_(5000),
+      port_(80),
+      size_(-1),
+      inProcess_(false) {}
+
+bool HTTPClient::begin(const String& url) {
+  std::string u = url.str();
+  size_t scheme = u.find("://");
+  if (scheme == std::string::npos || u.compare(0, scheme, "http") != 0) return false;
+
+  // Send the firmware's server URL to the one under test
+  if (!hostHal.httpOrigin.empty()) {
+    size_t pathStart = u.find('/', scheme + 3);
+    u = hostHal.httpOrigin + (pathStart == std::string::npos ? "/" : u.substr(pathStart));
+    scheme = u.find("://");
+  }
+
+  size_t hostStart = scheme + 3;
+  size_t pathStart = u.find('/', hostStart);
+  std::string authority = u.substr(hostStart, pathStart == std::string::npos ? std::string::npos
+                                                                              : pathStart - hostStart);
+  path_ = pathStart == std::string::npos ? "/" : u.substr(pathStart);
+  size_t colon = authority.rfind(':');
+  host_ = authority.substr(0, colon);
+  port_ = colon == std::string::npos ? 80 : (uint16_t)atoi(authority.c_str() + colon + 1);
+
+  std::string target = host_ + ":" + String((unsigned int)port_).str();
+  if (!connectedTo_.empty() && connectedTo_ != target) {
+    client_.stop();
+    connectedTo_.clear();
+  }
+  headers_.clear();
+  size_ = -1;
+  stream_ = &client_;
+  inProcess_ = hostHal.httpHandler != NULL;
+  return true;
+}
+
+void HTTPClient::end() {
+  // Drop what the caller left unread, as the device does
+  if (!inProcess_ && stream_ == &client_) {
+    while (client_.available() > 0 && client_.read() >= 0) {}
+  }
+  body_.setBuffer(std::string());
+  if (!reuse_ || !canReuse_) {
+    client_.stop();
+    connectedTo_.clear();
+  }
+}
+
+bool HTTPClient::connected() {
+  if (connectedTo_.empty()) return false;
+  if (inProcess_) return true;
+  if (!client_.connected()) {
+    connectedTo_.clear();
+    return false;
+  }
+  return true;
+}
+
+void HTTPClient::addHeader(const String& name, const String& value) {
+  headers_.push_back(std::make_pair(name.str(), value.str()));
+}
+
+int HTTPClient::GET() {
+  return request("GET", NULL, 0);
+}
+
+int HTTPClient::POST(uint8_t* payload, size_t size) {
+  return request("POST", payload, size);
+}
+
+int HTTPClient::request(const char* method, const uint8_t* payload, size_t size) {
+  if (WiFi.status() != WL_CONNECTED) {
+    bool wasOpen = !connectedTo_.empty();
+    client_.stop();
+    connectedTo_.clear();
+    return wasOpen ? HTTPC_ERROR_CONNECTION_LOST : HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  if (hostHal.httpLatencyMs > 0) hostHal.sleep(hostHal.httpLatencyMs);
+  return inProcess_ ? requestInProcess(method, payload, size) : requestSocket(method, payload, size);
+}
+
+int HTTPClient::requestInProcess(const char* method, const uint8_t* payload, size_t size) {
+  HostHttpRequest request;
+  request.method = method;
+  request.path = path_;
+  request.body.assign((const char*)payload, payload != NULL ? size : 0);
+  for (size_t i = 0; i < headers_.size(); i++) {
+    if (strcasecmp(headers_[i].first.c_str(), "Content-Type") == 0) request.contentType = headers_[i].second;
+    if (strcasecmp(headers_[i].first.c_str(), "X-Device-Key") == 0) request.deviceKey = headers_[i].second;
+  }
+
+  HostHttpResponse response;
+  response.status = 404;
+  hostHal.httpHandler->handle(request, &response);
+
+  connectedTo_ = host_ + ":" + String((unsigned int)port_).str();
+  canReuse_ = true;
+  size_ = (int)response.body.size();
+  body_.setBuffer(response.body);
+  stream_ = &body_;
+  return response.status;
+}
+
+int HTTPClient::requestSocket(const char* method, const uint8_t* payload, size_t size) {
+  std::string target = host_ + ":" + String((unsigned int)port_).str();
+  if (!connected()) {
+    if (!client_.connect(host_.c_str(), port_, connectTimeout_)) return HTTPC_ERROR_CONNECTION_REFUSED;
+    connectedTo_ = target;
+  }
+  client_.setTimeout(timeout_);
+
+  std::string header = std::string(method) + " " + path_ + " HTTP/1.1\r\n";
+  header += "Host: " + host_ + "\r\n";
+  header += "User-Agent: ESP32HTTPClient\r\n";
+  header += reuse_ ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+  header += "Accept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n";
+  if (payload != NULL || strcmp(method, "POST") == 0) {
+    header += "Content-Length: " + String((unsigned long)size).str() + "\r\n";
+  }
+  for (size_t i = 0; i < headers_.size(); i++) {
+    header += headers_[i].first + ": " + headers_[i].second + "\r\n";
+  }
+  header += "\r\n";
+
+  if (client_.write((const uint8_t*)header.data(), header.size()) != header.size()) {
+    client_.stop();
+    connectedTo_.clear();
+    return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+  if (size > 0 && client_.write(payload, size) != size) {
+    client_.stop();
+    connectedTo_.clear();
+    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+
+  // A keep-alive connection the server closed answers with nothing
+  std::string line;
+  if (!readLine(&line) || line.empty()) {
+    bool lost = !client_.connected();
+    client_.stop();
+    connectedTo_.clear();
+    return lost ? HTTPC_ERROR_CONNECTION_LOST : HTTPC_ERROR_READ_TIMEOUT;
+  }
+  int code = 0;
+  char version[16] = "";
+  if (sscanf(line.c_str(), "HTTP/%15s %d", version, &code) != 2 || code <= 0) {
+    client_.stop();
+    connectedTo_.clear();
+    return HTTPC_ERROR_NO_HTTP_SERVER;
+  }
+
+  canReuse_ = strcmp(version, "1.1") == 0;
+  bool chunked = false;
+  size_ = -1;
+  while (readLine(&line) && !line.empty()) {
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    std::string name = line.substr(0, colon);
+    std::string value = line.substr(colon + 1);
+    while (!value.empty() && value[0] == ' ') value.erase(0, 1);
+    if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+      size_ = atoi(value.c_str());
+    } else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+      chunked = strcasecmp(value.c_str(), "chunked") == 0;
+    } else if (strcasecmp(name.c_str(), "Connection") == 0) {
+      if (strcasecmp(value.c_str(), "close") == 0) canReuse_ = false;
+      if (strcasecmp(value.c_str(), "keep-alive") == 0) canReuse_ = true;
+    }
+  }
+
+  stream_ = &client_;
+  if (chunked) {
+    std::string body;
+    if (!readChunked(&body)) {
+      client_.stop();
+      connectedTo_.clear();
+      return HTTPC_ERROR_READ_TIMEOUT;
+    }
+    size_ = -1;
+    body_.setBuffer(body);
+    stream_ = &body_;
+  } else if (size_ < 0) {
+    canReuse_ = false;  // Body runs to the end of the connection
+  }
+  return code;
+}
+
+bool HTTPClient::readLine(std::string* line) {
+  String s = client_.readStringUntil('\n');
+  if (s.length() == 0 && !client_.connected()) return false;
+  *line = s.str();
+  if (!line->empty() && (*line)[line->size() - 1] == '\r') line->erase(line->size() - 1);
+  return true;
+}
+
+bool HTTPClient::readChunked(std::string* body) {
+  std::string line;
+  for (;;) {
+    if (!readLine(&line)) return false;
+    unsigned long len = strtoul(line.c_str(), NULL, 16);
+    if (len == 0) break;
+    std::vector<char> chunk(len);
+    if (client_.readBytes(chunk.data(), len) != len) return false;
+    body->append(chunk.data(), len);
+    readLine(&line);
+  }
+  // Trailers end with an empty line
+  while (readLine(&line) && !line.empty()) {}
+  return true;
+}
+
+String HTTPClient::getString() {
+  // Chunked bodies are already in memory; others without a length run to
+  // the end of the connection
+  if (size_ < 0) return stream_->readString();
+
+  std::string body(size_, '\0');
+  size_t got = stream_->readBytes(&body[0], body.size());
+  body.resize(got);
+  return String(body);
+}
+
+WiFiClient* HTTPClient::getStreamPtr() {
+  return stream_;
+}
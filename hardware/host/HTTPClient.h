@@ -0,0 +1,82 @@
+/*
+ * Host stand-in for the ESP32 HTTPClient
+ *
+ * HTTP/1.1 over WiFiClient with the same keep-alive rules as the device:
+ * with setReuse(true) the connection survives end() when the server kept
+ * it open, and a request on a connection the server has since closed
+ * fails with HTTPC_ERROR_CONNECTION_LOST for the caller to retry. Bodies
+ * come with a Content-Length or chunked; chunked ones are read whole and
+ * report a size of -1.
+ *
+ * With host_hal.h's httpHandler set, requests are answered in-process
+ * and the response is served from memory. Either way a request fails
+ * while WiFi is down.
+ */
+
+#ifndef HOST_HTTP_CLIENT_H
+#define HOST_HTTP_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <string>
+#include <vector>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED  (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED       (-4)
+#define HTTPC_ERROR_CONNECTION_LOST     (-5)
+#define HTTPC_ERROR_NO_STREAM           (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER      (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM        (-8)
+#define HTTPC_ERROR_ENCODING            (-9)
+#define HTTPC_ERROR_STREAM_WRITE        (-10)
+#define HTTPC_ERROR_READ_TIMEOUT        (-11)
+
+#define HTTP_CODE_OK 200
+
+class HTTPClient {
+public:
+  HTTPClient();
+
+  bool begin(const String& url);
+  void end();
+  bool connected();
+
+  void setReuse(bool reuse) { reuse_ = reuse; }
+  void setConnectTimeout(int32_t timeoutMs) { connectTimeout_ = timeoutMs; }
+  void setTimeout(uint16_t timeoutMs) { timeout_ = timeoutMs; }
+  void addHeader(const String& name, const String& value);
+
+  int GET();
+  int POST(uint8_t* payload, size_t size);
+  int POST(const String& payload) { return POST((uint8_t*)payload.c_str(), payload.length()); }
+
+  int getSize() const { return size_; }
+  String getString();
+  WiFiClient* getStreamPtr();
+
+private:
+  int request(const char* method, const uint8_t* payload, size_t size);
+  int requestInProcess(const char* method, const uint8_t* payload, size_t size);
+  int requestSocket(const char* method, const uint8_t* payload, size_t size);
+  bool readLine(std::string* line);
+  bool readChunked(std::string* body);
+
+  WiFiClient client_;  // The connection
+  WiFiClient body_;    // Bodies served from memory: in-process and chunked
+  WiFiClient* stream_;
+  bool reuse_;
+  bool canReuse_;
+  int32_t connectTimeout_;
+  uint16_t timeout_;
+  std::string host_;
+  uint16_t port_;
+  std::string path_;
+  std::string connectedTo_;  // host:port of the open connection
+  std::vector<std::pair<std::string, std::string> > headers_;
+  int size_;
+  bool inProcess_;
+};
+
+#endif // HOST_HTTP_CLIENT_H
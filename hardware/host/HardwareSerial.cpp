@@ -0,0 +1,21 @@
+/*
+ * Host stand-in for the ESP32 HardwareSerial
+ */
+
+#include "HardwareSerial.h"
+#include "host_hal.h"
+#include <stdio.h>
+
+HardwareSerial Serial(0);
+
+void HardwareSerial::flush() {
+  if (uart_ == 0) fflush(stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t size) {
+  if (uart_ != 0) return size;
+  if (hostHal.serialEcho) {
+    hostHal.output(buf, size);
+  }
+  return size;
+}
@@ -0,0 +1,45 @@
+/*
+ * Host stand-in for the ESP32 HardwareSerial
+ *
+ * UART 0 (Serial) goes to stdout while host_hal.h echoes serial output.
+ * The other UARTs only carry the fingerprint sensor, whose protocol the
+ * Adafruit_Fingerprint stand-in models directly, so they read nothing.
+ */
+
+#ifndef HOST_HARDWARE_SERIAL_H
+#define HOST_HARDWARE_SERIAL_H
+
+#include "Stream.h"
+
+#define SERIAL_8N1 0x800001c
+
+class HardwareSerial : public Stream {
+public:
+  explicit HardwareSerial(int uart) : uart_(uart), baud_(0) {}
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) {
+    (void)config;
+    (void)rxPin;
+    (void)txPin;
+    baud_ = baud;
+  }
+  void end() { baud_ = 0; }
+  unsigned long baudRate() const { return baud_; }
+
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override;
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+
+private:
+  int uart_;
+  unsigned long baud_;
+};
+
+extern HardwareSerial Serial;
+
+#endif // HOST_HARDWARE_SERIAL_H
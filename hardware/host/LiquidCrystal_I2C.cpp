@@ -0,0 +1,53 @@
+/*
+ * Host stand-in for LiquidCrystal_I2C
+ */
+
+#include "LiquidCrystal_I2C.h"
+#include "host_hal.h"
+#include <chrono>
+#include <thread>
+
+#define LCD_I2C_BYTES_PER_LCD_BYTE  12    // Six transactions of address + data
+#define LCD_I2C_US_PER_BYTE         90    // 9 bits at 100 kHz
+#define LCD_CLEAR_US                2000
+
+LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows)
+    : address_(address), cols_(cols), rows_(rows), col_(0), row_(0) {}
+
+void LiquidCrystal_I2C::send(size_t lcdBytes, uint32_t extraUs) {
+  size_t busBytes = lcdBytes * LCD_I2C_BYTES_PER_LCD_BYTE;
+  hostHal.lcdBusBytes += (uint32_t)busBytes;
+  if (hostHal.lcdTiming) {
+    std::this_thread::sleep_for(std::chrono::microseconds(busBytes * LCD_I2C_US_PER_BYTE + extraUs));
+  }
+}
+
+void LiquidCrystal_I2C::init() {
+  // Function set, display control, entry mode and clear
+  send(6, LCD_CLEAR_US);
+  hostHal.lcdClear();
+  col_ = 0;
+  row_ = 0;
+}
+
+void LiquidCrystal_I2C::clear() {
+  send(1, LCD_CLEAR_US);
+  hostHal.lcdClear();
+  col_ = 0;
+  row_ = 0;
+}
+
+void LiquidCrystal_I2C::setCursor(uint8_t col, uint8_t row) {
+  send(1, 0);
+  col_ = col;
+  row_ = row < rows_ ? row : rows_ - 1;
+}
+
+size_t LiquidCrystal_I2C::write(const uint8_t* buf, size_t size) {
+  send(size, 0);
+  for (size_t i = 0; i < size; i++) {
+    hostHal.lcdPut(col_, row_, (char)buf[i]);
+    col_++;
+  }
+  return size;
+}
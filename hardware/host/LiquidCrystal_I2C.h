@@ -0,0 +1,42 @@
+/*
+ * Host stand-in for LiquidCrystal_I2C: an HD44780 16x2 behind a PCF8574
+ *
+ * Characters land in host_hal.h's screen buffer. Each byte sent to the
+ * panel costs six 2-byte I2C transactions in 4-bit mode, about 1.1 ms at
+ * 100 kHz, and a clear adds the panel's 2 ms; with lcdTiming on, writes
+ * take that long here too.
+ */
+
+#ifndef HOST_LIQUID_CRYSTAL_I2C_H
+#define HOST_LIQUID_CRYSTAL_I2C_H
+
+#include <Arduino.h>
+
+class LiquidCrystal_I2C : public Print {
+public:
+  LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows);
+
+  void init();
+  void begin(uint8_t cols, uint8_t rows) { cols_ = cols; rows_ = rows; init(); }
+  void clear();
+  void home() { setCursor(0, 0); }
+  void setCursor(uint8_t col, uint8_t row);
+  void backlight() { send(0, 1); }
+  void noBacklight() { send(0, 1); }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+
+private:
+  // Bus time and bytes for commands and characters sent to the panel
+  void send(size_t lcdBytes, uint32_t extraUs);
+
+  uint8_t address_;
+  uint8_t cols_;
+  uint8_t rows_;
+  uint8_t col_;
+  uint8_t row_;
+};
+
+#endif // HOST_LIQUID_CRYSTAL_I2C_H
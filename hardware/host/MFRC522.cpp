@@ -0,0 +1,112 @@
+/*
+ * Host stand-in for the MFRC522 library
+ */
+
+#include "MFRC522.h"
+#include "host_hal.h"
+
+#define MFRC522_VERSION_2   0x92
+#define COM_IEN_RX          0x20  // RxIEn
+#define COM_IRQ_SET1        0x80  // Write 1s instead of clearing
+#define BIT_FRAMING_START   0x80  // StartSend
+
+MFRC522::MFRC522(byte ssPin, byte rstPin)
+    : ssPin_(ssPin), rstPin_(rstPin), reader_(0), command_(PCD_Idle), comIEn_(0),
+      irqAsserted_(false), haltedSerial_(0) {
+  memset(&uid, 0, sizeof(uid));
+}
+
+void MFRC522::PCD_Init() {
+  reader_ = hostHal.attachReader(ssPin_);
+  command_ = PCD_Idle;
+  comIEn_ = 0;
+  setIrq(false);
+}
+
+byte MFRC522::PCD_ReadRegister(PCD_Register reg) {
+  switch (reg) {
+    case VersionReg:
+      return MFRC522_VERSION_2;
+    case CommandReg:
+      return command_;
+    case ComIEnReg:
+      return comIEn_;
+    case ComIrqReg:
+      return irqAsserted_ ? COM_IEN_RX : 0;
+    default:
+      return 0;
+  }
+}
+
+void MFRC522::PCD_WriteRegister(PCD_Register reg, byte value) {
+  switch (reg) {
+    case CommandReg:
+      command_ = value & 0x0F;
+      break;
+    case ComIEnReg:
+      comIEn_ = value;
+      break;
+    case ComIrqReg:
+      if (!(value & COM_IRQ_SET1)) setIrq(false);
+      break;
+    case BitFramingReg:
+      // StartSend of the queued REQA: an idle card answers within microseconds
+      if ((value & BIT_FRAMING_START) && command_ == PCD_Transceive) {
+        uint8_t uidBytes[HOST_UID_MAX_LEN];
+        uint8_t uidLen;
+        uint32_t serial;
+        if (cardAnswers(uidBytes, &uidLen, &serial)) received();
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+bool MFRC522::PICC_IsNewCardPresent() {
+  uint8_t uidBytes[HOST_UID_MAX_LEN];
+  uint8_t uidLen;
+  uint32_t serial;
+  if (!cardAnswers(uidBytes, &uidLen, &serial)) {
+    hostHal.sleep(HOST_REQA_TIMEOUT_MS);
+    return false;
+  }
+  received();
+  return true;
+}
+
+bool MFRC522::PICC_ReadCardSerial() {
+  uint8_t uidBytes[HOST_UID_MAX_LEN];
+  uint8_t uidLen;
+  uint32_t serial;
+  hostHal.sleep(HOST_SELECT_MS);
+  if (!cardAnswers(uidBytes, &uidLen, &serial)) return false;
+
+  uid.size = uidLen;
+  memcpy(uid.uidByte, uidBytes, uidLen);
+  uid.sak = 0x08;
+  if (hostHal.listener != NULL) hostHal.listener->cardSelected(uid.uidByte, uid.size);
+  received();
+  return true;
+}
+
+MFRC522::StatusCode MFRC522::PICC_HaltA() {
+  uint8_t uidBytes[HOST_UID_MAX_LEN];
+  uint8_t uidLen;
+  uint32_t serial;
+  if (hostHal.cardInField(reader_, uidBytes, &uidLen, &serial)) haltedSerial_ = serial;
+  return STATUS_OK;
+}
+
+bool MFRC522::cardAnswers(uint8_t* uidBytes, uint8_t* uidLen, uint32_t* serial) {
+  return hostHal.cardInField(reader_, uidBytes, uidLen, serial) && *serial != haltedSerial_;
+}
+
+void MFRC522::received() {
+  if (comIEn_ & COM_IEN_RX) setIrq(true);
+}
+
+void MFRC522::setIrq(bool asserted) {
+  irqAsserted_ = asserted;
+  hostHal.readerIrq(reader_, asserted);
+}
@@ -0,0 +1,99 @@
+/*
+ * Host stand-in for the MFRC522 library
+ *
+ * Models the reader and a card in its field, as host_hal.h presents it;
+ * each chip select is its own reader with its own field. A card answers
+ * REQA until it is halted, and stays halted until it leaves the field. A
+ * REQA with no answer costs the reader's receive timeout. With RxIEn
+ * enabled in ComIEnReg, an answered Transceive pulls the IRQ line
+ * (host_hal.h's rfidIrqPin, shared by all readers) low, firing whatever
+ * interrupt is attached to it, until ComIrqReg is cleared.
+ */
+
+#ifndef HOST_MFRC522_H
+#define HOST_MFRC522_H
+
+#include <Arduino.h>
+
+class MFRC522 {
+public:
+  enum PCD_Register : byte {
+    CommandReg    = 0x01 << 1,
+    ComIEnReg     = 0x02 << 1,
+    DivIEnReg     = 0x03 << 1,
+    ComIrqReg     = 0x04 << 1,
+    DivIrqReg     = 0x05 << 1,
+    ErrorReg      = 0x06 << 1,
+    Status1Reg    = 0x07 << 1,
+    Status2Reg    = 0x08 << 1,
+    FIFODataReg   = 0x09 << 1,
+    FIFOLevelReg  = 0x0A << 1,
+    ControlReg    = 0x0C << 1,
+    BitFramingReg = 0x0D << 1,
+    CollReg       = 0x0E << 1,
+    ModeReg       = 0x11 << 1,
+    TxControlReg  = 0x14 << 1,
+    RFCfgReg      = 0x26 << 1,
+    VersionReg    = 0x37 << 1
+  };
+
+  enum PCD_Command : byte {
+    PCD_Idle       = 0x00,
+    PCD_Mem        = 0x01,
+    PCD_CalcCRC    = 0x03,
+    PCD_Transmit   = 0x04,
+    PCD_Receive    = 0x08,
+    PCD_Transceive = 0x0C,
+    PCD_MFAuthent  = 0x0E,
+    PCD_SoftReset  = 0x0F
+  };
+
+  enum PICC_Command : byte {
+    PICC_CMD_REQA = 0x26,
+    PICC_CMD_WUPA = 0x52,
+    PICC_CMD_HLTA = 0x50
+  };
+
+  enum StatusCode : byte {
+    STATUS_OK = 0,
+    STATUS_ERROR = 1,
+    STATUS_TIMEOUT = 3
+  };
+
+  typedef struct {
+    byte size;
+    byte uidByte[10];
+    byte sak;
+  } Uid;
+
+  Uid uid;
+
+  static const byte UNUSED_PIN = UINT8_MAX;  // No RST line: soft reset only
+
+  MFRC522(byte ssPin, byte rstPin);
+
+  void PCD_Init();
+  byte PCD_ReadRegister(PCD_Register reg);
+  void PCD_WriteRegister(PCD_Register reg, byte value);
+
+  bool PICC_IsNewCardPresent();
+  bool PICC_ReadCardSerial();
+  StatusCode PICC_HaltA();
+  void PCD_StopCrypto1() {}
+
+private:
+  // Card in the field that would answer REQA; false if none or halted
+  bool cardAnswers(uint8_t* uidBytes, uint8_t* uidLen, uint32_t* serial);
+  void received();  // A frame came back: raise RxIRq
+  void setIrq(bool asserted);
+
+  byte ssPin_;
+  byte rstPin_;
+  uint8_t reader_;  // hostHal's number for ssPin_
+  byte command_;
+  byte comIEn_;
+  bool irqAsserted_;
+  uint32_t haltedSerial_;  // hostHal card serial that was halted
+};
+
+#endif // HOST_MFRC522_H
@@ -0,0 +1,7 @@
+/*
+ * Host stand-in for the ESP32 SPI bus
+ */
+
+#include "SPI.h"
+
+SPIClass SPI;
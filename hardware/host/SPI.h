@@ -0,0 +1,28 @@
+/*
+ * Host stand-in for the ESP32 SPI bus; the MFRC522 stand-in models the
+ * reader directly, so the bus only records its pins
+ */
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include <Arduino.h>
+
+class SPIClass {
+public:
+  SPIClass() : sck_(-1), miso_(-1), mosi_(-1), ss_(-1) {}
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {
+    sck_ = sck;
+    miso_ = miso;
+    mosi_ = mosi;
+    ss_ = ss;
+  }
+  void end() {}
+
+private:
+  int8_t sck_, miso_, mosi_, ss_;
+};
+
+extern SPIClass SPI;
+
+#endif // HOST_SPI_H
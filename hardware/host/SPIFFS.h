@@ -0,0 +1,14 @@
+/*
+ * Host stand-in for the ESP32 SPIFFS filesystem; see FS.h
+ */
+
+#ifndef HOST_SPIFFS_H
+#define HOST_SPIFFS_H
+
+#include "FS.h"
+
+#define HOST_SPIFFS_BYTES 917504  // The spiffs partition in partitions.csv
+
+extern fs::FS SPIFFS;
+
+#endif // HOST_SPIFFS_H
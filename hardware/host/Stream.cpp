@@ -0,0 +1,80 @@
+/*
+ * Host stand-ins for the Arduino Print and Stream classes
+ */
+
+#include "Stream.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+size_t Print::write(const uint8_t* buf, size_t size) {
+  size_t n = 0;
+  while (n < size && write(buf[n]) == 1) n++;
+  return n;
+}
+
+size_t Print::printf(const char* fmt, ...) {
+  char small[128];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(small, sizeof(small), fmt, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if ((size_t)len < sizeof(small)) return write((const uint8_t*)small, len);
+
+  std::vector<char> big(len + 1);
+  va_start(args, fmt);
+  vsnprintf(big.data(), big.size(), fmt, args);
+  va_end(args);
+  return write((const uint8_t*)big.data(), len);
+}
+
+bool Stream::waitForData(unsigned long timeoutMs) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  while (available() <= 0) {
+    if (std::chrono::steady_clock::now() >= deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+int Stream::timedRead() {
+  if (available() <= 0 && !waitForData(timeout_)) return -1;
+  return read();
+}
+
+size_t Stream::readBytes(char* buf, size_t len) {
+  size_t n = 0;
+  while (n < len) {
+    int c = timedRead();
+    if (c < 0) break;
+    buf[n++] = (char)c;
+  }
+  return n;
+}
+
+size_t Stream::readBytesUntil(char terminator, char* buf, size_t len) {
+  size_t n = 0;
+  while (n < len) {
+    int c = timedRead();
+    if (c < 0 || c == terminator) break;
+    buf[n++] = (char)c;
+  }
+  return n;
+}
+
+String Stream::readString() {
+  std::string s;
+  int c;
+  while ((c = timedRead()) >= 0) s += (char)c;
+  return String(s);
+}
+
+String Stream::readStringUntil(char terminator) {
+  std::string s;
+  int c;
+  while ((c = timedRead()) >= 0 && c != terminator) s += (char)c;
+  return String(s);
+}
@@ -0,0 +1,74 @@
+/*
+ * Host stand-ins for the Arduino Print and Stream classes
+ *
+ * Stream reads wait up to the stream's timeout for each byte, as on the
+ * device, by polling available(); subclasses that can block on a socket
+ * override waitForData().
+ */
+
+#ifndef HOST_STREAM_H
+#define HOST_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+
+class Print {
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size);
+  size_t write(const char* s) { return s != NULL ? write((const uint8_t*)s, strlen(s)) : 0; }
+  size_t write(const char* buf, size_t size) { return write((const uint8_t*)buf, size); }
+
+  size_t print(const char* s) { return write(s); }
+  size_t print(const String& s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(double value, int digits = 2) { return print(String(value, (unsigned int)digits)); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& value) { return print(value) + println(); }
+
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+  Stream() : timeout_(1000) {}
+
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual void flush() {}
+
+  void setTimeout(unsigned long timeoutMs) { timeout_ = timeoutMs; }
+  unsigned long getTimeout() const { return timeout_; }
+
+  size_t readBytes(char* buf, size_t len);
+  size_t readBytes(uint8_t* buf, size_t len) { return readBytes((char*)buf, len); }
+  size_t readBytesUntil(char terminator, char* buf, size_t len);
+  size_t readBytesUntil(char terminator, uint8_t* buf, size_t len) {
+    return readBytesUntil(terminator, (char*)buf, len);
+  }
+  String readString();
+  String readStringUntil(char terminator);
+
+protected:
+  // Block up to timeoutMs for a byte; true if one is available
+  virtual bool waitForData(unsigned long timeoutMs);
+  int timedRead();
+
+  unsigned long timeout_;
+};
+
+#endif // HOST_STREAM_H
@@ -0,0 +1,137 @@
+/*
+ * Host stand-in for the Arduino String class
+ */
+
+#include "WString.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static std::string formatUnsigned(unsigned long long value, unsigned char base) {
+  static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  if (base < 2 || base > 36) base = 10;
+  char buf[72];
+  int pos = sizeof(buf);
+  buf[--pos] = '\0';
+  do {
+    buf[--pos] = digits[value % base];
+    value /= base;
+  } while (value > 0);
+  return std::string(buf + pos);
+}
+
+static std::string formatSigned(long long value, unsigned char base) {
+  // Like the Arduino core, only base 10 gets a sign
+  if (value < 0 && base == 10) return "-" + formatUnsigned(0ULL - (unsigned long long)value, base);
+  return formatUnsigned((unsigned long long)value, base);
+}
+
+String::String(const char* s) : s_(s != NULL ? s : "") {}
+String::String(char c) : s_(1, c) {}
+String::String(int value, unsigned char base) : s_(formatSigned(value, base)) {}
+String::String(unsigned int value, unsigned char base) : s_(formatUnsigned(value, base)) {}
+String::String(long value, unsigned char base) : s_(formatSigned(value, base)) {}
+String::String(unsigned long value, unsigned char base) : s_(formatUnsigned(value, base)) {}
+String::String(long long value, unsigned char base) : s_(formatSigned(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : s_(formatUnsigned(value, base)) {}
+
+String::String(double value, unsigned int decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", (int)decimals, value);
+  s_ = buf;
+}
+
+String String::substring(unsigned int from) const {
+  return from < s_.size() ? String(s_.substr(from)) : String();
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    unsigned int t = from;
+    from = to;
+    to = t;
+  }
+  if (from >= s_.size()) return String();
+  return String(s_.substr(from, to - from));
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t pos = s_.find(c, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String& s, unsigned int from) const {
+  size_t pos = s_.find(s.s_, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const {
+  size_t pos = s_.rfind(c);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+bool String::startsWith(const String& prefix) const {
+  return s_.compare(0, prefix.s_.size(), prefix.s_) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+  return s_.size() >= suffix.s_.size() &&
+         s_.compare(s_.size() - suffix.s_.size(), suffix.s_.size(), suffix.s_) == 0;
+}
+
+long String::toInt() const {
+  return strtol(s_.c_str(), NULL, 10);
+}
+
+double String::toFloat() const {
+  return strtod(s_.c_str(), NULL);
+}
+
+void String::trim() {
+  size_t start = 0;
+  while (start < s_.size() && isspace((unsigned char)s_[start])) start++;
+  size_t end = s_.size();
+  while (end > start && isspace((unsigned char)s_[end - 1])) end--;
+  s_ = s_.substr(start, end - start);
+}
+
+void String::toUpperCase() {
+  for (size_t i = 0; i < s_.size(); i++) s_[i] = (char)toupper((unsigned char)s_[i]);
+}
+
+void String::toLowerCase() {
+  for (size_t i = 0; i < s_.size(); i++) s_[i] = (char)tolower((unsigned char)s_[i]);
+}
+
+void String::replace(const String& find, const String& with) {
+  if (find.s_.empty()) return;
+  size_t pos = 0;
+  while ((pos = s_.find(find.s_, pos)) != std::string::npos) {
+    s_.replace(pos, find.s_.size(), with.s_);
+    pos += with.s_.size();
+  }
+}
+
+String operator+(const String& a, const String& b) {
+  String sum(a);
+  sum += b;
+  return sum;
+}
+
+String operator+(const String& a, const char* b) {
+  String sum(a);
+  sum += b;
+  return sum;
+}
+
+String operator+(const char* a, const String& b) {
+  String sum(a);
+  sum += b;
+  return sum;
+}
+
+String operator+(const String& a, char b) {
+  String sum(a);
+  sum += b;
+  return sum;
+}
@@ -0,0 +1,79 @@
+/*
+ * Host stand-in for the Arduino String class
+ *
+ * The subset the firmware uses, backed by std::string. Like the original
+ * it allocates on every change, so it stays off the tap path here too.
+ */
+
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+class String {
+public:
+  String(const char* s = "");
+  String(const std::string& s) : s_(s) {}
+  explicit String(char c);
+  String(int value, unsigned char base = 10);
+  String(unsigned int value, unsigned char base = 10);
+  String(long value, unsigned char base = 10);
+  String(unsigned long value, unsigned char base = 10);
+  String(long long value, unsigned char base = 10);
+  String(unsigned long long value, unsigned char base = 10);
+  String(double value, unsigned int decimals = 2);
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return (unsigned int)s_.size(); }
+  bool isEmpty() const { return s_.empty(); }
+  void reserve(unsigned int size) { s_.reserve(size); }
+
+  char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : '\0'; }
+  char& operator[](unsigned int i) { return s_[i]; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+
+  String& operator+=(const String& other) { s_ += other.s_; return *this; }
+  String& operator+=(const char* other) { s_ += other != NULL ? other : ""; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  String& operator+=(int value) { return *this += String(value); }
+  String& operator+=(unsigned int value) { return *this += String(value); }
+  String& operator+=(long value) { return *this += String(value); }
+  String& operator+=(unsigned long value) { return *this += String(value); }
+  bool concat(const String& other) { s_ += other.s_; return true; }
+
+  bool operator==(const String& other) const { return s_ == other.s_; }
+  bool operator==(const char* other) const { return s_ == (other != NULL ? other : ""); }
+  bool operator!=(const String& other) const { return !(*this == other); }
+  bool operator!=(const char* other) const { return !(*this == other); }
+  bool operator<(const String& other) const { return s_ < other.s_; }
+  bool equals(const String& other) const { return *this == other; }
+
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String& s, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  bool startsWith(const String& prefix) const;
+  bool endsWith(const String& suffix) const;
+
+  long toInt() const;
+  double toFloat() const;
+  void trim();
+  void toUpperCase();
+  void toLowerCase();
+  void replace(const String& find, const String& with);
+
+  const std::string& str() const { return s_; }
+
+private:
+  std::string s_;
+};
+
+String operator+(const String& a, const String& b);
+String operator+(const String& a, const char* b);
+String operator+(const char* a, const String& b);
+String operator+(const String& a, char b);
+
+#endif // HOST_WSTRING_H
@@ -0,0 +1,310 @@
+/*
+ * Host stand-in for the ESP32 WiFi station and WiFiClient
+ */
+
+#include "WiFi.h"
+#include "host_hal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+WiFiClass WiFi;
+
+// The access point's, as the station reads it once joined
+static const uint8_t hostBssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+static bool reached(uint32_t now, uint32_t at) {
+  return (int32_t)(now - at) >= 0;
+}
+
+String IPAddress::toString() const {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", octets_[0], octets_[1], octets_[2], octets_[3]);
+  return String(buf);
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password, int32_t channel,
+                             const uint8_t* bssid, bool connect) {
+  (void)password;
+  ssid_ = ssid != NULL ? ssid : "";
+  channelHint_ = channel;
+  bssidHint_ = bssid != NULL && memcmp(bssid, hostBssid, sizeof(hostBssid)) != 0;
+  joinMs_ = hostHal.associateMs + (channel == 0 ? hostHal.scanMs.load() : 0) +
+            (local_ == 0 ? hostHal.dhcpMs.load() : 0);
+  if (!connect) return status();
+  begunAt_ = millis();
+  begun_ = true;
+  // A new join starts over: with the AP gone it reports no SSID, not a lost link
+  int connected = WL_CONNECTED;
+  if (!lastStatus_.compare_exchange_strong(connected, WL_CONNECTED)) lastStatus_ = WL_DISCONNECTED;
+  return status();
+}
+
+bool WiFiClass::config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1) {
+  local_ = (uint32_t)local;
+  gateway_ = (uint32_t)gateway;
+  subnet_ = (uint32_t)subnet;
+  dns_ = (uint32_t)dns1;
+  return true;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+  if (wifiOff) mode_ = WIFI_OFF;
+  begun_ = false;
+  status();
+  return true;
+}
+
+bool WiFiClass::reconnect() {
+  begunAt_ = millis();
+  begun_ = true;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  wl_status_t status = WL_DISCONNECTED;
+  if (!begun_) {
+    status = WL_IDLE_STATUS;
+  } else if (!hostHal.accessPointUp()) {
+    status = lastStatus_ == WL_CONNECTED || lastStatus_ == WL_CONNECTION_LOST ? WL_CONNECTION_LOST
+                                                                              : WL_NO_SSID_AVAIL;
+  } else {
+    // Without auto-reconnect, an AP that came back after begin() stays lost
+    uint32_t upSince = hostHal.accessPointUpSince();
+    uint32_t from = begunAt_;
+    bool joinable = autoReconnect_ || reached(from, upSince);
+    if (channelHint_ != 0 && channelHint_ != hostHal.apChannel) joinable = false;
+    if (bssidHint_) joinable = false;
+    if ((int32_t)(upSince - from) > 0) from = upSince;
+    if (joinable && reached(millis(), from + joinMs_)) status = WL_CONNECTED;
+  }
+
+  int was = lastStatus_.exchange(status);
+  if ((was == WL_CONNECTED) != (status == WL_CONNECTED)) {
+    hostHal.event("wifi %s", status == WL_CONNECTED ? "connected" : "disconnected");
+  }
+  return status;
+}
+
+IPAddress WiFiClass::localIP() {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return local_ != 0 ? IPAddress(local_.load()) : IPAddress(127, 0, 0, 1);
+}
+
+IPAddress WiFiClass::gatewayIP() {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return local_ != 0 ? IPAddress(gateway_.load()) : IPAddress(127, 0, 0, 1);
+}
+
+IPAddress WiFiClass::subnetMask() {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return local_ != 0 ? IPAddress(subnet_.load()) : IPAddress(255, 0, 0, 0);
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t dnsNo) {
+  if (status() != WL_CONNECTED || dnsNo != 0) return IPAddress();
+  return local_ != 0 ? IPAddress(dns_.load()) : IPAddress(127, 0, 0, 1);
+}
+
+uint8_t* WiFiClass::BSSID() {
+  if (status() != WL_CONNECTED) return NULL;
+  memcpy(bssid_, hostBssid, sizeof(bssid_));
+  return bssid_;
+}
+
+int32_t WiFiClass::channel() {
+  return status() == WL_CONNECTED ? hostHal.apChannel.load() : 0;
+}
+
+int8_t WiFiClass::RSSI() {
+  return status() == WL_CONNECTED ? (int8_t)hostHal.rssi.load() : 0;
+}
+
+WiFiClient::WiFiClient() : fd_(-1), pos_(0) {}
+
+WiFiClient::WiFiClient(int fd) : fd_(fd), pos_(0) {}
+
+WiFiClient::WiFiClient(WiFiClient&& other)
+    : Stream(other), fd_(other.fd_), buf_(other.buf_), pos_(other.pos_) {
+  other.fd_ = -1;
+  other.buf_.clear();
+  other.pos_ = 0;
+}
+
+WiFiClient::~WiFiClient() {
+  stop();
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeoutMs) {
+  stop();
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* addrs = NULL;
+  if (getaddrinfo(host, service, &hints, &addrs) != 0) return 0;
+
+  for (struct addrinfo* a = addrs; a != NULL && fd_ < 0; a = a->ai_next) {
+    int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0) continue;
+
+    // Non-blocking connect so the timeout applies
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = ::connect(fd, a->ai_addr, a->ai_addrlen);
+    if (rc != 0 && errno == EINPROGRESS) {
+      struct pollfd p = {fd, POLLOUT, 0};
+      int err = 0;
+      socklen_t len = sizeof(err);
+      rc = poll(&p, 1, timeoutMs) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 &&
+           err == 0 ? 0 : -1;
+    }
+    if (rc == 0) {
+      fcntl(fd, F_SETFL, flags);
+      fd_ = fd;
+    } else {
+      close(fd);
+    }
+  }
+  freeaddrinfo(addrs);
+  return fd_ >= 0 ? 1 : 0;
+}
+
+uint8_t WiFiClient::connected() {
+  if (pos_ < buf_.size()) return 1;
+  if (fd_ < 0) return 0;
+  char c;
+  ssize_t n = recv(fd_, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    stop();
+    return 0;
+  }
+  return 1;
+}
+
+void WiFiClient::stop() {
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+  buf_.clear();
+  pos_ = 0;
+}
+
+void WiFiClient::setBuffer(const std::string& data) {
+  stop();
+  buf_ = data;
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+  if (fd_ < 0) return 0;
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t n = send(fd_, buf + sent, size - sent, MSG_NOSIGNAL);
+    if (n <= 0) break;
+    sent += (size_t)n;
+  }
+  return sent;
+}
+
+// Read whatever the socket has, waiting up to timeoutMs for the first byte
+bool WiFiClient::fill(unsigned long timeoutMs) {
+  if (pos_ < buf_.size()) return true;
+  if (fd_ < 0) return false;
+  buf_.clear();
+  pos_ = 0;
+
+  struct pollfd p = {fd_, POLLIN, 0};
+  if (poll(&p, 1, (int)timeoutMs) != 1) return false;
+  char chunk[1460];
+  ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+  if (n <= 0) return false;
+  buf_.assign(chunk, (size_t)n);
+  return true;
+}
+
+int WiFiClient::available() {
+  int pending = 0;
+  if (fd_ >= 0 && ioctl(fd_, FIONREAD, &pending) != 0) pending = 0;
+  return (int)(buf_.size() - pos_) + pending;
+}
+
+int WiFiClient::read() {
+  if (!fill(0)) return -1;
+  return (uint8_t)buf_[pos_++];
+}
+
+int WiFiClient::peek() {
+  if (!fill(0)) return -1;
+  return (uint8_t)buf_[pos_];
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size) {
+  if (!fill(0)) return -1;
+  size_t n = min(size, buf_.size() - pos_);
+  memcpy(buf, buf_.data() + pos_, n);
+  pos_ += n;
+  return (int)n;
+}
+
+bool WiFiClient::waitForData(unsigned long timeoutMs) {
+  return fill(timeoutMs);
+}
+
+WiFiServer::WiFiServer(uint16_t port) : port_(port), fd_(-1) {}
+
+WiFiServer::~WiFiServer() {
+  end();
+}
+
+void WiFiServer::begin(uint16_t port) {
+  // On the device a socket before WiFi.mode() asserts in lwIP
+  if (!WiFi.tcpipUp()) {
+    fprintf(stderr, "WiFiServer::begin: tcpip_send_msg_wait_sem (Invalid mbox): WiFi.mode() not called\n");
+    fflush(stdout);
+    abort();
+  }
+  if (port != 0) port_ = port;
+  end();
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return;
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons((uint16_t)hostHal.serverPort.load());
+  socklen_t len = sizeof(addr);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0 ||
+      getsockname(fd, (struct sockaddr*)&addr, &len) != 0) {
+    hostHal.event("server port %d unavailable for port %u", hostHal.serverPort.load(), port_);
+    close(fd);
+    return;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  fd_ = fd;
+  hostHal.serverBoundPort = ntohs(addr.sin_port);
+  hostHal.event("server port %u listening on %u", port_, (unsigned)ntohs(addr.sin_port));
+}
+
+WiFiClient WiFiServer::available() {
+  if (fd_ < 0) return WiFiClient();
+  int fd = accept(fd_, NULL, NULL);
+  if (fd < 0) return WiFiClient();
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+  return WiFiClient(fd);
+}
+
+void WiFiServer::end() {
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+}
@@ -0,0 +1,178 @@
+/*
+ * Host stand-in for the ESP32 WiFi station and WiFiClient
+ *
+ * The station joins host_hal.h's access point associateMs after both
+ * begin() and the AP coming up, and drops when the AP goes down, as the
+ * ESP32 does with auto-reconnect on. A join without a channel adds scanMs
+ * and one without a static address from config() adds dhcpMs; a join
+ * hinted at a channel or BSSID the AP isn't on never completes. The
+ * address is the host's loopback unless config() set one.
+ *
+ * WiFiClient is a TCP socket, or a buffer holding a response that an
+ * in-process handler produced; either way the firmware reads it as a
+ * Stream with its timeout.
+ *
+ * WiFiServer listens on the loopback at host_hal.h's serverPort rather
+ * than the firmware's port, which may need root or be taken on the host.
+ */
+
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <string>
+
+typedef enum {
+  WL_IDLE_STATUS     = 0,
+  WL_NO_SSID_AVAIL   = 1,
+  WL_SCAN_COMPLETED  = 2,
+  WL_CONNECTED       = 3,
+  WL_CONNECT_FAILED  = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED    = 6
+} wl_status_t;
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3
+} wifi_mode_t;
+
+class IPAddress {
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) {
+    octets_[0] = a;
+    octets_[1] = b;
+    octets_[2] = c;
+    octets_[3] = d;
+  }
+  // Packed as the ESP32 does: first octet in the low byte
+  IPAddress(uint32_t address) {
+    for (int i = 0; i < 4; i++) octets_[i] = (uint8_t)(address >> (8 * i));
+  }
+  operator uint32_t() const {
+    return octets_[0] | (uint32_t)octets_[1] << 8 | (uint32_t)octets_[2] << 16 |
+           (uint32_t)octets_[3] << 24;
+  }
+  uint8_t operator[](int i) const { return octets_[i]; }
+  String toString() const;
+
+private:
+  uint8_t octets_[4];
+};
+
+class WiFiClass {
+public:
+  WiFiClass()
+      : mode_(WIFI_OFF), tcpipUp_(false), begunAt_(0), begun_(false), autoReconnect_(true), lastStatus_(WL_IDLE_STATUS),
+        joinMs_(0), channelHint_(0), bssidHint_(false), local_(0), gateway_(0), subnet_(0), dns_(0) {}
+
+  // The first mode other than off brings up the TCP/IP stack, for good
+  bool mode(wifi_mode_t mode) {
+    mode_ = mode;
+    if (mode != WIFI_OFF) tcpipUp_ = true;
+    return true;
+  }
+  bool tcpipUp() const { return tcpipUp_; }
+  // channel 0 scans; bssid NULL takes any AP with the SSID
+  wl_status_t begin(const char* ssid, const char* password = NULL, int32_t channel = 0,
+                    const uint8_t* bssid = NULL, bool connect = true);
+  // A local address of 0.0.0.0 goes back to DHCP
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress());
+  bool disconnect(bool wifiOff = false);
+  bool reconnect();
+  bool setAutoReconnect(bool autoReconnect) { autoReconnect_ = autoReconnect; return true; }
+  bool getAutoReconnect() const { return autoReconnect_; }
+
+  wl_status_t status();
+  bool isConnected() { return status() == WL_CONNECTED; }
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t dnsNo = 0);
+  int8_t RSSI();
+  String SSID() const { return String(ssid_); }
+  uint8_t* BSSID();
+  int32_t channel();
+
+private:
+  wifi_mode_t mode_;
+  std::atomic<bool> tcpipUp_;
+  std::string ssid_;
+  std::atomic<uint32_t> begunAt_;
+  std::atomic<bool> begun_;
+  std::atomic<bool> autoReconnect_;
+  std::atomic<int> lastStatus_;
+  std::atomic<uint32_t> joinMs_;     // Association, plus the scan and DHCP it needs
+  std::atomic<int> channelHint_;
+  std::atomic<bool> bssidHint_;      // Hinted at an AP that isn't this one
+  std::atomic<uint32_t> local_;      // Static address; 0: DHCP
+  std::atomic<uint32_t> gateway_;
+  std::atomic<uint32_t> subnet_;
+  std::atomic<uint32_t> dns_;
+  uint8_t bssid_[6];
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient : public Stream {
+public:
+  WiFiClient();
+  WiFiClient(WiFiClient&& other);  // As WiFiServer::available() returns it
+  ~WiFiClient();
+
+  operator bool() { return connected() != 0; }
+
+  int connect(const char* host, uint16_t port, int32_t timeoutMs = 3000);
+  uint8_t connected();
+  void stop();
+
+  // Serve data from memory instead of a socket
+  void setBuffer(const std::string& data);
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  int read(uint8_t* buf, size_t size);
+
+protected:
+  bool waitForData(unsigned long timeoutMs) override;
+
+private:
+  friend class WiFiServer;
+  explicit WiFiClient(int fd);
+  WiFiClient(const WiFiClient&);
+  WiFiClient& operator=(const WiFiClient&);
+
+  bool fill(unsigned long timeoutMs);
+
+  int fd_;
+  std::string buf_;
+  size_t pos_;
+};
+
+class WiFiServer {
+public:
+  explicit WiFiServer(uint16_t port = 80);
+  ~WiFiServer();
+
+  void begin(uint16_t port = 0);
+  // Never blocks; a client that isn't connected when nobody is waiting
+  WiFiClient available();
+  void end();
+
+private:
+  WiFiServer(const WiFiServer&);
+  WiFiServer& operator=(const WiFiServer&);
+
+  uint16_t port_;
+  int fd_;
+};
+
+#endif // HOST_WIFI_H
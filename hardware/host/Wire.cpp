@@ -0,0 +1,7 @@
+/*
+ * Host stand-in for the ESP32 I2C bus
+ */
+
+#include "Wire.h"
+
+TwoWire Wire;
@@ -0,0 +1,27 @@
+/*
+ * Host stand-in for the ESP32 I2C bus; the LiquidCrystal_I2C stand-in
+ * models the panel directly, so the bus only records its pins
+ */
+
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include <Arduino.h>
+
+class TwoWire {
+public:
+  TwoWire() : sda_(-1), scl_(-1) {}
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) {
+    (void)frequency;
+    sda_ = sda;
+    scl_ = scl;
+    return true;
+  }
+
+private:
+  int sda_, scl_;
+};
+
+extern TwoWire Wire;
+
+#endif // HOST_WIRE_H
@@ -0,0 +1,584 @@
+/*
+ * door_bench - tap-to-unlock and tap-to-logged latency of the native firmware
+ *
+ * Usage:
+ *   door_bench --trace FILE [--server URL] [--irq-pin N] [--csv FILE] [--verbose]
+ *
+ * Boots esp32-main.cpp against the host stand-ins (see host_hal.h) and the
+ * in-process fake backend, or a real backend with --server, then replays
+ * a trace of people tapping cards. Each person steps up when they arrive
+ * and the previous tap is decided, holds the card until it is read, and
+ * puts the owner's finger down a reaction time later. Device time on the
+ * tap path (REQA, select, R307 capture and match, template download, LCD)
+ * is modeled by the stand-ins, so the latencies have the device's shape
+ * though not its exact values.
+ *
+ * Reported per path (cached: the card is in the allowlist and
+ * checkLocalCard() answers; miss: only the server knows it and
+ * checkServerCard() does), as p50/p95/p99/max in ms:
+ *   queue   arrival to card presented (waiting for the person ahead)
+ *   read    card presented to card selected
+ *   verify  card selected to the server's verify-rfid answer (miss)
+ *   finger  finger down to relay
+ *   unlock  card presented to relay: tap-to-unlock
+ *   logged  card presented to the event stored by the server: tap-to-logged
+ * and the peak taps per minute over any 60 s of the run. verify and
+ * logged need the fake backend.
+ *
+ * Trace format, one command per line, # comments. Setup lines first:
+ *   cards N          allowlisted cards, synced at boot (default 20)
+ *   unlisted N       cards only the server knows, each tapped at most once
+ *   backlog N        unsynced journal records left from before the boot
+ *   rtt MS           added server round trip
+ *   settle MS        wait after boot before the first tap (default 2000)
+ *   drain MS         wait for uploads after the last tap (default 45000)
+ * then timed lines, MS after the first tap:
+ *   MS tap cached|miss REACTION
+ *   MS burst COUNT INTERVAL cached|miss REACTION
+ *   MS wifi up|down
+ *   MS rtt MS
+ * Cached cards are used round-robin; the same card twice within the
+ * firmware's CARD_READ_DELAY is ignored by it, so use enough of them.
+ */
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include "attendance_journal.h"
+#include "fake_backend.h"
+#include "host_hal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+void setup();
+void loop();
+
+#define RELAY_PIN_HOST        32    // RELAY_PIN in esp32-main.cpp
+#define RED_LED_HOST          13    // RED_LED
+#define DENY_FEEDBACK_MS      1100  // Red LED pattern after a denial
+#define TAP_TIMEOUT_MS        20000
+#define BOOT_TIMEOUT_MS       60000
+#define POLL_MS               1
+#define PEAK_WINDOW_MS        60000
+
+struct Tap {
+  uint32_t at;         // Trace time the person arrives
+  bool miss;
+  uint32_t reactionMs;
+  uint8_t uid[4];
+  uint16_t fingerSlot;
+
+  // hostHal.millis() of each step; 0 if it didn't happen
+  uint32_t arrivedAt;
+  uint32_t presentedAt;
+  uint32_t selectedAt;
+  uint32_t verifiedAt;
+  uint32_t fingerAt;
+  uint32_t unlockedAt;
+  uint32_t deniedAt;
+  uint32_t loggedAt;
+};
+
+struct TraceEvent {
+  uint32_t at;
+  std::string command;  // wifi or rtt
+  std::string arg;
+};
+
+struct Trace {
+  uint32_t cards;
+  uint32_t unlisted;
+  uint32_t backlog;
+  uint32_t rttMs;
+  uint32_t settleMs;
+  uint32_t drainMs;
+  std::vector<Tap> taps;
+  std::vector<TraceEvent> events;
+};
+
+static FakeBackend backend;
+
+static std::string hexOf(const uint8_t* data, size_t len) {
+  char hex[2 * HOST_UID_MAX_LEN + 1];
+  for (size_t i = 0; i < len; i++) snprintf(hex + 2 * i, 3, "%02X", data[i]);
+  hex[2 * len] = '\0';
+  return hex;
+}
+
+static void cardUid(bool miss, uint32_t index, uint8_t* uid) {
+  uid[0] = miss ? 0x08 : 0x04;
+  uid[1] = (uint8_t)(index >> 16);
+  uid[2] = (uint8_t)(index >> 8);
+  uid[3] = (uint8_t)index;
+}
+
+// Watches the current tap from the firmware's threads
+class TapWatch : public HostListener, public HostHttpHandler {
+public:
+  TapWatch() : selectedAt(0), relayAt(0), redAt(0), verifiedAt(0), armed_(false), uidLen_(0) {}
+
+  void arm(const uint8_t* uid, uint8_t uidLen) {
+    std::lock_guard<std::mutex> lock(lock_);
+    memcpy(uid_, uid, uidLen);
+    uidLen_ = uidLen;
+    selectedAt = 0;
+    relayAt = 0;
+    redAt = 0;
+    verifiedAt = 0;
+    armed_ = true;
+  }
+  void disarm() { armed_ = false; }
+
+  // A grant while the door is still open from the last one rewrites HIGH
+  void pinWritten(uint8_t pin, uint8_t level) override {
+    if (!armed_ || level != HIGH) return;
+    uint32_t now = stamp();
+    uint32_t none = 0;
+    if (pin == RELAY_PIN_HOST) relayAt.compare_exchange_strong(none, now);
+    // A denial of this card, not the tail of the last one's pattern
+    if (pin == RED_LED_HOST && selectedAt != 0) redAt.compare_exchange_strong(none, now);
+  }
+
+  void cardSelected(const uint8_t* uid, uint8_t uidLen) override {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!armed_ || uidLen != uidLen_ || memcmp(uid, uid_, uidLen) != 0) return;
+    uint32_t none = 0;
+    selectedAt.compare_exchange_strong(none, stamp());
+  }
+
+  // Passes requests to the fake backend, timing the card's verify-rfid
+  void handle(const HostHttpRequest& request, HostHttpResponse* response) override {
+    backend.handle(request, response);
+    if (armed_ && request.path.find("/verify-rfid") != std::string::npos) {
+      uint32_t none = 0;
+      verifiedAt.compare_exchange_strong(none, stamp());
+    }
+  }
+
+  std::atomic<uint32_t> selectedAt;
+  std::atomic<uint32_t> relayAt;
+  std::atomic<uint32_t> redAt;
+  std::atomic<uint32_t> verifiedAt;
+
+private:
+  static uint32_t stamp() {
+    uint32_t now = hostHal.millis();
+    return now != 0 ? now : 1;
+  }
+
+  std::atomic<bool> armed_;
+  std::mutex lock_;
+  uint8_t uid_[HOST_UID_MAX_LEN];
+  uint8_t uidLen_;
+};
+
+static TapWatch watch;
+
+static bool parseTrace(const char* path, Trace* trace) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    return false;
+  }
+  trace->cards = 20;
+  trace->unlisted = 0;
+  trace->backlog = 0;
+  trace->rttMs = 0;
+  trace->settleMs = 2000;
+  trace->drainMs = 45000;
+
+  char line[256];
+  int lineNo = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), file) != NULL) {
+    lineNo++;
+    char* hash = strchr(line, '#');
+    if (hash != NULL) *hash = '\0';
+    char word[6][32];
+    int n = sscanf(line, "%31s %31s %31s %31s %31s %31s", word[0], word[1], word[2], word[3], word[4],
+                   word[5]);
+    if (n <= 0) continue;
+
+    if (word[0][0] < '0' || word[0][0] > '9') {
+      uint32_t value = n > 1 ? (uint32_t)strtoul(word[1], NULL, 10) : 0;
+      if (n == 2 && strcmp(word[0], "cards") == 0) trace->cards = value;
+      else if (n == 2 && strcmp(word[0], "unlisted") == 0) trace->unlisted = value;
+      else if (n == 2 && strcmp(word[0], "backlog") == 0) trace->backlog = value;
+      else if (n == 2 && strcmp(word[0], "rtt") == 0) trace->rttMs = value;
+      else if (n == 2 && strcmp(word[0], "settle") == 0) trace->settleMs = value;
+      else if (n == 2 && strcmp(word[0], "drain") == 0) trace->drainMs = value;
+      else ok = false;
+      continue;
+    }
+
+    uint32_t at = (uint32_t)strtoul(word[0], NULL, 10);
+    uint32_t count = 1, interval = 0;
+    const char* kind = NULL;
+    const char* reaction = NULL;
+    if (n == 4 && strcmp(word[1], "tap") == 0) {
+      kind = word[2];
+      reaction = word[3];
+    } else if (n == 6 && strcmp(word[1], "burst") == 0) {
+      count = (uint32_t)strtoul(word[2], NULL, 10);
+      interval = (uint32_t)strtoul(word[3], NULL, 10);
+      kind = word[4];
+      reaction = word[5];
+    } else if (n == 3 && (strcmp(word[1], "wifi") == 0 || strcmp(word[1], "rtt") == 0)) {
+      TraceEvent event;
+      event.at = at;
+      event.command = word[1];
+      event.arg = word[2];
+      trace->events.push_back(event);
+      continue;
+    } else {
+      ok = false;
+      continue;
+    }
+
+    if (strcmp(kind, "cached") != 0 && strcmp(kind, "miss") != 0) {
+      ok = false;
+      continue;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      Tap tap;
+      memset(&tap, 0, sizeof(tap));
+      tap.at = at + i * interval;
+      tap.miss = strcmp(kind, "miss") == 0;
+      tap.reactionMs = (uint32_t)strtoul(reaction, NULL, 10);
+      trace->taps.push_back(tap);
+    }
+  }
+  fclose(file);
+  if (!ok) {
+    fprintf(stderr, "%s:%d: bad trace line\n", path, lineNo);
+    return false;
+  }
+
+  // Cards round-robin for cached taps, once each for misses
+  std::stable_sort(trace->taps.begin(), trace->taps.end(),
+                   [](const Tap& a, const Tap& b) { return a.at < b.at; });
+  uint32_t cached = 0, misses = 0;
+  for (size_t i = 0; i < trace->taps.size(); i++) {
+    Tap& tap = trace->taps[i];
+    uint32_t index = tap.miss ? misses++ : cached++ % (trace->cards > 0 ? trace->cards : 1);
+    cardUid(tap.miss, index, tap.uid);
+    tap.fingerSlot = (uint16_t)(tap.miss ? trace->cards + index + 1 : index + 1);
+  }
+  if ((cached > 0 && trace->cards == 0) || misses > trace->unlisted) {
+    fprintf(stderr, "%s: %lu cached and %lu miss taps need cards and unlisted cards to match\n",
+            path, (unsigned long)cached, (unsigned long)misses);
+    return false;
+  }
+  std::stable_sort(trace->events.begin(), trace->events.end(),
+                   [](const TraceEvent& a, const TraceEvent& b) { return a.at < b.at; });
+  return true;
+}
+
+static void applyEvent(const TraceEvent& event) {
+  if (event.command == "wifi") {
+    hostHal.setAccessPoint(event.arg == "up");
+  } else {
+    hostHal.httpLatencyMs = (uint32_t)strtoul(event.arg.c_str(), NULL, 10);
+  }
+}
+
+static void addCards(const Trace& trace) {
+  for (uint32_t i = 0; i < trace.cards + trace.unlisted; i++) {
+    bool miss = i >= trace.cards;
+    uint32_t index = miss ? i - trace.cards : i;
+    uint8_t uid[4];
+    cardUid(miss, index, uid);
+    char name[24];
+    snprintf(name, sizeof(name), "%s %lu", miss ? "Visitor" : "Student", (unsigned long)index);
+    backend.addUser(hexOf(uid, sizeof(uid)), (uint16_t)(i + 1), name, !miss);
+  }
+}
+
+// Unsynced records from an earlier boot, ahead of every tap in the journal
+static void addBacklog(uint32_t records) {
+  if (records == 0) return;
+  SPIFFS.begin(true);
+  journalBegin();
+  uint8_t uid[4];
+  cardUid(false, 0, uid);
+  for (uint32_t i = 0; i < records; i++) {
+    JournalRecord rec;
+    journalAppend(uid, sizeof(uid), "Backlog", JOURNAL_ACTION_ENTRY, 1, i, &rec);
+  }
+}
+
+static bool lcdShows(const char* text) {
+  return hostHal.lcdLine(0).find(text) != std::string::npos ||
+         hostHal.lcdLine(1).find(text) != std::string::npos;
+}
+
+static void boot() {
+  setup();
+  hostHal.skipDelays = false;
+  loop();
+}
+
+// Replays the taps and timed events; one person at the door at a time
+static void replay(Trace* trace) {
+  uint32_t start = hostHal.millis();
+  size_t nextEvent = 0;
+  size_t next = 0;             // Next tap to step up
+  Tap* current = NULL;
+  uint32_t doorFreeAt = start; // When the next person may present
+
+  while (next < trace->taps.size() || current != NULL) {
+    uint32_t now = hostHal.millis();
+    while (nextEvent < trace->events.size() && now - start >= trace->events[nextEvent].at) {
+      applyEvent(trace->events[nextEvent++]);
+    }
+
+    if (current == NULL) {
+      Tap& tap = trace->taps[next];
+      if (now - start < tap.at) {
+        hostHal.sleep(POLL_MS);
+        continue;
+      }
+      if (tap.arrivedAt == 0) tap.arrivedAt = start + tap.at;
+      if ((int32_t)(now - doorFreeAt) < 0) {
+        hostHal.sleep(POLL_MS);
+        continue;
+      }
+      current = &tap;
+      next++;
+      watch.arm(tap.uid, sizeof(tap.uid));
+      tap.presentedAt = hostHal.millis();
+      hostHal.presentCard(tap.uid, sizeof(tap.uid), TAP_TIMEOUT_MS);
+      continue;
+    }
+
+    Tap& tap = *current;
+    uint32_t selected = watch.selectedAt;
+    if (selected != 0 && tap.fingerAt == 0 && now - selected >= tap.reactionMs) {
+      tap.fingerAt = now;
+      hostHal.presentFinger(tap.fingerSlot, TAP_TIMEOUT_MS);
+    }
+
+    uint32_t relay = watch.relayAt;
+    uint32_t red = watch.redAt;
+    bool timedOut = now - tap.presentedAt >= TAP_TIMEOUT_MS;
+    if (relay != 0 || red != 0 || timedOut) {
+      watch.disarm();
+      tap.selectedAt = selected;
+      tap.verifiedAt = watch.verifiedAt;
+      tap.unlockedAt = relay;
+      tap.deniedAt = relay == 0 ? red : 0;
+      hostHal.presentFinger(HOST_FINGER_NONE, 0);
+      hostHal.removeCard();
+      doorFreeAt = relay != 0 ? relay : now + (red != 0 ? DENY_FEEDBACK_MS : 0);
+      current = NULL;
+      continue;
+    }
+    hostHal.sleep(POLL_MS);
+  }
+}
+
+// Pairs each granted tap with the server's event for its card, in order
+static void matchLogged(Trace* trace) {
+  std::vector<FakeEvent> events = backend.events();
+  std::stable_sort(events.begin(), events.end(),
+                   [](const FakeEvent& a, const FakeEvent& b) { return a.receivedAt < b.receivedAt; });
+  std::map<std::string, size_t> used;
+  for (size_t i = 0; i < trace->taps.size(); i++) {
+    Tap& tap = trace->taps[i];
+    if (tap.unlockedAt == 0) continue;
+    std::string uid = hexOf(tap.uid, sizeof(tap.uid));
+    size_t& from = used[uid];
+    for (; from < events.size(); from++) {
+      if (events[from].uid == uid && events[from].bootId != 1 && events[from].receivedAt >= tap.unlockedAt) {
+        tap.loggedAt = events[from].receivedAt;
+        from++;
+        break;
+      }
+    }
+  }
+}
+
+static size_t granted(const Trace& trace) {
+  size_t count = 0;
+  for (size_t i = 0; i < trace.taps.size(); i++) count += trace.taps[i].unlockedAt != 0;
+  return count;
+}
+
+static uint32_t percentile(const std::vector<uint32_t>& sorted, int pct) {
+  size_t rank = (sorted.size() * pct + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void reportStage(const char* path, const char* stage, std::vector<uint32_t> samples) {
+  if (samples.empty()) return;
+  std::sort(samples.begin(), samples.end());
+  printf("  %-7s %-8s %5zu %7lu %7lu %7lu %7lu\n", path, stage, samples.size(),
+         (unsigned long)percentile(samples, 50), (unsigned long)percentile(samples, 95),
+         (unsigned long)percentile(samples, 99), (unsigned long)samples.back());
+}
+
+static void reportPath(const Trace& trace, bool miss) {
+  std::vector<uint32_t> queue, read, verify, finger, unlock, logged;
+  for (size_t i = 0; i < trace.taps.size(); i++) {
+    const Tap& tap = trace.taps[i];
+    if (tap.miss != miss || tap.presentedAt == 0) continue;
+    queue.push_back(tap.presentedAt - tap.arrivedAt);
+    if (tap.selectedAt != 0) read.push_back(tap.selectedAt - tap.presentedAt);
+    if (tap.verifiedAt != 0 && tap.selectedAt != 0) verify.push_back(tap.verifiedAt - tap.selectedAt);
+    if (tap.unlockedAt == 0) continue;
+    if (tap.fingerAt != 0) finger.push_back(tap.unlockedAt - tap.fingerAt);
+    unlock.push_back(tap.unlockedAt - tap.presentedAt);
+    if (tap.loggedAt != 0) logged.push_back(tap.loggedAt - tap.presentedAt);
+  }
+  const char* path = miss ? "miss" : "cached";
+  reportStage(path, "queue", queue);
+  reportStage(path, "read", read);
+  reportStage(path, "verify", verify);
+  reportStage(path, "finger", finger);
+  reportStage(path, "unlock", unlock);
+  reportStage(path, "logged", logged);
+}
+
+// Most unlocks in any PEAK_WINDOW_MS, or the rate over a shorter run
+static void reportPeak(const Trace& trace) {
+  std::vector<uint32_t> unlocks;
+  for (size_t i = 0; i < trace.taps.size(); i++) {
+    if (trace.taps[i].unlockedAt != 0) unlocks.push_back(trace.taps[i].unlockedAt);
+  }
+  if (unlocks.size() < 2) return;
+  std::sort(unlocks.begin(), unlocks.end());
+  uint32_t span = unlocks.back() - unlocks.front();
+  if (span < PEAK_WINDOW_MS) {
+    printf("Peak: %.1f taps/min (%zu unlocks over %.1f s)\n",
+           (unlocks.size() - 1) * 60000.0 / (span > 0 ? span : 1), unlocks.size(), span / 1000.0);
+    return;
+  }
+  size_t best = 0;
+  for (size_t first = 0, last = 0; last < unlocks.size(); last++) {
+    while (unlocks[last] - unlocks[first] >= PEAK_WINDOW_MS) first++;
+    best = std::max(best, last - first + 1);
+  }
+  printf("Peak: %zu taps/min (busiest 60 s)\n", best);
+}
+
+static void writeCsv(const char* path, const Trace& trace) {
+  FILE* csv = fopen(path, "w");
+  if (csv == NULL) {
+    perror(path);
+    return;
+  }
+  fprintf(csv, "path,uid,arrived,presented,selected,verified,finger,unlocked,denied,logged\n");
+  for (size_t i = 0; i < trace.taps.size(); i++) {
+    const Tap& tap = trace.taps[i];
+    fprintf(csv, "%s,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n", tap.miss ? "miss" : "cached",
+            hexOf(tap.uid, sizeof(tap.uid)).c_str(), (unsigned long)tap.arrivedAt,
+            (unsigned long)tap.presentedAt, (unsigned long)tap.selectedAt, (unsigned long)tap.verifiedAt,
+            (unsigned long)tap.fingerAt, (unsigned long)tap.unlockedAt, (unsigned long)tap.deniedAt,
+            (unsigned long)tap.loggedAt);
+  }
+  fclose(csv);
+}
+
+int main(int argc, char** argv) {
+  const char* tracePath = NULL;
+  const char* csvPath = NULL;
+  int irqPin = 4;
+  bool verbose = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--trace" && hasValue) {
+      tracePath = argv[++i];
+    } else if (arg == "--server" && hasValue) {
+      hostHal.httpOrigin = argv[++i];
+    } else if (arg == "--irq-pin" && hasValue) {
+      irqPin = atoi(argv[++i]);
+    } else if (arg == "--csv" && hasValue) {
+      csvPath = argv[++i];
+    } else if (arg == "--verbose") {
+      verbose = true;
+    } else {
+      tracePath = NULL;
+      break;
+    }
+  }
+  if (tracePath == NULL) {
+    fprintf(stderr, "usage: door_bench --trace FILE [--server URL] [--irq-pin N] [--csv FILE] [--verbose]\n");
+    return 2;
+  }
+
+  Trace trace;
+  if (!parseTrace(tracePath, &trace)) return 2;
+
+  char fsDir[] = "/tmp/door_bench.XXXXXX";
+  if (mkdtemp(fsDir) == NULL) {
+    perror("door_bench: mkdtemp");
+    return 2;
+  }
+  hostHal.fsRoot = fsDir;
+  hostHal.rfidIrqPin = irqPin;
+  hostHal.serialEcho = verbose;
+  hostHal.eventEcho = verbose;
+  hostHal.skipDelays = true;
+  hostHal.httpLatencyMs = trace.rttMs;
+  hostHal.listener = &watch;
+  bool fake = hostHal.httpOrigin.empty();
+  if (fake) hostHal.httpHandler = &watch;
+
+  addCards(trace);
+  addBacklog(trace.backlog);
+  hostHal.setAccessPoint(true);
+
+  uint32_t bootStart = hostHal.millis();
+  std::thread(boot).detach();
+  while (!lcdShows("Present Card") && hostHal.millis() - bootStart < BOOT_TIMEOUT_MS) {
+    hostHal.sleep(10);
+  }
+  if (!lcdShows("Present Card")) {
+    fprintf(stderr, "door_bench: firmware did not boot\n");
+    fflush(stdout);
+    _exit(1);
+  }
+  hostHal.sleep(trace.settleMs);
+
+  printf("door_bench: %s, %lu cards, %lu unlisted, %lu backlog, rtt %lu ms, %s, %s\n", tracePath,
+         (unsigned long)trace.cards, (unsigned long)trace.unlisted, (unsigned long)trace.backlog,
+         (unsigned long)trace.rttMs, fake ? "fake backend" : hostHal.httpOrigin.c_str(),
+         irqPin >= 0 ? "IRQ" : "polling");
+  fflush(stdout);
+
+  replay(&trace);
+
+  // Let the journal catch up before matching events to taps
+  uint32_t drainStart = hostHal.millis();
+  size_t grants = granted(trace);
+  while (fake && backend.uploaded() < grants + trace.backlog && hostHal.millis() - drainStart < trace.drainMs) {
+    hostHal.sleep(50);
+  }
+  if (fake) matchLogged(&trace);
+
+  size_t denied = 0, timedOut = 0;
+  for (size_t i = 0; i < trace.taps.size(); i++) {
+    const Tap& tap = trace.taps[i];
+    if (tap.unlockedAt == 0 && tap.deniedAt != 0) denied++;
+    if (tap.unlockedAt == 0 && tap.deniedAt == 0) timedOut++;
+  }
+  printf("Taps: %zu, %zu unlocked, %zu denied, %zu timed out; server: %lu verifies, %lu batches, %zu events\n",
+         trace.taps.size(), grants, denied, timedOut, (unsigned long)backend.verifies,
+         (unsigned long)backend.batches, backend.uploaded());
+  printf("  %-7s %-8s %5s %7s %7s %7s %7s  (ms)\n", "path", "stage", "n", "p50", "p95", "p99", "max");
+  reportPath(trace, false);
+  reportPath(trace, true);
+  reportPeak(trace);
+  if (csvPath != NULL) writeCsv(csvPath, trace);
+
+  fflush(stdout);
+  _exit(timedOut == 0 ? 0 : 1);
+}
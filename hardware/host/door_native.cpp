@@ -0,0 +1,373 @@
+/*
+ * door_native - the door firmware as a Linux process, driven by a script
+ *
+ * Usage:
+ *   door_native [--script FILE] [--fs DIR] [--server URL] [--skip-delays]
+ *               [--irq-pin N] [--metrics-port N] [--quiet]
+ *
+ * Runs esp32-main.cpp's setup() and tasks against the host stand-ins
+ * (see host_hal.h). Without --server, HTTP goes to the in-process fake
+ * backend; with it, to a real backend such as backend/server.js. SPIFFS
+ * files go under DIR, a fresh temporary directory by default.
+ * --skip-delays lets setup()'s delays advance the clock instead of
+ * sleeping. --irq-pin -1 leaves the readers' IRQ line unwired, so the
+ * firmware only looks for cards on its task tick. The firmware's /metrics listener takes --metrics-port on
+ * the loopback, any free port by default.
+ *
+ * The script (stdin without --script) is one command per line; # starts
+ * a comment, quotes group words and \ escapes the next character. Times
+ * are in ms.
+ *   user UID SLOT NAME         add a card to the fake backend
+ *   wifi up|down               the access point
+ *   verify ok|error            verify-rfid answers, or fails with 503
+ *   allocs reset               start counting heap allocations on the
+ *                              RFID task, from zero
+ *   boot                       run setup() and start the tasks
+ *   card UID [HOLD] [READER]   present a card for HOLD (300) to READER
+ *                              (0, the entry reader; 1, the exit reader)
+ *   finger SLOT|stranger [HOLD]  put a finger on the sensor for HOLD (1500)
+ *   finger none                lift the finger
+ *   button                     press and release the button
+ *   wait MS
+ *   expect lcd TEXT [TIMEOUT]  either LCD line contains TEXT
+ *   expect pin PIN high|low [TIMEOUT]
+ *   expect uploaded N [TIMEOUT]  the fake backend holds N events
+ *   expect event UID ENTRY|EXIT [TIMEOUT]  ... one of them for UID with
+ *                              that action
+ *   expect verifies N [TIMEOUT]  verify-rfid has been called N times
+ *   expect allocs N            at most N allocations since allocs reset
+ *   expect metrics TEXT [TIMEOUT]  GET /metrics returns TEXT
+ *   quit
+ * Expects wait up to TIMEOUT (5000) for the condition. Pin changes, the
+ * LCD and server events are printed as "@ <ms> ..." lines between the
+ * firmware's log. The exit status is the number of failed expects.
+ */
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <freertos/task.h>
+#include "fake_backend.h"
+#include "host_hal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+void setup();
+void loop();
+
+#define DOOR_BUTTON_PIN         0     // BUTTON_PIN in esp32-main.cpp
+#define DEFAULT_CARD_HOLD_MS    300
+#define DEFAULT_FINGER_HOLD_MS  1500
+#define DEFAULT_EXPECT_MS       5000
+#define BUTTON_PRESS_MS         200
+#define LCD_WATCH_MS            5
+#define EXPECT_POLL_MS          2
+#define METRICS_FETCH_MS        1000
+
+static FakeBackend backend;
+static int failures = 0;
+static int expects = 0;
+
+// Heap allocations made on the firmware's RFID task since "allocs reset".
+// malloc and operator new are replaced for the whole process; only that
+// task is counted, and only while counting is on.
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+extern "C" void __libc_free(void* p);
+
+static std::atomic<bool> countAllocs(false);
+static std::atomic<uint32_t> rfidAllocs(0);
+static thread_local bool inAllocHook = false;
+
+static void noteAlloc() {
+  if (!countAllocs || inAllocHook) return;
+  // Naming a thread the firmware didn't create allocates its handle
+  inAllocHook = true;
+  if (strcmp(pcTaskGetName(NULL), "rfid") == 0) rfidAllocs++;
+  inAllocHook = false;
+}
+
+extern "C" void* malloc(size_t size) {
+  noteAlloc();
+  return __libc_malloc(size);
+}
+extern "C" void* calloc(size_t n, size_t size) {
+  noteAlloc();
+  return __libc_calloc(n, size);
+}
+extern "C" void* realloc(void* p, size_t size) {
+  noteAlloc();
+  return __libc_realloc(p, size);
+}
+extern "C" void free(void* p) {
+  __libc_free(p);
+}
+
+void* operator new(size_t size) {
+  void* p = malloc(size);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// Prints the screen whenever it changes
+static void lcdWatch() {
+  uint32_t seen = hostHal.lcdVersion();
+  for (;;) {
+    hostHal.sleep(LCD_WATCH_MS);
+    uint32_t version = hostHal.lcdVersion();
+    if (version == seen) continue;
+    seen = version;
+    hostHal.event("lcd |%s|%s|", hostHal.lcdLine(0).c_str(), hostHal.lcdLine(1).c_str());
+  }
+}
+
+static void boot() {
+  setup();
+  hostHal.skipDelays = false;  // Only setup()'s delays are skipped
+  loop();
+}
+
+static std::vector<std::string> split(const std::string& line) {
+  std::vector<std::string> words;
+  std::string word;
+  bool quoted = false;
+  bool inWord = false;
+  for (size_t i = 0; i < line.size(); i++) {
+    char c = line[i];
+    if (c == '\\' && i + 1 < line.size()) {
+      word += line[++i];
+      inWord = true;
+    } else if (c == '"') {
+      quoted = !quoted;
+      inWord = true;
+    } else if (!quoted && c == '#') {
+      break;
+    } else if (!quoted && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+      if (inWord) words.push_back(word);
+      word.clear();
+      inWord = false;
+    } else {
+      word += c;
+      inWord = true;
+    }
+  }
+  if (inWord) words.push_back(word);
+  return words;
+}
+
+static size_t parseHex(const std::string& hex, uint8_t* out, size_t cap) {
+  size_t len = 0;
+  for (size_t i = 0; i + 1 < hex.size() && len < cap; i += 2) {
+    out[len++] = (uint8_t)strtoul(hex.substr(i, 2).c_str(), NULL, 16);
+  }
+  return len;
+}
+
+static uint32_t number(const std::vector<std::string>& words, size_t index, uint32_t fallback) {
+  return index < words.size() ? (uint32_t)strtoul(words[index].c_str(), NULL, 10) : fallback;
+}
+
+static bool lcdShows(const std::string& text) {
+  return hostHal.lcdLine(0).find(text) != std::string::npos ||
+         hostHal.lcdLine(1).find(text) != std::string::npos;
+}
+
+static bool backendHolds(const std::string& uid, const std::string& action) {
+  std::vector<FakeEvent> events = backend.events();
+  for (size_t i = 0; i < events.size(); i++) {
+    if (events[i].uid == uid && events[i].action == action) return true;
+  }
+  return false;
+}
+
+// The firmware's /metrics page, or "" if it didn't answer
+static std::string fetchMetrics() {
+  WiFiClient client;
+  if (hostHal.serverBoundPort == 0 ||
+      !client.connect("127.0.0.1", (uint16_t)hostHal.serverBoundPort.load(), METRICS_FETCH_MS)) {
+    return "";
+  }
+  client.print("GET /metrics HTTP/1.1\r\nHost: door\r\n\r\n");
+  client.setTimeout(METRICS_FETCH_MS);
+  std::string page;
+  uint8_t buf[512];
+  size_t n;
+  while ((n = client.readBytes(buf, sizeof(buf))) > 0) page.append((const char*)buf, n);
+  return page;
+}
+
+// Waits until check() holds or the timeout passes
+template <typename Check>
+static bool await(Check check, uint32_t timeoutMs) {
+  uint32_t start = hostHal.millis();
+  for (;;) {
+    if (check()) return true;
+    if (hostHal.millis() - start >= timeoutMs) return false;
+    hostHal.sleep(EXPECT_POLL_MS);
+  }
+}
+
+static void expect(const std::vector<std::string>& words, int lineNo, const std::string& line) {
+  expects++;
+  bool ok = false;
+  std::string what = words.size() > 1 ? words[1] : "";
+  if (what == "lcd" && words.size() > 2) {
+    std::string text = words[2];
+    ok = await([&] { return lcdShows(text); }, number(words, 3, DEFAULT_EXPECT_MS));
+  } else if (what == "pin" && words.size() > 3) {
+    uint8_t pin = (uint8_t)number(words, 2, 0);
+    int level = words[3] == "high" ? HIGH : LOW;
+    ok = await([&] { return hostHal.level(pin) == level; }, number(words, 4, DEFAULT_EXPECT_MS));
+  } else if (what == "uploaded" && words.size() > 2) {
+    size_t count = number(words, 2, 0);
+    ok = await([&] { return backend.uploaded() >= count; }, number(words, 3, DEFAULT_EXPECT_MS));
+  } else if (what == "event" && words.size() > 3) {
+    std::string uid = words[2];
+    std::string action = words[3];
+    ok = await([&] { return backendHolds(uid, action); }, number(words, 4, DEFAULT_EXPECT_MS));
+  } else if (what == "verifies" && words.size() > 2) {
+    uint32_t count = number(words, 2, 0);
+    ok = await([&] { return backend.verifies == count; }, number(words, 3, DEFAULT_EXPECT_MS));
+  } else if (what == "allocs" && words.size() > 2) {
+    // Nothing to wait for: the taps before it have been checked already
+    ok = rfidAllocs <= number(words, 2, 0);
+    if (!ok) hostHal.event("%u allocations on the RFID task", (unsigned)rfidAllocs.load());
+  } else if (what == "metrics" && words.size() > 2) {
+    std::string text = words[2];
+    ok = await([&] { return fetchMetrics().find(text) != std::string::npos; },
+               number(words, 3, DEFAULT_EXPECT_MS));
+  }
+  if (!ok) {
+    failures++;
+    hostHal.event("FAIL line %d: %s (lcd |%s|%s|, %lu uploaded)", lineNo, line.c_str(),
+                  hostHal.lcdLine(0).c_str(), hostHal.lcdLine(1).c_str(),
+                  (unsigned long)backend.uploaded());
+  }
+}
+
+static bool run(FILE* script) {
+  char buf[256];
+  int lineNo = 0;
+  while (fgets(buf, sizeof(buf), script) != NULL) {
+    lineNo++;
+    std::string line(buf);
+    while (!line.empty() && (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r')) {
+      line.erase(line.size() - 1);
+    }
+    std::vector<std::string> words = split(line);
+    if (words.empty()) continue;
+    const std::string& cmd = words[0];
+
+    if (cmd == "user" && words.size() > 3) {
+      backend.addUser(words[1], (uint16_t)number(words, 2, 0), words[3]);
+    } else if (cmd == "wifi" && words.size() > 1) {
+      hostHal.setAccessPoint(words[1] == "up");
+    } else if (cmd == "verify" && words.size() > 1) {
+      backend.verifyFailing = words[1] == "error";
+    } else if (cmd == "allocs" && words.size() > 1 && words[1] == "reset") {
+      rfidAllocs = 0;
+      countAllocs = true;
+    } else if (cmd == "boot") {
+      std::thread(boot).detach();
+    } else if (cmd == "card" && words.size() > 1) {
+      uint8_t uid[HOST_UID_MAX_LEN];
+      size_t len = parseHex(words[1], uid, sizeof(uid));
+      uint8_t reader = (uint8_t)number(words, 3, 0);
+      hostHal.event("script card %s reader %u", words[1].c_str(), (unsigned)reader);
+      hostHal.presentCard(uid, (uint8_t)len, number(words, 2, DEFAULT_CARD_HOLD_MS), reader);
+    } else if (cmd == "finger" && words.size() > 1) {
+      int identity = words[1] == "stranger" ? HOST_FINGER_STRANGER
+                     : words[1] == "none"   ? HOST_FINGER_NONE
+                                            : (int)number(words, 1, 0);
+      hostHal.event("script finger %s", words[1].c_str());
+      hostHal.presentFinger(identity, number(words, 2, DEFAULT_FINGER_HOLD_MS));
+    } else if (cmd == "button") {
+      hostHal.drive(DOOR_BUTTON_PIN, LOW);
+      hostHal.sleep(BUTTON_PRESS_MS);
+      hostHal.drive(DOOR_BUTTON_PIN, HIGH);
+    } else if (cmd == "wait") {
+      hostHal.sleep(number(words, 1, 0));
+    } else if (cmd == "expect") {
+      expect(words, lineNo, line);
+    } else if (cmd == "quit") {
+      return true;
+    } else {
+      fprintf(stderr, "door_native: line %d: unknown command: %s\n", lineNo, line.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: door_native [--script FILE] [--fs DIR] [--server URL] [--skip-delays] "
+                  "[--irq-pin N] [--metrics-port N] [--quiet]\n");
+}
+
+int main(int argc, char** argv) {
+  const char* scriptPath = NULL;
+  const char* fsDir = NULL;
+  int irqPin = 4;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--script" && hasValue) {
+      scriptPath = argv[++i];
+    } else if (arg == "--fs" && hasValue) {
+      fsDir = argv[++i];
+    } else if (arg == "--server" && hasValue) {
+      hostHal.httpOrigin = argv[++i];
+    } else if (arg == "--irq-pin" && hasValue) {
+      irqPin = atoi(argv[++i]);
+    } else if (arg == "--metrics-port" && hasValue) {
+      hostHal.serverPort = atoi(argv[++i]);
+    } else if (arg == "--skip-delays") {
+      hostHal.skipDelays = true;
+    } else if (arg == "--quiet") {
+      hostHal.serialEcho = false;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  char tmpDir[] = "/tmp/door_native.XXXXXX";
+  if (fsDir == NULL) {
+    fsDir = mkdtemp(tmpDir);
+    if (fsDir == NULL) {
+      perror("door_native: mkdtemp");
+      return 2;
+    }
+  }
+  hostHal.fsRoot = fsDir;
+  hostHal.rfidIrqPin = irqPin;
+  if (hostHal.httpOrigin.empty()) hostHal.httpHandler = &backend;
+
+  FILE* script = stdin;
+  if (scriptPath != NULL && (script = fopen(scriptPath, "r")) == NULL) {
+    perror(scriptPath);
+    return 2;
+  }
+
+  std::thread(lcdWatch).detach();
+  bool ok = run(script);
+  hostHal.event("door_native: %d expects, %d failed", expects, failures);
+
+  // The firmware's tasks never return; leave without unwinding them
+  fflush(stdout);
+  _exit(ok ? failures : 2);
+}
@@ -0,0 +1,142 @@
+/*
+ * Host stand-in for the ESP-IDF raw partition API
+ */
+
+#include "esp_partition.h"
+#include "host_hal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <mutex>
+#include <string>
+
+// The data partitions in partitions.csv beyond nvs, otadata and spiffs
+static const struct {
+  const char* label;
+  uint8_t subtype;
+  uint32_t address;
+  uint32_t size;
+} layout[] = {
+  {"journal", 0x40, 0x370000, 0x60000},
+  {"cardlog", 0x41, 0x3D0000, 0x20000},
+};
+
+#define HOST_PARTITIONS (sizeof(layout) / sizeof(layout[0]))
+
+struct HostPartition {
+  esp_partition_t info;
+  std::string path;  // Backing file; empty until first found
+  int fd;
+};
+
+static std::mutex partitionLock;
+static HostPartition partitions[HOST_PARTITIONS];
+
+static std::string partitionDir() {
+  return hostHal.partitionRoot.empty() ? hostHal.fsRoot + ".partitions" : hostHal.partitionRoot;
+}
+
+// Open the backing file, growing a new one to full size in the erased state
+static bool openPartition(size_t i) {
+  HostPartition& part = partitions[i];
+  std::string dir = partitionDir();
+  std::string path = dir + "/" + layout[i].label;
+  if (part.fd >= 0 && part.path == path) return true;
+  if (part.fd >= 0) close(part.fd);
+  part.fd = -1;
+
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return false;
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  uint8_t erased[SPI_FLASH_SEC_SIZE];
+  memset(erased, 0xFF, sizeof(erased));
+  for (off_t at = st.st_size; at < (off_t)layout[i].size; at += sizeof(erased)) {
+    if (pwrite(fd, erased, sizeof(erased), at) != (ssize_t)sizeof(erased)) {
+      close(fd);
+      return false;
+    }
+  }
+
+  esp_partition_t& info = part.info;
+  memset(&info, 0, sizeof(info));
+  info.type = ESP_PARTITION_TYPE_DATA;
+  info.subtype = (esp_partition_subtype_t)layout[i].subtype;
+  info.address = layout[i].address;
+  info.size = layout[i].size;
+  info.erase_size = SPI_FLASH_SEC_SIZE;
+  strncpy(info.label, layout[i].label, sizeof(info.label) - 1);
+  part.path = path;
+  part.fd = fd;
+  return true;
+}
+
+static HostPartition* lookup(const esp_partition_t* partition) {
+  for (size_t i = 0; i < HOST_PARTITIONS; i++) {
+    if (partition == &partitions[i].info && partitions[i].fd >= 0) return &partitions[i];
+  }
+  return NULL;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype, const char* label) {
+  std::lock_guard<std::mutex> lock(partitionLock);
+  static bool initialized = false;
+  if (!initialized) {
+    for (size_t i = 0; i < HOST_PARTITIONS; i++) partitions[i].fd = -1;
+    initialized = true;
+  }
+
+  for (size_t i = 0; i < HOST_PARTITIONS; i++) {
+    if (type != ESP_PARTITION_TYPE_DATA) continue;
+    if (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != layout[i].subtype) continue;
+    if (label != NULL && strcmp(label, layout[i].label) != 0) continue;
+    return openPartition(i) ? &partitions[i].info : NULL;
+  }
+  return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size) {
+  std::lock_guard<std::mutex> lock(partitionLock);
+  HostPartition* part = lookup(partition);
+  if (part == NULL || src_offset + size > part->info.size) return ESP_ERR_INVALID_ARG;
+  return pread(part->fd, dst, size, (off_t)src_offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size) {
+  std::lock_guard<std::mutex> lock(partitionLock);
+  HostPartition* part = lookup(partition);
+  if (part == NULL || dst_offset + size > part->info.size) return ESP_ERR_INVALID_ARG;
+
+  // Programming only clears bits
+  uint8_t chunk[256];
+  const uint8_t* in = (const uint8_t*)src;
+  for (size_t done = 0; done < size; done += sizeof(chunk)) {
+    size_t n = size - done < sizeof(chunk) ? size - done : sizeof(chunk);
+    off_t at = (off_t)(dst_offset + done);
+    if (pread(part->fd, chunk, n, at) != (ssize_t)n) return ESP_FAIL;
+    for (size_t i = 0; i < n; i++) chunk[i] &= in[done + i];
+    if (pwrite(part->fd, chunk, n, at) != (ssize_t)n) return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+  std::lock_guard<std::mutex> lock(partitionLock);
+  HostPartition* part = lookup(partition);
+  if (part == NULL || offset + size > part->info.size) return ESP_ERR_INVALID_ARG;
+  if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) return ESP_ERR_INVALID_SIZE;
+
+  uint8_t erased[SPI_FLASH_SEC_SIZE];
+  memset(erased, 0xFF, sizeof(erased));
+  for (size_t at = offset; at < offset + size; at += sizeof(erased)) {
+    if (pwrite(part->fd, erased, sizeof(erased), (off_t)at) != (ssize_t)sizeof(erased)) return ESP_FAIL;
+  }
+  return ESP_OK;
+}
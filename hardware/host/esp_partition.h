@@ -0,0 +1,53 @@
+/*
+ * Host stand-in for the ESP-IDF raw partition API
+ *
+ * Knows the data partitions partitions.csv adds for the firmware's own
+ * logs. Each is a file of the partition's size under host_hal.h's
+ * partitionRoot, so it outlives the process as flash outlives a reboot.
+ * Like NOR flash, a write only clears bits and an erase, in whole 4 KB
+ * sectors, sets them again.
+ */
+
+#ifndef HOST_ESP_PARTITION_H
+#define HOST_ESP_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                 0
+#define ESP_FAIL               -1
+#define ESP_ERR_INVALID_ARG    0x102
+#define ESP_ERR_INVALID_SIZE   0x104
+
+#define SPI_FLASH_SEC_SIZE     4096
+
+typedef enum {
+  ESP_PARTITION_TYPE_APP = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+  ESP_PARTITION_SUBTYPE_DATA_NVS = 0x02,
+  ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+  ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  uint32_t address;
+  uint32_t size;
+  uint32_t erase_size;
+  char label[17];
+  bool encrypted;
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype, const char* label);
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size);
+
+#endif // HOST_ESP_PARTITION_H
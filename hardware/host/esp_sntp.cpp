@@ -0,0 +1,41 @@
+/*
+ * Host stand-in for the ESP-IDF SNTP client
+ */
+
+#include "esp_sntp.h"
+#include "host_hal.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <atomic>
+
+static std::atomic<bool> started(false);
+static std::atomic<bool> everSynced(false);
+static std::atomic<uint32_t> lastSyncAt(0);
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char* server1,
+                const char* server2, const char* server3) {
+  (void)gmtOffsetSec;
+  (void)daylightOffsetSec;
+  (void)server1;
+  (void)server2;
+  (void)server3;
+  started = true;
+}
+
+bool sntp_enabled(void) {
+  return started;
+}
+
+sntp_sync_status_t sntp_get_sync_status(void) {
+  if (!started || !hostHal.ntpReachable || WiFi.status() != WL_CONNECTED) {
+    return SNTP_SYNC_STATUS_RESET;
+  }
+  uint32_t now = millis();
+  if (everSynced && now - lastSyncAt < SNTP_HOST_RESYNC_MS) {
+    return SNTP_SYNC_STATUS_RESET;
+  }
+  everSynced = true;
+  lastSyncAt = now;
+  hostHal.event("sntp synced");
+  return SNTP_SYNC_STATUS_COMPLETED;
+}
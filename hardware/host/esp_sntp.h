@@ -0,0 +1,25 @@
+/*
+ * Host stand-in for the ESP-IDF SNTP client
+ *
+ * configTime() starts it. Once WiFi is connected and host_hal.h says the
+ * NTP servers are reachable, the status reads as completed once, then
+ * again every SNTP_HOST_RESYNC_MS. The time itself is the host's.
+ */
+
+#ifndef HOST_ESP_SNTP_H
+#define HOST_ESP_SNTP_H
+
+#include <stdint.h>
+
+#define SNTP_HOST_RESYNC_MS 3600000
+
+typedef enum {
+  SNTP_SYNC_STATUS_RESET,
+  SNTP_SYNC_STATUS_COMPLETED,
+  SNTP_SYNC_STATUS_IN_PROGRESS,
+} sntp_sync_status_t;
+
+sntp_sync_status_t sntp_get_sync_status(void);
+bool sntp_enabled(void);
+
+#endif // HOST_ESP_SNTP_H
@@ -0,0 +1,345 @@
+/*
+ * Fake Backend - the attendance server's device API, in-process
+ */
+
+#include "fake_backend.h"
+#include "attendance_journal.h"
+#include "template_slots.h"
+#include "wire_protocol.h"
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <string.h>
+
+#define API_PREFIX "/api/"
+
+static std::string hexOf(const uint8_t* data, size_t len) {
+  static const char digits[] = "0123456789ABCDEF";
+  std::string hex;
+  for (size_t i = 0; i < len; i++) {
+    hex += digits[data[i] >> 4];
+    hex += digits[data[i] & 0x0F];
+  }
+  return hex;
+}
+
+// Little-endian reader over a request body; ok turns false past the end
+class WireReader {
+public:
+  WireReader(const std::string& body) : p_((const uint8_t*)body.data()), end_(p_ + body.size()), ok(true) {}
+
+  uint64_t uint(size_t bytes) {
+    if ((size_t)(end_ - p_) < bytes) {
+      ok = false;
+      return 0;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; i++) v |= (uint64_t)p_[i] << (8 * i);
+    p_ += bytes;
+    return v;
+  }
+  std::string bytes(size_t len) {
+    if ((size_t)(end_ - p_) < len) {
+      ok = false;
+      return std::string();
+    }
+    std::string s((const char*)p_, len);
+    p_ += len;
+    return s;
+  }
+  std::string str() { return bytes((size_t)uint(1)); }
+
+private:
+  const uint8_t* p_;
+  const uint8_t* end_;
+
+public:
+  bool ok;
+};
+
+static void putUint(std::string* out, uint64_t v, size_t bytes) {
+  for (size_t i = 0; i < bytes; i++) *out += (char)(v >> (8 * i));
+}
+
+static void putStr(std::string* out, const std::string& s) {
+  size_t len = s.size() < WIRE_STRING_MAX ? s.size() : WIRE_STRING_MAX;
+  putUint(out, len, 1);
+  out->append(s, 0, len);
+}
+
+static std::string wireHeader(uint8_t type) {
+  std::string out;
+  out += WIRE_MAGIC_0;
+  out += WIRE_MAGIC_1;
+  out += (char)WIRE_VERSION;
+  out += (char)type;
+  return out;
+}
+
+static uint8_t wireRole(const std::string& role) {
+  return cardRoleFromString(role.c_str());
+}
+
+FakeBackend::FakeBackend()
+    : registrations(0), verifies(0), batches(0), allowlistPulls(0), templateDownloads(0),
+      metricsUploads(0), verifyFailing(false), version_(1) {}
+
+void FakeBackend::addUser(const std::string& uidHex, uint16_t fingerSlot, const std::string& name,
+                          bool listed) {
+  std::lock_guard<std::mutex> lock(lock_);
+  FakeUser& user = users_[uidHex];
+  user.name = name;
+  user.userId = "u-" + uidHex.substr(0, 6);
+  user.role = "student";
+  user.fingerSlot = fingerSlot;
+  user.listed = listed;
+  version_++;
+}
+
+size_t FakeBackend::uploaded() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return events_.size();
+}
+
+std::vector<FakeEvent> FakeBackend::events() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  std::vector<FakeEvent> out;
+  for (std::map<std::string, FakeEvent>::const_iterator it = events_.begin(); it != events_.end(); ++it) {
+    out.push_back(it->second);
+  }
+  return out;
+}
+
+void FakeBackend::handle(const HostHttpRequest& request, HostHttpResponse* response) {
+  response->status = 404;
+  response->contentType = "text/plain";
+  response->body = "Not Found";
+
+  if (request.path.compare(0, strlen(API_PREFIX), API_PREFIX) != 0) return;
+  std::string path = request.path.substr(strlen(API_PREFIX));
+  std::string route = path.substr(0, path.find('?'));
+  bool binary = request.contentType == WIRE_CONTENT_TYPE;
+
+  bool keyed;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    keyed = !deviceKey_.empty() && request.deviceKey == deviceKey_;
+  }
+
+  if (request.method == "POST" && route == "device/register") {
+    uint32_t n = ++registrations;
+    char key[32];
+    snprintf(key, sizeof(key), "%08x%08x", (unsigned)n, (unsigned)hostHal.millis());
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      deviceKey_ = key;
+    }
+    response->status = 200;
+    response->contentType = "application/json";
+    response->body = std::string("{\"success\":true,\"device_key\":\"") + key +
+                     "\",\"message\":\"Device registered\"}";
+  } else if (request.method == "GET" && !keyed && route.compare(0, 20, "fingerprint/template") == 0) {
+    response->status = 401;
+    response->contentType = "application/json";
+    response->body = "{\"success\":false,\"error\":\"A registered device key is required\"}";
+  } else if (request.method == "POST" && route == "device/metrics") {
+    metricsUploads++;
+    response->status = 200;
+    response->contentType = "application/json";
+    response->body = "{\"success\":true}";
+  } else if (request.method == "GET" && route == "allowlist") {
+    allowlistPulls++;
+    allowlist(response);
+  } else if (request.method == "GET" && route == "fingerprint/templates") {
+    templateManifest(response);
+  } else if (request.method == "GET" && route.compare(0, 21, "fingerprint/template/") == 0) {
+    templateDownloads++;
+    templateDownload(route.substr(21), response);
+  } else if (request.method == "POST" && route == "verify-rfid") {
+    verifies++;
+    if (verifyFailing) {
+      response->status = 503;
+      response->body = "Service Unavailable";
+    } else if (binary) {
+      verifyBinary(request.body, response);
+    } else {
+      verifyJson(request.body, response);
+    }
+  } else if (request.method == "POST" && route == "log-attendance/batch") {
+    batches++;
+    if (binary) {
+      attendanceBinary(request.body, response);
+    } else {
+      attendanceJson(request.body, response);
+    }
+  }
+}
+
+// Always a snapshot: small enough at the sizes a script sets up
+void FakeBackend::allowlist(HostHttpResponse* response) {
+  std::lock_guard<std::mutex> lock(lock_);
+  char line[160];
+  snprintf(line, sizeof(line), "ALLOWLIST %lu SNAPSHOT\n", (unsigned long)version_);
+  response->body = line;
+  for (std::map<std::string, FakeUser>::const_iterator it = users_.begin(); it != users_.end(); ++it) {
+    if (!it->second.listed) continue;
+    snprintf(line, sizeof(line), "+%s,%s,%s,%s,%u\n", it->first.c_str(), it->second.name.c_str(),
+             it->second.userId.c_str(), it->second.role.c_str(), it->second.fingerSlot);
+    response->body += line;
+  }
+  response->body += "END\n";
+  response->status = 200;
+}
+
+void FakeBackend::templateManifest(HostHttpResponse* response) {
+  std::lock_guard<std::mutex> lock(lock_);
+  std::string rows;
+  size_t count = 0;
+  char line[32];
+  for (std::map<std::string, FakeUser>::const_iterator it = users_.begin(); it != users_.end(); ++it) {
+    if (it->second.fingerSlot == 0) continue;
+    snprintf(line, sizeof(line), "%u,1\n", it->second.fingerSlot);
+    rows += line;
+    count++;
+  }
+  snprintf(line, sizeof(line), "TEMPLATES %lu\n", (unsigned long)count);
+  response->body = line + rows + "END\n";
+  response->status = 200;
+}
+
+void FakeBackend::templateDownload(const std::string& slot, HostHttpResponse* response) {
+  unsigned long libSlot = strtoul(slot.c_str(), NULL, 10);
+  uint8_t tpl[TEMPLATE_BYTES];
+  hostTemplateFor((uint16_t)libSlot, tpl, sizeof(tpl));
+  char line[32];
+  snprintf(line, sizeof(line), "TEMPLATE %lu 1\n", libSlot);
+  response->body = line + hexOf(tpl, sizeof(tpl)) + "\nEND\n";
+  response->status = 200;
+}
+
+void FakeBackend::verifyBinary(const std::string& body, HostHttpResponse* response) {
+  response->contentType = WIRE_CONTENT_TYPE;
+  response->body = wireHeader(WIRE_VERIFY_REPLY);
+  WireReader in(body);
+  std::string header = in.bytes(WIRE_HEADER_SIZE);
+  std::string uid = in.bytes((size_t)in.uint(1));
+  if (!in.ok || !wireIsMessage((const uint8_t*)header.data(), header.size(), WIRE_VERIFY_REQUEST)) {
+    response->status = 400;
+    putUint(&response->body, WIRE_STATUS_BAD_REQUEST, 1);
+    putUint(&response->body, 0, 3);
+    putStr(&response->body, "");
+    putStr(&response->body, "");
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  std::map<std::string, FakeUser>::const_iterator it = users_.find(hexOf((const uint8_t*)uid.data(), uid.size()));
+  bool found = it != users_.end();
+  response->status = found ? 200 : 404;
+  putUint(&response->body, found ? WIRE_STATUS_OK : WIRE_STATUS_NOT_FOUND, 1);
+  putUint(&response->body, found ? wireRole(it->second.role) : 0, 1);
+  putUint(&response->body, found ? it->second.fingerSlot : 0, 2);
+  putStr(&response->body, found ? it->second.name : "");
+  putStr(&response->body, found ? it->second.userId : "");
+}
+
+void FakeBackend::verifyJson(const std::string& body, HostHttpResponse* response) {
+  DynamicJsonDocument doc(512);
+  response->contentType = "application/json";
+  if (deserializeJson(doc, body.c_str())) {
+    response->status = 400;
+    response->body = "{\"success\":false,\"message\":\"Bad request\"}";
+    return;
+  }
+  std::string uid = doc["rfid_uid"].as<String>().str();
+
+  std::lock_guard<std::mutex> lock(lock_);
+  std::map<std::string, FakeUser>::const_iterator it = users_.find(uid);
+  if (it == users_.end()) {
+    response->status = 200;
+    response->body = "{\"success\":false,\"message\":\"Card not registered\"}";
+    return;
+  }
+  DynamicJsonDocument reply(512);
+  reply["success"] = true;
+  reply["student_name"] = String(it->second.name);
+  reply["user_id"] = String(it->second.userId);
+  reply["role"] = String(it->second.role);
+  reply["fingerprint_slot"] = it->second.fingerSlot;
+  String out;
+  serializeJson(reply, out);
+  response->status = 200;
+  response->body = out.str();
+}
+
+void FakeBackend::accept(const std::string& device, const std::string& uid, const std::string& action,
+                         uint32_t bootId, uint32_t seq) {
+  char key[96];
+  snprintf(key, sizeof(key), "%s/%lu/%lu", device.c_str(), (unsigned long)bootId, (unsigned long)seq);
+  if (events_.count(key) > 0) return;
+  FakeEvent& event = events_[key];
+  event.uid = uid;
+  event.action = action;
+  event.bootId = bootId;
+  event.seq = seq;
+  event.receivedAt = hostHal.millis();
+  hostHal.event("server event %s %s seq %lu", uid.c_str(), action.c_str(), (unsigned long)seq);
+}
+
+void FakeBackend::attendanceBinary(const std::string& body, HostHttpResponse* response) {
+  WireReader in(body);
+  std::string header = in.bytes(WIRE_HEADER_SIZE);
+  std::string device = in.str();
+  in.str();  // Location
+  uint16_t count = (uint16_t)in.uint(2);
+  bool keyed = wireIsMessage((const uint8_t*)header.data(), header.size(), WIRE_ATTENDANCE_KEYED);
+
+  std::lock_guard<std::mutex> lock(lock_);
+  uint32_t ackedSeq = 0;
+  uint16_t accepted = 0;
+  for (uint16_t i = 0; keyed && in.ok && i < count; i++) {
+    uint32_t seq = (uint32_t)in.uint(4);
+    uint32_t bootId = (uint32_t)in.uint(4);
+    in.uint(8);  // Time
+    in.uint(1);  // Clock
+    uint8_t action = (uint8_t)in.uint(1);
+    std::string uid = in.bytes((size_t)in.uint(1));
+    if (!in.ok) break;
+    accept(device, hexOf((const uint8_t*)uid.data(), uid.size()), journalActionName(action), bootId, seq);
+    ackedSeq = seq > ackedSeq ? seq : ackedSeq;
+    accepted++;
+  }
+
+  bool ok = keyed && in.ok;
+  response->status = ok ? 200 : 400;
+  response->contentType = WIRE_CONTENT_TYPE;
+  response->body = wireHeader(WIRE_ATTENDANCE_REPLY);
+  putUint(&response->body, ok ? WIRE_STATUS_OK : WIRE_STATUS_BAD_REQUEST, 1);
+  putUint(&response->body, accepted, 2);
+  putUint(&response->body, ok ? 0 : count - accepted, 2);
+  putUint(&response->body, ackedSeq, 4);
+}
+
+void FakeBackend::attendanceJson(const std::string& body, HostHttpResponse* response) {
+  DynamicJsonDocument doc(16384);
+  response->contentType = "application/json";
+  if (deserializeJson(doc, body.c_str())) {
+    response->status = 400;
+    response->body = "{\"success\":false,\"message\":\"Bad request\"}";
+    return;
+  }
+  std::string device = doc["device_id"].as<String>().str();
+  JsonVariant events = doc["events"];
+
+  std::lock_guard<std::mutex> lock(lock_);
+  uint32_t ackedSeq = 0;
+  for (size_t i = 0; !events[i].isNull(); i++) {
+    uint32_t seq = events[i]["seq"].as<uint32_t>();
+    accept(device, events[i]["rfid_uid"].as<String>().str(), events[i]["action"].as<String>().str(),
+           events[i]["boot_id"].as<uint32_t>(), seq);
+    ackedSeq = seq > ackedSeq ? seq : ackedSeq;
+  }
+  char reply[64];
+  snprintf(reply, sizeof(reply), "{\"success\":true,\"acked_seq\":%lu}", (unsigned long)ackedSeq);
+  response->status = 200;
+  response->body = reply;
+}
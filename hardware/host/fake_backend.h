@@ -0,0 +1,85 @@
+/*
+ * Fake Backend - the attendance server's device API, in-process
+ *
+ * Answers the requests a door makes, in the formats the real backend uses:
+ * device/register and device/metrics, the text allowlist, the fingerprint template manifest
+ * and downloads, and verify-rfid and log-attendance/batch in either the
+ * binary wire format or JSON. Cards are added by the driver or benchmark;
+ * every card owner's template is the host template for their slot (see
+ * hostTemplateFor()).
+ *
+ * Registration issues a device key, which the template endpoints require
+ * as the real backend does.
+ *
+ * Install it as hostHal.httpHandler. Counters let a script or benchmark
+ * check what reached the server.
+ */
+
+#ifndef FAKE_BACKEND_H
+#define FAKE_BACKEND_H
+
+#include "host_hal.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct FakeUser {
+  std::string name;
+  std::string userId;
+  std::string role;
+  uint16_t fingerSlot;
+  bool listed;         // In the allowlist; else only verify-rfid knows it
+};
+
+// An attendance event as the server accepted it
+struct FakeEvent {
+  std::string uid;     // Hex
+  std::string action;  // "ENTRY" or "EXIT"
+  uint32_t bootId;
+  uint32_t seq;
+  uint32_t receivedAt; // hostHal.millis()
+};
+
+class FakeBackend : public HostHttpHandler {
+public:
+  FakeBackend();
+
+  // Adds or replaces a card; uidHex is upper-case hex
+  void addUser(const std::string& uidHex, uint16_t fingerSlot, const std::string& name,
+               bool listed = true);
+
+  void handle(const HostHttpRequest& request, HostHttpResponse* response) override;
+
+  size_t uploaded() const;               // Distinct events accepted
+  std::vector<FakeEvent> events() const;
+
+  std::atomic<uint32_t> registrations;
+  std::atomic<uint32_t> verifies;
+  std::atomic<uint32_t> batches;
+  std::atomic<uint32_t> allowlistPulls;
+  std::atomic<uint32_t> templateDownloads;
+  std::atomic<uint32_t> metricsUploads;
+  std::atomic<bool> verifyFailing;       // verify-rfid answers 503
+
+private:
+  void allowlist(HostHttpResponse* response);
+  void templateManifest(HostHttpResponse* response);
+  void templateDownload(const std::string& slot, HostHttpResponse* response);
+  void verifyBinary(const std::string& body, HostHttpResponse* response);
+  void verifyJson(const std::string& body, HostHttpResponse* response);
+  void attendanceBinary(const std::string& body, HostHttpResponse* response);
+  void attendanceJson(const std::string& body, HostHttpResponse* response);
+  // Records an event unless (device, boot, seq) was seen; lock held
+  void accept(const std::string& device, const std::string& uid, const std::string& action,
+              uint32_t bootId, uint32_t seq);
+
+  mutable std::mutex lock_;
+  std::string deviceKey_;                  // The last one issued
+  std::map<std::string, FakeUser> users_;  // By UID hex
+  uint32_t version_;
+  std::map<std::string, FakeEvent> events_; // By "device/boot/seq"
+};
+
+#endif // FAKE_BACKEND_H
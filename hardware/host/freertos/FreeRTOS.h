@@ -0,0 +1,26 @@
+/*
+ * Host stand-in for the FreeRTOS types and tick macros the firmware uses
+ *
+ * Ticks are milliseconds, as with the ESP32's 1 kHz tick.
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE               0
+#define pdTRUE                1
+#define pdPASS                pdTRUE
+#define pdFAIL                pdFALSE
+#define portMAX_DELAY         ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS    1
+#define configTICK_RATE_HZ    1000
+#define pdMS_TO_TICKS(ms)     ((TickType_t)(ms))
+#define portYIELD_FROM_ISR(...) do {} while (0)
+
+#endif // HOST_FREERTOS_H
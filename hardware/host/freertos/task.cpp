@@ -0,0 +1,113 @@
+/*
+ * Host stand-in for the FreeRTOS task API
+ */
+
+#include "task.h"
+#include <Arduino.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct HostTask {
+  std::string name;
+  UBaseType_t priority;
+  BaseType_t core;
+  std::mutex mutex;
+  std::condition_variable notified;
+  uint32_t notifications;
+};
+
+static thread_local HostTask* currentTask = NULL;
+
+// Threads the firmware didn't create (main, a test) get a handle on first use
+static HostTask* current() {
+  if (currentTask == NULL) {
+    currentTask = new HostTask();
+    currentTask->name = "host";
+    currentTask->priority = 1;
+    currentTask->core = -1;
+    currentTask->notifications = 0;
+  }
+  return currentTask;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth,
+                                   void* param, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core) {
+  (void)stackDepth;
+  HostTask* task = new HostTask();
+  task->name = name != NULL ? name : "";
+  task->priority = priority;
+  task->core = core;
+  task->notifications = 0;
+  if (handle != NULL) *handle = task;
+
+  std::thread([fn, param, task]() {
+    currentTask = task;
+    fn(param);
+    // Returning from a task function is a bug on the device; park instead
+    vTaskDelete(NULL);
+  }).detach();
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                       UBaseType_t priority, TaskHandle_t* handle) {
+  return xTaskCreatePinnedToCore(fn, name, stackDepth, param, priority, handle, -1);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task != NULL && task != currentTask) return;
+  for (;;) {
+    std::this_thread::sleep_for(std::chrono::hours(1));
+  }
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+  return millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return current();
+}
+
+const char* pcTaskGetName(TaskHandle_t task) {
+  return (task != NULL ? task : current())->name.c_str();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  HostTask* task = current();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  auto ready = [task]() { return task->notifications > 0; };
+  if (ticks == portMAX_DELAY) {
+    task->notified.wait(lock, ready);
+  } else {
+    task->notified.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+  }
+
+  uint32_t value = task->notifications;
+  if (value > 0) {
+    task->notifications = clearOnExit ? 0 : value - 1;
+  }
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notifications++;
+  }
+  task->notified.notify_one();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken) {
+  xTaskNotifyGive(task);
+  if (higherPriorityTaskWoken != NULL) *higherPriorityTaskWoken = pdTRUE;
+}
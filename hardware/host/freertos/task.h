@@ -0,0 +1,35 @@
+/*
+ * Host stand-in for the FreeRTOS task API
+ *
+ * Each task is a std::thread with a notification counter. Priorities and
+ * core affinity are recorded but not enforced: the Linux scheduler runs
+ * every task as soon as it is ready, so the host shows the firmware's
+ * logic and waits, not its contention for two cores.
+ */
+
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef struct HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth,
+                                   void* param, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                       UBaseType_t priority, TaskHandle_t* handle);
+
+// Only a task deleting itself (NULL) is supported; it never returns
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+const char* pcTaskGetName(TaskHandle_t task);
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken);
+
+#endif // HOST_FREERTOS_TASK_H
@@ -0,0 +1,249 @@
+/*
+ * Host HAL - the simulated hardware behind the Arduino stand-ins
+ */
+
+#include "host_hal.h"
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+HostHal hostHal;
+
+static uint64_t steadyMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool reached(uint32_t now, uint32_t at) {
+  return (int32_t)(now - at) >= 0;
+}
+
+void hostTemplateFor(uint16_t owner, uint8_t* tpl, size_t len) {
+  uint32_t x = owner * 2654435761u + 1;
+  for (size_t i = 0; i < len; i++) {
+    x = x * 1103515245 + 12345;
+    tpl[i] = (uint8_t)(x >> 16);
+  }
+  if (len >= 2) {
+    tpl[0] = (uint8_t)(owner >> 8);
+    tpl[1] = (uint8_t)owner;
+  }
+}
+
+int hostTemplateOwner(const uint8_t* tpl, size_t len) {
+  return len >= 2 ? ((int)tpl[0] << 8) | tpl[1] : HOST_FINGER_NONE;
+}
+
+HostHal::HostHal()
+    : skipDelays(false),
+      rfidIrqPin(-1),
+      fingerSensorPresent(true),
+      lcdTiming(true),
+      lcdBusBytes(0),
+      associateMs(300),
+      scanMs(0),
+      dhcpMs(0),
+      apChannel(6),
+      rssi(-58),
+      ntpReachable(true),
+      serverPort(0),
+      serverBoundPort(0),
+      httpHandler(NULL),
+      httpLatencyMs(0),
+      fsRoot("."),
+      listener(NULL),
+      serialEcho(true),
+      eventEcho(true),
+      startUs_(steadyMicros()),
+      skippedUs_(0),
+      readerCount_(0),
+      irqPulled_(0),
+      finger_(HOST_FINGER_NONE),
+      fingerUntil_(0),
+      lcdVersion_(0),
+      apUp_(false),
+      apUpSince_(0) {
+  for (int pin = 0; pin < HOST_PIN_COUNT; pin++) {
+    modes_[pin] = INPUT;
+    levels_[pin] = LOW;
+    interrupts_[pin].isr = NULL;
+    interrupts_[pin].mode = 0;
+  }
+  memset(fields_, 0, sizeof(fields_));
+  memset(readerPins_, 0, sizeof(readerPins_));
+  for (int row = 0; row < HOST_LCD_ROWS; row++) {
+    memset(lcd_[row], ' ', HOST_LCD_COLS);
+    lcd_[row][HOST_LCD_COLS] = '\0';
+  }
+}
+
+uint32_t HostHal::millis() const {
+  return (uint32_t)(micros() / 1000);
+}
+
+uint64_t HostHal::micros() const {
+  return steadyMicros() - startUs_ + skippedUs_.load();
+}
+
+void HostHal::delay(uint32_t ms) {
+  if (skipDelays) {
+    skippedUs_ += (int64_t)ms * 1000;
+    std::this_thread::yield();
+    return;
+  }
+  sleep(ms);
+}
+
+void HostHal::sleep(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void HostHal::pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= HOST_PIN_COUNT) return;
+  modes_[pin] = mode;
+  if (mode == INPUT_PULLUP) levels_[pin] = HIGH;
+}
+
+void HostHal::digitalWrite(uint8_t pin, uint8_t level) {
+  if (pin >= HOST_PIN_COUNT) return;
+  level = level ? HIGH : LOW;
+  if (levels_[pin].exchange(level) != level) {
+    event("pin %u %s", pin, level ? "high" : "low");
+  }
+  if (listener != NULL) listener->pinWritten(pin, level);
+}
+
+int HostHal::digitalRead(uint8_t pin) const {
+  return pin < HOST_PIN_COUNT ? levels_[pin].load() : LOW;
+}
+
+void HostHal::attachInterrupt(uint8_t pin, void (*isr)(), int mode) {
+  if (pin >= HOST_PIN_COUNT) return;
+  interrupts_[pin].mode = mode;
+  interrupts_[pin].isr = isr;
+}
+
+void HostHal::detachInterrupt(uint8_t pin) {
+  if (pin >= HOST_PIN_COUNT) return;
+  interrupts_[pin].isr = NULL;
+}
+
+void HostHal::drive(uint8_t pin, uint8_t level) {
+  if (pin >= HOST_PIN_COUNT) return;
+  level = level ? HIGH : LOW;
+  uint8_t was = levels_[pin].exchange(level);
+  if (was == level || interrupts_[pin].isr == NULL) return;
+
+  int mode = interrupts_[pin].mode;
+  bool fire = mode == CHANGE || (mode == FALLING && level == LOW) || (mode == RISING && level == HIGH);
+  if (fire) interrupts_[pin].isr();
+}
+
+void HostHal::presentCard(const uint8_t* uid, uint8_t uidLen, uint32_t holdMs, uint8_t reader) {
+  if (reader >= HOST_READER_MAX) return;
+  std::lock_guard<std::mutex> lock(cardLock_);
+  Field& field = fields_[reader];
+  field.uidLen = uidLen < HOST_UID_MAX_LEN ? uidLen : HOST_UID_MAX_LEN;
+  memcpy(field.uid, uid, field.uidLen);
+  field.serial++;
+  field.until = millis() + holdMs;
+}
+
+void HostHal::removeCard(uint8_t reader) {
+  if (reader >= HOST_READER_MAX) return;
+  std::lock_guard<std::mutex> lock(cardLock_);
+  fields_[reader].uidLen = 0;
+}
+
+bool HostHal::cardInField(uint8_t reader, uint8_t* uid, uint8_t* uidLen, uint32_t* serial) const {
+  if (reader >= HOST_READER_MAX) return false;
+  std::lock_guard<std::mutex> lock(cardLock_);
+  const Field& field = fields_[reader];
+  if (field.uidLen == 0 || reached(millis(), field.until)) return false;
+  memcpy(uid, field.uid, field.uidLen);
+  *uidLen = field.uidLen;
+  *serial = field.serial;
+  return true;
+}
+
+uint8_t HostHal::attachReader(uint8_t ssPin) {
+  std::lock_guard<std::mutex> lock(cardLock_);
+  for (uint8_t i = 0; i < readerCount_; i++) {
+    if (readerPins_[i] == ssPin) return i;
+  }
+  if (readerCount_ == HOST_READER_MAX) return HOST_READER_MAX - 1;
+  readerPins_[readerCount_] = ssPin;
+  return readerCount_++;
+}
+
+void HostHal::readerIrq(uint8_t reader, bool asserted) {
+  bool low;
+  {
+    std::lock_guard<std::mutex> lock(cardLock_);
+    uint8_t bit = (uint8_t)(1 << reader);
+    irqPulled_ = asserted ? (uint8_t)(irqPulled_ | bit) : (uint8_t)(irqPulled_ & ~bit);
+    low = irqPulled_ != 0;
+  }
+  int pin = rfidIrqPin;
+  if (pin >= 0) drive((uint8_t)pin, low ? LOW : HIGH);
+}
+
+void HostHal::presentFinger(int identity, uint32_t holdMs) {
+  fingerUntil_ = millis() + holdMs;
+  finger_ = identity;
+}
+
+int HostHal::fingerOnGlass() const {
+  int identity = finger_.load();
+  if (identity == HOST_FINGER_NONE || reached(millis(), fingerUntil_.load())) return HOST_FINGER_NONE;
+  return identity;
+}
+
+void HostHal::lcdPut(uint8_t col, uint8_t row, char c) {
+  if (col >= HOST_LCD_COLS || row >= HOST_LCD_ROWS) return;
+  std::lock_guard<std::mutex> lock(lcdLock_);
+  lcd_[row][col] = c;
+  lcdVersion_++;
+}
+
+void HostHal::lcdClear() {
+  std::lock_guard<std::mutex> lock(lcdLock_);
+  for (int row = 0; row < HOST_LCD_ROWS; row++) {
+    memset(lcd_[row], ' ', HOST_LCD_COLS);
+  }
+  lcdVersion_++;
+}
+
+std::string HostHal::lcdLine(uint8_t row) const {
+  if (row >= HOST_LCD_ROWS) return std::string();
+  std::lock_guard<std::mutex> lock(lcdLock_);
+  return std::string(lcd_[row]);
+}
+
+void HostHal::setAccessPoint(bool up) {
+  if (up && !apUp_) apUpSince_ = millis();
+  if (apUp_.exchange(up) != up) {
+    event("wifi ap %s", up ? "up" : "down");
+  }
+}
+
+void HostHal::output(const uint8_t* data, size_t len) {
+  std::lock_guard<std::mutex> lock(outputLock_);
+  fwrite(data, 1, len, stdout);
+  fflush(stdout);
+}
+
+void HostHal::event(const char* fmt, ...) {
+  if (!eventEcho) return;
+  char line[160];
+  int n = snprintf(line, sizeof(line), "@ %lu ", (unsigned long)millis());
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(line + n, sizeof(line) - n - 1, fmt, args);
+  va_end(args);
+  strcat(line, "\n");
+  output((const uint8_t*)line, strlen(line));
+}
@@ -0,0 +1,202 @@
+/*
+ * Host HAL - the simulated hardware behind the Arduino stand-ins
+ *
+ * The firmware builds natively against header-compatible stand-ins for
+ * the Arduino core, SPIFFS, WiFi, HTTPClient, MFRC522,
+ * Adafruit_Fingerprint and LiquidCrystal_I2C. Those talk to this one
+ * object, which a test, the door_native driver or a benchmark scripts:
+ * present a card or finger, take the access point down, press the button,
+ * watch pins and the screen. Files live under a directory on disk and
+ * HTTP goes either to a real server or to an in-process handler.
+ *
+ * Device timings the tap path waits on (REQA timeout, R307 capture and
+ * match, UART template download, I2C writes) are modeled by sleeping, so
+ * latencies measured on the host have the device's shape. The clock is
+ * the process's monotonic clock; with skipDelays, delay() advances it
+ * instead of sleeping so a boot takes no wall time.
+ */
+
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#define HOST_PIN_COUNT        40
+#define HOST_LCD_COLS         16
+#define HOST_LCD_ROWS         2
+#define HOST_UID_MAX_LEN      10
+#define HOST_READER_MAX       4
+#define HOST_FINGER_NONE      -1
+#define HOST_FINGER_STRANGER  0xFFFF  // Matches no enrolled template
+
+// R307 and MFRC522 timings modeled by the stand-ins (ms)
+#define HOST_REQA_TIMEOUT_MS      25   // PICC_IsNewCardPresent with no card
+#define HOST_SELECT_MS            3    // Anticollision and select
+#define HOST_FINGER_IMAGE_MS      150  // getImage with a finger on the glass
+#define HOST_FINGER_NO_IMAGE_MS   40   // getImage reporting no finger
+#define HOST_FINGER_TZ_MS         250  // image2Tz feature extraction
+#define HOST_FINGER_LOAD_MS       30   // loadModel from flash
+#define HOST_FINGER_MATCH_MS      20
+#define HOST_FINGER_STORE_MS      40
+#define HOST_FINGER_BAUD          57600
+
+// Fingerprint templates on the host carry their owner's library slot in
+// their first two bytes; the rest is filler. A finger presented as that
+// slot matches them and nothing else.
+void hostTemplateFor(uint16_t owner, uint8_t* tpl, size_t len);
+int hostTemplateOwner(const uint8_t* tpl, size_t len);
+
+// Answers HTTP requests in-process in place of a server
+struct HostHttpRequest {
+  std::string method;
+  std::string path;         // From the URL, with the query string
+  std::string contentType;
+  std::string deviceKey;    // X-Device-Key
+  std::string body;
+};
+
+struct HostHttpResponse {
+  int status;
+  std::string contentType;
+  std::string body;
+};
+
+class HostHttpHandler {
+public:
+  virtual ~HostHttpHandler() {}
+  virtual void handle(const HostHttpRequest& request, HostHttpResponse* response) = 0;
+};
+
+// Told of what the firmware does to the hardware, from the firmware's
+// threads, as it happens; for benchmarks timing the tap path
+class HostListener {
+public:
+  virtual ~HostListener() {}
+  virtual void pinWritten(uint8_t pin, uint8_t level) {}  // Changed or not
+  virtual void cardSelected(const uint8_t* uid, uint8_t uidLen) {}
+};
+
+class HostHal {
+public:
+  HostHal();
+
+  // Clock
+  uint32_t millis() const;
+  uint64_t micros() const;
+  void delay(uint32_t ms);
+  void sleep(uint32_t ms);  // Modeled device time: always sleeps
+  std::atomic<bool> skipDelays;
+
+  // GPIO: the firmware's side
+  void pinMode(uint8_t pin, uint8_t mode);
+  void digitalWrite(uint8_t pin, uint8_t level);
+  int digitalRead(uint8_t pin) const;
+  void attachInterrupt(uint8_t pin, void (*isr)(), int mode);
+  void detachInterrupt(uint8_t pin);
+
+  // GPIO: the outside world pulling an input, firing any attached ISR
+  void drive(uint8_t pin, uint8_t level);
+  int level(uint8_t pin) const { return pin < HOST_PIN_COUNT ? levels_[pin].load() : 0; }
+
+  // RFID fields, one per reader: a card stays in the field for holdMs.
+  // Readers are numbered in the order the firmware initializes them.
+  void presentCard(const uint8_t* uid, uint8_t uidLen, uint32_t holdMs, uint8_t reader = 0);
+  void removeCard(uint8_t reader = 0);
+  // Copies the card in the field; serial changes with every presentation
+  bool cardInField(uint8_t reader, uint8_t* uid, uint8_t* uidLen, uint32_t* serial) const;
+  uint8_t attachReader(uint8_t ssPin);  // The number of the reader on this chip select
+  // The readers' IRQ pins are open drain on one line: low while any pulls it
+  void readerIrq(uint8_t reader, bool asserted);
+  std::atomic<int> rfidIrqPin;  // -1: IRQ line not wired
+
+  // Fingerprint sensor: identity is the library slot of the finger's owner
+  void presentFinger(int identity, uint32_t holdMs);
+  int fingerOnGlass() const;
+  std::atomic<bool> fingerSensorPresent;
+
+  // LCD contents as last written over I2C
+  void lcdPut(uint8_t col, uint8_t row, char c);
+  void lcdClear();
+  std::string lcdLine(uint8_t row) const;
+  uint32_t lcdVersion() const { return lcdVersion_.load(); }
+  std::atomic<bool> lcdTiming;   // Sleep for the I2C time of each write
+  std::atomic<uint32_t> lcdBusBytes;
+
+  // WiFi: the access point and the link to it
+  void setAccessPoint(bool up);
+  bool accessPointUp() const { return apUp_.load(); }
+  uint32_t accessPointUpSince() const { return apUpSince_.load(); }
+  std::atomic<uint32_t> associateMs;  // Time to join once the AP is reachable
+  std::atomic<uint32_t> scanMs;       // More when joining without a channel
+  std::atomic<uint32_t> dhcpMs;       // More when joining without a static address
+  std::atomic<int> apChannel;         // A join hinted at another channel never completes
+  std::atomic<int> rssi;
+  std::atomic<bool> ntpReachable;
+  std::atomic<int> serverPort;       // Where WiFiServer listens; 0: any free port
+  std::atomic<int> serverBoundPort;  // The port it got
+
+  // HTTP: an in-process handler, else sockets to the URL's origin or to
+  // httpOrigin ("http://127.0.0.1:3050") when set
+  HostHttpHandler* httpHandler;
+  std::string httpOrigin;
+  std::atomic<uint32_t> httpLatencyMs;  // Added round trip per request
+
+  // SPIFFS files live under this directory; raw partitions (esp_partition.h)
+  // under partitionRoot, or fsRoot + ".partitions" when that is empty
+  std::string fsRoot;
+  std::string partitionRoot;
+
+  HostListener* listener;  // NULL: nobody listening
+
+  // Serial output and "@ <ms> ..." events share stdout
+  std::atomic<bool> serialEcho;
+  std::atomic<bool> eventEcho;
+  void output(const uint8_t* data, size_t len);
+  void event(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+private:
+  struct Interrupt {
+    void (*isr)();
+    int mode;
+  };
+
+  uint64_t startUs_;
+  std::atomic<int64_t> skippedUs_;
+
+  std::atomic<uint8_t> modes_[HOST_PIN_COUNT];
+  std::atomic<uint8_t> levels_[HOST_PIN_COUNT];
+  Interrupt interrupts_[HOST_PIN_COUNT];
+
+  struct Field {
+    uint8_t uid[HOST_UID_MAX_LEN];
+    uint8_t uidLen;
+    uint32_t serial;
+    uint32_t until;
+  };
+
+  mutable std::mutex cardLock_;
+  Field fields_[HOST_READER_MAX];
+  uint8_t readerPins_[HOST_READER_MAX];
+  uint8_t readerCount_;
+  uint8_t irqPulled_;  // Bit per reader
+
+  std::atomic<int> finger_;
+  std::atomic<uint32_t> fingerUntil_;
+
+  mutable std::mutex lcdLock_;
+  char lcd_[HOST_LCD_ROWS][HOST_LCD_COLS + 1];
+  std::atomic<uint32_t> lcdVersion_;
+
+  std::atomic<bool> apUp_;
+  std::atomic<uint32_t> apUpSince_;
+
+  std::mutex outputLock_;
+};
+
+extern HostHal hostHal;
+
+#endif // HOST_HAL_H
@@ -0,0 +1,140 @@
+/*
+ * LCD Shadow - differential rendering for the 16x2 character LCD
+ */
+
+#include "lcd_shadow.h"
+#include <string.h>
+
+// Unchanged cells inside a run that are cheaper to rewrite than to jump
+// over with a cursor move
+#define LCD_SHADOW_MAX_GAP  1
+
+LcdShadow::LcdShadow()
+    : lcd_(NULL), valid_(false), cursorCol_(0), cursorRow_(0), cursorKnown_(false) {
+  memset(shown_, ' ', sizeof(shown_));
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+void LcdShadow::begin(LcdDevice* lcd) {
+  lcd_ = lcd;
+  clearPanel();
+}
+
+void LcdShadow::invalidate() {
+  valid_ = false;
+  cursorKnown_ = false;
+}
+
+void LcdShadow::clearPanel() {
+  lcd_->clear();
+  memset(shown_, ' ', sizeof(shown_));
+  valid_ = true;
+  // clear() homes the cursor
+  cursorCol_ = 0;
+  cursorRow_ = 0;
+  cursorKnown_ = true;
+}
+
+static void padRow(char* want, const char* text) {
+  size_t len = text != NULL ? strnlen(text, LCD_SHADOW_COLS) : 0;
+  if (len > 0) memcpy(want, text, len);
+  memset(want + len, ' ', LCD_SHADOW_COLS - len);
+}
+
+void LcdShadow::show(const char* line1, const char* line2) {
+  if (lcd_ == NULL) return;
+  char want[LCD_SHADOW_ROWS][LCD_SHADOW_COLS];
+  padRow(want[0], line1);
+  padRow(want[1], line2);
+  stats_.updates++;
+
+  // When most of the screen changes, blanking it with clear() and writing
+  // only the text is cheaper than overwriting old text with spaces
+  if (valid_) {
+    uint32_t diffCost = planRows(want, false);
+    uint32_t clearCost = LCD_SHADOW_CLEAR_COST + planRows(want, true);
+    if (clearCost < diffCost) {
+      clearPanel();
+      stats_.clears++;
+    }
+  }
+
+  uint32_t before = stats_.cellsWritten;
+  drawRow(0, want[0]);
+  drawRow(1, want[1]);
+  valid_ = true;
+
+  if (stats_.cellsWritten == before) stats_.unchanged++;
+}
+
+// LCD bytes the two rows would cost, either against what is shown or
+// against a freshly cleared panel
+uint32_t LcdShadow::planRows(const char want[][LCD_SHADOW_COLS], bool afterClear) const {
+  static const char blank[LCD_SHADOW_COLS] = {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ',
+                                              ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '};
+  bool known = afterClear || cursorKnown_;
+  uint8_t curCol = afterClear ? 0 : cursorCol_;
+  uint8_t curRow = afterClear ? 0 : cursorRow_;
+  uint32_t cost = 0;
+
+  for (uint8_t row = 0; row < LCD_SHADOW_ROWS; row++) {
+    const char* have = afterClear ? blank : shown_[row];
+    uint8_t col = 0;
+    while (col < LCD_SHADOW_COLS) {
+      if (have[col] == want[row][col]) {
+        col++;
+        continue;
+      }
+      uint8_t end = runEnd(have, want[row], col, true);
+      if (!known || curRow != row || curCol != col) cost++;
+      cost += end - col;
+      curRow = row;
+      curCol = end;
+      known = end < LCD_SHADOW_COLS;
+      col = end;
+    }
+  }
+  return cost;
+}
+
+// End of the run of cells to write starting at the changed cell col,
+// extended while the next change is at most a short gap away
+uint8_t LcdShadow::runEnd(const char* have, const char* want, uint8_t col, bool valid) {
+  uint8_t end = col + 1;
+  while (end < LCD_SHADOW_COLS) {
+    uint8_t next = end;
+    while (next < LCD_SHADOW_COLS && valid && have[next] == want[next] &&
+           next - end < LCD_SHADOW_MAX_GAP) {
+      next++;
+    }
+    if (next >= LCD_SHADOW_COLS || (valid && have[next] == want[next])) break;
+    end = next + 1;
+  }
+  return end;
+}
+
+void LcdShadow::drawRow(uint8_t row, const char* want) {
+  char* have = shown_[row];
+  uint8_t col = 0;
+  while (col < LCD_SHADOW_COLS) {
+    if (valid_ && have[col] == want[col]) {
+      col++;
+      continue;
+    }
+
+    uint8_t end = runEnd(have, want, col, valid_);
+    if (!cursorKnown_ || cursorRow_ != row || cursorCol_ != col) {
+      lcd_->setCursor(col, row);
+      stats_.cursorMoves++;
+    }
+    lcd_->write((const uint8_t*)want + col, end - col);
+    memcpy(have + col, want + col, end - col);
+    stats_.cellsWritten += end - col;
+
+    // The cursor wraps to another row past the last column; don't trust it
+    cursorRow_ = row;
+    cursorCol_ = end;
+    cursorKnown_ = end < LCD_SHADOW_COLS;
+    col = end;
+  }
+}
@@ -0,0 +1,80 @@
+/*
+ * LCD Shadow - differential rendering for the 16x2 character LCD
+ *
+ * Every screen used to start with clear(), the slowest HD44780 command
+ * (about 2 ms), and rewrite all 32 cells over the I2C backpack at six bus
+ * writes per LCD byte. The shadow keeps a copy of what the panel shows and
+ * writes only the cells that changed. The HD44780 advances its cursor
+ * after each character, so a run of changed cells costs one cursor move
+ * plus one byte per cell. Short unchanged gaps inside a run are rewritten
+ * rather than skipped, since a cursor move costs as much as a cell. When
+most of the screen changes, clear() plus the new text can still be the
+cheaper way there, so the shadow prices both and picks the smaller.
+ *
+ * Only the UI task draws, so a slow bus never blocks the access path; the
+ * shadow just makes each of its updates smaller.
+ */
+
+#ifndef LCD_SHADOW_H
+#define LCD_SHADOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LCD_SHADOW_COLS  16
+#define LCD_SHADOW_ROWS  2
+
+// clear() in LCD bytes: the command itself plus its 2 ms wait, which is
+// about as long as two more bytes over a 100 kHz I2C backpack
+#ifndef LCD_SHADOW_CLEAR_COST
+#define LCD_SHADOW_CLEAR_COST  3
+#endif
+
+// The panel as driven by the shadow
+class LcdDevice {
+public:
+  virtual ~LcdDevice() {}
+  virtual void clear() = 0;
+  virtual void setCursor(uint8_t col, uint8_t row) = 0;
+  virtual void write(const uint8_t* data, size_t len) = 0;
+};
+
+struct LcdShadowStats {
+  uint32_t updates;      // show() calls
+  uint32_t unchanged;    // show() calls that wrote nothing
+  uint32_t cellsWritten;
+  uint32_t cursorMoves;
+  uint32_t clears;       // show() calls that found clear() cheaper
+};
+
+class LcdShadow {
+public:
+  LcdShadow();
+
+  // Clears the panel once; from then on the shadow knows every cell
+  void begin(LcdDevice* lcd);
+
+  // Show two lines, padded with spaces and cut at LCD_SHADOW_COLS
+  void show(const char* line1, const char* line2);
+
+  // Repaint everything on the next show(), e.g. after the panel was reset
+  void invalidate();
+
+  const LcdShadowStats& stats() const { return stats_; }
+
+private:
+  void clearPanel();
+  uint32_t planRows(const char want[][LCD_SHADOW_COLS], bool afterClear) const;
+  static uint8_t runEnd(const char* have, const char* want, uint8_t col, bool valid);
+  void drawRow(uint8_t row, const char* want);
+
+  LcdDevice* lcd_;
+  char shown_[LCD_SHADOW_ROWS][LCD_SHADOW_COLS];
+  bool valid_;        // shown_ matches the panel
+  uint8_t cursorCol_;
+  uint8_t cursorRow_;
+  bool cursorKnown_;
+  LcdShadowStats stats_;
+};
+
+#endif // LCD_SHADOW_H
@@ -0,0 +1,170 @@
+/*
+ * Link Manager - keeps the Wi-Fi station joined without blocking
+ */
+
+#include "link_manager.h"
+#include <string.h>
+
+static bool reached(uint32_t now, uint32_t at) {
+  return (int32_t)(now - at) >= 0;
+}
+
+LinkManager::LinkManager()
+    : radio_(NULL), state_(STATE_WAIT), hasStatic_(false), cacheDirty_(false), fast_(false),
+      everUp_(false), useLease_(false), retryAt_(0), attemptAt_(0), deadline_(0),
+      backoff_(LINK_BACKOFF_MIN_MS), downAt_(0), rng_(1) {
+  memset(&cache_, 0, sizeof(cache_));
+  memset(&static_, 0, sizeof(static_));
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+void LinkManager::begin(LinkRadio* radio, const LinkCache* cache, const LinkAddress* staticAddress,
+                        uint32_t seed, uint32_t now) {
+  radio_ = radio;
+  memset(&cache_, 0, sizeof(cache_));
+  if (cache != NULL) cache_ = *cache;
+  hasStatic_ = staticAddress != NULL;
+  if (hasStatic_) static_ = *staticAddress;
+  memset(&stats_, 0, sizeof(stats_));
+  cacheDirty_ = false;
+  everUp_ = false;
+  useLease_ = false;
+  state_ = STATE_WAIT;
+  fast_ = cache_.channel != 0;
+  backoff_ = LINK_BACKOFF_MIN_MS;
+  retryAt_ = now;
+  downAt_ = now;
+  rng_ = seed != 0 ? seed : 1;
+}
+
+uint8_t LinkManager::tick(uint32_t now) {
+  switch (state_) {
+    case STATE_WAIT:
+      if (reached(now, retryAt_)) startJoin(now);
+      break;
+
+    case STATE_JOINING: {
+      uint8_t status = radio_->status();
+      if (status == LINK_RADIO_UP) {
+        joined(now);
+        return LINK_EVENT_UP;
+      }
+      if (status == LINK_RADIO_FAILED || reached(now, deadline_)) {
+        radio_->drop();
+        retry(now, fast_);
+      }
+      break;
+    }
+
+    case STATE_UP:
+      if (radio_->status() != LINK_RADIO_UP) {
+        // Everyone behind the same AP lost it at once; spread the first retry
+        state_ = STATE_WAIT;
+        stats_.outages++;
+        downAt_ = now;
+        fast_ = cache_.channel != 0;
+        backoff_ = LINK_BACKOFF_MIN_MS;
+        retryAt_ = now + jitter(LINK_BACKOFF_MIN_MS);
+        return LINK_EVENT_DOWN;
+      }
+      if (useLease_ && !leaseUsable(now)) {
+        // Nobody renews a lease set statically; ask DHCP for it again
+        radio_->drop();
+        state_ = STATE_WAIT;
+        stats_.outages++;
+        downAt_ = now;
+        fast_ = false;
+        retryAt_ = now;
+        return LINK_EVENT_DOWN;
+      }
+      break;
+  }
+  return LINK_EVENT_NONE;
+}
+
+uint32_t LinkManager::offlineFor(uint32_t now) const {
+  return state_ != STATE_UP && everUp_ ? now - downAt_ : 0;
+}
+
+void LinkManager::startJoin(uint32_t now) {
+  fast_ = fast_ && cache_.channel != 0;
+  const LinkAddress* address = NULL;
+  if (hasStatic_) {
+    address = &static_;
+  } else if (fast_ && leaseUsable(now)) {
+    address = &cache_.lease;
+  }
+  useLease_ = address == &cache_.lease;
+
+  radio_->join(fast_ ? &cache_ : NULL, address);
+  stats_.attempts++;
+  attemptAt_ = now;
+  deadline_ = now + (fast_ ? LINK_FAST_ATTEMPT_MS : LINK_FULL_ATTEMPT_MS) +
+              (address == NULL ? LINK_DHCP_MS : 0);
+  state_ = STATE_JOINING;
+}
+
+void LinkManager::joined(uint32_t now) {
+  stats_.lastJoinMs = now - attemptAt_;
+  stats_.lastJoinFast = fast_;
+  if (fast_) {
+    stats_.fastJoins++;
+  } else {
+    stats_.fullJoins++;
+  }
+  if (everUp_) {
+    uint32_t outage = now - downAt_;
+    stats_.lastOutageMs = outage;
+    if (outage > stats_.maxOutageMs) stats_.maxOutageMs = outage;
+    stats_.offlineMs += outage;
+  }
+
+  uint8_t bssid[6];
+  uint8_t channel = 0;
+  LinkAddress address;
+  memset(&address, 0, sizeof(address));
+  radio_->read(bssid, &channel, &address);
+  if (channel != 0 && (channel != cache_.channel || memcmp(bssid, cache_.bssid, 6) != 0)) {
+    memcpy(cache_.bssid, bssid, 6);
+    cache_.channel = channel;
+    cacheDirty_ = true;
+  }
+  // An address DHCP handed out is a fresh lease
+  if (!hasStatic_ && !useLease_ && address.ip != 0) {
+    cache_.lease = address;
+    cache_.leaseAt = now;
+    cache_.leaseValid = 1;
+    cacheDirty_ = true;
+  }
+
+  everUp_ = true;
+  backoff_ = LINK_BACKOFF_MIN_MS;
+  state_ = STATE_UP;
+}
+
+// A cached AP that isn't there is given up on straight away for a scan;
+// a round that scanned waits out the backoff and starts from the cache again
+void LinkManager::retry(uint32_t now, bool fastFailed) {
+  state_ = STATE_WAIT;
+  if (fastFailed) {
+    stats_.fastFailures++;
+    fast_ = false;
+    retryAt_ = now;
+    return;
+  }
+  fast_ = cache_.channel != 0;
+  retryAt_ = now + backoff_ / 2 + jitter(backoff_ / 2);
+  backoff_ = backoff_ * 2 < LINK_BACKOFF_MAX_MS ? backoff_ * 2 : LINK_BACKOFF_MAX_MS;
+}
+
+bool LinkManager::leaseUsable(uint32_t now) const {
+  return cache_.leaseValid && now - cache_.leaseAt < LINK_LEASE_MAX_AGE_MS;
+}
+
+// Uniform in 0..range, xorshift32
+uint32_t LinkManager::jitter(uint32_t range) {
+  rng_ ^= rng_ << 13;
+  rng_ ^= rng_ >> 17;
+  rng_ ^= rng_ << 5;
+  return rng_ % (range + 1);
+}
@@ -0,0 +1,141 @@
+/*
+ * Link Manager - keeps the Wi-Fi station joined without blocking
+ *
+ * A join from nothing scans every channel for the SSID and then waits on
+ * DHCP, several seconds in all. Once joined, the manager keeps what it
+ * learned: the AP's BSSID and channel and the DHCP lease. The next join
+ * goes straight to that AP on that channel with the leased address set
+ * statically, which reassociates in well under a second. A fast join that
+ * fails (the AP moved channel, was replaced) falls straight back to a full
+ * scan with DHCP. A lease is reused for LINK_LEASE_MAX_AGE_MS from when
+ * DHCP handed it out: nothing renews it while it is set statically, so a
+ * link still up on it then rejoins through DHCP, a short planned outage.
+ * A configured static address replaces the lease entirely.
+ *
+ * Joins never block: tick() starts one, checks on it and gives up on it
+ * at its deadline. Failed rounds back off exponentially from
+ * LINK_BACKOFF_MIN_MS to LINK_BACKOFF_MAX_MS with jitter, so a building
+ * full of doors doesn't retry in lockstep after the AP reboots. tick()
+ * returns LINK_EVENT_UP and LINK_EVENT_DOWN as the link changes; each
+ * outage's length and the join that ended it are kept in LinkStats.
+ *
+ * This module has no Arduino dependencies so it can be tested on a host.
+ */
+
+#ifndef LINK_MANAGER_H
+#define LINK_MANAGER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LINK_CACHE_FILE         "/link"
+
+#define LINK_BACKOFF_MIN_MS     500
+#define LINK_BACKOFF_MAX_MS     60000
+#define LINK_FAST_ATTEMPT_MS    2000     // Associate with the cached AP, no scan
+#define LINK_FULL_ATTEMPT_MS    10000    // Scan, then associate
+#define LINK_DHCP_MS            8000     // More for an attempt that asks DHCP
+#define LINK_LEASE_MAX_AGE_MS   3600000  // Reuse a DHCP address this long
+
+#define LINK_EVENT_NONE  0
+#define LINK_EVENT_UP    1
+#define LINK_EVENT_DOWN  2
+
+// What the radio reports while joining
+#define LINK_RADIO_JOINING  0
+#define LINK_RADIO_UP       1
+#define LINK_RADIO_FAILED   2  // Gave up early: no such SSID, rejected
+
+// IPv4 addresses as the radio packs them
+struct LinkAddress {
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+// The AP last joined and the lease it gave; saved across reboots
+struct LinkCache {
+  uint8_t bssid[6];
+  uint8_t channel;     // 0: nothing cached
+  uint8_t leaseValid;
+  LinkAddress lease;
+  uint32_t leaseAt;    // millis() when the lease was handed out
+};
+
+class LinkRadio {
+public:
+  virtual ~LinkRadio() {}
+  // Start joining the SSID. ap NULL scans for it, otherwise only its BSSID
+  // on its channel is tried; address NULL asks DHCP.
+  virtual void join(const LinkCache* ap, const LinkAddress* address) = 0;
+  virtual void drop() = 0;
+  virtual uint8_t status() = 0;
+  // The AP joined and the address in use, once up
+  virtual void read(uint8_t* bssid, uint8_t* channel, LinkAddress* address) = 0;
+};
+
+struct LinkStats {
+  uint32_t outages;      // Link lost after being up
+  uint32_t attempts;
+  uint32_t fastJoins;    // Joins from the cached AP
+  uint32_t fullJoins;    // Joins after a scan
+  uint32_t fastFailures; // Cached AP tried and not found
+  uint32_t lastJoinMs;   // Attempt start to link up, for the last join
+  bool lastJoinFast;     // ... and whether it was from the cached AP
+  uint32_t lastOutageMs; // Link down to up, for the last outage
+  uint32_t maxOutageMs;
+  uint32_t offlineMs;    // All outages that have ended
+};
+
+class LinkManager {
+public:
+  LinkManager();
+
+  // cache is what was saved last time, NULL for none; staticAddress NULL
+  // uses DHCP. The first join starts on the first tick.
+  void begin(LinkRadio* radio, const LinkCache* cache, const LinkAddress* staticAddress,
+             uint32_t seed, uint32_t now);
+
+  // Call often, from one task
+  uint8_t tick(uint32_t now);
+
+  bool up() const { return state_ == STATE_UP; }
+  bool joiningFast() const { return state_ == STATE_JOINING && fast_; }
+  // Since the link went down; 0 while up and before the first join
+  uint32_t offlineFor(uint32_t now) const;
+
+  const LinkStats& stats() const { return stats_; }
+  const LinkCache& cache() const { return cache_; }
+  // The cache has changed since it was last saved
+  bool cacheDirty() const { return cacheDirty_; }
+  void cacheSaved() { cacheDirty_ = false; }
+
+private:
+  enum State { STATE_WAIT, STATE_JOINING, STATE_UP };
+
+  void startJoin(uint32_t now);
+  void joined(uint32_t now);
+  void retry(uint32_t now, bool fastFailed);
+  bool leaseUsable(uint32_t now) const;
+  uint32_t jitter(uint32_t range);
+
+  LinkRadio* radio_;
+  State state_;
+  LinkCache cache_;
+  LinkAddress static_;
+  bool hasStatic_;
+  bool cacheDirty_;
+  bool fast_;          // The current or next join uses the cache
+  bool everUp_;
+  bool useLease_;      // The current join set the lease statically
+  uint32_t retryAt_;
+  uint32_t attemptAt_;
+  uint32_t deadline_;
+  uint32_t backoff_;
+  uint32_t downAt_;
+  uint32_t rng_;
+  LinkStats stats_;
+};
+
+#endif // LINK_MANAGER_H
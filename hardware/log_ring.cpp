@@ -0,0 +1,124 @@
+/*
+ * Log Ring - leveled, asynchronous logging
+ *
+ * A bounded multi-producer queue: each slot carries the ring position it
+ * is ready for. A producer claims position p by moving head_ from p to
+ * p + 1 when slot p is free (seq == p), formats into it and publishes it
+ * with seq = p + 1. The drain consumes it and frees the slot for the next
+ * lap with seq = p + LOG_RING_SLOTS.
+ */
+
+#include "log_ring.h"
+#include <stdio.h>
+#include <string.h>
+
+#define LOG_RING_MASK  (LOG_RING_SLOTS - 1)
+
+// "<ms> <level> ", then the text and a newline
+#define LOG_PREFIX_MAX  16
+
+LogRing logRing;
+
+LogRing::LogRing()
+    : head_(0), tail_(0), clock_(NULL), written_(0), dropped_(0), truncated_(0),
+      droppedReported_(0) {
+  for (uint32_t i = 0; i < LOG_RING_SLOTS; i++) {
+    slots_[i].seq.store(i, std::memory_order_relaxed);
+  }
+}
+
+void LogRing::begin(uint32_t (*clock)()) {
+  clock_ = clock;
+}
+
+char LogRing::levelChar(uint8_t level) {
+  switch (level) {
+    case LOG_LEVEL_ERROR: return 'E';
+    case LOG_LEVEL_WARN:  return 'W';
+    case LOG_LEVEL_INFO:  return 'I';
+    default:              return 'D';
+  }
+}
+
+bool LogRing::vprint(uint8_t level, const char* fmt, va_list args) {
+  uint32_t pos = head_.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &slots_[pos & LOG_RING_MASK];
+    int32_t lag = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+    if (lag == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (lag < 0) {
+      // The drain hasn't freed this slot from the last lap
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+
+  int len = vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+  if (len < 0) len = 0;
+  if (len >= (int)sizeof(slot->text)) {
+    len = sizeof(slot->text) - 1;
+    truncated_.fetch_add(1, std::memory_order_relaxed);
+  }
+  slot->len = (uint8_t)len;
+  slot->level = level;
+  slot->timestamp = clock_ != NULL ? clock_() : 0;
+  written_.fetch_add(1, std::memory_order_relaxed);
+  slot->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+size_t LogRing::drain(LogSink* sink, size_t maxLines) {
+  char line[LOG_PREFIX_MAX + LOG_LINE_MAX + 1];
+  size_t lines = 0;
+
+  uint32_t tail = tail_.load(std::memory_order_relaxed);
+  while (lines < maxLines) {
+    Slot* slot = &slots_[tail & LOG_RING_MASK];
+    if (slot->seq.load(std::memory_order_acquire) != tail + 1) break;
+
+    int prefix = snprintf(line, LOG_PREFIX_MAX, "%lu %c ", (unsigned long)slot->timestamp,
+                          levelChar(slot->level));
+    if (prefix < 0 || prefix >= LOG_PREFIX_MAX) prefix = 0;
+    memcpy(line + prefix, slot->text, slot->len);
+    size_t len = prefix + slot->len;
+    line[len++] = '\n';
+
+    // Free the slot before the slow write so producers get it back sooner
+    slot->seq.store(tail + LOG_RING_SLOTS, std::memory_order_release);
+    tail_.store(++tail, std::memory_order_relaxed);
+    sink->write((const uint8_t*)line, len);
+    lines++;
+  }
+
+  uint32_t dropped = dropped_.load(std::memory_order_relaxed);
+  if (dropped != droppedReported_) {
+    int len = snprintf(line, sizeof(line), "-- %lu log lines dropped\n",
+                       (unsigned long)(dropped - droppedReported_));
+    droppedReported_ = dropped;
+    if (len > 0) sink->write((const uint8_t*)line, len);
+  }
+  return lines;
+}
+
+size_t LogRing::waiting() const {
+  return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed);
+}
+
+LogStats LogRing::stats() const {
+  LogStats stats;
+  stats.written = written_.load(std::memory_order_relaxed);
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  stats.truncated = truncated_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void logPrint(uint8_t level, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  logRing.vprint(level, fmt, args);
+  va_end(args);
+}
@@ -0,0 +1,104 @@
+/*
+ * Log Ring - leveled, asynchronous logging
+ *
+ * Serial.println() blocks once the UART's 128-byte FIFO is full: at 115200
+ * baud every further 100 characters is about 9 ms on the calling task. The
+ * LOG_* macros instead format the line into a slot of a fixed ring and
+ * return; a low-priority task drains the ring to the console. Any task can
+ * log without a lock: a slot is claimed with one compare-and-swap. When
+ * the ring is full the line is dropped and counted, never waited for, and
+ * the drain reports how many were lost.
+ *
+ * LOG_LEVEL picks the most verbose level built in; set it for every file
+ * at once with -DLOG_LEVEL=... in the build flags. Calls above it sit
+ * behind a constant false condition, so the compiler removes them and
+ * their arguments are never evaluated. They are still type-checked against
+ * the format string.
+ */
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <atomic>
+
+#define LOG_LEVEL_OFF    0
+#define LOG_LEVEL_ERROR  1
+#define LOG_LEVEL_WARN   2
+#define LOG_LEVEL_INFO   3
+#define LOG_LEVEL_DEBUG  4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL  LOG_LEVEL_INFO
+#endif
+#ifndef LOG_RING_SLOTS
+#define LOG_RING_SLOTS  32   // Power of two
+#endif
+#ifndef LOG_LINE_MAX
+#define LOG_LINE_MAX    120  // Longer lines are cut
+#endif
+
+#define LOG_ERROR(...) do { if (LOG_LEVEL >= LOG_LEVEL_ERROR) logPrint(LOG_LEVEL_ERROR, __VA_ARGS__); } while (0)
+#define LOG_WARN(...)  do { if (LOG_LEVEL >= LOG_LEVEL_WARN) logPrint(LOG_LEVEL_WARN, __VA_ARGS__); } while (0)
+#define LOG_INFO(...)  do { if (LOG_LEVEL >= LOG_LEVEL_INFO) logPrint(LOG_LEVEL_INFO, __VA_ARGS__); } while (0)
+#define LOG_DEBUG(...) do { if (LOG_LEVEL >= LOG_LEVEL_DEBUG) logPrint(LOG_LEVEL_DEBUG, __VA_ARGS__); } while (0)
+
+// Where drained lines go: the serial console on the device
+class LogSink {
+public:
+  virtual ~LogSink() {}
+  virtual void write(const uint8_t* data, size_t len) = 0;
+};
+
+struct LogStats {
+  uint32_t written;    // Lines queued
+  uint32_t dropped;    // Lines lost to a full ring
+  uint32_t truncated;  // Lines cut at LOG_LINE_MAX
+};
+
+class LogRing {
+public:
+  LogRing();
+
+  // Timestamps come from clock(), in ms; without one they are 0
+  void begin(uint32_t (*clock)());
+
+  // Any task. Returns false if the ring was full and the line dropped.
+  bool vprint(uint8_t level, const char* fmt, va_list args);
+
+  // One task only. Writes up to maxLines queued lines to the sink as
+  // "<ms> <level> <text>\n", and a note for lines dropped since the last
+  // call. Returns the number of lines written.
+  size_t drain(LogSink* sink, size_t maxLines);
+
+  size_t waiting() const;
+  LogStats stats() const;
+  static char levelChar(uint8_t level);
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> seq;  // Ring position this slot is ready for
+    uint32_t timestamp;
+    uint8_t level;
+    uint8_t len;
+    char text[LOG_LINE_MAX];
+  };
+
+  Slot slots_[LOG_RING_SLOTS];
+  std::atomic<uint32_t> head_;  // Next position a producer claims
+  std::atomic<uint32_t> tail_;  // Next position the drain reads
+  uint32_t (*clock_)();
+  std::atomic<uint32_t> written_;
+  std::atomic<uint32_t> dropped_;
+  std::atomic<uint32_t> truncated_;
+  uint32_t droppedReported_;
+};
+
+extern LogRing logRing;
+
+// Queue one line on logRing; use the LOG_* macros rather than calling this
+void logPrint(uint8_t level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif // LOG_RING_H
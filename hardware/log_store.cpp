@@ -0,0 +1,406 @@
+/*
+ * Log Store - wear-leveled, log-structured records on a raw flash partition
+ *
+ * A segment's life: erased, then its erase count and magic are written
+ * (free); when it becomes the head its sequence number and a check are
+ * written (used); records are appended until the next one doesn't fit.
+ * Each of those writes only clears bits in erased bytes, and a header
+ * torn at any point reads as something mount erases again.
+ *
+ * Segment state lives in RAM, 16 bytes per segment, rebuilt by mount from
+ * the headers and a scan of every used segment.
+ */
+
+#include "log_store.h"
+#include <string.h>
+
+#define LOG_SEGMENT_HEADER_BYTES  sizeof(LogSegmentHeader)
+#define LOG_SEGMENT_DATA_BYTES    (LOG_STORE_SEGMENT_BYTES - LOG_SEGMENT_HEADER_BYTES)
+#define LOG_ERASED_WORD           0xFFFFFFFF
+
+// Nibble-at-a-time table for the reflected IEEE polynomial 0xEDB88320
+static const uint32_t crcNibbles[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+uint32_t logStoreCrc(uint32_t crc, const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  crc = ~crc;
+  while (len-- > 0) {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ crcNibbles[crc & 0x0F];
+    crc = (crc >> 4) ^ crcNibbles[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+static uint32_t headerCheck(uint32_t eraseCount, uint32_t seq) {
+  uint32_t fields[3] = {LOG_STORE_MAGIC, eraseCount, seq};
+  return logStoreCrc(0, fields, sizeof(fields));
+}
+
+uint32_t LogStore::recordBytes(size_t len) {
+  return (uint32_t)((sizeof(LogRecordHeader) + len + 3) & ~(size_t)3);
+}
+
+LogStore::LogStore() : flash_(NULL), client_(NULL), count_(0), head_(-1), nextSeq_(1) {
+  memset(segments_, 0, sizeof(segments_));
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+bool LogStore::begin(LogStoreFlash* flash, LogStoreClient* client) {
+  flash_ = NULL;
+  client_ = client;
+  head_ = -1;
+  nextSeq_ = 1;
+  memset(segments_, 0, sizeof(segments_));
+  memset(&stats_, 0, sizeof(stats_));
+
+  size_t segments = flash != NULL ? flash->size() / LOG_STORE_SEGMENT_BYTES : 0;
+  if (segments > LOG_STORE_MAX_SEGMENTS) segments = LOG_STORE_MAX_SEGMENTS;
+  if (client == NULL || segments < LOG_STORE_RESERVE + 2) return false;
+  count_ = (uint16_t)segments;
+  flash_ = flash;
+
+  // Headers first, so a segment with an unreadable header is formatted
+  // with an erase count in line with the rest
+  bool valid[LOG_STORE_MAX_SEGMENTS];
+  uint32_t maxErases = 0;
+  for (uint16_t i = 0; i < count_; i++) valid[i] = classify(i, &maxErases);
+  for (uint16_t i = 0; i < count_; i++) {
+    if (valid[i]) continue;
+    if (segments_[i].eraseCount == LOG_ERASED_WORD) segments_[i].eraseCount = maxErases;
+    bool ok = blank(i) ? markFree(i, segments_[i].eraseCount) : eraseSegment(i);
+    if (!ok) {
+      flash_ = NULL;
+      return false;
+    }
+  }
+
+  // Replay oldest first
+  uint16_t order[LOG_STORE_MAX_SEGMENTS];
+  uint16_t used = 0;
+  for (uint16_t i = 0; i < count_; i++) {
+    if (!segments_[i].used) continue;
+    uint16_t at = used++;
+    while (at > 0 && segments_[order[at - 1]].seq > segments_[i].seq) {
+      order[at] = order[at - 1];
+      at--;
+    }
+    order[at] = i;
+  }
+  for (uint16_t i = 0; i < used; i++) scan(order[i]);
+
+  // Appends continue in the newest segment unless a torn record sealed it
+  if (used > 0) {
+    head_ = order[used - 1];
+    nextSeq_ = segments_[head_].seq + 1;
+  }
+  return true;
+}
+
+// Fill in segment i from its header; false if it has to be formatted
+bool LogStore::classify(uint16_t i, uint32_t* maxErases) {
+  Segment& seg = segments_[i];
+  seg.eraseCount = LOG_ERASED_WORD;
+  seg.end = LOG_SEGMENT_HEADER_BYTES;
+
+  LogSegmentHeader header;
+  if (!flash_->read((uint32_t)i * LOG_STORE_SEGMENT_BYTES, &header, sizeof(header))) return false;
+  if (header.magic != LOG_STORE_MAGIC) return false;
+
+  // The erase count goes on flash before the magic, so it is whole here
+  seg.eraseCount = header.eraseCount;
+  if (header.eraseCount > *maxErases) *maxErases = header.eraseCount;
+
+  if (header.seq == LOG_ERASED_WORD && header.check == LOG_ERASED_WORD) return true;
+  if (header.check != headerCheck(header.eraseCount, header.seq)) return false;
+  seg.used = true;
+  seg.seq = header.seq;
+  return true;
+}
+
+// Never written since its last erase, as a new partition reads
+bool LogStore::blank(uint16_t i) {
+  uint32_t words[64];
+  for (uint32_t offset = 0; offset < LOG_STORE_SEGMENT_BYTES; offset += sizeof(words)) {
+    if (!flash_->read((uint32_t)i * LOG_STORE_SEGMENT_BYTES + offset, words, sizeof(words))) return false;
+    for (size_t w = 0; w < sizeof(words) / sizeof(words[0]); w++) {
+      if (words[w] != LOG_ERASED_WORD) return false;
+    }
+  }
+  return true;
+}
+
+// Replay segment i's records and find where appends would go. A record
+// that fails its CRC seals the segment: nothing after it is trusted.
+void LogStore::scan(uint16_t i) {
+  Segment& seg = segments_[i];
+  uint32_t base = (uint32_t)i * LOG_STORE_SEGMENT_BYTES;
+  seg.end = LOG_SEGMENT_HEADER_BYTES;
+  seg.live = 0;
+
+  LogEntry entry;
+  while (seg.end + sizeof(LogRecordHeader) <= LOG_STORE_SEGMENT_BYTES) {
+    LogRecordHeader header;
+    if (!flash_->read(base + seg.end, &header, sizeof(header))) break;
+    if (header.len == 0xFFFF && header.crc == LOG_ERASED_WORD) return;  // End of the log
+
+    if (!readAt(base + seg.end, base + LOG_STORE_SEGMENT_BYTES, &entry)) break;
+    uint32_t bytes = recordBytes(entry.len);
+    seg.end += bytes;
+    seg.live += bytes;
+    client_->replay(entry);
+  }
+  if (seg.end + sizeof(LogRecordHeader) <= LOG_STORE_SEGMENT_BYTES) stats_.tornRecords++;
+  seg.end = LOG_STORE_SEGMENT_BYTES;
+}
+
+bool LogStore::markFree(uint16_t i, uint32_t eraseCount) {
+  uint32_t base = (uint32_t)i * LOG_STORE_SEGMENT_BYTES;
+  uint32_t magic = LOG_STORE_MAGIC;
+  Segment& seg = segments_[i];
+  seg.used = false;
+  seg.seq = 0;
+  seg.eraseCount = eraseCount;
+  seg.end = LOG_SEGMENT_HEADER_BYTES;
+  seg.live = 0;
+
+  if (!flash_->write(base + offsetof(LogSegmentHeader, eraseCount), &eraseCount, sizeof(eraseCount)) ||
+      !flash_->write(base + offsetof(LogSegmentHeader, magic), &magic, sizeof(magic))) {
+    return false;
+  }
+  stats_.flashBytes += sizeof(eraseCount) + sizeof(magic);
+  return true;
+}
+
+bool LogStore::eraseSegment(uint16_t i) {
+  uint32_t erases = segments_[i].eraseCount;
+  if (!flash_->erase((uint32_t)i * LOG_STORE_SEGMENT_BYTES, LOG_STORE_SEGMENT_BYTES)) return false;
+  stats_.erases++;
+  if ((int)i == head_) head_ = -1;
+  return markFree(i, erases + 1);
+}
+
+// Start appending to the least worn free segment, leaving keep free
+bool LogStore::openHead(uint16_t keep) {
+  if (freeSegments() <= keep) return false;
+
+  int best = -1;
+  for (uint16_t i = 0; i < count_; i++) {
+    if (segments_[i].used) continue;
+    if (best < 0 || segments_[i].eraseCount < segments_[best].eraseCount) best = i;
+  }
+
+  Segment& seg = segments_[best];
+  uint32_t tail[2] = {nextSeq_, headerCheck(seg.eraseCount, nextSeq_)};
+  seg.used = true;
+  seg.seq = nextSeq_++;
+  seg.live = 0;
+  head_ = -1;
+  if (!flash_->write((uint32_t)best * LOG_STORE_SEGMENT_BYTES + offsetof(LogSegmentHeader, seq),
+                     tail, sizeof(tail))) {
+    seg.end = LOG_STORE_SEGMENT_BYTES;  // Nothing live: the next compaction erases it
+    return false;
+  }
+  stats_.flashBytes += sizeof(tail);
+  seg.end = LOG_SEGMENT_HEADER_BYTES;
+  head_ = best;
+  return true;
+}
+
+bool LogStore::fits(uint32_t bytes) const {
+  return head_ >= 0 && segments_[head_].end + bytes <= LOG_STORE_SEGMENT_BYTES;
+}
+
+// One flash write of header, payload and padding at the head
+bool LogStore::writeRecord(uint8_t type, const void* payload, size_t len, uint32_t* addr, bool copy) {
+  uint8_t buf[sizeof(LogRecordHeader) + LOG_STORE_RECORD_MAX + 3];
+  uint32_t bytes = recordBytes(len);
+  memset(buf, 0xFF, bytes);
+
+  LogRecordHeader header;
+  header.len = (uint16_t)len;
+  header.type = type;
+  header.reserved = 0;
+  header.crc = logStoreCrc(logStoreCrc(0, &header, offsetof(LogRecordHeader, crc)), payload, len);
+  memcpy(buf, &header, sizeof(header));
+  memcpy(buf + sizeof(header), payload, len);
+
+  Segment& seg = segments_[head_];
+  uint32_t at = (uint32_t)head_ * LOG_STORE_SEGMENT_BYTES + seg.end;
+  if (!flash_->write(at, buf, bytes)) {
+    // Part of the record may be on flash: nothing more goes after it
+    seg.end = LOG_STORE_SEGMENT_BYTES;
+    head_ = -1;
+    return false;
+  }
+  seg.end += bytes;
+  seg.live += bytes;
+
+  stats_.flashBytes += bytes;
+  if (copy) {
+    stats_.copies++;
+    stats_.copiedBytes += bytes;
+  } else {
+    stats_.appends++;
+    stats_.payloadBytes += len;
+    stats_.recordBytes += bytes;
+  }
+  if (addr != NULL) *addr = at;
+  return true;
+}
+
+bool LogStore::append(uint8_t type, const void* payload, size_t len, uint32_t* addr) {
+  if (flash_ == NULL || len > LOG_STORE_RECORD_MAX) return false;
+
+  uint32_t bytes = recordBytes(len);
+  if (!fits(bytes)) {
+    for (uint16_t n = 0; freeSegments() <= LOG_STORE_RESERVE && n < count_; n++) {
+      int victim = pickVictim(false);
+      if (victim < 0 || !reclaim((uint16_t)victim)) break;
+    }
+    if (!fits(bytes) && !openHead(LOG_STORE_RESERVE)) {
+      stats_.full++;
+      return false;
+    }
+  }
+  return writeRecord(type, payload, len, addr, false);
+}
+
+bool LogStore::readAt(uint32_t addr, uint32_t limit, LogEntry* out) const {
+  LogRecordHeader header;
+  if (addr + sizeof(header) > limit || !flash_->read(addr, &header, sizeof(header))) return false;
+  if (header.len > LOG_STORE_RECORD_MAX || addr + recordBytes(header.len) > limit) return false;
+  if (!flash_->read(addr + sizeof(header), out->payload, header.len)) return false;
+
+  uint32_t crc = logStoreCrc(logStoreCrc(0, &header, offsetof(LogRecordHeader, crc)),
+                             out->payload, header.len);
+  if (crc != header.crc) return false;
+  out->addr = addr;
+  out->type = header.type;
+  out->len = header.len;
+  return true;
+}
+
+bool LogStore::read(uint32_t addr, LogEntry* out) const {
+  uint16_t segment = segmentOf(addr);
+  if (flash_ == NULL || segment >= count_) return false;
+  uint32_t base = (uint32_t)segment * LOG_STORE_SEGMENT_BYTES;
+  if (addr < base + LOG_SEGMENT_HEADER_BYTES) return false;
+  return readAt(addr, base + LOG_STORE_SEGMENT_BYTES, out);
+}
+
+bool LogStore::next(uint16_t segment, uint32_t* offset, LogEntry* out) const {
+  if (flash_ == NULL || segment >= count_ || !segments_[segment].used) return false;
+  uint32_t at = *offset != 0 ? *offset : LOG_SEGMENT_HEADER_BYTES;
+  if (at >= segments_[segment].end) return false;
+
+  uint32_t base = (uint32_t)segment * LOG_STORE_SEGMENT_BYTES;
+  if (!readAt(base + at, base + segments_[segment].end, out)) return false;
+  *offset = at + recordBytes(out->len);
+  return true;
+}
+
+void LogStore::retire(uint32_t addr, uint32_t bytes) {
+  uint16_t segment = segmentOf(addr);
+  if (segment >= count_ || !segments_[segment].used) return;
+  Segment& seg = segments_[segment];
+  seg.live = bytes < seg.live ? (uint16_t)(seg.live - bytes) : 0;
+}
+
+// Most reclaimable space, or with cold set the least worn data
+int LogStore::pickVictim(bool cold) const {
+  int best = -1;
+  for (uint16_t i = 0; i < count_; i++) {
+    if (!segments_[i].used || (int)i == head_) continue;
+    if (best < 0) {
+      best = i;
+      continue;
+    }
+    const Segment& seg = segments_[i];
+    const Segment& other = segments_[best];
+    if (cold ? seg.eraseCount < other.eraseCount
+             : seg.live < other.live || (seg.live == other.live && seg.eraseCount < other.eraseCount)) {
+      best = i;
+    }
+  }
+  if (best >= 0 && !cold && segments_[best].live >= LOG_SEGMENT_DATA_BYTES) return -1;
+  return best;
+}
+
+// Copy the victim's live records to the head, then erase it. Stops short
+// of the erase on any failure, leaving the victim as it was.
+bool LogStore::reclaim(uint16_t victim) {
+  uint32_t offset = 0;
+  LogEntry entry;
+  while (next(victim, &offset, &entry)) {
+    if (!client_->live(entry)) continue;
+    uint32_t to;
+    if (!fits(recordBytes(entry.len)) && !openHead(0)) return false;
+    if (!writeRecord(entry.type, entry.payload, entry.len, &to, true)) return false;
+    client_->moved(entry, to);
+  }
+  if (!eraseSegment(victim)) return false;
+  stats_.compactions++;
+  client_->erased(victim);
+  return true;
+}
+
+bool LogStore::compact() {
+  if (flash_ == NULL) return false;
+
+  // Nothing live: only the erase
+  for (uint16_t i = 0; i < count_; i++) {
+    if (segments_[i].used && (int)i != head_ && segments_[i].live == 0) return reclaim(i);
+  }
+
+  uint16_t free = freeSegments();
+  if ((uint32_t)free * 100 < (uint32_t)count_ * LOG_STORE_LOW_WATER_PCT) {
+    int victim = pickVictim(false);
+    if (victim >= 0) return reclaim((uint16_t)victim);
+  }
+
+  // Data that never changes pins its segment at a low erase count
+  uint32_t lo, hi;
+  wear(&lo, &hi);
+  if (hi - lo > LOG_STORE_WEAR_SPREAD && free > LOG_STORE_RESERVE + 1) {
+    int victim = pickVictim(true);
+    if (victim >= 0 && segments_[victim].eraseCount + LOG_STORE_WEAR_SPREAD < hi) {
+      return reclaim((uint16_t)victim);
+    }
+  }
+  return false;
+}
+
+uint16_t LogStore::freeSegments() const {
+  uint16_t free = 0;
+  for (uint16_t i = 0; i < count_; i++) {
+    if (!segments_[i].used) free++;
+  }
+  return free;
+}
+
+uint32_t LogStore::liveBytes() const {
+  uint32_t live = 0;
+  for (uint16_t i = 0; i < count_; i++) {
+    if (segments_[i].used) live += segments_[i].live;
+  }
+  return live;
+}
+
+uint32_t LogStore::capacityBytes() const {
+  return (uint32_t)count_ * LOG_SEGMENT_DATA_BYTES;
+}
+
+void LogStore::wear(uint32_t* minErases, uint32_t* maxErases) const {
+  uint32_t lo = count_ > 0 ? segments_[0].eraseCount : 0;
+  uint32_t hi = lo;
+  for (uint16_t i = 1; i < count_; i++) {
+    if (segments_[i].eraseCount < lo) lo = segments_[i].eraseCount;
+    if (segments_[i].eraseCount > hi) hi = segments_[i].eraseCount;
+  }
+  *minErases = lo;
+  *maxErases = hi;
+}
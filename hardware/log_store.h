@@ -0,0 +1,185 @@
+/*
+ * Log Store - wear-leveled, log-structured records on a raw flash partition
+ *
+ * The partition is cut into fixed-size segments, one flash sector each.
+ * Records are only ever appended: a change is a new record and the one it
+ * supersedes is retired, so a write programs just the bytes of the record
+ * instead of rewriting a file. Each record carries a CRC-32; a crash
+ * mid-write leaves a record whose CRC doesn't match, and mount seals that
+ * segment and carries on in a fresh one.
+ *
+ * Compaction reclaims one segment at a time: it asks the client which of
+ * the segment's records are still live, copies those to the head and
+ * erases the segment. Victims are the segments with the most retired
+ * bytes; when erase counts drift too far apart a segment of cold data is
+ * moved instead, so every sector wears at about the same rate. Copies land
+ * before the erase, so a crash mid-compaction leaves a record twice, never
+ * zero times, and mount replays both in write order.
+ *
+ * What a record means, and so whether it is live, belongs to the client;
+ * the store only keeps per-segment byte counts to pick victims.
+ *
+ * This module has no Arduino dependencies so it can be tested on a host.
+ */
+
+#ifndef LOG_STORE_H
+#define LOG_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LOG_STORE_MAGIC          0x474F4C44  // "DLOG"
+
+#ifndef LOG_STORE_SEGMENT_BYTES
+#define LOG_STORE_SEGMENT_BYTES  4096  // One flash sector, the unit of erase
+#endif
+#ifndef LOG_STORE_MAX_SEGMENTS
+#define LOG_STORE_MAX_SEGMENTS   128   // 512 KB of 4 KB sectors
+#endif
+#define LOG_STORE_RECORD_MAX     128   // Payload bytes per record
+#define LOG_STORE_RESERVE        1     // Free segments only compaction may open
+#define LOG_STORE_LOW_WATER_PCT  25    // Background compaction below this share free
+#ifndef LOG_STORE_WEAR_SPREAD
+#define LOG_STORE_WEAR_SPREAD    64    // Erase count gap that moves cold data
+#endif
+
+// The raw partition. Like NOR flash, a write can only clear bits, so a
+// region is written once between erases.
+class LogStoreFlash {
+public:
+  virtual ~LogStoreFlash() {}
+  virtual size_t size() = 0;
+  virtual bool read(uint32_t addr, void* buf, size_t len) = 0;
+  virtual bool write(uint32_t addr, const void* buf, size_t len) = 0;
+  virtual bool erase(uint32_t addr, size_t len) = 0;  // Whole segments
+};
+
+// On-flash layout: a segment header, then records back to back
+struct LogSegmentHeader {
+  uint32_t magic;
+  uint32_t eraseCount;  // Written right after the erase
+  uint32_t seq;         // Age order; all ones while the segment is free
+  uint32_t check;       // CRC-32 of the fields above, written with seq
+};
+
+struct LogRecordHeader {
+  uint16_t len;         // Payload bytes; all ones where nothing was written
+  uint8_t type;
+  uint8_t reserved;
+  uint32_t crc;         // CRC-32 of len, type, reserved and the payload
+};
+
+// One record as read back
+struct LogEntry {
+  uint32_t addr;  // Offset in the partition; changes only when compaction moves it
+  uint8_t type;
+  uint16_t len;
+  uint8_t payload[LOG_STORE_RECORD_MAX];
+};
+
+// The module whose records the store holds
+class LogStoreClient {
+public:
+  virtual ~LogStoreClient() {}
+
+  // Mount: every intact record, oldest segment first and in write order
+  // within it. A record compaction copied but didn't get to erase shows
+  // up twice, the copy last.
+  virtual void replay(const LogEntry& entry) = 0;
+
+  // Compaction: should the record survive its segment being erased?
+  virtual bool live(const LogEntry& entry) = 0;
+
+  // Compaction copied a live record; the old address goes with the erase
+  // and must not be retired
+  virtual void moved(const LogEntry& entry, uint32_t to) = 0;
+
+  // Nothing in the segment is on flash any more
+  virtual void erased(uint16_t segment) { (void)segment; }
+};
+
+struct LogStoreStats {
+  uint64_t payloadBytes;  // What clients asked to store
+  uint64_t recordBytes;   // ... with record headers and padding
+  uint64_t flashBytes;    // Everything programmed: records, copies, segment headers
+  uint64_t copiedBytes;   // Programmed by compaction
+  uint32_t appends;
+  uint32_t copies;        // Records moved by compaction
+  uint32_t compactions;   // Segments reclaimed
+  uint32_t erases;
+  uint32_t tornRecords;   // Found at mount
+  uint32_t full;          // Appends refused for lack of space
+};
+
+class LogStore {
+public:
+  LogStore();
+
+  // Mount: format what isn't ours, replay every record to the client and
+  // reopen the newest segment for appends
+  bool begin(LogStoreFlash* flash, LogStoreClient* client);
+
+  // Compacts inline if the background step fell behind; false when every
+  // segment is live or the flash failed
+  bool append(uint8_t type, const void* payload, size_t len, uint32_t* addr);
+
+  // Checks the CRC. Touches no store state, so may run on another task
+  // than the writer as long as the client keeps addr from being reclaimed.
+  bool read(uint32_t addr, LogEntry* out) const;
+
+  // Walk one segment's records; start with *offset = 0
+  bool next(uint16_t segment, uint32_t* offset, LogEntry* out) const;
+
+  // bytes of the segment holding addr no longer hold live data
+  void retire(uint32_t addr, uint32_t bytes);
+
+  // One step of background maintenance: reclaim a dead segment, or the
+  // best victim below the low-water mark, or move cold data. Returns true
+  // if it erased something.
+  bool compact();
+
+  bool mounted() const { return flash_ != NULL; }
+  uint16_t segmentCount() const { return count_; }
+  uint16_t freeSegments() const;
+  uint32_t liveBytes() const;
+  uint32_t capacityBytes() const;  // Record space across all segments
+  void wear(uint32_t* minErases, uint32_t* maxErases) const;
+  const LogStoreStats& stats() const { return stats_; }
+
+  static uint32_t recordBytes(size_t len);  // On flash, header and padding included
+  static uint16_t segmentOf(uint32_t addr) { return (uint16_t)(addr / LOG_STORE_SEGMENT_BYTES); }
+
+private:
+  struct Segment {
+    uint32_t seq;
+    uint32_t eraseCount;
+    uint16_t end;   // Write offset; the segment size once sealed
+    uint16_t live;  // Record bytes not yet retired
+    bool used;
+  };
+
+  bool classify(uint16_t i, uint32_t* maxErases);
+  bool blank(uint16_t i);
+  void scan(uint16_t i);
+  bool markFree(uint16_t i, uint32_t eraseCount);
+  bool eraseSegment(uint16_t i);
+  bool openHead(uint16_t keep);
+  bool fits(uint32_t bytes) const;
+  bool writeRecord(uint8_t type, const void* payload, size_t len, uint32_t* addr, bool copy);
+  int pickVictim(bool cold) const;
+  bool reclaim(uint16_t victim);
+  bool readAt(uint32_t addr, uint32_t limit, LogEntry* out) const;
+
+  LogStoreFlash* flash_;
+  LogStoreClient* client_;
+  Segment segments_[LOG_STORE_MAX_SEGMENTS];
+  uint16_t count_;
+  int head_;         // Segment taking appends; -1 until one is opened
+  uint32_t nextSeq_;
+  LogStoreStats stats_;
+};
+
+// CRC-32 (IEEE), continuing from crc; start with 0
+uint32_t logStoreCrc(uint32_t crc, const void* data, size_t len);
+
+#endif // LOG_STORE_H
@@ -0,0 +1,26 @@
+/*
+ * Partition Flash - a raw data partition as log store flash
+ */
+
+#include "partition_flash.h"
+
+bool PartitionFlash::begin(const char* label) {
+  partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+  return partition_ != NULL;
+}
+
+size_t PartitionFlash::size() {
+  return partition_ != NULL ? partition_->size : 0;
+}
+
+bool PartitionFlash::read(uint32_t addr, void* buf, size_t len) {
+  return partition_ != NULL && esp_partition_read(partition_, addr, buf, len) == ESP_OK;
+}
+
+bool PartitionFlash::write(uint32_t addr, const void* buf, size_t len) {
+  return partition_ != NULL && esp_partition_write(partition_, addr, buf, len) == ESP_OK;
+}
+
+bool PartitionFlash::erase(uint32_t addr, size_t len) {
+  return partition_ != NULL && esp_partition_erase_range(partition_, addr, len) == ESP_OK;
+}
@@ -0,0 +1,32 @@
+/*
+ * Partition Flash - a raw data partition as log store flash
+ *
+ * The partitions are declared in partitions.csv, which the Arduino
+ * builder picks up from the sketch folder. esp_partition_* goes through
+ * the flash driver, so reads from one task and writes from another are
+ * safe.
+ */
+
+#ifndef PARTITION_FLASH_H
+#define PARTITION_FLASH_H
+
+#include <esp_partition.h>
+#include "log_store.h"
+
+class PartitionFlash : public LogStoreFlash {
+public:
+  PartitionFlash() : partition_(NULL) {}
+
+  // False if the partition table has no data partition with this label
+  bool begin(const char* label);
+
+  size_t size() override;
+  bool read(uint32_t addr, void* buf, size_t len) override;
+  bool write(uint32_t addr, const void* buf, size_t len) override;
+  bool erase(uint32_t addr, size_t len) override;
+
+private:
+  const esp_partition_t* partition_;
+};
+
+#endif // PARTITION_FLASH_H
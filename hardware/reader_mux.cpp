@@ -0,0 +1,39 @@
+/*
+ * Reader Mux - several MFRC522 readers on one SPI bus, one chip select each
+ */
+
+#include "reader_mux.h"
+
+ReaderMux::ReaderMux() : count_(0), next_(0), mode_(CARD_DETECT_POLL) {
+  for (uint8_t i = 0; i < READER_MAX; i++) {
+    readers_[i].radio = NULL;
+    readers_[i].direction = 0;
+  }
+}
+
+bool ReaderMux::add(CardDetectRadio* radio, uint8_t direction) {
+  if (count_ >= READER_MAX) return false;
+  readers_[count_].radio = radio;
+  readers_[count_].direction = direction;
+  count_++;
+  return true;
+}
+
+void ReaderMux::begin(uint8_t mode, uint32_t now) {
+  mode_ = count_ > 1 ? CARD_DETECT_STATUS : mode;
+  next_ = 0;
+  for (uint8_t i = 0; i < count_; i++) {
+    readers_[i].detector.begin(readers_[i].radio, mode_, now);
+  }
+}
+
+int ReaderMux::check(uint32_t now, bool irqFired) {
+  for (uint8_t k = 0; k < count_; k++) {
+    uint8_t i = (uint8_t)((next_ + k) % count_);
+    if (readers_[i].detector.check(now, irqFired)) {
+      next_ = (uint8_t)((i + 1) % count_);
+      return i;
+    }
+  }
+  return READER_NONE;
+}
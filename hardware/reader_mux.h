@@ -0,0 +1,72 @@
+/*
+ * Reader Mux - several MFRC522 readers on one SPI bus, one chip select each
+ *
+ * Every reader has its own card detector and a direction its taps are
+ * tagged with (an entry and an exit reader on the same door). Each pass
+ * of the RFID task sweeps all readers, starting after the one that
+ * produced the last card, and stops at the first card found, so a reader
+ * with a queue of people can't starve the one next to it: any other
+ * reader is looked at within READER_MAX passes at worst.
+ *
+ * A lone reader keeps the mode it was given. With several, blocking polls
+ * would take turns (each REQA with no card waits out a 25 ms timeout),
+ * leaving the door no more scans per second than one reader, and one
+ * shared IRQ line can't say which reader answered. So they all run in
+ * status mode: REQAs are queued on every reader without waiting, and the
+ * answer is read back from each reader's ComIrqReg. The IRQ line, wired
+ * to every reader's open-drain IRQ pin, only wakes the task early.
+ *
+ * Each reader is still sent a REQA every CARD_IRQ_REARM_MS, so the
+ * door scans N times as often as one reader would. What it costs is the
+ * status read per reader per pass and the passes where a card is being
+ * selected; those keep the aggregate within READER_SCAN_MARGIN_PCT of N
+ * times one reader's scan rate (test/reader_mux_test.cpp measures it).
+ *
+ * This module has no Arduino dependencies so it can be tested on a host.
+ */
+
+#ifndef READER_MUX_H
+#define READER_MUX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "card_detect.h"
+
+#define READER_MAX              4
+#define READER_NONE             -1
+#define READER_SCAN_MARGIN_PCT  10  // Aggregate scans may fall this far short of N x one reader
+
+class ReaderMux {
+public:
+  ReaderMux();
+
+  // Before begin(); false once READER_MAX readers are added
+  bool add(CardDetectRadio* radio, uint8_t direction);
+
+  // mode is what a lone reader uses; several readers use status mode
+  void begin(uint8_t mode, uint32_t now);
+
+  // One pass of the RFID task. Returns the reader whose card has been
+  // selected and can be read from its radio, or READER_NONE.
+  int check(uint32_t now, bool irqFired);
+
+  uint8_t count() const { return count_; }
+  uint8_t mode() const { return mode_; }
+  uint8_t direction(uint8_t reader) const { return readers_[reader].direction; }
+  CardDetectRadio* radio(uint8_t reader) const { return readers_[reader].radio; }
+  const CardDetectStats& stats(uint8_t reader) const { return readers_[reader].detector.stats(); }
+
+private:
+  struct Reader {
+    CardDetectRadio* radio;
+    uint8_t direction;
+    CardDetector detector;
+  };
+
+  Reader readers_[READER_MAX];
+  uint8_t count_;
+  uint8_t next_;  // First reader of the next sweep
+  uint8_t mode_;
+};
+
+#endif // READER_MUX_H
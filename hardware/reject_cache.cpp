@@ -0,0 +1,132 @@
+/*
+ * Reject Cache - unknown cards answered without asking the server
+ */
+
+#include "reject_cache.h"
+#include <string.h>
+
+static bool reached(uint32_t now, uint32_t at) {
+  return (int32_t)(now - at) >= 0;
+}
+
+// Holding a rejection that hasn't expired
+static bool holding(const RejectEntry& e, uint32_t now) {
+  return e.strikes > 0 && !reached(now, e.expiresAt);
+}
+
+RejectCache::RejectCache() {
+  clear();
+}
+
+void RejectCache::clear() {
+  memset(entries_, 0, sizeof(entries_));
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+uint8_t RejectCache::check(const uint8_t* uid, uint8_t uidLen, uint32_t now) {
+  RejectEntry* e = find(uid, uidLen);
+  if (e == NULL) e = claim(uid, uidLen, now);
+  e->seenAt = now;
+  refill(e, now);
+
+  if (holding(*e, now)) {
+    stats_.cached++;
+    return REJECT_CACHED;
+  }
+  if (e->tokens == 0) {
+    stats_.limited++;
+    return REJECT_LIMITED;
+  }
+  e->tokens--;
+  stats_.asked++;
+  return REJECT_ASK;
+}
+
+void RejectCache::rejected(const uint8_t* uid, uint8_t uidLen, uint32_t now) {
+  RejectEntry* e = find(uid, uidLen);
+  if (e == NULL) e = claim(uid, uidLen, now);
+  e->seenAt = now;
+
+  uint32_t ttl = REJECT_TTL_MS;
+  for (uint8_t i = 0; i < e->strikes && ttl < REJECT_TTL_MAX_MS; i++) ttl *= 2;
+  if (ttl > REJECT_TTL_MAX_MS) ttl = REJECT_TTL_MAX_MS;
+  if (e->strikes < 0xFF) e->strikes++;
+  e->expiresAt = now + ttl;
+  stats_.rejections++;
+}
+
+void RejectCache::accepted(const uint8_t* uid, uint8_t uidLen) {
+  RejectEntry* e = find(uid, uidLen);
+  if (e != NULL) memset(e, 0, sizeof(*e));
+}
+
+size_t RejectCache::count() const {
+  size_t n = 0;
+  for (size_t i = 0; i < REJECT_CACHE_SIZE; i++) {
+    if (entries_[i].uidLen != 0) n++;
+  }
+  return n;
+}
+
+const char* RejectCache::decisionName(uint8_t decision) {
+  switch (decision) {
+    case REJECT_ASK:     return "ask";
+    case REJECT_CACHED:  return "cached";
+    case REJECT_LIMITED: return "limited";
+    default:             return "unknown";
+  }
+}
+
+RejectEntry* RejectCache::find(const uint8_t* uid, uint8_t uidLen) {
+  for (size_t i = 0; i < REJECT_CACHE_SIZE; i++) {
+    RejectEntry& e = entries_[i];
+    if (e.uidLen == uidLen && memcmp(e.uid, uid, uidLen) == 0) return &e;
+  }
+  return NULL;
+}
+
+// A free entry, else the one seen least recently, preferring those that
+// aren't holding a rejection
+RejectEntry* RejectCache::claim(const uint8_t* uid, uint8_t uidLen, uint32_t now) {
+  RejectEntry* victim = NULL;
+  bool victimHolding = true;
+  for (size_t i = 0; i < REJECT_CACHE_SIZE; i++) {
+    RejectEntry& e = entries_[i];
+    if (e.uidLen == 0) {
+      victim = &e;
+      break;
+    }
+    bool h = holding(e, now);
+    if (victim == NULL || (victimHolding && !h) ||
+        (victimHolding == h && now - e.seenAt > now - victim->seenAt)) {
+      victim = &e;
+      victimHolding = h;
+    }
+  }
+  if (victim->uidLen != 0) stats_.evictions++;
+
+  memset(victim, 0, sizeof(*victim));
+  if (uidLen > CARD_UID_MAX_LEN) uidLen = CARD_UID_MAX_LEN;
+  memcpy(victim->uid, uid, uidLen);
+  victim->uidLen = uidLen;
+  victim->tokens = REJECT_BUCKET_TOKENS;
+  victim->refilledAt = now;
+  victim->seenAt = now;
+  return victim;
+}
+
+void RejectCache::refill(RejectEntry* e, uint32_t now) {
+  if (e->tokens >= REJECT_BUCKET_TOKENS) {
+    e->refilledAt = now;
+    return;
+  }
+  uint32_t earned = (now - e->refilledAt) / REJECT_REFILL_MS;
+  if (earned == 0) return;
+  if (e->tokens + earned >= REJECT_BUCKET_TOKENS) {
+    e->tokens = REJECT_BUCKET_TOKENS;
+    e->refilledAt = now;
+  } else {
+    e->tokens = (uint8_t)(e->tokens + earned);
+    e->refilledAt += earned * REJECT_REFILL_MS;
+  }
+}
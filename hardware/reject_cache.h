@@ -0,0 +1,87 @@
+/*
+ * Reject Cache - unknown cards answered without asking the server
+ *
+ * A card that isn't stored locally is sent to the server, a round trip of
+ * up to ten seconds. Someone tapping a bus pass over and over would keep
+ * the door waiting and hit /api/verify-rfid on every tap. Each UID the
+ * server has said it doesn't know is remembered for REJECT_TTL_MS and
+ * rejected locally until then; a UID rejected again as soon as it expires
+ * is kept twice as long each time, up to REJECT_TTL_MAX_MS.
+ *
+ * Every unknown UID also has a token bucket of REJECT_BUCKET_TOKENS server
+ * checks, one back every REJECT_REFILL_MS. It covers what the TTL can't:
+ * taps the server never answered (timeouts, errors) and taps made faster
+ * than the verdicts come back.
+ *
+ * The table is small and fixed; when it is full the entry seen least
+ * recently is replaced, preferring one whose rejection has expired. A
+ * check is a scan of REJECT_CACHE_SIZE short UIDs, a few microseconds.
+ * Not thread safe: one task checks and records verdicts.
+ *
+ * This module has no Arduino dependencies so it can be tested on a host.
+ */
+
+#ifndef REJECT_CACHE_H
+#define REJECT_CACHE_H
+
+#include "card_index.h"
+
+#define REJECT_CACHE_SIZE      32
+#define REJECT_TTL_MS          60000   // First rejection
+#define REJECT_TTL_MAX_MS      900000  // Doubling stops here
+#define REJECT_BUCKET_TOKENS   3       // Server checks in a burst
+#define REJECT_REFILL_MS       20000   // One more check after this
+
+// What check() decided
+#define REJECT_ASK      0  // Ask the server; a token was taken
+#define REJECT_CACHED   1  // The server rejected it within the TTL
+#define REJECT_LIMITED  2  // Out of tokens
+
+struct RejectEntry {
+  uint8_t uid[CARD_UID_MAX_LEN];
+  uint8_t uidLen;       // 0: free
+  uint8_t tokens;
+  uint8_t strikes;      // Rejections in a row; 0 while none is known
+  uint32_t expiresAt;   // End of the last rejection's TTL
+  uint32_t refilledAt;  // Tokens are counted up to here
+  uint32_t seenAt;
+};
+
+struct RejectStats {
+  uint32_t asked;       // Server checks let through
+  uint32_t cached;      // Taps rejected from the cache
+  uint32_t limited;     // Taps refused by the token bucket
+  uint32_t rejections;  // Rejections recorded
+  uint32_t evictions;   // Live entries replaced to make room
+};
+
+class RejectCache {
+public:
+  RejectCache();
+  void clear();
+
+  // For a card not stored locally, before asking the server
+  uint8_t check(const uint8_t* uid, uint8_t uidLen, uint32_t now);
+
+  // The server's verdict. A card it knows is forgotten, since it will be
+  // stored locally from now on.
+  void rejected(const uint8_t* uid, uint8_t uidLen, uint32_t now);
+  void accepted(const uint8_t* uid, uint8_t uidLen);
+
+  // Server checks skipped, for either reason
+  uint32_t suppressed() const { return stats_.cached + stats_.limited; }
+  const RejectStats& stats() const { return stats_; }
+  size_t count() const;
+
+  static const char* decisionName(uint8_t decision);
+
+private:
+  RejectEntry* find(const uint8_t* uid, uint8_t uidLen);
+  RejectEntry* claim(const uint8_t* uid, uint8_t uidLen, uint32_t now);
+  void refill(RejectEntry* e, uint32_t now);
+
+  RejectEntry entries_[REJECT_CACHE_SIZE];
+  RejectStats stats_;
+};
+
+#endif // REJECT_CACHE_H
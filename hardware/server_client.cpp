@@ -0,0 +1,191 @@
+/*
+ * Server Client - one persistent HTTP connection for all server traffic
+ *
+ * HTTPClient keeps its TCP connection open across begin()/end() when reuse
+ * is enabled, the server answers with keep-alive and the response body has
+ * been read in full. Every helper here therefore drains the body before
+ * end(). HTTPClient cannot pipeline, so requests are strictly sequential.
+ */
+
+#include "server_client.h"
+#include <HTTPClient.h>
+#include <SPIFFS.h>
+
+static HTTPClient http;
+static String serverBaseUrl;
+static char deviceKey[SERVER_KEY_MAX + 1] = "";
+static ServerClientStats stats = {0, 0, 0, 0};
+
+void serverClientBegin(const char* baseUrl) {
+  serverBaseUrl = baseUrl;
+  http.setReuse(true);
+  http.setConnectTimeout(SERVER_CONNECT_TIMEOUT);
+
+  File file = SPIFFS.open(SERVER_KEY_FILE, "r");
+  if (file) {
+    size_t len = file.read((uint8_t*)deviceKey, SERVER_KEY_MAX);
+    deviceKey[len] = '\0';
+    file.close();
+  }
+}
+
+// Remember the key device/register issued. Returns false if it couldn't
+// be saved; it is still used until the next reboot.
+bool serverSetDeviceKey(const char* key) {
+  size_t len = strlen(key);
+  if (len == 0 || len > SERVER_KEY_MAX) return false;
+  memcpy(deviceKey, key, len + 1);
+
+  File file = SPIFFS.open(SERVER_KEY_FILE ".tmp", "w");
+  if (!file) return false;
+  bool ok = file.write((const uint8_t*)key, len) == len;
+  file.close();
+  if (ok) {
+    SPIFFS.remove(SERVER_KEY_FILE);
+    ok = SPIFFS.rename(SERVER_KEY_FILE ".tmp", SERVER_KEY_FILE);
+  }
+  return ok;
+}
+
+bool serverHasDeviceKey() {
+  return deviceKey[0] != '\0';
+}
+
+// Errors that mean an idle keep-alive connection was closed under us
+static bool isStaleConnection(int code) {
+  return code == HTTPC_ERROR_CONNECTION_LOST ||
+         code == HTTPC_ERROR_SEND_HEADER_FAILED ||
+         code == HTTPC_ERROR_SEND_PAYLOAD_FAILED ||
+         code == HTTPC_ERROR_NOT_CONNECTED;
+}
+
+// Point the client at path. Returns true if an open connection is reused.
+static bool prepare(const char* path, uint32_t timeoutMs) {
+  http.begin(serverBaseUrl + path);
+  http.setTimeout((uint16_t)min(timeoutMs, (uint32_t)65535));
+  if (deviceKey[0] != '\0') http.addHeader("X-Device-Key", deviceKey);
+
+  bool reused = http.connected();
+  if (!reused) stats.connectionsOpened++;
+  return reused;
+}
+
+// Read a response body of known length into buf. Bytes past cap are read
+// and dropped so the connection stays usable. Returns the bytes stored.
+static size_t readBody(uint8_t* buf, size_t cap) {
+  int remaining = http.getSize();
+  if (remaining < 0) {
+    // Chunked: none of our endpoints answer that way
+    http.getString();
+    return 0;
+  }
+
+  WiFiClient* stream = http.getStreamPtr();
+  size_t stored = 0;
+  uint8_t scratch[64];
+  while (remaining > 0) {
+    bool keep = stored < cap;
+    uint8_t* dst = keep ? buf + stored : scratch;
+    size_t room = keep ? cap - stored : sizeof(scratch);
+    size_t got = stream->readBytes(dst, min(room, (size_t)remaining));
+    if (got == 0) break;  // Timed out
+    if (keep) stored += got;
+    remaining -= got;
+  }
+  return stored;
+}
+
+// POST a body, then read the response into either response or buf
+static int post(const char* path, const char* contentType, const uint8_t* body, size_t len,
+                String* response, uint8_t* buf, size_t cap, size_t* received,
+                uint32_t timeoutMs) {
+  stats.requests++;
+
+  for (int attempt = 0; attempt < 2; attempt++) {
+    bool reused = prepare(path, timeoutMs);
+    http.addHeader("Content-Type", contentType);
+
+    int code = http.POST((uint8_t*)body, len);
+    if (code > 0) {
+      // Always read the body so the connection is clean for the next request
+      if (buf != NULL) {
+        *received = readBody(buf, cap);
+      } else if (response != NULL) {
+        *response = http.getString();
+      } else {
+        http.getString();
+      }
+      http.end();
+      return code;
+    }
+
+    http.end();
+    if (!reused || !isStaleConnection(code)) break;
+    stats.retries++;
+  }
+
+  stats.failures++;
+  return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+int serverPost(const char* path, const String& body, String* response, uint32_t timeoutMs) {
+  return post(path, "application/json", (const uint8_t*)body.c_str(), body.length(),
+              response, NULL, 0, NULL, timeoutMs);
+}
+
+// The response body is stored in buf, up to cap bytes; received is set to
+// the bytes stored
+int serverPostBinary(const char* path, const char* contentType, const uint8_t* body, size_t len,
+                     uint8_t* buf, size_t cap, size_t* received, uint32_t timeoutMs) {
+  *received = 0;
+  return post(path, contentType, body, len, NULL, buf, cap, received, timeoutMs);
+}
+
+// Starts a GET whose body is read from serverStream(). Always finish with
+// serverEnd(), whatever the status code.
+int serverGet(const char* path, uint32_t timeoutMs) {
+  stats.requests++;
+
+  for (int attempt = 0; attempt < 2; attempt++) {
+    bool reused = prepare(path, timeoutMs);
+
+    int code = http.GET();
+    if (code > 0) return code;
+
+    http.end();
+    if (!reused || !isStaleConnection(code)) break;
+    stats.retries++;
+  }
+
+  stats.failures++;
+  return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+Stream* serverStream() {
+  return http.getStreamPtr();
+}
+
+void serverEnd() {
+  http.end();
+}
+
+// Percent-encode a query parameter value
+String serverUrlEncode(const String& value) {
+  static const char digits[] = "0123456789ABCDEF";
+  String encoded;
+  for (unsigned int i = 0; i < value.length(); i++) {
+    char c = value[i];
+    if (isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.') {
+      encoded += c;
+    } else {
+      encoded += '%';
+      encoded += digits[(c >> 4) & 0x0F];
+      encoded += digits[c & 0x0F];
+    }
+  }
+  return encoded;
+}
+
+const ServerClientStats& serverClientStats() {
+  return stats;
+}
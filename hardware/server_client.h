@@ -0,0 +1,47 @@
+/*
+ * Server Client - one persistent HTTP connection for all server traffic
+ *
+ * Device registration, card verification, attendance upload and allowlist
+ * sync all go through a single long-lived HTTPClient with keep-alive, so a
+ * burst of requests shares one TCP connection instead of paying a handshake
+ * each. A request that fails on a reused connection the server has already
+ * closed is retried once on a fresh connection.
+ *
+ * Every request carries the key device/register issued (X-Device-Key),
+ * kept in SERVER_KEY_FILE across reboots; the template endpoints refuse
+ * requests without it.
+ */
+
+#ifndef SERVER_CLIENT_H
+#define SERVER_CLIENT_H
+
+#include <Arduino.h>
+
+#ifndef SERVER_CONNECT_TIMEOUT
+#define SERVER_CONNECT_TIMEOUT 5000  // TCP connect timeout (ms)
+#endif
+
+#define SERVER_KEY_FILE   "/device.key"
+#define SERVER_KEY_MAX    64  // Hex characters
+
+struct ServerClientStats {
+  uint32_t requests;
+  uint32_t connectionsOpened;
+  uint32_t retries;
+  uint32_t failures;
+};
+
+// Function declarations
+void serverClientBegin(const char* baseUrl);
+bool serverSetDeviceKey(const char* key);
+bool serverHasDeviceKey();
+int serverPost(const char* path, const String& body, String* response, uint32_t timeoutMs);
+int serverPostBinary(const char* path, const char* contentType, const uint8_t* body, size_t len,
+                     uint8_t* buf, size_t cap, size_t* received, uint32_t timeoutMs);
+int serverGet(const char* path, uint32_t timeoutMs);
+Stream* serverStream();
+void serverEnd();
+const ServerClientStats& serverClientStats();
+String serverUrlEncode(const String& value);
+
+#endif // SERVER_CLIENT_H
@@ -0,0 +1,243 @@
+/*
+ * Stage Metrics - per-stage latency histograms for the tap path
+ *
+ * Each histogram is a seqlock over relaxed atomics: the writer makes seq_
+ * odd, updates the fields and makes it even again; a reader copies the
+ * fields and keeps the copy only if seq_ was even and unchanged around it.
+ * The writer never waits; a reader retries until it gets a clean copy.
+ * Writers record a few samples per tap, so a reader loses at most a couple
+ * of rounds. A reader mustn't outrank a writer on the same core, or it
+ * could spin on an update that never finishes; on the door the readers
+ * are the network and metrics tasks.
+ */
+
+#include "stage_metrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define STAGE_LINE_MAX    112
+
+static const uint32_t bucketBounds[STAGE_BUCKETS - 1] = {
+  50, 100, 200, 500,
+  1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,
+  1000000, 2000000, 5000000, 10000000, 20000000
+};
+
+static const char* const stageNames[STAGE_COUNT] = {
+  "card_read", "card_lookup", "server_verify", "http_verify", "finger_capture",
+  "finger_match", "tap_to_unlock", "journal_append", "http_upload", "wifi_join", "wifi_outage"
+};
+
+StageMetrics stageMetrics;
+
+uint32_t StageSummary::percentileUs(uint32_t pct) const {
+  if (count == 0) return 0;
+  uint64_t rank = ((uint64_t)count * pct + 99) / 100;
+  if (rank == 0) rank = 1;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < STAGE_BUCKETS; i++) {
+    if (buckets[i] == 0 || seen + buckets[i] < rank) {
+      seen += buckets[i];
+      continue;
+    }
+    uint32_t lower = i == 0 ? 0 : bucketBounds[i - 1];
+    uint32_t upper = i < STAGE_BUCKETS - 1 ? bucketBounds[i] : maxUs;
+    if (upper > maxUs) upper = maxUs;
+    if (upper < lower) return upper;
+    uint64_t estimate = lower + (uint64_t)(upper - lower) * (rank - seen) / buckets[i];
+    return (uint32_t)estimate;
+  }
+  return maxUs;
+}
+
+StageHistogram::StageHistogram() : seq_(0) {
+  reset();
+}
+
+size_t StageHistogram::bucketFor(uint32_t us) {
+  size_t i = 0;
+  while (i < STAGE_BUCKETS - 1 && us > bucketBounds[i]) i++;
+  return i;
+}
+
+uint32_t StageHistogram::bucketBound(size_t bucket) {
+  return bucket < STAGE_BUCKETS - 1 ? bucketBounds[bucket] : UINT32_MAX;
+}
+
+void StageHistogram::record(uint32_t us) {
+  uint32_t seq = seq_.load(std::memory_order_relaxed);
+  seq_.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  size_t bucket = bucketFor(us);
+  fields_.buckets[bucket].store(fields_.buckets[bucket].load(std::memory_order_relaxed) + 1,
+                                std::memory_order_relaxed);
+  fields_.count.store(fields_.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  uint32_t lo = fields_.sumLo.load(std::memory_order_relaxed);
+  if (lo + us < lo) {
+    fields_.sumHi.store(fields_.sumHi.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+  fields_.sumLo.store(lo + us, std::memory_order_relaxed);
+  if (us > fields_.maxUs.load(std::memory_order_relaxed)) {
+    fields_.maxUs.store(us, std::memory_order_relaxed);
+  }
+
+  seq_.store(seq + 2, std::memory_order_release);
+}
+
+void StageHistogram::read(StageSummary* out) const {
+  for (;;) {
+    uint32_t before = seq_.load(std::memory_order_acquire);
+    if (before & 1) continue;  // Mid-update
+    out->count = fields_.count.load(std::memory_order_relaxed);
+    out->sumUs = ((uint64_t)fields_.sumHi.load(std::memory_order_relaxed) << 32) |
+                 fields_.sumLo.load(std::memory_order_relaxed);
+    out->maxUs = fields_.maxUs.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < STAGE_BUCKETS; i++) {
+      out->buckets[i] = fields_.buckets[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq_.load(std::memory_order_relaxed) == before) return;
+  }
+}
+
+void StageHistogram::reset() {
+  fields_.count.store(0, std::memory_order_relaxed);
+  fields_.sumLo.store(0, std::memory_order_relaxed);
+  fields_.sumHi.store(0, std::memory_order_relaxed);
+  fields_.maxUs.store(0, std::memory_order_relaxed);
+  for (size_t i = 0; i < STAGE_BUCKETS; i++) {
+    fields_.buckets[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+StageMetrics::StageMetrics() : cycles_(NULL), ms_(NULL), cyclesPerUs_(1), cycleSpanMs_(0) {}
+
+void StageMetrics::begin(uint32_t (*cycles)(), uint32_t cyclesPerUs, uint32_t (*ms)()) {
+  cycles_ = cycles;
+  ms_ = ms;
+  cyclesPerUs_ = cyclesPerUs > 0 ? cyclesPerUs : 1;
+  // Half a wrap of the cycle counter, so a stage can't alias
+  cycleSpanMs_ = (uint32_t)((((uint64_t)1 << 32) / cyclesPerUs_) / 1000 / 2);
+}
+
+StageStamp StageMetrics::now() const {
+  StageStamp stamp;
+  stamp.cycles = cycles_ != NULL ? cycles_() : 0;
+  stamp.ms = ms_ != NULL ? ms_() : 0;
+  return stamp;
+}
+
+uint32_t StageMetrics::elapsedUs(const StageStamp& from) const {
+  if (cycles_ == NULL || ms_ == NULL) return 0;
+  uint32_t ms = ms_() - from.ms;
+  if (ms >= cycleSpanMs_) {
+    return ms < UINT32_MAX / 1000 ? ms * 1000 : UINT32_MAX;
+  }
+  return (cycles_() - from.cycles) / cyclesPerUs_;
+}
+
+uint32_t StageMetrics::record(uint8_t stage, const StageStamp& from) {
+  uint32_t us = elapsedUs(from);
+  recordUs(stage, us);
+  return us;
+}
+
+void StageMetrics::recordUs(uint8_t stage, uint32_t us) {
+  if (stage < STAGE_COUNT) stages_[stage].record(us);
+}
+
+void StageMetrics::read(uint8_t stage, StageSummary* out) const {
+  if (stage < STAGE_COUNT) {
+    stages_[stage].read(out);
+  } else {
+    memset(out, 0, sizeof(*out));
+  }
+}
+
+void StageMetrics::reset() {
+  for (size_t i = 0; i < STAGE_COUNT; i++) stages_[i].reset();
+}
+
+const char* StageMetrics::stageName(uint8_t stage) {
+  return stage < STAGE_COUNT ? stageNames[stage] : "unknown";
+}
+
+static void emit(MetricsSink* sink, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void emit(MetricsSink* sink, const char* fmt, ...) {
+  char line[STAGE_LINE_MAX];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  if (len <= 0) return;
+  if ((size_t)len >= sizeof(line)) len = sizeof(line) - 1;
+  sink->write(line, (size_t)len);
+}
+
+void StageMetrics::render(const MetricsGauges& gauges, MetricsSink* sink) const {
+  StageSummary summaries[STAGE_COUNT];
+  for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) read(stage, &summaries[stage]);
+
+  emit(sink, "# HELP door_stage_latency_us Time spent in each stage of the tap path\n");
+  emit(sink, "# TYPE door_stage_latency_us histogram\n");
+  for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+    const StageSummary& s = summaries[stage];
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i < STAGE_BUCKETS - 1; i++) {
+      cumulative += s.buckets[i];
+      emit(sink, "door_stage_latency_us_bucket{stage=\"%s\",le=\"%lu\"} %lu\n", stageNames[stage],
+           (unsigned long)bucketBounds[i], (unsigned long)cumulative);
+    }
+    emit(sink, "door_stage_latency_us_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n", stageNames[stage],
+         (unsigned long)s.count);
+    emit(sink, "door_stage_latency_us_sum{stage=\"%s\"} %llu\n", stageNames[stage],
+         (unsigned long long)s.sumUs);
+    emit(sink, "door_stage_latency_us_count{stage=\"%s\"} %lu\n", stageNames[stage],
+         (unsigned long)s.count);
+  }
+
+  emit(sink, "# HELP door_stage_latency_max_us Longest time spent in each stage\n");
+  emit(sink, "# TYPE door_stage_latency_max_us gauge\n");
+  for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+    emit(sink, "door_stage_latency_max_us{stage=\"%s\"} %lu\n", stageNames[stage],
+         (unsigned long)summaries[stage].maxUs);
+  }
+
+  emit(sink, "# TYPE door_uptime_seconds gauge\n");
+  emit(sink, "door_uptime_seconds %lu.%03lu\n", (unsigned long)(gauges.uptimeMs / 1000),
+       (unsigned long)(gauges.uptimeMs % 1000));
+  emit(sink, "# HELP door_card_lookups_total Card lookups by where they were answered\n");
+  emit(sink, "# TYPE door_card_lookups_total counter\n");
+  emit(sink, "door_card_lookups_total{result=\"cache\"} %lu\n", (unsigned long)gauges.cacheHits);
+  emit(sink, "door_card_lookups_total{result=\"index\"} %lu\n", (unsigned long)gauges.indexHits);
+  emit(sink, "door_card_lookups_total{result=\"miss\"} %lu\n", (unsigned long)gauges.lookupMisses);
+  emit(sink, "# HELP door_verify_suppressed_total Unknown cards turned away without asking the server\n");
+  emit(sink, "# TYPE door_verify_suppressed_total counter\n");
+  emit(sink, "door_verify_suppressed_total{reason=\"rejected\"} %lu\n", (unsigned long)gauges.rejectsCached);
+  emit(sink, "door_verify_suppressed_total{reason=\"rate_limited\"} %lu\n",
+       (unsigned long)gauges.rejectsLimited);
+  emit(sink, "# TYPE door_card_cache_hit_ratio gauge\n");
+  emit(sink, "door_card_cache_hit_ratio %.3f\n", (double)metricsCacheHitRatio(gauges));
+  emit(sink, "# HELP door_journal_backlog Attendance events not yet acknowledged by the server\n");
+  emit(sink, "# TYPE door_journal_backlog gauge\n");
+  emit(sink, "door_journal_backlog %lu\n", (unsigned long)gauges.journalBacklog);
+  emit(sink, "# TYPE door_free_heap_bytes gauge\n");
+  emit(sink, "door_free_heap_bytes %lu\n", (unsigned long)gauges.freeHeap);
+  emit(sink, "# TYPE door_min_free_heap_bytes gauge\n");
+  emit(sink, "door_min_free_heap_bytes %lu\n", (unsigned long)gauges.minFreeHeap);
+  emit(sink, "# TYPE door_wifi_connected gauge\n");
+  emit(sink, "door_wifi_connected %d\n", gauges.online ? 1 : 0);
+  if (gauges.online) {
+    emit(sink, "# TYPE door_wifi_rssi_dbm gauge\n");
+    emit(sink, "door_wifi_rssi_dbm %d\n", gauges.rssi);
+  }
+}
+
+float metricsCacheHitRatio(const MetricsGauges& gauges) {
+  uint32_t lookups = gauges.cacheHits + gauges.indexHits + gauges.lookupMisses;
+  return lookups > 0 ? (float)gauges.cacheHits / lookups : 0.0f;
+}
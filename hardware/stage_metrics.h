@@ -0,0 +1,146 @@
+/*
+ * Stage Metrics - per-stage latency histograms for the tap path
+ *
+ * Each stage of a tap (card read, card lookup, server verify, finger
+ * capture and match, unlock, journal write, upload) is timed with the CPU
+ * cycle counter: one register read at each end, so timing costs nothing
+ * next to the stage itself. The cycle counter wraps every 17.9 s at
+ * 240 MHz, so each stamp also carries millis() and a stage that outlasts
+ * half a wrap is measured in ms instead. A stage must start and end on the
+ * same task: the ESP32's two cores count cycles independently, and the
+ * tasks are pinned. Wi-Fi joins and outages are timed in ms by the link
+ * manager and recorded as they are.
+ *
+ * Durations go into fixed 1-2-5 buckets from 50 us to 20 s. A stage has
+ * one writer task and is read by any: the writer bumps a sequence number
+ * around each update so readers retry a torn copy, with no lock on the tap
+ * path. The histograms, with the gauges in MetricsGauges, render as
+ * Prometheus text for the /metrics endpoint.
+ *
+ * This module has no Arduino dependencies so it can be tested on a host.
+ */
+
+#ifndef STAGE_METRICS_H
+#define STAGE_METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Stages, with the task that records each
+#define STAGE_CARD_READ       0  // Detect and select (RFID)
+#define STAGE_CARD_LOOKUP     1  // Card cache, or the index on flash (RFID)
+#define STAGE_SERVER_VERIFY   2  // Verify queued to verdict, as the tap sees it (RFID)
+#define STAGE_HTTP_VERIFY     3  // verify-rfid round trip (network)
+#define STAGE_FINGER_CAPTURE  4  // getImage and image2Tz with a finger down (RFID)
+#define STAGE_FINGER_MATCH    5  // loadModel and match against the owner (RFID)
+#define STAGE_TAP_TO_UNLOCK   6  // Card read to relay open (RFID)
+#define STAGE_JOURNAL_APPEND  7  // One journal record on flash (network)
+#define STAGE_HTTP_UPLOAD     8  // log-attendance/batch round trip (network)
+#define STAGE_WIFI_JOIN       9  // Start of the join that succeeded to link up (network)
+#define STAGE_WIFI_OUTAGE     10 // Link down to up again (network)
+#define STAGE_COUNT           11
+
+#define STAGE_BUCKETS         19  // 18 bounds and +Inf
+
+struct StageStamp {
+  uint32_t cycles;
+  uint32_t ms;
+};
+
+// A consistent copy of one stage's histogram
+struct StageSummary {
+  uint32_t count;
+  uint64_t sumUs;
+  uint32_t maxUs;
+  uint32_t buckets[STAGE_BUCKETS];  // Per bucket, not cumulative
+
+  // Estimated from the buckets, interpolating within one; 0 with no samples
+  uint32_t percentileUs(uint32_t pct) const;
+};
+
+class StageHistogram {
+public:
+  StageHistogram();
+
+  void record(uint32_t us);  // The stage's writer task only
+  void read(StageSummary* out) const;
+  void reset();              // Not while the writer runs
+
+  static size_t bucketFor(uint32_t us);
+  static uint32_t bucketBound(size_t bucket);  // Upper bound in us; UINT32_MAX for +Inf
+
+private:
+  // Relaxed atomics, so a racing reader is well defined; seq_ makes the
+  // copy consistent. The sum is split because 64-bit atomics take a lock
+  // on the ESP32.
+  struct Fields {
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> sumLo;
+    std::atomic<uint32_t> sumHi;
+    std::atomic<uint32_t> maxUs;
+    std::atomic<uint32_t> buckets[STAGE_BUCKETS];
+  };
+
+  std::atomic<uint32_t> seq_;  // Odd while an update is in progress
+  Fields fields_;
+};
+
+// Device state reported alongside the histograms
+struct MetricsGauges {
+  uint32_t uptimeMs;
+  uint32_t cacheHits;      // Card lookups answered from the RAM cache
+  uint32_t indexHits;      // ... from the index on flash
+  uint32_t lookupMisses;   // Not stored locally
+  uint32_t rejectsCached;  // Of those, not sent to the server: rejected recently
+  uint32_t rejectsLimited; // ... or checked too often
+  uint32_t journalBacklog; // Events not yet acknowledged by the server
+  uint32_t freeHeap;
+  uint32_t minFreeHeap;
+  bool online;
+  int8_t rssi;             // dBm, when online
+};
+
+// Where rendered text goes: the HTTP client on the device
+class MetricsSink {
+public:
+  virtual ~MetricsSink() {}
+  virtual void write(const char* text, size_t len) = 0;
+};
+
+class StageMetrics {
+public:
+  StageMetrics();
+
+  // Without a clock, stamps are zero and only recordUs() is meaningful
+  void begin(uint32_t (*cycles)(), uint32_t cyclesPerUs, uint32_t (*ms)());
+
+  StageStamp now() const;
+  uint32_t elapsedUs(const StageStamp& from) const;
+
+  // Record the time since from; returns it in us
+  uint32_t record(uint8_t stage, const StageStamp& from);
+  void recordUs(uint8_t stage, uint32_t us);
+
+  void read(uint8_t stage, StageSummary* out) const;
+  void reset();
+
+  // Prometheus text exposition format, version 0.0.4
+  void render(const MetricsGauges& gauges, MetricsSink* sink) const;
+
+  static const char* stageName(uint8_t stage);
+
+private:
+  StageHistogram stages_[STAGE_COUNT];
+  uint32_t (*cycles_)();
+  uint32_t (*ms_)();
+  uint32_t cyclesPerUs_;
+  uint32_t cycleSpanMs_;  // Longer stages are timed in ms
+};
+
+extern StageMetrics stageMetrics;
+
+// Card lookups answered from RAM, 0..1; 0 before the first lookup
+float metricsCacheHitRatio(const MetricsGauges& gauges);
+
+#endif // STAGE_METRICS_H
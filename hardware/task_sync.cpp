@@ -0,0 +1,222 @@
+/*
+ * Task Sync - bounded queues and mutexes shared by the device tasks
+ */
+
+#include "task_sync.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ARDUINO
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+static TickType_t toTicks(uint32_t timeoutMs) {
+  return timeoutMs == TASK_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+}
+
+struct TaskQueueBase::Impl {
+  QueueHandle_t queue;
+};
+
+struct TaskMutex::Impl {
+  SemaphoreHandle_t mutex;
+};
+
+#else
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+// Ring buffer of depth slots guarded by one mutex
+struct TaskQueueBase::Impl {
+  std::mutex mutex;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+  uint8_t* slots;
+  size_t head;
+  size_t count;
+};
+
+struct TaskMutex::Impl {
+  std::mutex mutex;
+};
+
+// Wait on cv until ready() or timeoutMs passes
+template <typename Pred>
+static bool waitFor(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                    uint32_t timeoutMs, Pred ready) {
+  if (timeoutMs == TASK_WAIT_FOREVER) {
+    cv.wait(lock, ready);
+    return true;
+  }
+  return cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready);
+}
+
+#endif
+
+TaskQueueBase::TaskQueueBase()
+    : impl_(NULL), itemSize_(0), depth_(0), highWater_(0), dropped_(0) {}
+
+TaskQueueBase::~TaskQueueBase() {
+  if (impl_ == NULL) return;
+#ifdef ARDUINO
+  vQueueDelete(impl_->queue);
+#else
+  free(impl_->slots);
+#endif
+  delete impl_;
+}
+
+bool TaskQueueBase::begin(size_t itemSize, size_t depth) {
+  if (impl_ != NULL || itemSize == 0 || depth == 0) return false;
+
+  impl_ = new Impl();
+#ifdef ARDUINO
+  impl_->queue = xQueueCreate(depth, itemSize);
+  if (impl_->queue == NULL) {
+    delete impl_;
+    impl_ = NULL;
+    return false;
+  }
+#else
+  impl_->slots = (uint8_t*)malloc(itemSize * depth);
+  impl_->head = 0;
+  impl_->count = 0;
+  if (impl_->slots == NULL) {
+    delete impl_;
+    impl_ = NULL;
+    return false;
+  }
+#endif
+  itemSize_ = itemSize;
+  depth_ = depth;
+  return true;
+}
+
+// Racy max is fine: it is a diagnostic
+void TaskQueueBase::noteWaiting(size_t waiting) {
+  if (waiting > highWater_) highWater_ = waiting;
+}
+
+bool TaskQueueBase::push(const void* item, uint32_t timeoutMs, bool front) {
+#ifdef ARDUINO
+  BaseType_t ok = front ? xQueueSendToFront(impl_->queue, item, toTicks(timeoutMs))
+                        : xQueueSendToBack(impl_->queue, item, toTicks(timeoutMs));
+  if (ok != pdTRUE) {
+    dropped_++;
+    return false;
+  }
+  noteWaiting(uxQueueMessagesWaiting(impl_->queue));
+  return true;
+#else
+  std::unique_lock<std::mutex> lock(impl_->mutex);
+  if (!waitFor(impl_->notFull, lock, timeoutMs, [this] { return impl_->count < depth_; })) {
+    dropped_++;
+    return false;
+  }
+
+  size_t slot;
+  if (front) {
+    impl_->head = (impl_->head + depth_ - 1) % depth_;
+    slot = impl_->head;
+  } else {
+    slot = (impl_->head + impl_->count) % depth_;
+  }
+  memcpy(impl_->slots + slot * itemSize_, item, itemSize_);
+  impl_->count++;
+  noteWaiting(impl_->count);
+
+  lock.unlock();
+  impl_->notEmpty.notify_one();
+  return true;
+#endif
+}
+
+bool TaskQueueBase::send(const void* item, uint32_t timeoutMs) {
+  return impl_ != NULL && push(item, timeoutMs, false);
+}
+
+bool TaskQueueBase::sendToFront(const void* item, uint32_t timeoutMs) {
+  return impl_ != NULL && push(item, timeoutMs, true);
+}
+
+bool TaskQueueBase::receive(void* item, uint32_t timeoutMs) {
+  if (impl_ == NULL) return false;
+#ifdef ARDUINO
+  return xQueueReceive(impl_->queue, item, toTicks(timeoutMs)) == pdTRUE;
+#else
+  std::unique_lock<std::mutex> lock(impl_->mutex);
+  if (!waitFor(impl_->notEmpty, lock, timeoutMs, [this] { return impl_->count > 0; })) {
+    return false;
+  }
+
+  memcpy(item, impl_->slots + impl_->head * itemSize_, itemSize_);
+  impl_->head = (impl_->head + 1) % depth_;
+  impl_->count--;
+
+  lock.unlock();
+  impl_->notFull.notify_one();
+  return true;
+#endif
+}
+
+bool TaskQueueBase::overwrite(const void* item) {
+  if (impl_ == NULL || depth_ != 1) return false;
+#ifdef ARDUINO
+  xQueueOverwrite(impl_->queue, item);
+  noteWaiting(1);
+  return true;
+#else
+  {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    memcpy(impl_->slots, item, itemSize_);
+    impl_->head = 0;
+    impl_->count = 1;
+    noteWaiting(1);
+  }
+  impl_->notEmpty.notify_one();
+  return true;
+#endif
+}
+
+size_t TaskQueueBase::waiting() const {
+  if (impl_ == NULL) return 0;
+#ifdef ARDUINO
+  return uxQueueMessagesWaiting(impl_->queue);
+#else
+  std::lock_guard<std::mutex> lock(impl_->mutex);
+  return impl_->count;
+#endif
+}
+
+TaskMutex::TaskMutex() : impl_(new Impl()) {
+#ifdef ARDUINO
+  impl_->mutex = xSemaphoreCreateMutex();
+#endif
+}
+
+TaskMutex::~TaskMutex() {
+#ifdef ARDUINO
+  vSemaphoreDelete(impl_->mutex);
+#endif
+  delete impl_;
+}
+
+void TaskMutex::lock() {
+#ifdef ARDUINO
+  xSemaphoreTake(impl_->mutex, portMAX_DELAY);
+#else
+  impl_->mutex.lock();
+#endif
+}
+
+void TaskMutex::unlock() {
+#ifdef ARDUINO
+  xSemaphoreGive(impl_->mutex);
+#else
+  impl_->mutex.unlock();
+#endif
+}
@@ -0,0 +1,85 @@
+/*
+ * Task Sync - bounded queues and mutexes shared by the device tasks
+ *
+ * On the ESP32 these wrap FreeRTOS queues and mutexes. The host build
+ * implements the same API with std::mutex and std::condition_variable, so
+ * the task pipeline can be exercised with threads. Queue items are copied
+ * by value and must be plain structs.
+ */
+
+#ifndef TASK_SYNC_H
+#define TASK_SYNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TASK_WAIT_FOREVER 0xFFFFFFFFUL
+
+// Fixed-depth queue of fixed-size items
+class TaskQueueBase {
+public:
+  TaskQueueBase();
+  ~TaskQueueBase();
+
+  bool begin(size_t itemSize, size_t depth);
+
+  // Block up to timeoutMs for space / an item; 0 means don't wait
+  bool send(const void* item, uint32_t timeoutMs);
+  bool sendToFront(const void* item, uint32_t timeoutMs);
+  bool receive(void* item, uint32_t timeoutMs);
+  // Depth-1 queues only: replace whatever is waiting, never blocks
+  bool overwrite(const void* item);
+
+  size_t waiting() const;
+  size_t depth() const { return depth_; }
+  size_t highWater() const { return highWater_; }
+  uint32_t dropped() const { return dropped_; }
+
+private:
+  bool push(const void* item, uint32_t timeoutMs, bool front);
+  void noteWaiting(size_t waiting);
+
+  struct Impl;
+  Impl* impl_;
+  size_t itemSize_;
+  size_t depth_;
+  volatile size_t highWater_;
+  volatile uint32_t dropped_;
+};
+
+template <typename T>
+class TaskQueue : public TaskQueueBase {
+public:
+  bool begin(size_t depth) { return TaskQueueBase::begin(sizeof(T), depth); }
+  bool send(const T& item, uint32_t timeoutMs) { return TaskQueueBase::send(&item, timeoutMs); }
+  bool sendToFront(const T& item, uint32_t timeoutMs) { return TaskQueueBase::sendToFront(&item, timeoutMs); }
+  bool receive(T* item, uint32_t timeoutMs) { return TaskQueueBase::receive(item, timeoutMs); }
+  bool overwrite(const T& item) { return TaskQueueBase::overwrite(&item); }
+};
+
+class TaskMutex {
+public:
+  TaskMutex();
+  ~TaskMutex();
+
+  void lock();
+  void unlock();
+
+private:
+  struct Impl;
+  Impl* impl_;
+};
+
+// Holds a TaskMutex for the rest of the scope
+class TaskLock {
+public:
+  explicit TaskLock(TaskMutex& mutex) : mutex_(mutex) { mutex_.lock(); }
+  ~TaskLock() { mutex_.unlock(); }
+
+private:
+  TaskLock(const TaskLock&);
+  TaskLock& operator=(const TaskLock&);
+  TaskMutex& mutex_;
+};
+
+#endif // TASK_SYNC_H
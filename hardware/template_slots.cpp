@@ -0,0 +1,187 @@
+/*
+ * Template Slots - LRU table of fingerprint templates held by the sensor
+ *
+ * Lookups scan the table; at 1000 entries of 12 bytes that is a few
+ * microseconds, far below one sensor transaction.
+ */
+
+#include "template_slots.h"
+#include <string.h>
+
+TemplateSlots::TemplateSlots()
+    : sensor_(NULL), store_(NULL), capacity_(0), used_(0), useClock_(0),
+      syncing_(false), syncMark_(0) {
+  memset(entries_, 0, sizeof(entries_));
+  memset(marks_, 0, sizeof(marks_));
+  memset(dirty_, 0, sizeof(dirty_));
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+static size_t entryOffset(uint16_t index) {
+  return sizeof(TemplateSlotsHeader) + (size_t)index * sizeof(TemplateSlotEntry);
+}
+
+bool TemplateSlots::begin(TemplateSensor* sensor, TemplateSlotStore* store, uint16_t capacity) {
+  sensor_ = sensor;
+  store_ = store;
+  capacity_ = capacity < TEMPLATE_SLOTS_MAX ? capacity : TEMPLATE_SLOTS_MAX;
+  used_ = 0;
+  useClock_ = 0;
+  syncing_ = false;
+  memset(entries_, 0, sizeof(entries_));
+  memset(marks_, 0, sizeof(marks_));
+  memset(dirty_, 0, sizeof(dirty_));
+  memset(&stats_, 0, sizeof(stats_));
+
+  TemplateSlotsHeader header;
+  bool valid = store_->size() == entryOffset(capacity_) &&
+               store_->readAt(0, &header, sizeof(header)) &&
+               header.magic == TEMPLATE_SLOTS_MAGIC &&
+               header.version == TEMPLATE_SLOTS_VERSION &&
+               header.capacity == capacity_ &&
+               header.entrySize == sizeof(TemplateSlotEntry) &&
+               store_->readAt(entryOffset(0), entries_, capacity_ * sizeof(TemplateSlotEntry));
+
+  if (!valid) {
+    // Whatever the sensor holds is unknown, so every slot counts as free
+    memset(entries_, 0, sizeof(entries_));
+    if (!writeHeader()) return false;
+    for (uint16_t i = 0; i < capacity_; i++) {
+      if (!writeEntry(i)) return false;
+    }
+    return true;
+  }
+
+  for (uint16_t i = 0; i < capacity_; i++) {
+    if (entries_[i].libSlot != TEMPLATE_LIB_NONE) used_++;
+    if (entries_[i].lastUse > useClock_) useClock_ = entries_[i].lastUse;
+  }
+  return true;
+}
+
+bool TemplateSlots::writeHeader() {
+  TemplateSlotsHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = TEMPLATE_SLOTS_MAGIC;
+  header.version = TEMPLATE_SLOTS_VERSION;
+  header.capacity = capacity_;
+  header.entrySize = sizeof(TemplateSlotEntry);
+  return store_->writeAt(0, &header, sizeof(header));
+}
+
+bool TemplateSlots::writeEntry(uint16_t index) {
+  dirty_[index / 8] &= (uint8_t)~(1u << (index % 8));
+  if (store_->writeAt(entryOffset(index), &entries_[index], sizeof(TemplateSlotEntry))) {
+    return true;
+  }
+  stats_.failures++;
+  return false;
+}
+
+int32_t TemplateSlots::indexOf(uint16_t libSlot) const {
+  if (libSlot == TEMPLATE_LIB_NONE) return -1;
+  for (uint16_t i = 0; i < capacity_; i++) {
+    if (entries_[i].libSlot == libSlot) return i;
+  }
+  return -1;
+}
+
+int32_t TemplateSlots::find(uint16_t libSlot) {
+  int32_t index = indexOf(libSlot);
+  if (index < 0) {
+    stats_.misses++;
+  } else {
+    stats_.hits++;
+  }
+  return index;
+}
+
+bool TemplateSlots::current(uint16_t libSlot, uint32_t version) const {
+  int32_t index = indexOf(libSlot);
+  return index >= 0 && entries_[index].version == version;
+}
+
+void TemplateSlots::touch(uint16_t libSlot) {
+  int32_t index = indexOf(libSlot);
+  if (index < 0) return;
+  entries_[index].lastUse = ++useClock_;
+  dirty_[index / 8] |= (uint8_t)(1u << (index % 8));
+}
+
+void TemplateSlots::flush() {
+  for (uint16_t i = 0; i < capacity_; i++) {
+    if (dirty_[i / 8] & (1u << (i % 8))) writeEntry(i);
+  }
+}
+
+// A free slot, else the least recently used one this sync pass hasn't kept
+int32_t TemplateSlots::victim() const {
+  int32_t best = -1;
+  for (uint16_t i = 0; i < capacity_; i++) {
+    const TemplateSlotEntry& e = entries_[i];
+    if (e.libSlot == TEMPLATE_LIB_NONE) return i;
+    if (syncing_ && marks_[i] == syncMark_) continue;
+    if (best < 0 || e.lastUse < entries_[best].lastUse) best = i;
+  }
+  return best;
+}
+
+int32_t TemplateSlots::install(uint16_t libSlot, uint32_t version, const uint8_t* tpl, size_t len) {
+  if (libSlot == TEMPLATE_LIB_NONE) return -1;
+
+  // A new version replaces the old one in place
+  int32_t index = indexOf(libSlot);
+  if (index < 0) index = victim();
+  if (index < 0) return -1;
+
+  TemplateSlotEntry& e = entries_[index];
+  bool evicting = e.libSlot != TEMPLATE_LIB_NONE && e.libSlot != libSlot;
+  // Synced templates haven't been used here yet; one fetched for a tap is
+  // about to be
+  uint32_t lastUse = e.libSlot == libSlot ? e.lastUse : (syncing_ ? 0 : ++useClock_);
+
+  // Free the entry on flash before the sensor slot changes under it
+  if (e.libSlot != TEMPLATE_LIB_NONE) {
+    e.libSlot = TEMPLATE_LIB_NONE;
+    used_--;
+    if (!writeEntry(index)) return -1;
+  }
+
+  if (!sensor_->storeTemplate(index, tpl, len)) {
+    stats_.failures++;
+    return -1;
+  }
+
+  e.libSlot = libSlot;
+  e.version = version;
+  e.lastUse = lastUse;
+  marks_[index] = syncMark_;
+  used_++;
+  if (!writeEntry(index)) {
+    // Not persisted: forget it rather than trust a mapping that may not survive a reboot
+    e.libSlot = TEMPLATE_LIB_NONE;
+    used_--;
+    return -1;
+  }
+
+  stats_.installs++;
+  if (evicting) stats_.evictions++;
+  return index;
+}
+
+void TemplateSlots::beginSync() {
+  syncing_ = true;
+  // Skip 0 on wrap so freshly loaded entries are never already kept
+  if (++syncMark_ == 0) syncMark_ = 1;
+}
+
+bool TemplateSlots::keep(uint16_t libSlot, uint32_t version) {
+  int32_t index = indexOf(libSlot);
+  if (index < 0) return false;
+  marks_[index] = syncMark_;
+  return entries_[index].version == version;
+}
+
+void TemplateSlots::endSync() {
+  syncing_ = false;
+}
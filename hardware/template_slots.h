@@ -0,0 +1,126 @@
+/*
+ * Template Slots - LRU table of fingerprint templates held by the sensor
+ *
+ * The server keeps every user's template in a library addressed by library
+ * slot (the fingerprint_slot sent with each card). The R307 only holds
+ * TEMPLATE_SLOTS_MAX of them, so each door keeps the templates its
+ * location needs in its own sensor slots and this table maps one to the
+ * other. When the sensor is full the least recently matched template is
+ * evicted.
+ *
+ * The table is persisted one fixed-size entry per sensor slot, so a use or
+ * an install rewrites only that entry. Before a sensor slot is overwritten
+ * its entry is freed on flash, so a crash mid-install can never leave a
+ * card mapped to someone else's template.
+ */
+
+#ifndef TEMPLATE_SLOTS_H
+#define TEMPLATE_SLOTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TEMPLATE_SLOTS_MAGIC    0x544C5354  // "TSLT"
+#define TEMPLATE_SLOTS_VERSION  1
+#define TEMPLATE_LIB_NONE       0           // Entry holds no template
+
+#ifndef TEMPLATE_SLOTS_MAX
+#define TEMPLATE_SLOTS_MAX      1000        // R307 library capacity
+#endif
+#ifndef TEMPLATE_BYTES
+#define TEMPLATE_BYTES          512         // One R307 character file
+#endif
+
+// The fingerprint sensor's template library
+class TemplateSensor {
+public:
+  virtual ~TemplateSensor() {}
+  // Download a template and store it in sensorSlot (DownChar + Store)
+  virtual bool storeTemplate(uint16_t sensorSlot, const uint8_t* tpl, size_t len) = 0;
+};
+
+// Random-access file holding the persisted table
+class TemplateSlotStore {
+public:
+  virtual ~TemplateSlotStore() {}
+  virtual size_t size() = 0;
+  virtual bool readAt(size_t offset, void* buf, size_t len) = 0;
+  virtual bool writeAt(size_t offset, const void* buf, size_t len) = 0;
+};
+
+// On-flash layout: header, then one entry per sensor slot
+struct TemplateSlotsHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t capacity;
+  uint16_t entrySize;
+  uint16_t reserved;
+};
+
+struct TemplateSlotEntry {
+  uint16_t libSlot;   // TEMPLATE_LIB_NONE if the sensor slot is free
+  uint16_t reserved;
+  uint32_t version;   // Server template version stored in the slot
+  uint32_t lastUse;   // Use clock at the last match; 0 = never used here
+};
+
+struct TemplateSlotStats {
+  uint32_t hits;       // Lookups answered by a resident template
+  uint32_t misses;
+  uint32_t installs;
+  uint32_t evictions;  // Installs that replaced another template
+  uint32_t failures;   // Sensor or flash writes that failed
+};
+
+class TemplateSlots {
+public:
+  TemplateSlots();
+
+  // Load the table, or start an empty one if the file is missing or from
+  // another layout. capacity is clamped to TEMPLATE_SLOTS_MAX.
+  bool begin(TemplateSensor* sensor, TemplateSlotStore* store, uint16_t capacity);
+
+  // Sensor slot holding libSlot, or -1; counted in the hit rate
+  int32_t find(uint16_t libSlot);
+  bool holds(uint16_t libSlot) const { return indexOf(libSlot) >= 0; }
+  bool current(uint16_t libSlot, uint32_t version) const;
+  // Record a match; kept in RAM until flush()
+  void touch(uint16_t libSlot);
+  // Write entries touched since the last flush
+  void flush();
+
+  // Store a template in a free sensor slot, or in place of the least
+  // recently used one. During a sync pass templates the pass has kept are
+  // never evicted. Returns the sensor slot, or -1.
+  int32_t install(uint16_t libSlot, uint32_t version, const uint8_t* tpl, size_t len);
+
+  // Sync pass: keep() each template the location wants in priority order,
+  // installing the ones it returns false for, then endSync()
+  void beginSync();
+  bool keep(uint16_t libSlot, uint32_t version);
+  void endSync();
+
+  uint16_t capacity() const { return capacity_; }
+  uint16_t used() const { return used_; }
+  const TemplateSlotStats& stats() const { return stats_; }
+
+private:
+  int32_t indexOf(uint16_t libSlot) const;
+  int32_t victim() const;
+  bool writeEntry(uint16_t index);
+  bool writeHeader();
+
+  TemplateSensor* sensor_;
+  TemplateSlotStore* store_;
+  uint16_t capacity_;
+  uint16_t used_;
+  uint32_t useClock_;
+  bool syncing_;
+  uint16_t syncMark_;
+  TemplateSlotEntry entries_[TEMPLATE_SLOTS_MAX];
+  uint16_t marks_[TEMPLATE_SLOTS_MAX];  // syncMark_ of the pass that kept the entry
+  uint8_t dirty_[(TEMPLATE_SLOTS_MAX + 7) / 8];
+  TemplateSlotStats stats_;
+};
+
+#endif // TEMPLATE_SLOTS_H
@@ -0,0 +1,258 @@
+/*
+ * Template Sync - loads the location's fingerprint templates into the sensor
+ *
+ * Wire format, text like the allowlist:
+ *   GET fingerprint/templates?location=<loc>&limit=<capacity>
+ *     TEMPLATES <count>
+ *     <slot>,<version>        one line per template, most wanted first
+ *     END
+ *   GET fingerprint/template/<slot>
+ *     TEMPLATE <slot> <version>
+ *     <hex>                   TEMPLATE_BYTES bytes
+ *     END
+ * A response without the END line was cut off and is discarded.
+ */
+
+#include "template_sync.h"
+#include "server_client.h"
+#include "log_ring.h"
+#include <SPIFFS.h>
+#include <atomic>
+
+#define TEMPLATE_LINE_MAX (2 * TEMPLATE_BYTES + 8)
+
+struct ManifestEntry {
+  uint16_t libSlot;
+  uint32_t version;
+};
+
+static TemplateSlots slots;
+static TaskMutex sensorLock;
+static File slotsFile;
+static std::atomic<bool> ready(false);  // Set by the finger task at boot
+
+// Network task only; kept off its stack
+static ManifestEntry manifest[TEMPLATE_SLOTS_MAX];
+static char line[TEMPLATE_LINE_MAX];
+static uint8_t templateBuf[TEMPLATE_BYTES];
+
+// The slot table file, rewritten one entry at a time
+class SpiffsSlotStore : public TemplateSlotStore {
+public:
+  size_t size() override { return slotsFile ? slotsFile.size() : 0; }
+  bool readAt(size_t offset, void* buf, size_t len) override {
+    return slotsFile.seek(offset) && slotsFile.read((uint8_t*)buf, len) == len;
+  }
+  bool writeAt(size_t offset, const void* buf, size_t len) override {
+    if (!slotsFile.seek(offset) || slotsFile.write((const uint8_t*)buf, len) != len) return false;
+    slotsFile.flush();
+    return true;
+  }
+};
+
+static SpiffsSlotStore slotStore;
+
+bool templateSyncBegin(TemplateSensor* sensor, uint16_t capacity) {
+  if (!SPIFFS.exists(TEMPLATE_SLOTS_FILE)) {
+    File created = SPIFFS.open(TEMPLATE_SLOTS_FILE, "w");
+    created.close();
+  }
+  slotsFile = SPIFFS.open(TEMPLATE_SLOTS_FILE, "r+");
+  if (!slotsFile) {
+    LOG_ERROR("Template slots: cannot open " TEMPLATE_SLOTS_FILE);
+    return false;
+  }
+
+  TaskLock lock(sensorLock);
+  ready = slots.begin(sensor, &slotStore, capacity);
+  LOG_INFO("Template slots: %lu/%lu in use", (unsigned long)slots.used(), (unsigned long)slots.capacity());
+  return ready;
+}
+
+TaskMutex& templateSensorLock() {
+  return sensorLock;
+}
+
+int32_t templateSensorSlot(uint16_t libSlot) {
+  return ready ? slots.find(libSlot) : -1;
+}
+
+void templateUsed(uint16_t libSlot) {
+  if (ready) slots.touch(libSlot);
+}
+
+void templateFlush() {
+  if (!ready) return;
+  TaskLock lock(sensorLock);
+  slots.flush();
+}
+
+const TemplateSlotStats& templateStats() {
+  return slots.stats();
+}
+
+static bool readLine(Stream& stream) {
+  size_t len = stream.readBytesUntil('\n', line, sizeof(line) - 1);
+  if (len == 0 && !stream.available()) return false;
+  if (len > 0 && line[len - 1] == '\r') len--;
+  line[len] = '\0';
+  return true;
+}
+
+static int hexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+// Download one template into templateBuf
+static bool download(uint16_t libSlot, uint32_t* version) {
+  String path = "fingerprint/template/" + String(libSlot);
+  int httpResponseCode = serverGet(path.c_str(), TEMPLATE_HTTP_TIMEOUT);
+  if (httpResponseCode != 200) {
+    LOG_WARN("Template %u download failed: %d", libSlot, httpResponseCode);
+    serverEnd();
+    return false;
+  }
+
+  Stream& stream = *serverStream();
+  stream.setTimeout(TEMPLATE_HTTP_TIMEOUT);
+
+  unsigned long slot = 0, ver = 0;
+  bool ok = readLine(stream) && sscanf(line, "TEMPLATE %lu %lu", &slot, &ver) == 2 &&
+            slot == libSlot && readLine(stream) && strlen(line) == 2 * TEMPLATE_BYTES;
+  for (size_t i = 0; ok && i < TEMPLATE_BYTES; i++) {
+    int hi = hexDigit(line[2 * i]);
+    int lo = hexDigit(line[2 * i + 1]);
+    ok = hi >= 0 && lo >= 0;
+    templateBuf[i] = (uint8_t)((hi << 4) | lo);
+  }
+  ok = ok && readLine(stream) && strcmp(line, "END") == 0;
+  serverEnd();
+
+  if (!ok) {
+    LOG_WARN("Template %u: bad response", libSlot);
+    return false;
+  }
+  *version = (uint32_t)ver;
+  return true;
+}
+
+static bool downloadAndInstall(uint16_t libSlot) {
+  uint32_t version = 0;
+  if (!download(libSlot, &version)) return false;
+
+  TaskLock lock(sensorLock);
+  return slots.install(libSlot, version, templateBuf, sizeof(templateBuf)) >= 0;
+}
+
+// Fetch the manifest into manifest[]; returns the entry count or -1
+static int fetchManifest(const String& location) {
+  String path = "fingerprint/templates?location=" + serverUrlEncode(location) +
+                "&limit=" + String(slots.capacity());
+  int httpResponseCode = serverGet(path.c_str(), TEMPLATE_HTTP_TIMEOUT);
+  if (httpResponseCode != 200) {
+    LOG_WARN("Template manifest failed: %d", httpResponseCode);
+    serverEnd();
+    return -1;
+  }
+
+  Stream& stream = *serverStream();
+  stream.setTimeout(TEMPLATE_HTTP_TIMEOUT);
+
+  unsigned long total = 0;
+  if (!readLine(stream) || sscanf(line, "TEMPLATES %lu", &total) != 1) {
+    LOG_WARN("Template manifest: bad response header");
+    serverEnd();
+    return -1;
+  }
+
+  int count = 0;
+  bool ended = false;
+  while (readLine(stream)) {
+    if (strcmp(line, "END") == 0) {
+      ended = true;
+      break;
+    }
+    unsigned long libSlot = 0, version = 0;
+    if (count < slots.capacity() && sscanf(line, "%lu,%lu", &libSlot, &version) == 2 &&
+        libSlot != TEMPLATE_LIB_NONE && libSlot <= 0xFFFF) {
+      manifest[count].libSlot = (uint16_t)libSlot;
+      manifest[count].version = (uint32_t)version;
+      count++;
+    }
+  }
+  serverEnd();
+
+  if (!ended) {
+    LOG_WARN("Template manifest: response cut off");
+    return -1;
+  }
+  return count;
+}
+
+// One sync pass. Returns how many wanted templates are still not on the
+// sensor at their current version, or -1 if the manifest couldn't be read.
+int templateSync(const String& location, uint16_t maxInstalls) {
+  if (!ready) return -1;
+
+  int count = fetchManifest(location);
+  if (count < 0) return -1;
+
+  unsigned long start = millis();
+  uint16_t attempts = 0;
+  uint16_t installed = 0;
+  int missing = 0;
+
+  {
+    TaskLock lock(sensorLock);
+    slots.beginSync();
+  }
+  for (int i = 0; i < count; i++) {
+    bool held;
+    {
+      TaskLock lock(sensorLock);
+      held = slots.keep(manifest[i].libSlot, manifest[i].version);
+    }
+    if (held) continue;
+    // Past the batch, keep() still runs so nothing wanted is evicted
+    if (attempts < maxInstalls) {
+      attempts++;
+      if (downloadAndInstall(manifest[i].libSlot)) {
+        installed++;
+        continue;
+      }
+    }
+    missing++;
+  }
+  {
+    TaskLock lock(sensorLock);
+    slots.endSync();
+  }
+
+  if (installed > 0 || missing > 0) {
+    const TemplateSlotStats& stats = slots.stats();
+    LOG_INFO("Template sync: %d installed in %lu ms, %d still missing, %lu/%lu slots, "
+             "%lu evictions, %lu failures", installed, (unsigned long)(millis() - start), missing,
+             (unsigned long)slots.used(), (unsigned long)slots.capacity(),
+             (unsigned long)stats.evictions, (unsigned long)stats.failures);
+  }
+  return missing;
+}
+
+// Make sure libSlot is on the sensor, evicting the least recently used
+// template if it is full. Network task.
+bool templateFetch(uint16_t libSlot) {
+  if (!ready || libSlot == TEMPLATE_LIB_NONE) return false;
+  {
+    TaskLock lock(sensorLock);
+    if (slots.holds(libSlot)) return true;
+  }
+
+  unsigned long start = millis();
+  bool ok = downloadAndInstall(libSlot);
+  LOG_DEBUG("Template %u %s on demand in %lu ms", libSlot, ok ? "loaded" : "not loaded",
+            (unsigned long)(millis() - start));
+  return ok;
+}
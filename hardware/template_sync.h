@@ -0,0 +1,48 @@
+/*
+ * Template Sync - loads the location's fingerprint templates into the sensor
+ *
+ * Pulls the server's template manifest for this door (most wanted first,
+ * capped at the sensor's capacity) and downloads each template the sensor
+ * doesn't hold at the current version into a sensor slot. Runs on the
+ * network task a batch at a time, so a tap never waits behind more than
+ * one install. A card whose template isn't on the sensor has it fetched
+ * on demand as soon as the card is accepted.
+ */
+
+#ifndef TEMPLATE_SYNC_H
+#define TEMPLATE_SYNC_H
+
+#include <Arduino.h>
+#include "template_slots.h"
+#include "task_sync.h"
+
+#define TEMPLATE_SLOTS_FILE  "/tslots.bin"
+
+#ifndef TEMPLATE_SYNC_INTERVAL
+#define TEMPLATE_SYNC_INTERVAL  600000  // Full manifest check every 10 minutes (ms)
+#endif
+#ifndef TEMPLATE_SYNC_RETRY_MS
+#define TEMPLATE_SYNC_RETRY_MS  1000    // Next batch while templates are missing
+#endif
+#ifndef TEMPLATE_SYNC_BATCH
+#define TEMPLATE_SYNC_BATCH     16      // Installs per pass, ~150 ms of sensor time each
+#endif
+#ifndef TEMPLATE_HTTP_TIMEOUT
+#define TEMPLATE_HTTP_TIMEOUT   15000
+#endif
+
+// Function declarations
+bool templateSyncBegin(TemplateSensor* sensor, uint16_t capacity);
+int templateSync(const String& location, uint16_t maxInstalls);
+bool templateFetch(uint16_t libSlot);
+void templateFlush();
+const TemplateSlotStats& templateStats();
+
+// The sensor's UART and the slot table are shared by the RFID task
+// (capture and match) and the network task (installs). Hold this lock
+// around any sensor transaction and around the two calls below.
+TaskMutex& templateSensorLock();
+int32_t templateSensorSlot(uint16_t libSlot);
+void templateUsed(uint16_t libSlot);
+
+#endif // TEMPLATE_SYNC_H
@@ -0,0 +1,280 @@
+/*
+ * Host-side test for the access flow and speculative fingerprint capture
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -I. test/access_flow_test.cpp access_flow.cpp -o access_flow_test
+ *   ./access_flow_test
+ *
+ * Drives the flow on a virtual clock against a simulated R307 and server.
+ * Sensor calls block the RFID task for roughly the R307's timings, and the
+ * person puts a finger down a reaction time after "Place Finger" appears.
+ * Checks the verify-state transitions, then reports tap-to-unlock for
+ * uncached cards with the finger read after the server verdict (serial)
+ * and while the request is in flight (speculative).
+ */
+
+#include "access_flow.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+#define NEVER 0xFFFFFFFFu
+
+// R307 timings in milliseconds
+#define GET_IMAGE_EMPTY_MS  60   // getImage() with no finger
+#define CAPTURE_MS          450  // getImage() plus image2Tz()
+#define MATCH_MS            80   // loadModel() plus Match
+#define TICK_MS             10   // RFID task tick
+
+class SimDoor : public AccessHardware {
+public:
+  uint32_t clock;
+  uint16_t ownerSlot;   // Slot the finger on the sensor belongs to
+  uint32_t reactionMs;  // Prompt to finger down
+  uint32_t promptAt;
+  uint32_t fingerAt;
+  uint32_t unlockAt;
+  uint32_t captures;
+  uint32_t matches;
+  uint32_t templateAt;  // Template reaches the sensor
+  char line1[ACCESS_LCD_COLS + 1];
+  char line2[ACCESS_LCD_COLS + 1];
+
+  SimDoor(uint16_t slot, uint32_t reaction)
+      : clock(0), ownerSlot(slot), reactionMs(reaction), promptAt(NEVER),
+        fingerAt(NEVER), unlockAt(NEVER), captures(0), matches(0), templateAt(0) {
+    line1[0] = line2[0] = '\0';
+  }
+
+  void setOutput(uint8_t output, bool on) override {
+    if (output == ACCESS_OUT_RELAY && on && unlockAt == NEVER) unlockAt = clock;
+  }
+  void display(const char* l1, const char* l2) override {
+    strncpy(line1, l1, ACCESS_LCD_COLS);
+    line1[ACCESS_LCD_COLS] = '\0';
+    strncpy(line2, l2, ACCESS_LCD_COLS);
+    line2[ACCESS_LCD_COLS] = '\0';
+    if (strcmp(l1, "Place Finger") == 0 && promptAt == NEVER) {
+      promptAt = clock;
+      fingerAt = clock + reactionMs;
+    }
+  }
+  bool captureFingerprint() override {
+    if (fingerAt == NEVER || clock < fingerAt) {
+      clock += GET_IMAGE_EMPTY_MS;
+      return false;
+    }
+    clock += CAPTURE_MS;
+    captures++;
+    return true;
+  }
+  int matchCaptured(uint16_t slot) override {
+    if (clock < templateAt) return -1;
+    clock += MATCH_MS;
+    matches++;
+    return slot == ownerSlot ? 1 : 0;
+  }
+};
+
+// Tick the flow until it reports an outcome or limitMs passes. The server
+// verdict for slot is delivered at verdictAt, before the tick as in the
+// RFID task.
+static AccessEvent runUntilEvent(AccessFlow& flow, SimDoor& door, uint32_t verdictAt,
+                                 uint16_t slot, uint32_t limitMs) {
+  bool delivered = verdictAt == NEVER;
+  while (door.clock < limitMs) {
+    if (!delivered && door.clock >= verdictAt) {
+      delivered = true;
+      flow.cardAccepted(slot, door.clock);
+    }
+    AccessEvent event = flow.tick(door.clock);
+    if (event != ACCESS_EVENT_NONE) return event;
+    door.clock += TICK_MS;
+  }
+  return ACCESS_EVENT_NONE;
+}
+
+static void testCapturedBeforeVerdict() {
+  SimDoor door(7, 200);
+  AccessFlow flow;
+  flow.begin(&door, 0);
+  flow.cardDetected("04A1B2C3", 0);
+  flow.cardPending(0);
+  CHECK(flow.state() == ACCESS_CARD_VERIFY);
+  CHECK(strcmp(door.line1, "Place Finger") == 0);
+
+  // The finger is read and held while the server is still thinking
+  while (door.clock < 1000) {
+    flow.tick(door.clock);
+    door.clock += TICK_MS;
+  }
+  CHECK(flow.fingerCaptured());
+  CHECK(door.captures == 1);
+  CHECK(door.matches == 0);
+  CHECK(strcmp(door.line1, "Finger Read") == 0);
+
+  // The verdict matches the held features without another capture
+  CHECK(runUntilEvent(flow, door, door.clock, 7, 5000) == ACCESS_EVENT_GRANTED);
+  CHECK(door.captures == 1);
+  CHECK(door.matches == 1);
+  CHECK(flow.doorOpen());
+}
+
+static void testRejectedDiscardsCapture() {
+  SimDoor door(7, 200);
+  AccessFlow flow;
+  flow.begin(&door, 0);
+  flow.cardPending(0);
+  while (!flow.fingerCaptured() && door.clock < 2000) {
+    flow.tick(door.clock);
+    door.clock += TICK_MS;
+  }
+  CHECK(flow.fingerCaptured());
+
+  flow.deny("Invalid Card", door.clock);
+  CHECK(flow.ready());
+  CHECK(!flow.fingerCaptured());
+  CHECK(door.matches == 0);
+  CHECK(!flow.doorOpen());
+
+  // The next card starts from a clean sensor state
+  flow.cardPending(door.clock);
+  CHECK(!flow.fingerCaptured());
+}
+
+static void testWrongFingerUsesAttempt() {
+  SimDoor door(3, 200);  // Someone else's finger
+  AccessFlow flow;
+  flow.begin(&door, 0);
+  flow.cardPending(0);
+  while (!flow.fingerCaptured() && door.clock < 2000) {
+    flow.tick(door.clock);
+    door.clock += TICK_MS;
+  }
+
+  // The speculative capture is the first of the three attempts
+  flow.cardAccepted(7, door.clock);
+  door.clock += TICK_MS;
+  flow.tick(door.clock);
+  CHECK(door.matches == 1);
+  CHECK(flow.state() == ACCESS_FINGER_PAUSE);
+  CHECK(strcmp(door.line1, "Try Again") == 0);
+
+  CHECK(runUntilEvent(flow, door, NEVER, 7, 60000) == ACCESS_EVENT_DENIED);
+  CHECK(door.matches == ACCESS_FINGER_ATTEMPTS);
+  CHECK(!flow.doorOpen());
+}
+
+static void testVerdictBeforeFinger() {
+  SimDoor door(7, 1500);  // Slow to put a finger down
+  AccessFlow flow;
+  flow.begin(&door, 0);
+  flow.cardPending(0);
+
+  // Accepted before any capture: straight into attempt 1, no "Card Valid"
+  CHECK(runUntilEvent(flow, door, 100, 7, 10000) == ACCESS_EVENT_GRANTED);
+  CHECK(door.captures == 1);
+  CHECK(door.unlockAt < 1500 + CAPTURE_MS + MATCH_MS + 2 * GET_IMAGE_EMPTY_MS + TICK_MS);
+}
+
+static void testTemplateStillLoading() {
+  SimDoor door(7, 200);
+  door.templateAt = 2500;  // Fetched on demand after the verdict
+  AccessFlow flow;
+  flow.begin(&door, 0);
+  flow.cardPending(0);
+
+  // The held features wait for the template instead of failing attempt 1
+  CHECK(runUntilEvent(flow, door, 1200, 7, 10000) == ACCESS_EVENT_GRANTED);
+  CHECK(door.captures == 1);
+  CHECK(door.matches == 1);
+  CHECK(door.unlockAt >= 2500 && door.unlockAt < 2500 + ACCESS_FINGER_POLL_MS + MATCH_MS + TICK_MS);
+}
+
+static void testSerialMode() {
+  SimDoor door(7, 200);
+  AccessFlow flow;
+  flow.setSpeculativeCapture(false);
+  flow.begin(&door, 0);
+  flow.cardPending(0);
+  CHECK(strcmp(door.line1, "Checking Card") == 0);
+
+  CHECK(runUntilEvent(flow, door, 400, 7, 10000) == ACCESS_EVENT_GRANTED);
+  CHECK(door.captures == 1);
+  // Prompted only after the verdict and the "Card Valid" pause
+  CHECK(door.promptAt >= 400 + ACCESS_CARD_VALID_MS);
+}
+
+// One uncached tap: card read at 0, server verdict after verifyMs
+static uint32_t tapToUnlock(bool speculative, uint32_t verifyMs, uint32_t reactionMs) {
+  SimDoor door(7, reactionMs);
+  AccessFlow flow;
+  flow.setSpeculativeCapture(speculative);
+  flow.begin(&door, 0);
+  flow.cardDetected("04A1B2C3", 0);
+  flow.cardPending(0);
+  AccessEvent event = runUntilEvent(flow, door, verifyMs, 7, 30000);
+  CHECK(event == ACCESS_EVENT_GRANTED);
+  return door.unlockAt;
+}
+
+static double percentile(std::vector<uint32_t> values, double p) {
+  std::sort(values.begin(), values.end());
+  size_t i = (size_t)(p * (values.size() - 1) + 0.5);
+  return values[i];
+}
+
+static void testLatency() {
+  const int samples = 2000;
+  std::vector<uint32_t> serial, speculative;
+  srand(4242);
+  for (int i = 0; i < samples; i++) {
+    // Server round trip 150-900 ms, person reacts 300-900 ms after the prompt
+    uint32_t verifyMs = 150 + rand() % 750;
+    uint32_t reactionMs = 300 + rand() % 600;
+    serial.push_back(tapToUnlock(false, verifyMs, reactionMs));
+    speculative.push_back(tapToUnlock(true, verifyMs, reactionMs));
+  }
+
+  double serialP50 = percentile(serial, 0.50), serialP95 = percentile(serial, 0.95);
+  double specP50 = percentile(speculative, 0.50), specP95 = percentile(speculative, 0.95);
+  printf("  uncached card, server 150-900 ms, reaction 300-900 ms, %d taps\n", samples);
+  printf("  %-34s p50 %6.0f  p95 %6.0f  max %6.0f ms\n", "serial (finger after verdict)",
+         serialP50, serialP95, percentile(serial, 1.0));
+  printf("  %-34s p50 %6.0f  p95 %6.0f  max %6.0f ms\n", "speculative (finger during verify)",
+         specP50, specP95, percentile(speculative, 1.0));
+
+  // The verify round trip and "Card Valid" pause are hidden behind the
+  // finger; what is left is reaction, capture and match
+  CHECK(specP50 + ACCESS_CARD_VALID_MS < serialP50);
+  CHECK(specP95 < serialP95);
+  for (int i = 0; i < samples; i++) CHECK(speculative[i] <= serial[i]);
+}
+
+int main() {
+  printf("Verify state\n");
+  testCapturedBeforeVerdict();
+  testRejectedDiscardsCapture();
+  testWrongFingerUsesAttempt();
+  testVerdictBeforeFinger();
+  testTemplateStillLoading();
+  testSerialMode();
+
+  printf("Tap to unlock\n");
+  testLatency();
+
+  if (failures == 0) {
+    printf("All access flow tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
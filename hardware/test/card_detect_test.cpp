@@ -0,0 +1,242 @@
+/*
+ * Host-side test for polling vs IRQ card detection
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -I. test/card_detect_test.cpp card_detect.cpp -o card_detect_test
+ *   ./card_detect_test
+ *
+ * Runs the detector against a simulated MFRC522 on a virtual clock, with the
+ * reader's timings: a REQA with no card waits out the 25 ms receive timeout,
+ * one with a card returns in about 1 ms, and select takes about 4 ms. Cards
+ * arrive at random moments. Reports the detection latency distribution and
+ * how busy the SPI bus is while nobody is at the door:
+ *   - the legacy loop: poll, then delay(100)
+ *   - the RFID task polling every 10 ms tick
+ *   - IRQ mode
+ *   - status mode, reading RxIRq back on every tick
+ */
+
+#include "card_detect.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+#define NEVER 0xFFFFFFFFFFFFFFFFULL
+
+// Timings in microseconds
+#define REQA_TIMEOUT_US  25000  // PCD_Init sets a 25 ms receive timeout
+#define REQA_ANSWER_US   1000
+#define SELECT_US        4000
+#define ARM_US           60     // Three SPI register writes
+#define IRQ_DELAY_US     300    // ATQA arrives and RxIRq fires
+
+class SimRadio : public CardDetectRadio {
+public:
+  uint64_t clock = 0;
+  uint64_t cardAt = NEVER;  // Card enters the field
+  uint64_t irqAt = NEVER;
+  uint64_t busyUs = 0;      // Time spent in SPI transactions
+
+  bool present() const { return clock >= cardAt; }
+
+  void spend(uint64_t us) {
+    clock += us;
+    busyUs += us;
+  }
+
+  bool isNewCardPresent() override {
+    bool found = present();
+    spend(found ? REQA_ANSWER_US : REQA_TIMEOUT_US);
+    return found;
+  }
+  bool readCardSerial() override {
+    bool found = present();
+    spend(found ? SELECT_US : REQA_TIMEOUT_US);
+    return found;
+  }
+  void armIrq() override {
+    // Only a card already in the field answers this REQA
+    irqAt = present() ? clock + IRQ_DELAY_US : NEVER;
+    spend(ARM_US);
+  }
+  void clearIrq() override {
+    irqAt = NEVER;
+    spend(ARM_US / 3);
+  }
+  bool irqPending() override {
+    spend(ARM_US / 3);
+    return irqAt <= clock;
+  }
+};
+
+// One RFID loop model: mode plus how long the task sleeps between checks
+struct LoopModel {
+  const char* name;
+  uint8_t mode;
+  uint32_t sleepMs;
+};
+
+// Run the loop until a card arriving at cardAtUs is detected; returns the
+// detection latency in microseconds
+static uint64_t detectOnce(const LoopModel& model, uint64_t startUs, uint64_t cardAtUs) {
+  SimRadio radio;
+  radio.clock = startUs;
+  radio.cardAt = cardAtUs;
+
+  CardDetector detector;
+  detector.begin(&radio, model.mode, (uint32_t)(radio.clock / 1000));
+
+  for (int guard = 0; guard < 100000; guard++) {
+    // Status mode reads the register itself; the detector clears it
+    bool irqFired = model.mode == CARD_DETECT_IRQ && radio.irqAt <= radio.clock;
+
+    if (detector.check((uint32_t)(radio.clock / 1000), irqFired)) {
+      return radio.clock - cardAtUs;
+    }
+
+    // The task sleeps for its tick, or until the IRQ wakes it
+    uint64_t wake = radio.clock + model.sleepMs * 1000ULL;
+    if (model.mode == CARD_DETECT_IRQ && radio.irqAt < wake) wake = radio.irqAt;
+    radio.clock = wake;
+  }
+  return NEVER;
+}
+
+// Fraction of time the SPI bus is busy over 10 s with no card
+static double idleBusy(const LoopModel& model, CardDetectStats* stats) {
+  SimRadio radio;
+  CardDetector detector;
+  detector.begin(&radio, model.mode, 0);
+
+  const uint64_t runUs = 10000000ULL;
+  while (radio.clock < runUs) {
+    detector.check((uint32_t)(radio.clock / 1000), false);
+    radio.clock += model.sleepMs * 1000ULL;
+  }
+  *stats = detector.stats();
+  return (double)radio.busyUs / (double)radio.clock;
+}
+
+static double percentileMs(std::vector<uint64_t> values, double p) {
+  std::sort(values.begin(), values.end());
+  size_t i = (size_t)(p * (values.size() - 1) + 0.5);
+  return values[i] / 1000.0;
+}
+
+struct Report {
+  double p50, p95, p99, max, busy;
+};
+
+static Report run(const LoopModel& model) {
+  const int samples = 5000;
+  std::vector<uint64_t> latencies;
+  srand(12345);
+  for (int i = 0; i < samples; i++) {
+    // Boot at a random phase, card arrives somewhere in the next 2 s
+    uint64_t start = (uint64_t)(rand() % 1000) * 1000;
+    uint64_t cardAt = start + 200000 + (uint64_t)(rand() % 2000000);
+    uint64_t latency = detectOnce(model, start, cardAt);
+    CHECK(latency != NEVER);
+    latencies.push_back(latency);
+  }
+
+  CardDetectStats stats;
+  Report r;
+  r.busy = idleBusy(model, &stats);
+  r.p50 = percentileMs(latencies, 0.50);
+  r.p95 = percentileMs(latencies, 0.95);
+  r.p99 = percentileMs(latencies, 0.99);
+  r.max = percentileMs(latencies, 1.0);
+
+  printf("  %-24s p50 %6.1f  p95 %6.1f  p99 %6.1f  max %6.1f ms   idle SPI busy %5.1f%%"
+         "  (%u polls, %u arms in 10 s)\n",
+         model.name, r.p50, r.p95, r.p99, r.max, r.busy * 100.0,
+         (unsigned)stats.polls, (unsigned)stats.arms);
+  return r;
+}
+
+static void testSpuriousIrq() {
+  SimRadio radio;
+  CardDetector detector;
+  detector.begin(&radio, CARD_DETECT_IRQ, 0);
+  CHECK(detector.stats().arms == 1);
+
+  // IRQ with no card to select: counted, re-armed, no detection
+  CHECK(!detector.check(5, true));
+  CHECK(detector.stats().spuriousIrqs == 1);
+  CHECK(detector.stats().arms == 2);
+
+  // Safety poll picks up a card even if its IRQ edge was lost
+  radio.cardAt = 0;
+  radio.clock = (CARD_IRQ_SAFETY_POLL_MS + 10) * 1000ULL;
+  CHECK(detector.check(CARD_IRQ_SAFETY_POLL_MS + 10, false));
+  CHECK(detector.stats().polls == 1);
+  CHECK(detector.stats().detected == 1);
+}
+
+static void testStatusMode() {
+  SimRadio radio;
+  CardDetector detector;
+  detector.begin(&radio, CARD_DETECT_STATUS, 0);
+  CHECK(detector.stats().arms == 1);
+
+  // No line to watch: the status register says whether the REQA was answered
+  radio.cardAt = 3000;
+  radio.clock = 25000;
+  CHECK(!detector.check(25, true));  // Armed before the card arrived; the edge is ignored
+  CHECK(detector.stats().arms == 2);
+  radio.clock = 26000;
+  CHECK(detector.check(26, false));
+  CHECK(detector.stats().irqs == 1);
+
+  // Never falls back to a blocking poll
+  radio.cardAt = NEVER;
+  for (uint32_t ms = 30; ms < 3 * CARD_IRQ_SAFETY_POLL_MS; ms += 10) {
+    radio.clock = ms * 1000ULL;
+    CHECK(!detector.check(ms, false));
+  }
+  CHECK(detector.stats().polls == 0);
+}
+
+int main() {
+  printf("Spurious IRQ and safety poll\n");
+  testSpuriousIrq();
+
+  printf("Status mode\n");
+  testStatusMode();
+
+  printf("Detection latency, card arrival to UID selected\n");
+  LoopModel legacy = {"poll + delay(100)", CARD_DETECT_POLL, 100};
+  LoopModel tick = {"poll, 10 ms task tick", CARD_DETECT_POLL, 10};
+  LoopModel irq = {"irq, 10 ms task tick", CARD_DETECT_IRQ, 10};
+  LoopModel status = {"status, 10 ms task tick", CARD_DETECT_STATUS, 10};
+  Report legacyReport = run(legacy);
+  Report tickReport = run(tick);
+  Report irqReport = run(irq);
+  Report statusReport = run(status);
+
+  CHECK(irqReport.p50 < legacyReport.p50);
+  CHECK(irqReport.p95 < legacyReport.p95);
+  CHECK(irqReport.p95 < tickReport.p95);
+  // Worst case is one re-arm interval plus the select
+  CHECK(irqReport.max <= CARD_IRQ_REARM_MS + 10 + SELECT_US / 1000.0 + 1);
+  CHECK(irqReport.busy < 0.05);
+  CHECK(irqReport.busy < tickReport.busy / 10);
+  // No wake-up from the line: up to one tick later than IRQ mode
+  CHECK(statusReport.max <= irqReport.max + 10);
+  CHECK(statusReport.busy < 0.05);
+
+  if (failures == 0) {
+    printf("All card detect tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
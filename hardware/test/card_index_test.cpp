@@ -0,0 +1,297 @@
+/*
+ * Host-side test for the binary card index
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -I. test/card_index_test.cpp card_index.cpp -o card_index_test
+ *   ./card_index_test
+ *
+ * Checks lookups, upserts and merges, then shows that lookup cost stays flat as the
+ * index grows from 100 to 50,000 cards.
+ */
+
+#include "card_index.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+// In-memory index file that counts record reads
+class MemoryIndex : public CardIndexSource, public CardIndexSink {
+public:
+  std::vector<uint8_t> data;
+  size_t reads = 0;
+
+  size_t size() override { return data.size(); }
+  bool readAt(size_t offset, void* buf, size_t len) override {
+    if (offset + len > data.size()) return false;
+    memcpy(buf, &data[offset], len);
+    reads++;
+    return true;
+  }
+  bool write(const void* buf, size_t len) override {
+    const uint8_t* bytes = (const uint8_t*)buf;
+    data.insert(data.end(), bytes, bytes + len);
+    return true;
+  }
+};
+
+static CardRecord makeCard(uint32_t n) {
+  uint8_t uid[7];
+  uint8_t uidLen = (n % 3 == 0) ? 7 : 4;  // Mix of 4 and 7 byte UIDs
+  uint32_t h = n * 2654435761u;           // Spread keys over the UID space
+  for (uint8_t i = 0; i < uidLen; i++) {
+    uid[i] = (uint8_t)(h >> ((i % 4) * 8)) ^ (uint8_t)(i * 31 + (n >> 24));
+  }
+  uid[uidLen - 1] = (uint8_t)n;  // Keep UIDs unique for small n
+
+  char name[32];
+  char userId[32];
+  snprintf(name, sizeof(name), "User %u", n);
+  snprintf(userId, sizeof(userId), "user_%06u", n);
+
+  CardRecord rec;
+  cardRecordSet(&rec, uid, uidLen, name, userId, (n % 10 == 0) ? CARD_ROLE_TEACHER : CARD_ROLE_STUDENT);
+  return rec;
+}
+
+static std::vector<CardRecord> buildIndex(MemoryIndex& index, uint32_t count) {
+  std::vector<CardRecord> cards;
+  for (uint32_t i = 0; i < count; i++) cards.push_back(makeCard(i));
+  cardRecordSort(cards.data(), cards.size());
+
+  // Drop accidental UID collisions so every key is unique
+  std::vector<CardRecord> unique;
+  for (size_t i = 0; i < cards.size(); i++) {
+    if (unique.empty() || cardRecordOrder(unique.back(), cards[i]) != 0) unique.push_back(cards[i]);
+  }
+
+  index.data.clear();
+  cardIndexWrite(index, unique.data(), unique.size());
+  return unique;
+}
+
+static void testHexAndRoles() {
+  uint8_t uid[CARD_UID_MAX_LEN];
+  uint8_t uidLen = 0;
+  char hex[2 * CARD_UID_MAX_LEN + 1];
+
+  CHECK(cardUidFromHex("04A1B2C3", uid, &uidLen));
+  CHECK(uidLen == 4 && uid[0] == 0x04 && uid[3] == 0xC3);
+  cardUidToHex(uid, uidLen, hex, sizeof(hex));
+  CHECK(strcmp(hex, "04A1B2C3") == 0);
+
+  CHECK(!cardUidFromHex("", uid, &uidLen));
+  CHECK(!cardUidFromHex("ABC", uid, &uidLen));
+  CHECK(!cardUidFromHex("RFID101", uid, &uidLen));
+  CHECK(!cardUidFromHex("00112233445566778899AA", uid, &uidLen));
+
+  CHECK(cardRoleFromString("teacher") == CARD_ROLE_TEACHER);
+  CHECK(cardRoleFromString("student") == CARD_ROLE_STUDENT);
+  CHECK(strcmp(cardRoleName(cardRoleFromString("admin")), "unknown") == 0);
+}
+
+static void testLookupAndUpsert() {
+  MemoryIndex empty;
+  CHECK(cardIndexCount(empty) == 0);
+  CHECK(!cardIndexFind(empty, (const uint8_t*)"\x01\x02\x03\x04", 4, NULL));
+
+  // Build a small index one upsert at a time, in reverse order
+  MemoryIndex index;
+  for (int n = 20; n >= 0; n--) {
+    MemoryIndex next;
+    CHECK(cardIndexUpsert(index, next, makeCard((uint32_t)n)));
+    index.data.swap(next.data);
+  }
+  CHECK(cardIndexCount(index) == 21);
+
+  // Records must come out sorted
+  CardRecord prev, cur;
+  for (size_t i = 0; i < 21; i++) {
+    index.readAt(CARD_INDEX_HEADER_SIZE + i * CARD_RECORD_SIZE, &cur, sizeof(cur));
+    if (i > 0) CHECK(cardRecordOrder(prev, cur) < 0);
+    prev = cur;
+  }
+
+  // One lookup returns name, user ID and role together
+  CardRecord want = makeCard(10);
+  CardRecord got;
+  CHECK(cardIndexFind(index, want.uid, want.uidLen, &got));
+  CHECK(strcmp(got.name, "User 10") == 0);
+  CHECK(strcmp(got.userId, "user_000010") == 0);
+  CHECK(got.role == CARD_ROLE_TEACHER);
+
+  // Upserting an existing UID replaces it instead of adding a duplicate
+  CardRecord renamed = want;
+  strcpy(renamed.name, "Renamed");
+  MemoryIndex next;
+  CHECK(cardIndexUpsert(index, next, renamed));
+  CHECK(cardIndexCount(next) == 21);
+  CHECK(cardIndexFind(next, want.uid, want.uidLen, &got));
+  CHECK(strcmp(got.name, "Renamed") == 0);
+
+  // Same leading bytes, different length, are different cards
+  uint8_t shortUid[4];
+  memcpy(shortUid, want.uid, 4);
+  CHECK(want.uidLen != 7 || !cardIndexFind(index, shortUid, 4, NULL));
+
+  // A foreign or truncated header reads as empty
+  MemoryIndex corrupt = index;
+  corrupt.data[0] ^= 0xFF;
+  CHECK(cardIndexCount(corrupt) == 0);
+}
+
+// Replays a fixed list of changes
+class ChangeList : public CardChangeSource {
+public:
+  std::vector<CardRecord> records;
+  std::vector<bool> revokes;
+  size_t pos = 0;
+
+  void add(const CardRecord& rec, bool revoke) {
+    records.push_back(rec);
+    revokes.push_back(revoke);
+  }
+  bool next(CardRecord* rec, bool* revoke) override {
+    if (pos >= records.size()) return false;
+    *rec = records[pos];
+    *revoke = revokes[pos];
+    pos++;
+    return true;
+  }
+};
+
+static void testMerge() {
+  MemoryIndex index;
+  std::vector<CardRecord> cards = buildIndex(index, 50);
+
+  // Revoke every fifth card, rename every seventh, add five new ones
+  ChangeList changes;
+  std::vector<CardRecord> added;
+  for (uint32_t n = 1000; n < 1005; n++) added.push_back(makeCard(n));
+  std::vector<CardRecord> all = cards;
+  all.insert(all.end(), added.begin(), added.end());
+  cardRecordSort(all.data(), all.size());
+
+  size_t expected = 0;
+  for (size_t i = 0; i < all.size(); i++) {
+    bool isNew = cardIndexFind(index, all[i].uid, all[i].uidLen, NULL) == false;
+    if (isNew) {
+      changes.add(all[i], false);
+      expected++;
+    } else if (i % 5 == 0) {
+      changes.add(all[i], true);
+    } else {
+      if (i % 7 == 0) {
+        CardRecord renamed = all[i];
+        strcpy(renamed.name, "Renamed");
+        changes.add(renamed, false);
+      }
+      expected++;
+    }
+  }
+
+  MemoryIndex merged;
+  CHECK(cardIndexMerge(index, merged, changes));
+  CHECK(cardIndexCount(merged) == expected);
+
+  for (size_t i = 0; i < changes.records.size(); i++) {
+    const CardRecord& c = changes.records[i];
+    CardRecord got;
+    bool found = cardIndexFind(merged, c.uid, c.uidLen, &got);
+    CHECK(found == !changes.revokes[i]);
+    if (found) CHECK(strcmp(got.name, c.name) == 0);
+  }
+
+  // A snapshot is a merge into an empty index
+  MemoryIndex empty;
+  MemoryIndex snapshot;
+  ChangeList full;
+  for (size_t i = 0; i < all.size(); i++) full.add(all[i], false);
+  CHECK(cardIndexMerge(empty, snapshot, full));
+  CHECK(cardIndexCount(snapshot) == all.size());
+
+  // The fold epoch rides in the header; an upsert keeps it
+  CHECK(cardIndexEpoch(merged) == 0);
+  MemoryIndex folded;
+  ChangeList none;
+  CHECK(cardIndexMerge(merged, folded, none, 7));
+  CHECK(cardIndexEpoch(folded) == 7);
+  CHECK(cardIndexCount(folded) == expected);
+  MemoryIndex upserted;
+  CHECK(cardIndexUpsert(folded, upserted, all[0]));
+  CHECK(cardIndexEpoch(upserted) == 7);
+  CHECK(cardIndexEpoch(empty) == 0);
+
+  // Out-of-order changes are rejected
+  ChangeList unordered;
+  unordered.add(all[3], false);
+  unordered.add(all[1], false);
+  MemoryIndex rejected;
+  CHECK(!cardIndexMerge(index, rejected, unordered));
+}
+
+static void testLookupScaling() {
+  const uint32_t sizes[] = {100, 1000, 10000, 50000};
+  const int lookups = 20000;
+  double firstNs = 0;
+  double lastNs = 0;
+
+  printf("%8s %12s %14s %12s\n", "cards", "ns/lookup", "reads/lookup", "max reads");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    MemoryIndex index;
+    std::vector<CardRecord> cards = buildIndex(index, sizes[s]);
+    size_t count = cards.size();
+    CHECK(cardIndexCount(index) == count);
+
+    srand(42);
+    size_t totalReads = 0;
+    size_t maxReads = 0;
+    int found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; i++) {
+      const CardRecord& want = cards[(size_t)rand() % count];
+      CardRecord got;
+      index.reads = 0;
+      if (cardIndexFind(index, want.uid, want.uidLen, &got) &&
+          strcmp(got.userId, want.userId) == 0) {
+        found++;
+      }
+      totalReads += index.reads;
+      if (index.reads > maxReads) maxReads = index.reads;
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / lookups;
+    if (s == 0) firstNs = ns;
+    lastNs = ns;
+
+    printf("%8zu %12.1f %14.2f %12zu\n", count, ns, (double)totalReads / lookups, maxReads);
+
+    CHECK(found == lookups);
+    // Header read plus at most ceil(log2(N + 1)) record reads
+    CHECK(maxReads <= 1 + (size_t)ceil(log2((double)count + 1)));
+  }
+  printf("50000/100 lookup time ratio: %.2f (log2 ratio %.2f)\n",
+         lastNs / firstNs, log2(50001.0) / log2(101.0));
+}
+
+int main() {
+  testHexAndRoles();
+  testLookupAndUpsert();
+  testMerge();
+  testLookupScaling();
+
+  if (failures > 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All card index tests passed\n");
+  return 0;
+}
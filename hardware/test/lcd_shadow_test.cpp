@@ -0,0 +1,252 @@
+/*
+ * Host-side test for differential LCD rendering
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -I. test/lcd_shadow_test.cpp lcd_shadow.cpp access_flow.cpp -o lcd_shadow_test
+ *   ./lcd_shadow_test
+ *
+ * The stand-in LCD models the HD44780's display RAM and auto-incrementing
+ * cursor behind a PCF8574 backpack. LiquidCrystal_I2C sends every LCD byte
+ * as two nibbles of three expander writes each (address plus data), so one
+ * LCD byte is 12 bytes on the bus, about 1.1 ms at 100 kHz. clear() also
+ * waits 2 ms. Screens recorded from the access flow for granted and denied
+ * taps, and the Wi-Fi connect progress dots, are drawn the old way (clear,
+ * then both rows) and through the shadow. After every screen the panel
+ * must read the same either way. Reports bus bytes and time per tap.
+ *
+ * A tap changes nearly every cell on each screen, so there the shadow
+ * mostly saves the clear() waits; progress screens that only tick a
+ * counter or add a dot shrink to a few bytes.
+ */
+
+#include "lcd_shadow.h"
+#include "access_flow.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+#define DDRAM_COLS           40    // Per row in two-line mode
+#define BUS_BYTES_PER_LCD    12    // 2 nibbles x 3 expander writes x (address + data)
+#define BUS_US_PER_BYTE      90    // 9 clocks at 100 kHz
+#define CLEAR_WAIT_US        2000  // LiquidCrystal_I2C::clear()
+
+class SimLcd : public LcdDevice {
+public:
+  char ddram[2][DDRAM_COLS];
+  uint8_t col, row;
+  uint32_t lcdBytes;
+  uint32_t clears;
+
+  SimLcd() : col(0), row(0), lcdBytes(0), clears(0) {
+    memset(ddram, ' ', sizeof(ddram));
+  }
+
+  void clear() override {
+    memset(ddram, ' ', sizeof(ddram));
+    col = row = 0;
+    lcdBytes++;
+    clears++;
+  }
+  void setCursor(uint8_t c, uint8_t r) override {
+    col = c;
+    row = r;
+    lcdBytes++;
+  }
+  void write(const uint8_t* data, size_t len) override {
+    for (size_t i = 0; i < len; i++) {
+      ddram[row][col] = (char)data[i];
+      // Address counter runs past the visible columns, then to the other row
+      if (++col == DDRAM_COLS) {
+        col = 0;
+        row ^= 1;
+      }
+      lcdBytes++;
+    }
+  }
+
+  std::string visible(uint8_t r) const { return std::string(ddram[r], LCD_SHADOW_COLS); }
+  uint32_t busBytes() const { return lcdBytes * BUS_BYTES_PER_LCD; }
+  uint32_t busUs() const { return busBytes() * BUS_US_PER_BYTE + clears * CLEAR_WAIT_US; }
+};
+
+// What displayMessage() used to do
+static void legacyShow(SimLcd& lcd, const char* line1, const char* line2) {
+  lcd.clear();
+  lcd.setCursor(0, 0);
+  lcd.write((const uint8_t*)line1, strnlen(line1, LCD_SHADOW_COLS));
+  if (line2[0] != '\0') {
+    lcd.setCursor(0, 1);
+    lcd.write((const uint8_t*)line2, strnlen(line2, LCD_SHADOW_COLS));
+  }
+}
+
+static std::string padded(const std::string& text) {
+  std::string row = text.substr(0, LCD_SHADOW_COLS);
+  row.resize(LCD_SHADOW_COLS, ' ');
+  return row;
+}
+
+struct Screen {
+  std::string line1, line2;
+};
+
+class RecordingDoor : public AccessHardware {
+public:
+  std::vector<Screen> screens;
+  uint32_t clock;
+  bool fingerOk;
+
+  RecordingDoor(bool finger) : clock(0), fingerOk(finger) {}
+
+  void setOutput(uint8_t, bool) override {}
+  void display(const char* line1, const char* line2) override {
+    screens.push_back(Screen{line1, line2});
+  }
+  bool captureFingerprint() override { return clock >= 600; }
+  int matchCaptured(uint16_t) override { return fingerOk ? 1 : 0; }
+};
+
+// Screens shown for one tap, from the card until the idle screen is back
+static std::vector<Screen> recordTap(bool cardValid, bool fingerOk) {
+  RecordingDoor door(fingerOk);
+  AccessFlow flow;
+  flow.begin(&door, 0);
+  door.screens.clear();
+  flow.cardDetected("04A1B2C3", 0);
+  if (cardValid) {
+    flow.cardAccepted(7, 0);
+  } else {
+    flow.deny("Invalid Card", 0);
+  }
+  for (door.clock = 0; door.clock < 30000; door.clock += 10) flow.tick(door.clock);
+  return door.screens;
+}
+
+struct Cost {
+  uint32_t lcdBytes, busBytes, busUs;
+};
+
+static Cost replay(const std::vector<Screen>& screens, bool differential) {
+  SimLcd lcd;
+  LcdShadow shadow;
+  shadow.begin(&lcd);
+  // Start from the idle screen either way
+  shadow.show("System Ready", "Present Card");
+  uint32_t lcdStart = lcd.lcdBytes, clearStart = lcd.clears;
+
+  for (size_t i = 0; i < screens.size(); i++) {
+    const Screen& s = screens[i];
+    if (differential) {
+      shadow.show(s.line1.c_str(), s.line2.c_str());
+    } else {
+      legacyShow(lcd, s.line1.c_str(), s.line2.c_str());
+    }
+    CHECK(lcd.visible(0) == padded(s.line1));
+    CHECK(lcd.visible(1) == padded(s.line2));
+  }
+
+  SimLcd delta;
+  delta.lcdBytes = lcd.lcdBytes - lcdStart;
+  delta.clears = lcd.clears - clearStart;
+  Cost cost = {delta.lcdBytes, delta.busBytes(), delta.busUs()};
+  return cost;
+}
+
+static void testRuns() {
+  SimLcd lcd;
+  LcdShadow shadow;
+  shadow.begin(&lcd);
+  shadow.show("Place Finger", "Attempt 1/3");
+  uint32_t before = lcd.lcdBytes;
+
+  // One changed digit: a cursor move and one cell
+  shadow.show("Place Finger", "Attempt 2/3");
+  CHECK(lcd.lcdBytes - before == 2);
+  CHECK(lcd.visible(1) == padded("Attempt 2/3"));
+
+  // Identical screen: nothing on the bus
+  before = lcd.lcdBytes;
+  shadow.show("Place Finger", "Attempt 2/3");
+  CHECK(lcd.lcdBytes == before);
+  CHECK(shadow.stats().unchanged == 1);
+
+  // Changes one cell apart are one run, not two cursor moves
+  before = lcd.lcdBytes;
+  shadow.show("Place Finger", "AXtXmpt 2/3");
+  CHECK(lcd.lcdBytes - before == 1 + 3);
+
+  // A shorter line blanks the rest of the row
+  shadow.show("OK", "");
+  CHECK(lcd.visible(0) == padded("OK"));
+  CHECK(lcd.visible(1) == padded(""));
+
+  // Long lines are cut at the panel width; the cursor wrap is not trusted
+  shadow.show("0123456789ABCDEFXYZ", "abcdefghijklmnop");
+  CHECK(lcd.visible(0) == "0123456789ABCDEF");
+  CHECK(lcd.visible(1) == "abcdefghijklmnop");
+  shadow.show("0123456789ABCDEx", "abcdefghijklmnoq");
+  CHECK(lcd.visible(0) == "0123456789ABCDEx");
+  CHECK(lcd.visible(1) == "abcdefghijklmnoq");
+
+  // A screen that changes almost everywhere goes through clear()
+  uint32_t clears = lcd.clears;
+  uint32_t chosen = shadow.stats().clears;
+  shadow.show("Hi", "");
+  CHECK(lcd.clears == clears + 1);
+  CHECK(shadow.stats().clears == chosen + 1);
+  CHECK(lcd.visible(0) == padded("Hi"));
+  CHECK(lcd.visible(1) == padded(""));
+
+  // After invalidate() every cell is rewritten, even ones that match
+  lcd.clear();  // Panel reset behind the shadow's back
+  shadow.invalidate();
+  shadow.show("0123456789ABCDEx", "abcdefghijklmnoq");
+  CHECK(lcd.visible(0) == "0123456789ABCDEx");
+  CHECK(lcd.visible(1) == "abcdefghijklmnoq");
+}
+
+// Shadow cost as a fraction of the old cost; never worse
+static double report(const char* name, const std::vector<Screen>& screens) {
+  Cost before = replay(screens, false);
+  Cost after = replay(screens, true);
+  printf("  %-22s %2zu screens  %5u -> %4u LCD bytes  %6u -> %5u bus bytes  %5.1f -> %4.1f ms\n",
+         name, screens.size(), before.lcdBytes, after.lcdBytes, before.busBytes, after.busBytes,
+         before.busUs / 1000.0, after.busUs / 1000.0);
+  CHECK(after.busBytes <= before.busBytes);
+  CHECK(after.busUs <= before.busUs);
+  return (double)after.busBytes / before.busBytes;
+}
+
+int main() {
+  printf("Rendering\n");
+  testRuns();
+
+  printf("Per tap\n");
+  report("granted", recordTap(true, true));
+  report("wrong finger x3", recordTap(true, false));
+  report("unknown card", recordTap(false, false));
+
+  // connectToWiFi(): one more progress dot per attempt
+  std::vector<Screen> wifi;
+  std::string dots;
+  for (int attempt = 1; attempt <= 20; attempt++) {
+    if (dots.size() < LCD_SHADOW_COLS) dots += '.';
+    wifi.push_back(Screen{"WiFi Connect", dots});
+  }
+  // Screens that only tick a counter are where the shadow pays off
+  CHECK(report("Wi-Fi connect, 20 s", wifi) < 0.25);
+
+  if (failures == 0) {
+    printf("All LCD shadow tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
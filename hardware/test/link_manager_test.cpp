@@ -0,0 +1,398 @@
+/*
+ * Host-side test for the Wi-Fi link manager
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -I. test/link_manager_test.cpp link_manager.cpp -o link_manager_test
+ *   ./link_manager_test
+ *
+ * Drives the manager against a simulated access point: a scan, then
+ * association, then DHCP, each taking its time, and the AP going away,
+ * coming back and changing channel. Checks that a reconnect to the cached
+ * AP with the cached lease is sub-second, that a stale cache falls back
+ * to a scan, and how retries back off while the AP stays down. Reports
+ * fast and full reconnect times and the offline time per outage.
+ */
+
+#include "link_manager.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+#define TICK_MS      100  // The network task's idle pass
+#define SCAN_MS      2300 // All channels
+#define ASSOCIATE_MS 250  // Auth, association and the 4-way handshake
+#define DHCP_MS      1800 // Discover to ack
+
+static const uint8_t AP_BSSID[6] = {0x24, 0xA4, 0x3C, 0x10, 0x20, 0x30};
+static const LinkAddress AP_LEASE = {0x6568A8C0, 0x0168A8C0, 0x00FFFFFF, 0x0168A8C0};
+static const LinkAddress FIXED = {0x3268A8C0, 0x0168A8C0, 0x00FFFFFF, 0x0868A8C0};
+
+class SimAp : public LinkRadio {
+public:
+  uint32_t* clock;
+  bool apUp = true;
+  uint8_t apChannel = 6;
+  uint8_t apBssid[6];
+  uint32_t upSince = 0;
+
+  bool joining = false;
+  bool fast = false;
+  bool dhcp = false;
+  uint32_t joinAt = 0;
+  LinkAddress address;
+  bool linked = false;
+
+  uint32_t joins = 0;
+  uint32_t dhcpJoins = 0;
+  uint32_t joinTimes[512];
+
+  explicit SimAp(uint32_t* now) : clock(now) {
+    memcpy(apBssid, AP_BSSID, 6);
+    memset(&address, 0, sizeof(address));
+  }
+
+  void setAp(bool up) {
+    if (up && !apUp) upSince = *clock;
+    apUp = up;
+    if (!up) linked = false;
+  }
+
+  void join(const LinkCache* ap, const LinkAddress* fixed) override {
+    linked = false;
+    joining = true;
+    joinAt = *clock;
+    fast = ap != NULL;
+    // A cached AP that isn't on its channel never answers the probe
+    if (fast && (ap->channel != apChannel || memcmp(ap->bssid, apBssid, 6) != 0)) joining = false;
+    dhcp = fixed == NULL;
+    if (dhcp) {
+      address = AP_LEASE;
+      dhcpJoins++;
+    } else {
+      address = *fixed;
+    }
+    if (joins < sizeof(joinTimes) / sizeof(joinTimes[0])) joinTimes[joins] = *clock;
+    joins++;
+  }
+  void drop() override {
+    joining = false;
+    linked = false;
+  }
+  uint8_t status() override {
+    if (linked) return LINK_RADIO_UP;
+    if (!joining) return fast ? LINK_RADIO_JOINING : LINK_RADIO_FAILED;
+    uint32_t took = *clock - joinAt;
+    if (!apUp) {
+      // A scan that doesn't find the SSID says so; a direct probe just waits
+      if (!fast && took >= SCAN_MS) return LINK_RADIO_FAILED;
+      return LINK_RADIO_JOINING;
+    }
+    // The AP came back during the attempt: the radio finds it from there
+    uint32_t from = (int32_t)(upSince - joinAt) > 0 ? upSince : joinAt;
+    uint32_t needs = (fast ? 0 : SCAN_MS) + ASSOCIATE_MS + (dhcp ? DHCP_MS : 0);
+    if (*clock - from >= needs) {
+      joining = false;
+      linked = true;
+      return LINK_RADIO_UP;
+    }
+    return LINK_RADIO_JOINING;
+  }
+  void read(uint8_t* bssid, uint8_t* channel, LinkAddress* out) override {
+    memcpy(bssid, apBssid, 6);
+    *channel = apChannel;
+    *out = address;
+  }
+};
+
+struct Events {
+  uint32_t ups;
+  uint32_t downs;
+  uint32_t lastUpAt;
+};
+
+static void run(LinkManager& link, uint32_t* now, uint32_t untilMs, Events* events) {
+  while ((int32_t)(*now - untilMs) < 0) {
+    uint8_t event = link.tick(*now);
+    if (event == LINK_EVENT_UP) {
+      events->ups++;
+      events->lastUpAt = *now;
+    } else if (event == LINK_EVENT_DOWN) {
+      events->downs++;
+    }
+    *now += TICK_MS;
+  }
+}
+
+// Tick until the link is up or untilMs passes
+static bool runUntilUp(LinkManager& link, uint32_t* now, uint32_t untilMs, Events* events) {
+  while ((int32_t)(*now - untilMs) < 0) {
+    run(link, now, *now + TICK_MS, events);
+    if (link.up()) return true;
+  }
+  return false;
+}
+
+static void testColdJoin() {
+  uint32_t now = 1000;
+  SimAp ap(&now);
+  LinkManager link;
+  Events events = {0, 0, 0};
+  link.begin(&ap, NULL, NULL, 1234, now);
+  CHECK(!link.up());
+
+  CHECK(runUntilUp(link, &now, 30000, &events));
+  CHECK(events.ups == 1);
+  CHECK(events.downs == 0);
+  CHECK(link.stats().fullJoins == 1);
+  CHECK(link.stats().fastJoins == 0);
+  CHECK(link.stats().outages == 0);  // Not having joined yet isn't an outage
+  CHECK(link.stats().lastJoinMs >= SCAN_MS + ASSOCIATE_MS + DHCP_MS);
+  CHECK(link.offlineFor(now) == 0);
+
+  // What the next join needs, ready to be saved
+  CHECK(link.cacheDirty());
+  CHECK(link.cache().channel == 6);
+  CHECK(memcmp(link.cache().bssid, AP_BSSID, 6) == 0);
+  CHECK(link.cache().leaseValid);
+  CHECK(link.cache().lease.ip == AP_LEASE.ip);
+  link.cacheSaved();
+  CHECK(!link.cacheDirty());
+  printf("  no cache: joined in %lu ms (scan, associate, DHCP)\n",
+         (unsigned long)link.stats().lastJoinMs);
+
+  // A reboot with the saved cache skips the scan and DHCP
+  LinkCache saved = link.cache();
+  uint32_t dhcpJoins = ap.dhcpJoins;
+  LinkManager again;
+  again.begin(&ap, &saved, NULL, 99, now);
+  ap.drop();
+  CHECK(runUntilUp(again, &now, now + 30000, &events));
+  CHECK(again.stats().fastJoins == 1);
+  CHECK(again.stats().lastJoinMs < 1000);
+  CHECK(ap.dhcpJoins == dhcpJoins);
+  CHECK(!again.cacheDirty());  // Nothing new learned
+  printf("  saved cache: joined in %lu ms\n", (unsigned long)again.stats().lastJoinMs);
+}
+
+static void testOutage() {
+  uint32_t now = 1000;
+  SimAp ap(&now);
+  LinkManager link;
+  Events events = {0, 0, 0};
+  link.begin(&ap, NULL, NULL, 42, now);
+  CHECK(runUntilUp(link, &now, 30000, &events));
+
+  // The AP reboots for ten seconds
+  uint32_t joinsBefore = ap.joins;
+  run(link, &now, now + 5000, &events);
+  uint32_t lostAt = now;
+  ap.setAp(false);
+  run(link, &now, now + TICK_MS, &events);
+  CHECK(events.downs == 1);
+  CHECK(!link.up());
+  CHECK(link.stats().outages == 1);
+  run(link, &now, lostAt + 10000, &events);
+  CHECK(link.offlineFor(now) >= 10000 - TICK_MS);
+  CHECK(ap.joins > joinsBefore);  // Kept trying all along
+  uint32_t backAt = now;
+  ap.setAp(true);
+  CHECK(runUntilUp(link, &now, now + 60000, &events));
+  CHECK(events.ups == 2);
+
+  const LinkStats& s = link.stats();
+  CHECK(s.lastOutageMs >= 10000);
+  CHECK(s.offlineMs == s.lastOutageMs);
+  CHECK(s.maxOutageMs == s.lastOutageMs);
+  CHECK(link.offlineFor(now) == 0);
+  printf("  AP down 10 s: back %lu ms after the AP, outage %lu ms, %lu attempts\n",
+         (unsigned long)(events.lastUpAt - backAt), (unsigned long)s.lastOutageMs,
+         (unsigned long)s.attempts);
+
+  // A blip: the link drops with the AP still there, reassociates sub-second
+  ap.linked = false;
+  uint32_t blipAt = now;
+  CHECK(runUntilUp(link, &now, now + 30000, &events));
+  CHECK(events.downs == 2);
+  CHECK(link.stats().outages == 2);
+  CHECK(link.stats().lastJoinMs < 1000);
+  CHECK(link.stats().lastOutageMs < 1000 + LINK_BACKOFF_MIN_MS);
+  CHECK(link.stats().offlineMs == s.maxOutageMs + link.stats().lastOutageMs);
+  printf("  dropped with the AP up: fast join %lu ms, outage %lu ms\n",
+         (unsigned long)link.stats().lastJoinMs, (unsigned long)(events.lastUpAt - blipAt));
+}
+
+// The AP came back on another channel: one fast attempt, then a scan
+static void testChannelChange() {
+  uint32_t now = 1000;
+  SimAp ap(&now);
+  LinkManager link;
+  Events events = {0, 0, 0};
+  link.begin(&ap, NULL, NULL, 7, now);
+  CHECK(runUntilUp(link, &now, 30000, &events));
+  link.cacheSaved();
+
+  ap.setAp(false);
+  run(link, &now, now + 3000, &events);
+  ap.apChannel = 11;
+  ap.setAp(true);
+  uint32_t backAt = now;
+  CHECK(runUntilUp(link, &now, now + 60000, &events));
+  CHECK(link.stats().fastFailures >= 1);
+  CHECK(link.stats().fullJoins == 2);
+  CHECK(link.cache().channel == 11);
+  CHECK(link.cacheDirty());
+  // At most one fast attempt and one backoff ahead of the scan
+  CHECK(now - backAt <= LINK_FAST_ATTEMPT_MS + LINK_BACKOFF_MAX_MS / 2 + SCAN_MS +
+                        ASSOCIATE_MS + DHCP_MS + 2 * TICK_MS);
+  printf("  AP on a new channel: %lu fast attempts failed, full join %lu ms\n",
+         (unsigned long)link.stats().fastFailures, (unsigned long)link.stats().lastJoinMs);
+
+  // The new channel is what the next reconnect uses
+  ap.linked = false;
+  CHECK(runUntilUp(link, &now, now + 30000, &events));
+  CHECK(link.stats().lastJoinMs < 1000);
+}
+
+// With the AP gone, rounds space out exponentially up to the cap
+static void testBackoff() {
+  uint32_t now = 1000;
+  SimAp ap(&now);
+  LinkManager link;
+  Events events = {0, 0, 0};
+  link.begin(&ap, NULL, NULL, 2024, now);
+  CHECK(runUntilUp(link, &now, 30000, &events));
+  ap.setAp(false);
+  uint32_t firstJoin = ap.joins;
+  run(link, &now, now + 600000, &events);
+
+  // Every round is a fast attempt straight followed by a scan; the gap
+  // before the next round is the backoff
+  uint32_t delay = LINK_BACKOFF_MIN_MS;
+  uint32_t rounds = 0;
+  bool inRange = true;
+  bool capped = false;
+  for (uint32_t i = firstJoin + 1; i + 1 < ap.joins && i + 1 < 512; i += 2) {
+    uint32_t scanEnd = ap.joinTimes[i] + SCAN_MS;
+    uint32_t gap = ap.joinTimes[i + 1] - scanEnd;
+    if (gap + TICK_MS < delay / 2 || gap > delay + TICK_MS) inRange = false;
+    if (delay == LINK_BACKOFF_MAX_MS) capped = true;
+    delay = delay * 2 < LINK_BACKOFF_MAX_MS ? delay * 2 : LINK_BACKOFF_MAX_MS;
+    rounds++;
+  }
+  CHECK(inRange);
+  CHECK(capped);
+  CHECK(rounds < 30);  // At most twenty at the cap, plus the ramp
+  printf("  AP down 10 min: %lu rounds, %lu attempts\n", (unsigned long)rounds,
+         (unsigned long)(ap.joins - firstJoin));
+
+  // Two doors that lose the same AP at the same moment don't retry together
+  uint32_t clocks[2] = {1000, 1000};
+  SimAp apA(&clocks[0]);
+  SimAp apB(&clocks[1]);
+  LinkManager doorA, doorB;
+  doorA.begin(&apA, NULL, NULL, 1, clocks[0]);
+  doorB.begin(&apB, NULL, NULL, 2, clocks[1]);
+  CHECK(runUntilUp(doorA, &clocks[0], 30000, &events));
+  CHECK(runUntilUp(doorB, &clocks[1], 30000, &events));
+  CHECK(clocks[0] == clocks[1]);
+  apA.setAp(false);
+  apB.setAp(false);
+  uint32_t joinsA = apA.joins;
+  run(doorA, &clocks[0], clocks[0] + 120000, &events);
+  run(doorB, &clocks[1], clocks[1] + 120000, &events);
+  uint32_t together = 0;
+  for (uint32_t i = joinsA; i < apA.joins && i < apB.joins && i < 512; i++) {
+    if (apA.joinTimes[i] == apB.joinTimes[i]) together++;
+  }
+  CHECK(together < 3);
+  printf("  two doors, 2 minutes without the AP: %lu of %lu attempts at the same time\n",
+         (unsigned long)together, (unsigned long)(apA.joins - joinsA));
+}
+
+static void testLeaseAge() {
+  uint32_t now = 1000;
+  SimAp ap(&now);
+  Events events = {0, 0, 0};
+
+  // Saved long enough ago that the address may have gone to someone else
+  LinkCache stale;
+  memset(&stale, 0, sizeof(stale));
+  memcpy(stale.bssid, AP_BSSID, 6);
+  stale.channel = 6;
+  stale.leaseValid = 1;
+  stale.lease = AP_LEASE;
+  stale.leaseAt = now - LINK_LEASE_MAX_AGE_MS;
+  LinkManager link;
+  link.begin(&ap, &stale, NULL, 5, now);
+  CHECK(runUntilUp(link, &now, 30000, &events));
+  CHECK(link.stats().fastJoins == 1);  // Still skips the scan...
+  CHECK(ap.dhcpJoins == 1);            // ... but asks DHCP
+  CHECK(link.cacheDirty());
+  CHECK(link.cache().leaseAt == now - TICK_MS || link.cache().leaseAt == now);
+  link.cacheSaved();
+
+  // A lease reused for its whole age is given back to DHCP
+  ap.linked = false;
+  CHECK(runUntilUp(link, &now, now + 30000, &events));
+  CHECK(ap.dhcpJoins == 1);
+  uint32_t downs = events.downs;
+  uint32_t leaseAt = link.cache().leaseAt;
+  run(link, &now, leaseAt + LINK_LEASE_MAX_AGE_MS + TICK_MS, &events);
+  CHECK(events.downs == downs + 1);
+  CHECK(runUntilUp(link, &now, now + 30000, &events));
+  CHECK(ap.dhcpJoins == 2);
+  CHECK(link.stats().fullJoins == 1);
+  CHECK(link.cache().leaseAt != leaseAt);
+}
+
+static void testStaticAddress() {
+  uint32_t now = 1000;
+  SimAp ap(&now);
+  Events events = {0, 0, 0};
+  LinkManager link;
+  link.begin(&ap, NULL, &FIXED, 3, now);
+  CHECK(runUntilUp(link, &now, 30000, &events));
+  CHECK(ap.dhcpJoins == 0);
+  CHECK(ap.address.ip == FIXED.ip);
+  CHECK(link.stats().lastJoinMs < SCAN_MS + ASSOCIATE_MS + DHCP_MS);
+  CHECK(!link.cache().leaseValid);  // Nothing leased
+  CHECK(link.cache().channel == 6);
+
+  ap.linked = false;
+  CHECK(runUntilUp(link, &now, now + 30000, &events));
+  CHECK(ap.dhcpJoins == 0);
+  CHECK(ap.address.ip == FIXED.ip);
+  CHECK(link.stats().lastJoinMs < 1000);
+}
+
+int main() {
+  printf("Cold join and saved cache\n");
+  testColdJoin();
+
+  printf("Outages\n");
+  testOutage();
+
+  printf("AP changes channel\n");
+  testChannelChange();
+
+  printf("Backoff\n");
+  testBackoff();
+
+  printf("Lease age\n");
+  testLeaseAge();
+
+  printf("Static address\n");
+  testStaticAddress();
+
+  if (failures == 0) {
+    printf("All link manager tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
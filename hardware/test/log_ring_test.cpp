@@ -0,0 +1,335 @@
+/*
+ * Host-side test for the log ring
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -pthread -I. test/log_ring_test.cpp log_ring.cpp -o log_ring_test
+ *   ./log_ring_test
+ *
+ * Checks formatting, truncation, dropping with a count when full, levels
+ * compiled out without evaluating their arguments, and four threads logging
+ * at once against one draining thread. Then logs the lines of one tap the
+ * way the firmware does (card lookup on the server over JSON, the most
+ * verbose path) and reports per-tap latency for the logging task: the old
+ * synchronous Serial.println() at 115200 baud, modeled from the bytes
+ * written, against the ring built at DEBUG, INFO and OFF. A drain thread
+ * writes to a sink paced like the UART meanwhile.
+ */
+
+#include "log_ring.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+typedef std::chrono::steady_clock Clock;
+
+#define UART_US_PER_BYTE  86.8  // 10 bits at 115200 baud
+#define UART_FIFO_BYTES   128   // Serial.write() returns at once until this fills
+
+class StringSink : public LogSink {
+public:
+  std::string text;
+  void write(const uint8_t* data, size_t len) override { text.append((const char*)data, len); }
+};
+
+// Console as slow as the UART; only the drain thread ever waits on it
+class UartSink : public LogSink {
+public:
+  std::atomic<uint64_t> bytes;
+  UartSink() : bytes(0) {}
+  void write(const uint8_t* data, size_t len) override {
+    (void)data;
+    bytes += len;
+    std::this_thread::sleep_for(std::chrono::microseconds((long)(len * UART_US_PER_BYTE)));
+  }
+};
+
+static uint32_t fakeNow = 0;
+static uint32_t fakeClock() { return fakeNow; }
+
+// LOG_* for a ring other than the global one
+static bool ringPrint(LogRing& ring, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  bool ok = ring.vprint(LOG_LEVEL_INFO, fmt, args);
+  va_end(args);
+  return ok;
+}
+
+static void testFormat() {
+  // Through the macros and the global ring, as the firmware logs
+  fakeNow = 1234;
+  logRing.begin(fakeClock);
+  CHECK(logRing.waiting() == 0);
+  StringSink global;
+  LOG_INFO("Card %s (%u bytes)", "04A1B2C3", 4u);
+  LOG_WARN("queue full");
+  LOG_ERROR("journal %d", -1);
+  CHECK(logRing.waiting() == 3);
+  CHECK(logRing.drain(&global, 2) == 2);
+  CHECK(logRing.drain(&global, 100) == 1);
+  CHECK(global.text == "1234 I Card 04A1B2C3 (4 bytes)\n1234 W queue full\n1234 E journal -1\n");
+
+  // Long lines are cut and counted
+  std::string longText(300, 'x');
+  uint32_t truncated = logRing.stats().truncated;
+  LOG_INFO("%s", longText.c_str());
+  global.text.clear();
+  logRing.drain(&global, 100);
+  CHECK(global.text.size() == strlen("1234 I ") + LOG_LINE_MAX - 1 + 1);
+  CHECK(logRing.stats().truncated == truncated + 1);
+}
+
+static void testDropWhenFull() {
+  StringSink sink;
+  logRing.begin(NULL);
+  for (int i = 0; i < LOG_RING_SLOTS + 10; i++) {
+    LOG_INFO("line %d", i);
+  }
+  CHECK(logRing.waiting() == LOG_RING_SLOTS);
+  CHECK(logRing.stats().dropped == 10);
+
+  // The oldest lines survive, then one note for everything lost
+  CHECK(logRing.drain(&sink, 1000) == LOG_RING_SLOTS);
+  CHECK(sink.text.find("0 I line 0\n") == 0);
+  CHECK(sink.text.find("-- 10 log lines dropped\n") != std::string::npos);
+  sink.text.clear();
+  logRing.drain(&sink, 1000);
+  CHECK(sink.text.empty());
+
+  // Room again once drained
+  LOG_INFO("after");
+  CHECK(logRing.drain(&sink, 1000) == 1);
+}
+
+static int evaluated = 0;
+static int sideEffect() { return ++evaluated; }
+
+#undef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_WARN
+
+static void logAtWarn() {
+  LOG_DEBUG("debug %d", sideEffect());
+  LOG_INFO("info %d", sideEffect());
+  LOG_WARN("warn %d", sideEffect());
+  LOG_ERROR("error %d", sideEffect());
+}
+
+static void testLevels() {
+  StringSink sink;
+  logRing.drain(&sink, 1000);
+  sink.text.clear();
+  uint32_t written = logRing.stats().written;
+  evaluated = 0;
+  logAtWarn();
+  CHECK(evaluated == 2);  // DEBUG and INFO arguments never ran
+  CHECK(logRing.stats().written == written + 2);
+  logRing.drain(&sink, 1000);
+  CHECK(sink.text == "0 W warn 1\n0 E error 2\n");
+}
+
+static void testConcurrent() {
+  const int producers = 4;
+  const int perProducer = 50000;
+  LogRing ring;
+  std::atomic<bool> done(false);
+  std::vector<int> lastSeen(producers, -1);
+  int received = 0;
+  bool ordered = true;
+
+  class ParseSink : public LogSink {
+  public:
+    std::vector<int>* lastSeen;
+    int* received;
+    bool* ordered;
+    void write(const uint8_t* data, size_t len) override {
+      std::string line((const char*)data, len);
+      int producer, n;
+      if (sscanf(line.c_str(), "0 I p%d n%d", &producer, &n) != 2) return;
+      if (n <= (*lastSeen)[producer]) *ordered = false;
+      (*lastSeen)[producer] = n;
+      (*received)++;
+    }
+  } sink;
+  sink.lastSeen = &lastSeen;
+  sink.received = &received;
+  sink.ordered = &ordered;
+
+  std::thread drainer([&]() {
+    while (!done) {
+      if (ring.drain(&sink, 64) == 0) std::this_thread::yield();
+    }
+    while (ring.drain(&sink, 64) > 0) {}
+  });
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.push_back(std::thread([&ring, p, perProducer]() {
+      for (int n = 0; n < perProducer; n++) {
+        ringPrint(ring, "p%d n%d", p, n);
+        // Tasks log in bursts between blocking on something else
+        if (n % 16 == 15) std::this_thread::yield();
+      }
+    }));
+  }
+  for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+  done = true;
+  drainer.join();
+
+  LogStats stats = ring.stats();
+  CHECK(ordered);
+  CHECK((int)stats.written == received);
+  CHECK(stats.written + stats.dropped == (uint32_t)(producers * perProducer));
+  printf("  %d threads x %d lines: %u delivered in order, %u dropped\n", producers, perProducer,
+         stats.written, stats.dropped);
+}
+
+// The lines one tap logs in the firmware: a card the door doesn't know,
+// looked up on the server over JSON, then granted and journaled
+struct Tap {
+  const char* uid;
+  const char* name;
+  const char* request;
+  const char* response;
+  uint32_t seq;
+};
+
+#define TAP_LOGS(t) \
+  LOG_INFO("RFID Card detected: %s (%u bytes)", t.uid, 4u); \
+  LOG_DEBUG("Checking card on server..."); \
+  LOG_DEBUG("Sending RFID verification request: %s", t.request); \
+  LOG_DEBUG("Server response code: %d", 200); \
+  LOG_DEBUG("Server response: %s", t.response); \
+  LOG_DEBUG("User info cached locally: %s", t.name); \
+  LOG_DEBUG("Server verdict after %lu ms%s", 180ul, ", finger already captured"); \
+  LOG_DEBUG("Fingerprint matches template %u, score %u", 17u, 143u); \
+  LOG_INFO("ACCESS GRANTED: %s, card %s, fingerprint slot %d", t.name, t.uid, 17); \
+  LOG_DEBUG("Tap to unlock: %lu ms", 412ul); \
+  LOG_INFO("Attendance logged locally: %s (seq %lu)", t.name, (unsigned long)t.seq); \
+  LOG_DEBUG("Sending %u attendance records (%u bytes, binary)", 1u, 36u); \
+  LOG_DEBUG("Attendance batch accepted up to seq %lu", (unsigned long)t.seq);
+
+#undef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+static void tapAtDebug(const Tap& t) { TAP_LOGS(t) }
+
+#undef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+static void tapAtInfo(const Tap& t) { TAP_LOGS(t) }
+
+#undef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_OFF
+static void tapAtOff(const Tap& t) { TAP_LOGS(t) }
+
+// Bytes the old firmware printed for the same tap: each line through
+// Serial.println(), so the same text plus "\r\n" and no prefix
+static size_t syncTapBytes(const Tap& t) {
+  StringSink sink;
+  logRing.drain(&sink, 1000);
+  sink.text.clear();
+  uint32_t before = logRing.stats().written;
+  tapAtDebug(t);
+  size_t lines = logRing.stats().written - before;
+  logRing.drain(&sink, 1000);
+  // Drop the "0 X " prefix; '\n' becomes "\r\n"
+  return sink.text.size() - lines * strlen("0 X ") + lines;
+}
+
+struct Latency {
+  double p50, p99, max;
+};
+
+static Latency measure(void (*tap)(const Tap&), const Tap& t, int taps, int intervalMs,
+                       uint32_t* dropped) {
+  UartSink uart;
+  std::atomic<bool> done(false);
+  std::thread drainer([&]() {
+    while (!done) {
+      if (logRing.drain(&uart, 8) == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  uint32_t droppedBefore = logRing.stats().dropped;
+  std::vector<double> us;
+  for (int i = 0; i < taps; i++) {
+    Clock::time_point start = Clock::now();
+    tap(t);
+    us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    // Taps come seconds apart at a door; the interval only has to let the
+    // drain empty the ring
+    std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+  }
+  done = true;
+  drainer.join();
+  StringSink rest;
+  logRing.drain(&rest, 1000);
+  *dropped = logRing.stats().dropped - droppedBefore;
+
+  std::sort(us.begin(), us.end());
+  Latency lat = {us[us.size() / 2], us[us.size() * 99 / 100], us.back()};
+  return lat;
+}
+
+static void reportTapLatency() {
+  Tap t;
+  t.uid = "04A1B2C3";
+  t.name = "Adaeze Okonkwo-Bello";
+  t.request = "{\"rfid_uid\":\"04A1B2C3\"}";
+  t.response = "{\"success\":true,\"student_name\":\"Adaeze Okonkwo-Bello\",\"user_id\":"
+               "\"user_000123\",\"role\":\"student\",\"fingerprint_slot\":17,\"message\":"
+               "\"Card verified\"}";
+  t.seq = 48213;
+
+  size_t bytes = syncTapBytes(t);
+  double syncMs = bytes > UART_FIFO_BYTES ? (bytes - UART_FIFO_BYTES) * UART_US_PER_BYTE / 1000 : 0;
+  printf("  Serial.println at 115200: %zu bytes per tap, %.1f ms blocked (modeled)\n", bytes, syncMs);
+
+  const int taps = 40;
+  struct Run {
+    const char* name;
+    void (*tap)(const Tap&);
+    int intervalMs;
+  } runs[] = {{"DEBUG", tapAtDebug, 100}, {"INFO", tapAtInfo, 20}, {"OFF", tapAtOff, 5}};
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    uint32_t before = logRing.stats().written;
+    uint32_t dropped = 0;
+    Latency lat = measure(runs[i].tap, t, taps, runs[i].intervalMs, &dropped);
+    uint32_t lines = (logRing.stats().written - before) / taps;
+    printf("  ring at %-5s %2u lines per tap: p50 %6.2f us, p99 %6.2f us, max %6.2f us, %u dropped\n",
+           runs[i].name, lines, lat.p50, lat.p99, lat.max, dropped);
+    CHECK(dropped == 0);
+    // Microseconds against the milliseconds the UART used to cost
+    CHECK(lat.p50 < syncMs * 1000 / 100);
+    if (runs[i].tap == tapAtOff) CHECK(lines == 0);
+  }
+}
+
+int main() {
+  printf("Format\n");
+  testFormat();
+  printf("Full ring\n");
+  testDropWhenFull();
+  printf("Levels\n");
+  testLevels();
+  printf("Concurrent producers\n");
+  testConcurrent();
+  printf("Per-tap logging latency\n");
+  reportTapLatency();
+
+  if (failures == 0) {
+    printf("All log ring tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
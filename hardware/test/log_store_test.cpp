@@ -0,0 +1,884 @@
+/*
+ * Host-side test for the log-structured store
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -I. test/log_store_test.cpp log_store.cpp card_index.cpp -o log_store_test
+ *   ./log_store_test
+ *
+ * Runs the store on simulated NOR flash that only clears bits and can lose
+ * power after any byte. Checks replay, compaction keeping only the newest
+ * record per key, recovery from a power cut at every stage of a write or
+ * a compaction, and that erases spread across the partition. Then replays
+ * a month of door traffic through models of the journal and the learned
+ * card log and reports write amplification and lookup cost next to what
+ * the SPIFFS files cost.
+ */
+
+#include "log_store.h"
+#include "card_index.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+#define SEGMENT       LOG_STORE_SEGMENT_BYTES
+#define ERASE_COST    64  // Bytes of the power budget an erase takes
+#define NO_ADDR       0xFFFFFFFF
+
+static uint32_t rngState = 12345;
+static uint32_t rng() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+// NOR flash in RAM. With a budget set, power fails once that many bytes
+// have been programmed: the write in progress stops partway, an erase in
+// progress leaves half the sector as it was, and nothing works until
+// powerOn().
+class MemFlash : public LogStoreFlash {
+public:
+  std::vector<uint8_t> data;
+  std::vector<uint32_t> erases;
+  uint64_t bytesRead = 0;
+  uint64_t bytesWritten = 0;
+  uint32_t violations = 0;  // Writes that tried to set a bit
+  int64_t budget = -1;      // -1: power never fails
+  bool dead = false;
+
+  explicit MemFlash(size_t segments) : data(segments * SEGMENT, 0xFF), erases(segments, 0) {}
+
+  void powerOn() {
+    dead = false;
+    budget = -1;
+  }
+
+  size_t size() override { return data.size(); }
+
+  bool read(uint32_t addr, void* buf, size_t len) override {
+    if (dead || addr + len > data.size()) return false;
+    memcpy(buf, &data[addr], len);
+    bytesRead += len;
+    return true;
+  }
+
+  bool write(uint32_t addr, const void* buf, size_t len) override {
+    if (dead || addr + len > data.size()) return false;
+    size_t n = len;
+    if (budget >= 0 && (int64_t)len > budget) {
+      n = (size_t)budget;
+      dead = true;
+    }
+    const uint8_t* src = (const uint8_t*)buf;
+    for (size_t i = 0; i < n; i++) {
+      if (src[i] & ~data[addr + i]) violations++;
+      data[addr + i] &= src[i];
+    }
+    if (budget >= 0) budget -= (int64_t)n;
+    bytesWritten += n;
+    return !dead;
+  }
+
+  bool erase(uint32_t addr, size_t len) override {
+    if (dead || addr % SEGMENT != 0 || len % SEGMENT != 0 || addr + len > data.size()) return false;
+    if (budget >= 0 && budget < ERASE_COST) {
+      memset(&data[addr], 0xFF, len / 2);
+      dead = true;
+      return false;
+    }
+    if (budget >= 0) budget -= ERASE_COST;
+    memset(&data[addr], 0xFF, len);
+    for (size_t s = 0; s < len / SEGMENT; s++) erases[addr / SEGMENT + s]++;
+    return true;
+  }
+};
+
+// Keyed records where the newest version of a key wins, as the learned
+// card log uses them
+#define KV_TYPE  1
+
+struct KvRecord {
+  uint16_t key;
+  uint16_t reserved;
+  uint32_t version;
+  uint8_t fill[LOG_STORE_RECORD_MAX - 8];
+};
+
+class KvClient : public LogStoreClient {
+public:
+  struct Slot {
+    uint32_t version;
+    uint32_t addr;
+    uint16_t len;
+  };
+
+  LogStore store;
+  std::map<uint16_t, Slot> keys;
+  uint32_t regressions = 0;  // Replay saw a key go back in time
+  uint32_t corrupt = 0;
+
+  bool begin(MemFlash* flash) {
+    keys.clear();
+    return store.begin(flash, this);
+  }
+
+  bool put(uint16_t key, uint32_t version, uint16_t len) {
+    KvRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.key = key;
+    rec.version = version;
+    for (size_t i = 0; i < sizeof(rec.fill); i++) rec.fill[i] = (uint8_t)(key + version + i);
+    uint32_t addr;
+    if (!store.append(KV_TYPE, &rec, len, &addr)) return false;
+    set(key, version, addr, len);
+    return true;
+  }
+
+  uint32_t version(uint16_t key) const {
+    std::map<uint16_t, Slot>::const_iterator it = keys.find(key);
+    return it != keys.end() ? it->second.version : 0;
+  }
+
+  void replay(const LogEntry& entry) override {
+    KvRecord rec;
+    memcpy(&rec, entry.payload, sizeof(rec));
+    for (size_t i = 8; i < entry.len; i++) {
+      if (rec.fill[i - 8] != (uint8_t)(rec.key + rec.version + i - 8)) corrupt++;
+    }
+    if (version(rec.key) > rec.version) {
+      regressions++;
+      store.retire(entry.addr, LogStore::recordBytes(entry.len));
+      return;
+    }
+    set(rec.key, rec.version, entry.addr, entry.len);
+  }
+
+  bool live(const LogEntry& entry) override {
+    uint16_t key;
+    memcpy(&key, entry.payload, sizeof(key));
+    std::map<uint16_t, Slot>::const_iterator it = keys.find(key);
+    return it != keys.end() && it->second.addr == entry.addr;
+  }
+
+  void moved(const LogEntry& entry, uint32_t to) override {
+    uint16_t key;
+    memcpy(&key, entry.payload, sizeof(key));
+    keys[key].addr = to;
+  }
+
+private:
+  void set(uint16_t key, uint32_t version, uint32_t addr, uint16_t len) {
+    std::map<uint16_t, Slot>::iterator it = keys.find(key);
+    if (it != keys.end()) store.retire(it->second.addr, LogStore::recordBytes(it->second.len));
+    Slot slot = {version, addr, len};
+    keys[key] = slot;
+  }
+};
+
+static void testCrc() {
+  CHECK(logStoreCrc(0, "123456789", 9) == 0xCBF43926);
+  uint32_t split = logStoreCrc(logStoreCrc(0, "1234", 4), "56789", 5);
+  CHECK(split == 0xCBF43926);
+  CHECK(LogStore::recordBytes(0) == 8);
+  CHECK(LogStore::recordBytes(1) == 12);
+  CHECK(LogStore::recordBytes(64) == 72);
+}
+
+static void testReplay() {
+  MemFlash flash(8);
+  KvClient kv;
+  CHECK(kv.begin(&flash));
+  CHECK(kv.store.freeSegments() == 8);
+  CHECK(flash.erases[0] == 0);  // A blank partition is formatted without erasing
+
+  for (uint16_t key = 0; key < 40; key++) CHECK(kv.put(key, 1, 16 + key));
+  for (uint16_t key = 0; key < 40; key += 2) CHECK(kv.put(key, 2, 100));
+  CHECK(!kv.put(1, 3, LOG_STORE_RECORD_MAX + 1));
+
+  LogEntry entry;
+  CHECK(kv.store.read(kv.keys[3].addr, &entry));
+  CHECK(entry.type == KV_TYPE && entry.len == 19);
+  CHECK(!kv.store.read(0, &entry));  // Segment header, not a record
+
+  KvClient again;
+  CHECK(again.begin(&flash));
+  CHECK(again.keys.size() == 40);
+  for (uint16_t key = 0; key < 40; key++) CHECK(again.version(key) == (key % 2 == 0 ? 2u : 1u));
+  CHECK(again.regressions == 0 && again.corrupt == 0);
+  CHECK(again.store.liveBytes() == kv.store.liveBytes());
+  CHECK(again.store.stats().tornRecords == 0);
+
+  // Appends continue where the last boot left off
+  CHECK(again.put(7, 5, 10));
+  KvClient third;
+  CHECK(third.begin(&flash));
+  CHECK(third.version(7) == 5);
+  CHECK(flash.violations == 0);
+
+  // Someone else's data is formatted, not replayed
+  MemFlash foreign(4);
+  memset(&foreign.data[0], 0x5A, 100);
+  KvClient fresh;
+  CHECK(fresh.begin(&foreign));
+  CHECK(fresh.keys.empty() && fresh.store.freeSegments() == 4);
+  CHECK(foreign.erases[0] == 1 && foreign.erases[1] == 0);
+}
+
+// Hot keys rewritten over and over in a small partition
+static void testCompaction() {
+  MemFlash flash(8);
+  KvClient kv;
+  CHECK(kv.begin(&flash));
+
+  uint32_t versions[30] = {0};
+  bool ok = true;
+  for (int i = 0; i < 20000 && ok; i++) {
+    uint16_t key = (uint16_t)(rng() % 30);
+    ok = kv.put(key, ++versions[key], (uint16_t)(16 + rng() % 100));
+    if (i % 3 == 0) kv.store.compact();
+  }
+  CHECK(ok);
+  CHECK(kv.store.stats().full == 0);
+  CHECK(kv.store.stats().compactions > 0);
+  CHECK(kv.store.freeSegments() >= LOG_STORE_RESERVE);
+  CHECK(kv.store.liveBytes() <= kv.store.capacityBytes());
+
+  KvClient again;
+  CHECK(again.begin(&flash));
+  bool same = again.keys.size() == 30;
+  for (uint16_t key = 0; key < 30; key++) same = same && again.version(key) == versions[key];
+  CHECK(same);
+  CHECK(again.regressions == 0 && again.corrupt == 0);
+  CHECK(flash.violations == 0);
+
+  // Live data beyond the partition is refused, not corrupted
+  MemFlash tiny(3);
+  KvClient full;
+  CHECK(full.begin(&tiny));
+  uint16_t stored = 0;
+  while (full.put(stored, 1, LOG_STORE_RECORD_MAX)) stored++;
+  CHECK(stored > 40 && full.store.stats().full == 1);
+  KvClient reread;
+  CHECK(reread.begin(&tiny));
+  CHECK(reread.keys.size() == stored);
+}
+
+// Lose power after every possible number of programmed bytes, in a
+// workload busy enough to compact, and every key must come back as its
+// last acknowledged version or the one being written
+static void testPowerCuts() {
+  const int ops = 1500;
+  const uint16_t keySpace = 24;
+
+  // Bytes the whole workload programs, to spread the cuts over
+  int64_t total;
+  {
+    MemFlash flash(6);
+    KvClient kv;
+    kv.begin(&flash);
+    rngState = 777;
+    uint32_t v = 0;
+    for (int i = 0; i < ops; i++) {
+      kv.put((uint16_t)(rng() % keySpace), ++v, (uint16_t)(8 + rng() % 80));
+      if (i % 5 == 0) kv.store.compact();
+    }
+    total = (int64_t)flash.bytesWritten + (int64_t)flash.erases.size() * ERASE_COST;
+    CHECK(kv.store.stats().compactions > 10);
+  }
+
+  uint32_t cuts = 0, midCompaction = 0, torn = 0, bad = 0;
+  for (int64_t budget = 1; budget < total; budget += 1 + budget / 97) {
+    MemFlash flash(6);
+    std::map<uint16_t, uint32_t> committed;
+    uint16_t inflightKey = 0;
+    uint32_t inflightVersion = 0;
+    {
+      KvClient kv;
+      kv.begin(&flash);
+      flash.budget = budget;
+      rngState = 777;
+      uint32_t v = 0;
+      for (int i = 0; i < ops && !flash.dead; i++) {
+        inflightKey = (uint16_t)(rng() % keySpace);
+        inflightVersion = ++v;
+        uint32_t compactions = kv.store.stats().compactions;
+        if (!kv.put(inflightKey, inflightVersion, (uint16_t)(8 + rng() % 80))) {
+          if (kv.store.stats().compactions != compactions || kv.store.freeSegments() <= 1) midCompaction++;
+          break;
+        }
+        committed[inflightKey] = inflightVersion;
+        inflightVersion = 0;
+        if (i % 5 == 0 && !kv.store.compact() && flash.dead) {
+          midCompaction++;
+          break;
+        }
+      }
+    }
+    cuts++;
+    flash.powerOn();
+
+    KvClient kv;
+    if (!kv.begin(&flash)) {
+      bad++;
+      continue;
+    }
+    torn += kv.store.stats().tornRecords;
+    bool ok = kv.regressions == 0 && kv.corrupt == 0;
+    for (uint16_t key = 0; key < keySpace; key++) {
+      uint32_t got = kv.version(key);
+      uint32_t want = committed.count(key) ? committed[key] : 0;
+      if (got != want && !(key == inflightKey && got == inflightVersion && inflightVersion != 0)) ok = false;
+    }
+    // And carries on: one more write, still there after another boot
+    ok = ok && kv.put(0, 1000000, 40);
+    KvClient after;
+    ok = ok && after.begin(&flash) && after.version(0) == 1000000 && after.regressions == 0;
+    if (!ok) bad++;
+    if (flash.violations != 0) bad++;
+  }
+  printf("  %lu power cuts, %lu during compaction, %lu torn records found, %lu lost or corrupted\n",
+         (unsigned long)cuts, (unsigned long)midCompaction, (unsigned long)torn, (unsigned long)bad);
+  CHECK(cuts > 500);
+  CHECK(midCompaction > 0);
+  CHECK(torn > 0);
+  CHECK(bad == 0);
+}
+
+// Cold keys written once must not pin their sectors while hot ones churn
+static void testWear() {
+  MemFlash flash(16);
+  KvClient kv;
+  CHECK(kv.begin(&flash));
+  for (uint16_t key = 1000; key < 1060; key++) CHECK(kv.put(key, 1, LOG_STORE_RECORD_MAX));
+
+  uint32_t versions[8] = {0};
+  for (int i = 0; i < 300000; i++) {
+    uint16_t key = (uint16_t)(rng() % 8);
+    kv.put(key, ++versions[key], 120);
+    kv.store.compact();
+  }
+  uint32_t lo, hi;
+  kv.store.wear(&lo, &hi);
+  uint32_t flashLo = flash.erases[0], flashHi = flash.erases[0];
+  for (size_t i = 1; i < flash.erases.size(); i++) {
+    if (flash.erases[i] < flashLo) flashLo = flash.erases[i];
+    if (flash.erases[i] > flashHi) flashHi = flash.erases[i];
+  }
+  printf("  %lu erases, per sector %lu..%lu\n", (unsigned long)kv.store.stats().erases,
+         (unsigned long)flashLo, (unsigned long)flashHi);
+  CHECK(lo == flashLo && hi == flashHi);
+  CHECK(hi > 5 * LOG_STORE_WEAR_SPREAD);
+  CHECK(hi - lo <= 2 * LOG_STORE_WEAR_SPREAD);
+
+  KvClient again;
+  CHECK(again.begin(&flash));
+  bool cold = true;
+  for (uint16_t key = 1000; key < 1060; key++) cold = cold && again.version(key) == 1;
+  CHECK(cold);
+}
+
+// A month at one door: 400 taps a day, uploaded one by one while online
+// and in batches of 32 after a six-hour outage each week; four cards a
+// day learned from the server and folded into the index by the nightly
+// allowlist sync; a reboot every week
+#define MONTH_DAYS          30
+#define TAPS_PER_DAY        400
+#define OUTAGE_TAPS         150
+#define LEARNED_PER_DAY     4
+#define INDEX_CARDS         500
+#define JOURNAL_SEGMENTS    96   // 384 KB partition
+#define CARD_LOG_SEGMENTS   32   // 128 KB partition
+#define LEARNED_MAX         128
+#define UPLOAD_BATCH        32
+
+#define EVENT_TYPE   1
+#define ACK_TYPE     2
+#define EVENT_BYTES  64  // sizeof(JournalRecord)
+
+// The journal's bookkeeping: events are live until acknowledged
+class JournalModel : public LogStoreClient {
+public:
+  struct Span {
+    uint32_t minSeq;
+    uint32_t maxSeq;
+    uint32_t bytes;  // Event bytes not yet retired
+  };
+
+  LogStore store;
+  Span spans[LOG_STORE_MAX_SEGMENTS];
+  uint32_t nextSeq, acked, ackAddr, dropped, acks;
+
+  bool begin(MemFlash* flash) {
+    memset(spans, 0, sizeof(spans));
+    nextSeq = 1;
+    acked = 0;
+    ackAddr = NO_ADDR;
+    dropped = 0;
+    acks = 0;
+    if (!store.begin(flash, this)) return false;
+    retireAcked();
+    return true;
+  }
+
+  bool append() {
+    uint8_t rec[EVENT_BYTES];
+    memset(rec, 0x42, sizeof(rec));
+    memcpy(rec, &nextSeq, sizeof(nextSeq));
+    uint32_t addr;
+    while (!store.append(EVENT_TYPE, rec, sizeof(rec), &addr)) {
+      if (!dropOldest()) return false;
+    }
+    note(addr, nextSeq);
+    nextSeq++;
+    return true;
+  }
+
+  void ack(uint32_t seq) {
+    if (seq <= acked) return;
+    acked = seq;
+    retireAcked();
+    uint32_t addr;
+    if (store.append(ACK_TYPE, &acked, sizeof(acked), &addr)) {
+      if (ackAddr != NO_ADDR) store.retire(ackAddr, LogStore::recordBytes(sizeof(acked)));
+      ackAddr = addr;
+    }
+    acks++;
+  }
+
+  // The max lowest unacknowledged sequence numbers from fromSeq, walking
+  // segments by their lowest sequence number
+  size_t read(uint32_t fromSeq, uint32_t* out, size_t max) {
+    uint16_t order[LOG_STORE_MAX_SEGMENTS];
+    uint16_t n = 0;
+    for (uint16_t s = 0; s < store.segmentCount(); s++) {
+      if (spans[s].bytes == 0 || spans[s].maxSeq < fromSeq) continue;
+      uint16_t at = n++;
+      while (at > 0 && spans[order[at - 1]].minSeq > spans[s].minSeq) {
+        order[at] = order[at - 1];
+        at--;
+      }
+      order[at] = s;
+    }
+
+    size_t count = 0;
+    LogEntry entry;
+    for (uint16_t i = 0; i < n; i++) {
+      if (count == max && spans[order[i]].minSeq > out[count - 1]) break;
+      uint32_t offset = 0;
+      while (store.next(order[i], &offset, &entry)) {
+        uint32_t seq;
+        memcpy(&seq, entry.payload, sizeof(seq));
+        if (entry.type != EVENT_TYPE || seq < fromSeq) continue;
+        size_t at = count;
+        while (at > 0 && out[at - 1] > seq) at--;
+        if ((at > 0 && out[at - 1] == seq) || at == max) continue;
+        if (count < max) count++;
+        memmove(&out[at + 1], &out[at], (count - 1 - at) * sizeof(out[0]));
+        out[at] = seq;
+      }
+    }
+    return count;
+  }
+
+  void replay(const LogEntry& entry) override {
+    uint32_t value;
+    memcpy(&value, entry.payload, sizeof(value));
+    if (entry.type == EVENT_TYPE) {
+      note(entry.addr, value);
+      if (value >= nextSeq) nextSeq = value + 1;
+    } else if (value > acked) {
+      if (ackAddr != NO_ADDR) store.retire(ackAddr, LogStore::recordBytes(entry.len));
+      acked = value;
+      ackAddr = entry.addr;
+    } else {
+      store.retire(entry.addr, LogStore::recordBytes(entry.len));
+    }
+  }
+
+  bool live(const LogEntry& entry) override {
+    uint32_t value;
+    memcpy(&value, entry.payload, sizeof(value));
+    return entry.type == EVENT_TYPE ? value > acked : entry.addr == ackAddr;
+  }
+
+  void moved(const LogEntry& entry, uint32_t to) override {
+    uint32_t value;
+    memcpy(&value, entry.payload, sizeof(value));
+    if (entry.type == EVENT_TYPE) {
+      note(to, value);
+    } else {
+      ackAddr = to;
+    }
+  }
+
+  void erased(uint16_t segment) override {
+    memset(&spans[segment], 0, sizeof(spans[segment]));
+  }
+
+private:
+  void note(uint32_t addr, uint32_t seq) {
+    Span& span = spans[LogStore::segmentOf(addr)];
+    if (span.bytes == 0 || seq < span.minSeq) span.minSeq = seq;
+    if (span.bytes == 0 || seq > span.maxSeq) span.maxSeq = seq;
+    span.bytes += LogStore::recordBytes(EVENT_BYTES);
+  }
+
+  void retireAcked() {
+    for (uint16_t s = 0; s < store.segmentCount(); s++) {
+      if (spans[s].bytes == 0 || spans[s].maxSeq > acked) continue;
+      store.retire((uint32_t)s * SEGMENT, spans[s].bytes);
+      spans[s].bytes = 0;
+    }
+  }
+
+  bool dropOldest() {
+    int oldest = -1;
+    for (uint16_t s = 0; s < store.segmentCount(); s++) {
+      if (spans[s].bytes == 0) continue;
+      if (oldest < 0 || spans[s].minSeq < spans[oldest].minSeq) oldest = s;
+    }
+    if (oldest < 0) return false;
+    dropped += spans[oldest].maxSeq - acked;
+    ack(spans[oldest].maxSeq);
+    return true;
+  }
+};
+
+// Cards learned from the server since the last index rewrite. An epoch
+// record marks a fold into the index; puts from earlier epochs are dead.
+#define CARD_PUT_TYPE    1
+#define CARD_EPOCH_TYPE  2
+
+struct CardPut {
+  uint32_t epoch;
+  CardRecord rec;
+};
+
+class CardModel : public LogStoreClient {
+public:
+  struct Learned {
+    uint8_t uid[CARD_UID_MAX_LEN];
+    uint8_t uidLen;
+    uint32_t addr;
+  };
+
+  LogStore store;
+  Learned learned[LEARNED_MAX];
+  size_t count;
+  uint32_t epoch, epochAddr, folds;
+
+  bool begin(MemFlash* flash) {
+    count = 0;
+    epoch = 0;
+    epochAddr = NO_ADDR;
+    folds = 0;
+    return store.begin(flash, this);
+  }
+
+  bool save(const CardRecord& rec) {
+    if (count == LEARNED_MAX && find(rec.uid, rec.uidLen) < 0) fold();
+    CardPut put;
+    put.epoch = epoch;
+    put.rec = rec;
+    uint32_t addr;
+    if (!store.append(CARD_PUT_TYPE, &put, sizeof(put), &addr)) return false;
+    set(rec.uid, rec.uidLen, addr);
+    return true;
+  }
+
+  // The index was rewritten with every learned card in it
+  void fold() {
+    uint32_t next = epoch + 1;
+    uint32_t addr;
+    if (!store.append(CARD_EPOCH_TYPE, &next, sizeof(next), &addr)) return;
+    advance(next);
+    if (epochAddr != NO_ADDR) store.retire(epochAddr, LogStore::recordBytes(sizeof(next)));
+    epochAddr = addr;
+    folds++;
+  }
+
+  int find(const uint8_t* uid, uint8_t uidLen) const {
+    for (size_t i = 0; i < count; i++) {
+      if (learned[i].uidLen == uidLen && memcmp(learned[i].uid, uid, uidLen) == 0) return (int)i;
+    }
+    return -1;
+  }
+
+  void replay(const LogEntry& entry) override {
+    uint32_t value;
+    memcpy(&value, entry.payload, sizeof(value));
+    if (value < epoch) {
+      store.retire(entry.addr, LogStore::recordBytes(entry.len));
+      return;
+    }
+    if (value > epoch) advance(value);
+    if (entry.type == CARD_EPOCH_TYPE) {
+      if (epochAddr != NO_ADDR) store.retire(epochAddr, LogStore::recordBytes(entry.len));
+      epochAddr = entry.addr;
+    } else {
+      CardPut put;
+      memcpy(&put, entry.payload, sizeof(put));
+      set(put.rec.uid, put.rec.uidLen, entry.addr);
+    }
+  }
+
+  bool live(const LogEntry& entry) override {
+    if (entry.type == CARD_EPOCH_TYPE) return entry.addr == epochAddr;
+    CardPut put;
+    memcpy(&put, entry.payload, sizeof(put));
+    int i = find(put.rec.uid, put.rec.uidLen);
+    return put.epoch == epoch && i >= 0 && learned[i].addr == entry.addr;
+  }
+
+  void moved(const LogEntry& entry, uint32_t to) override {
+    if (entry.type == CARD_EPOCH_TYPE) {
+      epochAddr = to;
+      return;
+    }
+    CardPut put;
+    memcpy(&put, entry.payload, sizeof(put));
+    int i = find(put.rec.uid, put.rec.uidLen);
+    if (i >= 0) learned[i].addr = to;
+  }
+
+private:
+  void set(const uint8_t* uid, uint8_t uidLen, uint32_t addr) {
+    int i = find(uid, uidLen);
+    if (i >= 0) {
+      store.retire(learned[i].addr, LogStore::recordBytes(sizeof(CardPut)));
+    } else {
+      if (count == LEARNED_MAX) return;
+      i = (int)count++;
+      memcpy(learned[i].uid, uid, uidLen);
+      learned[i].uidLen = uidLen;
+    }
+    learned[i].addr = addr;
+  }
+
+  void advance(uint32_t to) {
+    for (size_t i = 0; i < count; i++) {
+      store.retire(learned[i].addr, LogStore::recordBytes(sizeof(CardPut)));
+    }
+    count = 0;
+    epoch = to;
+  }
+};
+
+// An index in RAM that counts what a lookup or a rewrite costs
+class MemIndex : public CardIndexSource, public CardIndexSink {
+public:
+  std::vector<uint8_t> bytes;
+  uint64_t bytesRead = 0;
+  uint32_t reads = 0;
+  uint64_t bytesWritten = 0;
+
+  size_t size() override { return bytes.size(); }
+  bool readAt(size_t offset, void* buf, size_t len) override {
+    if (offset + len > bytes.size()) return false;
+    memcpy(buf, &bytes[offset], len);
+    bytesRead += len;
+    reads++;
+    return true;
+  }
+  bool write(const void* buf, size_t len) override {
+    bytes.insert(bytes.end(), (const uint8_t*)buf, (const uint8_t*)buf + len);
+    bytesWritten += len;
+    return true;
+  }
+};
+
+static void makeCard(uint32_t n, CardRecord* rec) {
+  uint8_t uid[4] = {(uint8_t)(n >> 24), (uint8_t)(n >> 16), (uint8_t)(n >> 8), (uint8_t)n};
+  char name[24];
+  snprintf(name, sizeof(name), "Visitor %lu", (unsigned long)n);
+  cardRecordSet(rec, uid, sizeof(uid), name, "00000000-0000-4000-8000-000000000000",
+                CARD_ROLE_STUDENT);
+}
+
+static void monthOfTraffic() {
+  MemFlash journalFlash(JOURNAL_SEGMENTS);
+  MemFlash cardFlash(CARD_LOG_SEGMENTS);
+  JournalModel* journal = new JournalModel();
+  CardModel* cards = new CardModel();
+  CHECK(journal->begin(&journalFlash));
+  CHECK(cards->begin(&cardFlash));
+
+  // What the SPIFFS files were written with for the same traffic: each
+  // learned card rewrote the whole index, each ack rewrote the cursor
+  uint64_t spiffsJournalBytes = 0;
+  uint64_t spiffsCardBytes = 0;
+  uint32_t learnedCards = 0;
+  uint32_t maxBacklog = 0;
+  uint32_t reboots = 0;
+  uint64_t batchReadBytes = 0;
+  uint32_t batchReads = 0;
+  bool stateKept = true;
+
+  for (int day = 0; day < MONTH_DAYS; day++) {
+    cards->fold();
+    bool outageDay = day % 7 == 3;
+
+    for (int tap = 0; tap < TAPS_PER_DAY; tap++) {
+      CHECK(journal->append());
+      spiffsJournalBytes += EVENT_BYTES;
+
+      bool offline = outageDay && tap >= 100 && tap < 100 + OUTAGE_TAPS;
+      uint32_t backlog = journal->nextSeq - 1 - journal->acked;
+      if (backlog > maxBacklog) maxBacklog = backlog;
+      while (!offline && journal->acked + 1 < journal->nextSeq) {
+        uint32_t batch[UPLOAD_BATCH];
+        uint64_t before = journalFlash.bytesRead;
+        size_t got = journal->read(journal->acked + 1, batch, UPLOAD_BATCH);
+        if (got > 1) {
+          batchReadBytes += journalFlash.bytesRead - before;
+          batchReads++;
+        }
+        if (got == 0) break;
+        journal->ack(batch[got - 1]);
+        char cursor[12];
+        spiffsJournalBytes += snprintf(cursor, sizeof(cursor), "%lu", (unsigned long)journal->acked);
+      }
+
+      if (tap % (TAPS_PER_DAY / LEARNED_PER_DAY) == 50) {
+        CardRecord rec;
+        makeCard(0x10000000 + learnedCards, &rec);
+        CHECK(cards->save(rec));
+        learnedCards++;
+        spiffsCardBytes += CARD_INDEX_HEADER_SIZE + (uint64_t)(INDEX_CARDS + learnedCards) * CARD_RECORD_SIZE;
+      }
+
+      journal->store.compact();
+      cards->store.compact();
+    }
+
+    // Weekly reboot mid-day: everything comes back from flash
+    if (day % 7 == 6) {
+      uint32_t nextSeq = journal->nextSeq, acked = journal->acked;
+      size_t learned = cards->count;
+      uint32_t epoch = cards->epoch;
+      JournalModel* j = new JournalModel();
+      CardModel* c = new CardModel();
+      stateKept = stateKept && j->begin(&journalFlash) && c->begin(&cardFlash);
+      stateKept = stateKept && j->nextSeq == nextSeq && j->acked == acked;
+      stateKept = stateKept && c->count == learned && c->epoch == epoch;
+      delete journal;
+      delete cards;
+      journal = j;
+      cards = c;
+      reboots++;
+    }
+  }
+  CHECK(stateKept);
+  CHECK(journal->dropped == 0);
+  CHECK(journal->acked + 1 == journal->nextSeq);
+
+  const LogStoreStats& js = journal->store.stats();
+  uint32_t events = MONTH_DAYS * TAPS_PER_DAY;
+  // Reboots restart the counters; the flash's own count covers the month
+  double journalWa = (double)journalFlash.bytesWritten / ((double)events * EVENT_BYTES);
+  double cardWa = (double)cardFlash.bytesWritten / ((double)learnedCards * CARD_RECORD_SIZE);
+  uint32_t jlo, jhi, clo, chi;
+  journal->store.wear(&jlo, &jhi);
+  cards->store.wear(&clo, &chi);
+
+  printf("  %d days, %lu events, %lu learned cards, %lu reboots, backlog peaked at %lu\n",
+         MONTH_DAYS, (unsigned long)events, (unsigned long)learnedCards, (unsigned long)reboots,
+         (unsigned long)maxBacklog);
+  printf("  journal: %.0f KB of events, %.0f KB programmed: write amplification %.2f "
+         "(%.2f in the last week: %lu copies)\n",
+         events * EVENT_BYTES / 1024.0, journalFlash.bytesWritten / 1024.0, journalWa,
+         (double)js.flashBytes / (double)(js.payloadBytes > 0 ? js.payloadBytes : 1),
+         (unsigned long)js.copies);
+  printf("           erases per sector %lu..%lu; SPIFFS files wrote %.0f KB\n", (unsigned long)jlo,
+         (unsigned long)jhi, spiffsJournalBytes / 1024.0);
+  printf("  cards:   %.1f KB of records, %.1f KB programmed: write amplification %.2f; "
+         "erases per sector %lu..%lu\n",
+         learnedCards * CARD_RECORD_SIZE / 1024.0, cardFlash.bytesWritten / 1024.0, cardWa,
+         (unsigned long)clo, (unsigned long)chi);
+  printf("           index rewrite per card wrote %.0f KB: %.0fx more\n", spiffsCardBytes / 1024.0,
+         (double)spiffsCardBytes / (double)cardFlash.bytesWritten);
+
+  CHECK(journalWa < 1.6);
+  CHECK(journalFlash.bytesWritten < spiffsJournalBytes * 2);
+  CHECK(cardFlash.bytesWritten * 100 < spiffsCardBytes);
+  CHECK(journalFlash.violations == 0 && cardFlash.violations == 0);
+
+  // Upload after an outage: what reading one batch costs
+  CHECK(batchReads > 0);
+  printf("  upload batch of %d: %.1f KB read from the journal\n", UPLOAD_BATCH,
+         batchReads > 0 ? batchReadBytes / 1024.0 / batchReads : 0.0);
+  CHECK(batchReads == 0 || batchReadBytes / batchReads < 3 * SEGMENT);
+
+  // Lookup of a learned card: one record read, against a binary search of
+  // the SPIFFS index holding the same cards
+  MemIndex index;
+  std::vector<CardRecord> all(INDEX_CARDS + learnedCards);
+  for (size_t i = 0; i < all.size(); i++) {
+    makeCard(i < INDEX_CARDS ? 0x01000000 + i * 7919 : 0x10000000 + (i - INDEX_CARDS), &all[i]);
+  }
+  cardRecordSort(&all[0], all.size());
+  CHECK(cardIndexWrite(index, &all[0], all.size()));
+
+  const int lookups = 100000;
+  uint64_t logBytes = 0;
+  bool found = true;
+  LogEntry entry;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < lookups; i++) {
+    const CardModel::Learned& card = cards->learned[i % cards->count];
+    uint64_t before = cardFlash.bytesRead;
+    found = found && cards->store.read(card.addr, &entry);
+    logBytes += cardFlash.bytesRead - before;
+  }
+  double logNs = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / lookups;
+
+  // On the device each index read is a SPIFFS seek and read; on the host
+  // only the count means anything
+  CardRecord rec;
+  uint64_t indexBytes = index.bytesRead;
+  uint32_t indexReads = index.reads;
+  for (int i = 0; i < lookups; i++) {
+    const CardModel::Learned& card = cards->learned[i % cards->count];
+    found = found && cardIndexFind(index, card.uid, card.uidLen, &rec);
+  }
+  CHECK(found);
+  printf("  learned card lookup: %.0f bytes in 2 reads, CRC checked, %.0f ns on the host\n",
+         (double)logBytes / lookups, logNs);
+  printf("  index of %lu cards:   %.0f bytes in %.1f reads\n", (unsigned long)all.size(),
+         (double)(index.bytesRead - indexBytes) / lookups, (double)(index.reads - indexReads) / lookups);
+  CHECK(logBytes / lookups <= LogStore::recordBytes(sizeof(CardPut)));
+
+  delete journal;
+  delete cards;
+}
+
+int main() {
+  printf("CRC and sizes\n");
+  testCrc();
+  printf("Replay\n");
+  testReplay();
+  printf("Compaction\n");
+  testCompaction();
+  printf("Power cuts\n");
+  testPowerCuts();
+  printf("Wear\n");
+  testWear();
+  printf("A month of traffic\n");
+  monthOfTraffic();
+
+  if (failures == 0) {
+    printf("All log store tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
@@ -0,0 +1,260 @@
+/*
+ * Host-side test for several MFRC522 readers on one SPI bus
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -I. test/reader_mux_test.cpp reader_mux.cpp card_detect.cpp -o reader_mux_test
+ *   ./reader_mux_test
+ *
+ * Simulates the readers on one virtual clock, as they share one bus and one
+ * task: every register access, REQA timeout and select holds up the whole
+ * pass. People tap each reader every one to three seconds. Reports the
+ * aggregate scan rate (REQAs sent per second across all readers) against
+ * one reader's, and checks it stays within READER_SCAN_MARGIN_PCT of
+ * N times that; also shows what blocking polls taking turns would get.
+ */
+
+#include "reader_mux.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+#define NEVER 0xFFFFFFFFFFFFFFFFULL
+
+// Timings in microseconds
+#define SPI_REG_US       12     // One register access with its chip select
+#define REQA_TIMEOUT_US  25000
+#define REQA_ANSWER_US   1000
+#define SELECT_US        4000
+#define HANDLE_US        2000   // Local lookup, halt and feedback start
+#define TICK_US          10000  // RFID task sleep after each pass
+#define CARD_HOLD_US     300000
+
+class SimRadio : public CardDetectRadio {
+public:
+  uint64_t* clock;
+  uint64_t cardFrom = NEVER;
+  uint64_t cardUntil = 0;
+  bool halted = false;
+  bool answered = false;
+  bool queue = false;          // Another card is always waiting
+  uint32_t reqas = 0;
+  uint32_t presented = 0;
+  uint32_t missed = 0;         // Left the field without being selected
+  uint32_t selected = 0;
+
+  explicit SimRadio(uint64_t* busClock) : clock(busClock) {}
+
+  // Tap schedule: a card every one to three seconds, held CARD_HOLD_US
+  void advance() {
+    while (*clock >= cardUntil) {
+      if (cardFrom != NEVER && !halted) missed++;
+      uint64_t gap = 1000000 + (uint64_t)(rand() % 2000) * 1000;
+      cardFrom = (cardFrom == NEVER ? *clock : cardUntil) + gap;
+      cardUntil = cardFrom + CARD_HOLD_US;
+      halted = false;
+      presented++;
+    }
+  }
+  bool present() {
+    if (queue) return true;
+    advance();
+    return *clock >= cardFrom && !halted;
+  }
+  void spend(uint64_t us) { *clock += us; }
+
+  bool isNewCardPresent() override {
+    reqas++;
+    bool found = present();
+    spend(found ? REQA_ANSWER_US : REQA_TIMEOUT_US);
+    return found;
+  }
+  bool readCardSerial() override {
+    bool found = present();
+    spend(found ? SELECT_US : REQA_TIMEOUT_US);
+    if (found) {
+      halted = true;  // The tap handler halts it
+      selected++;
+    }
+    return found;
+  }
+  void armIrq() override {
+    reqas++;
+    spend(6 * SPI_REG_US);
+    answered = present();
+  }
+  void clearIrq() override {
+    answered = false;
+    spend(SPI_REG_US);
+  }
+  bool irqPending() override {
+    spend(SPI_REG_US);
+    return answered;
+  }
+};
+
+struct ScanReport {
+  double reqasPerSec;
+  uint32_t presented;
+  uint32_t missed;
+  uint32_t selected;
+};
+
+static void runTask(ReaderMux& mux, SimRadio** radios, uint64_t* clock, uint64_t runUs) {
+  while (*clock < runUs) {
+    // The shared IRQ line is low while any reader holds RxIRq
+    bool line = false;
+    for (uint8_t i = 0; i < mux.count(); i++) line = line || radios[i]->answered;
+    int reader = mux.check((uint32_t)(*clock / 1000), line);
+    if (reader != READER_NONE) {
+      *clock += HANDLE_US;
+      mux.radio((uint8_t)reader)->clearIrq();
+    }
+    *clock += TICK_US;
+  }
+}
+
+// The door through the mux, with traffic on every reader
+static ScanReport scanRate(uint8_t readers, uint8_t loneMode) {
+  const uint64_t runUs = 120000000ULL;
+  uint64_t clock = 0;
+  SimRadio* radios[READER_MAX];
+  ReaderMux mux;
+  srand(777);
+  for (uint8_t i = 0; i < readers; i++) {
+    radios[i] = new SimRadio(&clock);
+    mux.add(radios[i], i & 1);
+  }
+  mux.begin(loneMode, 0);
+  runTask(mux, radios, &clock, runUs);
+
+  ScanReport r = {0, 0, 0, 0};
+  for (uint8_t i = 0; i < readers; i++) {
+    r.reqasPerSec += radios[i]->reqas;
+    r.presented += radios[i]->presented - 1;  // The last one is still coming
+    r.missed += radios[i]->missed;
+    r.selected += radios[i]->selected;
+    delete radios[i];
+  }
+  r.reqasPerSec /= runUs / 1000000.0;
+  return r;
+}
+
+// The alternative: each reader blocking-polled in turn, one per pass
+static double turnTakingRate(uint8_t readers) {
+  const uint64_t runUs = 120000000ULL;
+  uint64_t clock = 0;
+  SimRadio* radios[READER_MAX];
+  CardDetector detectors[READER_MAX];
+  srand(777);
+  for (uint8_t i = 0; i < readers; i++) {
+    radios[i] = new SimRadio(&clock);
+    detectors[i].begin(radios[i], CARD_DETECT_POLL, 0);
+  }
+  uint32_t reqas = 0;
+  for (uint8_t turn = 0; clock < runUs; turn = (uint8_t)((turn + 1) % readers)) {
+    if (detectors[turn].check((uint32_t)(clock / 1000), false)) clock += HANDLE_US;
+    clock += TICK_US;
+  }
+  for (uint8_t i = 0; i < readers; i++) {
+    reqas += radios[i]->reqas;
+    delete radios[i];
+  }
+  return reqas / (runUs / 1000000.0);
+}
+
+static void testSetup() {
+  uint64_t clock = 0;
+  SimRadio entry(&clock);
+  SimRadio exitSide(&clock);
+  ReaderMux mux;
+
+  CHECK(mux.add(&entry, 0));
+  mux.begin(CARD_DETECT_IRQ, 0);
+  CHECK(mux.mode() == CARD_DETECT_IRQ);  // A lone reader keeps its mode
+
+  CHECK(mux.add(&exitSide, 1));
+  mux.begin(CARD_DETECT_IRQ, 0);
+  CHECK(mux.mode() == CARD_DETECT_STATUS);
+  CHECK(mux.count() == 2);
+  CHECK(mux.direction(0) == 0);
+  CHECK(mux.direction(1) == 1);
+  CHECK(mux.radio(1) == &exitSide);
+
+  SimRadio spare(&clock);
+  CHECK(mux.add(&spare, 0));
+  CHECK(mux.add(&spare, 0));
+  CHECK(!mux.add(&spare, 0));  // READER_MAX
+}
+
+// A reader with someone always at it can't keep the other one waiting
+static void testFairness() {
+  uint64_t clock = 0;
+  SimRadio busy(&clock);
+  SimRadio quiet(&clock);
+  busy.queue = true;
+  ReaderMux mux;
+  mux.add(&busy, 0);
+  mux.add(&quiet, 1);
+  mux.begin(CARD_DETECT_IRQ, 0);
+
+  quiet.cardFrom = 50000;
+  quiet.cardUntil = 50000 + CARD_HOLD_US;
+  uint32_t busyCards = 0;
+  uint64_t quietAt = NEVER;
+  for (int pass = 0; pass < 100; pass++) {
+    int reader = mux.check((uint32_t)(clock / 1000), false);
+    if (reader == 0) busyCards++;
+    if (reader == 1 && quietAt == NEVER) quietAt = clock;
+    if (reader != READER_NONE) mux.radio((uint8_t)reader)->clearIrq();
+    clock += TICK_US;
+  }
+  CHECK(quietAt != NEVER);
+  // Armed on its next turn, at most one re-arm interval plus two passes later
+  CHECK(quietAt - 50000 <= (CARD_IRQ_REARM_MS + 2 * TICK_US / 1000) * 1000ULL + SELECT_US);
+  CHECK(busyCards >= 40);  // ... and the busy reader still gets its turns
+  printf("  busy reader %u cards in 100 passes, quiet reader's card after %.1f ms\n",
+         (unsigned)busyCards, (quietAt - 50000) / 1000.0);
+}
+
+static void testScanRate() {
+  ScanReport one = scanRate(1, CARD_DETECT_IRQ);
+  printf("  1 reader (irq)        %6.1f REQA/s, %u/%u taps selected\n", one.reqasPerSec,
+         (unsigned)one.selected, (unsigned)one.presented);
+  CHECK(one.missed == 0);
+
+  for (uint8_t n = 2; n <= READER_MAX; n++) {
+    ScanReport many = scanRate(n, CARD_DETECT_IRQ);
+    double ideal = n * one.reqasPerSec;
+    double turns = turnTakingRate(n);
+    printf("  %u readers (status)   %6.1f REQA/s, %5.1f%% of %u x one reader, %u/%u taps selected;"
+           " polls taking turns %5.1f REQA/s\n",
+           (unsigned)n, many.reqasPerSec, 100.0 * many.reqasPerSec / ideal, (unsigned)n,
+           (unsigned)many.selected, (unsigned)many.presented, turns);
+    CHECK(many.reqasPerSec * 100 >= ideal * (100 - READER_SCAN_MARGIN_PCT));
+    CHECK(many.missed == 0);
+    CHECK(turns < one.reqasPerSec);  // Why status mode: turns don't scale at all
+  }
+}
+
+int main() {
+  printf("Setup and directions\n");
+  testSetup();
+
+  printf("Fairness\n");
+  testFairness();
+
+  printf("Aggregate scan rate\n");
+  testScanRate();
+
+  if (failures == 0) {
+    printf("All reader mux tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
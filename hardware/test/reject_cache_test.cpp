@@ -0,0 +1,209 @@
+/*
+ * Host-side test for the negative cache of unknown cards
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -I. test/reject_cache_test.cpp reject_cache.cpp -o reject_cache_test
+ *   ./reject_cache_test
+ *
+ * Replays someone tapping an unregistered card against a server that
+ * rejects it, and checks how many taps reach the server; also the token
+ * bucket on its own, eviction with the table full and the time a check
+ * takes.
+ */
+
+#include "reject_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+static void makeUid(uint32_t n, uint8_t* uid) {
+  uid[0] = 0x04;
+  uid[1] = (uint8_t)(n >> 16);
+  uid[2] = (uint8_t)(n >> 8);
+  uid[3] = (uint8_t)n;
+}
+
+static void testRejectedWithinTtl() {
+  RejectCache cache;
+  uint8_t uid[4];
+  makeUid(1, uid);
+  uint32_t now = 1000;
+
+  CHECK(cache.check(uid, 4, now) == REJECT_ASK);
+  cache.rejected(uid, 4, now);
+  CHECK(cache.check(uid, 4, now + 3000) == REJECT_CACHED);
+  CHECK(cache.check(uid, 4, now + REJECT_TTL_MS - 1) == REJECT_CACHED);
+  CHECK(cache.check(uid, 4, now + REJECT_TTL_MS) == REJECT_ASK);
+
+  // Rejected again: twice as long
+  now += REJECT_TTL_MS;
+  cache.rejected(uid, 4, now);
+  CHECK(cache.check(uid, 4, now + 2 * REJECT_TTL_MS - 1) == REJECT_CACHED);
+  CHECK(cache.check(uid, 4, now + 2 * REJECT_TTL_MS) == REJECT_ASK);
+
+  // ... up to the cap
+  for (int i = 0; i < 10; i++) {
+    now += REJECT_TTL_MAX_MS;
+    cache.rejected(uid, 4, now);
+  }
+  CHECK(cache.check(uid, 4, now + REJECT_TTL_MAX_MS - 1) == REJECT_CACHED);
+  CHECK(cache.check(uid, 4, now + REJECT_TTL_MAX_MS) == REJECT_ASK);
+
+  // A different UID, and one of the same bytes but longer, aren't affected
+  uint8_t other[7] = {0x04, 0x00, 0x00, 0x01, 0x55, 0x66, 0x77};
+  uint8_t another[4];
+  makeUid(2, another);
+  cache.rejected(uid, 4, now);
+  CHECK(cache.check(another, 4, now) == REJECT_ASK);
+  CHECK(cache.check(other, 7, now) == REJECT_ASK);
+
+  // Registered since: the server says yes and the entry goes
+  cache.accepted(uid, 4);
+  CHECK(cache.check(uid, 4, now + 1) == REJECT_ASK);
+  CHECK(cache.stats().rejections == 13);
+  CHECK(cache.suppressed() == cache.stats().cached + cache.stats().limited);
+}
+
+// Taps the server never answers: only the bucket stands between them and it
+static void testTokenBucket() {
+  RejectCache cache;
+  uint8_t uid[4];
+  makeUid(7, uid);
+  uint32_t now = 5000;
+
+  for (int i = 0; i < REJECT_BUCKET_TOKENS; i++) CHECK(cache.check(uid, 4, now + i) == REJECT_ASK);
+  CHECK(cache.check(uid, 4, now + 10) == REJECT_LIMITED);
+  CHECK(cache.check(uid, 4, now + REJECT_REFILL_MS - 1) == REJECT_LIMITED);
+  CHECK(cache.check(uid, 4, now + REJECT_REFILL_MS) == REJECT_ASK);
+  CHECK(cache.check(uid, 4, now + REJECT_REFILL_MS + 1) == REJECT_LIMITED);
+
+  // Left alone, it fills up and no further
+  now += REJECT_REFILL_MS + 10 * REJECT_REFILL_MS;
+  for (int i = 0; i < REJECT_BUCKET_TOKENS; i++) CHECK(cache.check(uid, 4, now) == REJECT_ASK);
+  CHECK(cache.check(uid, 4, now) == REJECT_LIMITED);
+  CHECK(cache.stats().limited == 4);
+
+  // Across the millis() wrap
+  RejectCache wrapped;
+  now = 0xFFFFFFFFUL - 5000;
+  for (int i = 0; i < REJECT_BUCKET_TOKENS; i++) wrapped.check(uid, 4, now);
+  CHECK(wrapped.check(uid, 4, now + REJECT_REFILL_MS) == REJECT_ASK);
+  wrapped.rejected(uid, 4, now + REJECT_REFILL_MS);
+  CHECK(wrapped.check(uid, 4, now + REJECT_REFILL_MS + 10000) == REJECT_CACHED);
+}
+
+// Someone tapping a bus pass every two seconds for ten minutes; the server
+// takes 800 ms to say no
+static void testRepeatOffender() {
+  RejectCache cache;
+  uint8_t uid[4];
+  makeUid(42, uid);
+  uint32_t taps = 0;
+  uint32_t asked = 0;
+  for (uint32_t now = 0; now < 600000; now += 2000) {
+    taps++;
+    if (cache.check(uid, 4, now) == REJECT_ASK) {
+      asked++;
+      cache.rejected(uid, 4, now + 800);
+    }
+  }
+  printf("  %u taps, %u reached the server, %u suppressed\n", (unsigned)taps, (unsigned)asked,
+         (unsigned)cache.suppressed());
+  CHECK(asked + cache.suppressed() == taps);
+  CHECK(asked == 4);  // 0, ~60 s, ~180 s, ~420 s
+}
+
+static void testEviction() {
+  RejectCache cache;
+  uint8_t uid[4];
+  uint32_t now = 0;
+
+  // Rejections fill the table; the oldest goes when another card comes
+  for (uint32_t n = 0; n < REJECT_CACHE_SIZE; n++) {
+    makeUid(n, uid);
+    cache.check(uid, 4, now);
+    cache.rejected(uid, 4, now);
+    now += 100;
+  }
+  CHECK(cache.count() == REJECT_CACHE_SIZE);
+  makeUid(1000, uid);
+  CHECK(cache.check(uid, 4, now) == REJECT_ASK);
+  CHECK(cache.count() == REJECT_CACHE_SIZE);
+  CHECK(cache.stats().evictions == 1);
+  makeUid(0, uid);
+  CHECK(cache.check(uid, 4, now) == REJECT_ASK);  // Forgotten: asks again
+  makeUid(2, uid);
+  CHECK(cache.check(uid, 4, now) == REJECT_CACHED);
+
+  // An entry without a live rejection goes before an older one holding one
+  RejectCache mixed;
+  now = 0;
+  for (uint32_t n = 0; n < REJECT_CACHE_SIZE; n++) {
+    makeUid(n, uid);
+    mixed.check(uid, 4, now);
+    if (n != 20) mixed.rejected(uid, 4, now);
+    now += 100;
+  }
+  makeUid(1000, uid);
+  mixed.check(uid, 4, now);
+  makeUid(20, uid);
+  CHECK(mixed.check(uid, 4, now) == REJECT_ASK);
+  CHECK(mixed.stats().evictions == 2);  // 20, then 1000 to take 20 back
+  makeUid(1, uid);
+  CHECK(mixed.check(uid, 4, now) == REJECT_CACHED);
+}
+
+static void testCheckTime() {
+  RejectCache cache;
+  uint8_t uid[CARD_UID_MAX_LEN];
+  memset(uid, 0x04, sizeof(uid));
+  for (uint32_t n = 0; n < REJECT_CACHE_SIZE; n++) {
+    makeUid(n, uid);
+    cache.check(uid, 7, 0);
+    cache.rejected(uid, 7, 0);
+  }
+
+  const uint32_t rounds = 1000000;
+  uint32_t cached = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rounds; i++) {
+    makeUid(i % REJECT_CACHE_SIZE, uid);
+    if (cache.check(uid, 7, 1000) == REJECT_CACHED) cached++;
+  }
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start)
+                  .count() / rounds;
+  printf("  %.3f us per check, table of %d\n", us, REJECT_CACHE_SIZE);
+  CHECK(cached == rounds);
+  CHECK(us < 10.0);
+  CHECK(strcmp(RejectCache::decisionName(REJECT_LIMITED), "limited") == 0);
+}
+
+int main() {
+  printf("Rejections and TTL\n");
+  testRejectedWithinTtl();
+
+  printf("Token bucket\n");
+  testTokenBucket();
+
+  printf("Repeat offender\n");
+  testRepeatOffender();
+
+  printf("Eviction\n");
+  testEviction();
+
+  printf("Check time\n");
+  testCheckTime();
+
+  if (failures == 0) {
+    printf("All reject cache tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
@@ -0,0 +1,276 @@
+/*
+ * Host-side test for the stage latency histograms
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -pthread -I. test/stage_metrics_test.cpp stage_metrics.cpp -o stage_metrics_test
+ *   ./stage_metrics_test
+ *
+ * Checks bucketing at the bounds, percentile estimates, cycle-to-us
+ * conversion across a counter wrap and the fall back to ms for long
+ * stages, and the Prometheus rendering. Then one thread records while
+ * another reads and every copy must be consistent, and reports what a
+ * stamp and a record cost.
+ */
+
+#include "stage_metrics.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+// A 240 MHz core on a virtual clock
+#define CYCLES_PER_US  240
+
+static uint32_t fakeCycles = 0;
+static uint32_t fakeMs = 0;
+static uint32_t fakeCycleClock() { return fakeCycles; }
+static uint32_t fakeMsClock() { return fakeMs; }
+
+static void advanceUs(uint64_t us) {
+  static uint64_t remainderUs = 0;
+  fakeCycles += (uint32_t)(us * CYCLES_PER_US);
+  remainderUs += us;
+  fakeMs += (uint32_t)(remainderUs / 1000);
+  remainderUs %= 1000;
+}
+
+class StringSink : public MetricsSink {
+public:
+  std::string text;
+  void write(const char* data, size_t len) override { text.append(data, len); }
+};
+
+static void testBuckets() {
+  CHECK(StageHistogram::bucketFor(0) == 0);
+  CHECK(StageHistogram::bucketFor(50) == 0);
+  CHECK(StageHistogram::bucketFor(51) == 1);
+  CHECK(StageHistogram::bucketFor(1000) == 4);
+  CHECK(StageHistogram::bucketFor(20000000) == STAGE_BUCKETS - 2);
+  CHECK(StageHistogram::bucketFor(20000001) == STAGE_BUCKETS - 1);
+  CHECK(StageHistogram::bucketFor(UINT32_MAX) == STAGE_BUCKETS - 1);
+  CHECK(StageHistogram::bucketBound(STAGE_BUCKETS - 1) == UINT32_MAX);
+  for (size_t i = 1; i < STAGE_BUCKETS; i++) {
+    CHECK(StageHistogram::bucketBound(i) > StageHistogram::bucketBound(i - 1));
+  }
+}
+
+static void testPercentiles() {
+  StageHistogram hist;
+  StageSummary s;
+  hist.read(&s);
+  CHECK(s.count == 0);
+  CHECK(s.percentileUs(50) == 0);
+
+  // 90 fast lookups around 300 us, 10 slow ones around 40 ms
+  for (int i = 0; i < 90; i++) hist.record(250 + i);
+  for (int i = 0; i < 10; i++) hist.record(40000 + i * 100);
+  hist.read(&s);
+  CHECK(s.count == 100);
+  CHECK(s.maxUs == 40900);
+  CHECK(s.sumUs == 90ULL * 250 + 89 * 90 / 2 + 10ULL * 40000 + 100 * 45);
+  uint32_t p50 = s.percentileUs(50);
+  uint32_t p95 = s.percentileUs(95);
+  uint32_t p100 = s.percentileUs(100);
+  printf("  p50 %lu us, p95 %lu us, p100 %lu us\n", (unsigned long)p50, (unsigned long)p95,
+         (unsigned long)p100);
+  CHECK(p50 > 200 && p50 <= 500);
+  CHECK(p95 > 20000 && p95 <= 40900);
+  CHECK(p100 == 40900);
+  CHECK(s.percentileUs(1) <= 500);
+
+  // Past the last bound the estimate is capped by the longest sample
+  StageHistogram slow;
+  slow.record(30000000);
+  slow.read(&s);
+  CHECK(s.percentileUs(99) == 30000000);
+
+  hist.reset();
+  hist.read(&s);
+  CHECK(s.count == 0 && s.sumUs == 0 && s.maxUs == 0);
+}
+
+static void testClock() {
+  StageMetrics metrics;
+  CHECK(metrics.now().cycles == 0);
+  CHECK(metrics.elapsedUs(metrics.now()) == 0);  // No clock yet
+
+  metrics.begin(fakeCycleClock, CYCLES_PER_US, fakeMsClock);
+
+  // Short stage: cycles, to the microsecond
+  StageStamp start = metrics.now();
+  advanceUs(1234);
+  CHECK(metrics.record(STAGE_CARD_LOOKUP, start) == 1234);
+
+  // Across the 32-bit cycle counter wrap
+  fakeCycles = UINT32_MAX - 1000;
+  start = metrics.now();
+  advanceUs(500);
+  CHECK(metrics.elapsedUs(start) == 500);
+
+  // 12 s is more than half of the 17.9 s wrap: timed in ms
+  start = metrics.now();
+  advanceUs(12000000);
+  CHECK(metrics.elapsedUs(start) == 12000000);
+
+  // 25 s would alias to 7.1 s if counted in cycles
+  start = metrics.now();
+  advanceUs(25000000);
+  CHECK(metrics.record(STAGE_TAP_TO_UNLOCK, start) == 25000000);
+
+  StageSummary s;
+  metrics.read(STAGE_TAP_TO_UNLOCK, &s);
+  CHECK(s.count == 1 && s.maxUs == 25000000);
+  metrics.read(STAGE_COUNT, &s);
+  CHECK(s.count == 0);
+  CHECK(strcmp(StageMetrics::stageName(STAGE_FINGER_MATCH), "finger_match") == 0);
+  CHECK(strcmp(StageMetrics::stageName(STAGE_COUNT), "unknown") == 0);
+}
+
+static void testRender() {
+  StageMetrics metrics;
+  metrics.recordUs(STAGE_CARD_READ, 4000);
+  metrics.recordUs(STAGE_CARD_READ, 30);
+  metrics.recordUs(STAGE_HTTP_VERIFY, 65000);
+
+  MetricsGauges gauges;
+  memset(&gauges, 0, sizeof(gauges));
+  gauges.uptimeMs = 61005;
+  gauges.cacheHits = 97;
+  gauges.indexHits = 1;
+  gauges.lookupMisses = 2;
+  gauges.rejectsCached = 5;
+  gauges.rejectsLimited = 1;
+  gauges.journalBacklog = 12;
+  gauges.freeHeap = 150000;
+  gauges.minFreeHeap = 120000;
+  gauges.online = true;
+  gauges.rssi = -61;
+
+  StringSink sink;
+  metrics.render(gauges, &sink);
+  const std::string& text = sink.text;
+  CHECK(text.find("# TYPE door_stage_latency_us histogram\n") != std::string::npos);
+  CHECK(text.find("door_stage_latency_us_bucket{stage=\"card_read\",le=\"50\"} 1\n") != std::string::npos);
+  CHECK(text.find("door_stage_latency_us_bucket{stage=\"card_read\",le=\"2000\"} 1\n") != std::string::npos);
+  CHECK(text.find("door_stage_latency_us_bucket{stage=\"card_read\",le=\"5000\"} 2\n") != std::string::npos);
+  CHECK(text.find("door_stage_latency_us_bucket{stage=\"card_read\",le=\"+Inf\"} 2\n") != std::string::npos);
+  CHECK(text.find("door_stage_latency_us_sum{stage=\"card_read\"} 4030\n") != std::string::npos);
+  CHECK(text.find("door_stage_latency_us_count{stage=\"http_upload\"} 0\n") != std::string::npos);
+  CHECK(text.find("door_stage_latency_max_us{stage=\"http_verify\"} 65000\n") != std::string::npos);
+  CHECK(text.find("door_uptime_seconds 61.005\n") != std::string::npos);
+  CHECK(text.find("door_card_lookups_total{result=\"cache\"} 97\n") != std::string::npos);
+  CHECK(text.find("door_card_cache_hit_ratio 0.970\n") != std::string::npos);
+  CHECK(text.find("door_verify_suppressed_total{reason=\"rejected\"} 5\n") != std::string::npos);
+  CHECK(text.find("door_verify_suppressed_total{reason=\"rate_limited\"} 1\n") != std::string::npos);
+  CHECK(text.find("door_journal_backlog 12\n") != std::string::npos);
+  CHECK(text.find("door_free_heap_bytes 150000\n") != std::string::npos);
+  CHECK(text.find("door_wifi_rssi_dbm -61\n") != std::string::npos);
+  CHECK(text[text.size() - 1] == '\n');
+  printf("  %u bytes for %d stages\n", (unsigned)text.size(), STAGE_COUNT);
+
+  // Offline: no RSSI to report
+  gauges.online = false;
+  StringSink offline;
+  metrics.render(gauges, &offline);
+  CHECK(offline.text.find("door_wifi_connected 0\n") != std::string::npos);
+  CHECK(offline.text.find("door_wifi_rssi_dbm") == std::string::npos);
+
+  memset(&gauges, 0, sizeof(gauges));
+  CHECK(metricsCacheHitRatio(gauges) == 0.0f);
+}
+
+// Every copy a reader takes while the writer runs must be exactly some
+// prefix of what was recorded: count, buckets, sum and max all from the
+// same sample. The sum carries into its high word thousands of times on the
+// way, so a torn copy of it is off by 2^32 and shows up here too.
+static void testConcurrentReads() {
+  StageHistogram hist;
+  const uint32_t samples = 20000000;
+  std::atomic<bool> done(false);
+  uint32_t reads = 0;
+  uint32_t torn = 0;
+
+  std::thread writer([&] {
+    for (uint32_t i = 0; i < samples; i++) hist.record(100 + (i & 1) * 900000);
+    done = true;
+  });
+  while (!done) {
+    StageSummary s;
+    hist.read(&s);
+    reads++;
+    // Samples alternate 100 and 900100 us, starting with 100
+    uint64_t slow = s.count / 2;
+    uint64_t fast = s.count - slow;
+    bool exact = s.sumUs == fast * 100 + slow * 900100 &&
+                 s.buckets[StageHistogram::bucketFor(100)] == fast &&
+                 s.buckets[StageHistogram::bucketFor(900100)] == slow &&
+                 s.maxUs == (slow > 0 ? 900100u : fast > 0 ? 100u : 0u);
+    if (!exact) torn++;
+  }
+  writer.join();
+
+  StageSummary s;
+  hist.read(&s);
+  CHECK(s.count == samples);
+  CHECK(s.sumUs == (uint64_t)samples / 2 * 100 + (uint64_t)samples / 2 * 900100);
+  CHECK(s.sumUs > UINT32_MAX);  // Carried into the high word
+  printf("  %lu reads during %lu records, %lu stale or torn\n", (unsigned long)reads,
+         (unsigned long)samples, (unsigned long)torn);
+  CHECK(torn == 0);
+}
+
+static uint32_t steadyCycles() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t steadyMs() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void reportCost() {
+  StageMetrics metrics;
+  metrics.begin(steadyCycles, 1000, steadyMs);  // ns as "cycles"
+  const int rounds = 1000000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    StageStamp stamp = metrics.now();
+    metrics.record(STAGE_CARD_LOOKUP, stamp);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("  stamp and record: %.0f ns on the host\n", ns / rounds);
+  StageSummary s;
+  metrics.read(STAGE_CARD_LOOKUP, &s);
+  CHECK(s.count == (uint32_t)rounds);
+}
+
+int main() {
+  printf("Buckets\n");
+  testBuckets();
+  printf("Percentiles\n");
+  testPercentiles();
+  printf("Cycle clock\n");
+  testClock();
+  printf("Prometheus text\n");
+  testRender();
+  printf("Reads racing the writer\n");
+  testConcurrentReads();
+  printf("Cost\n");
+  reportCost();
+
+  if (failures == 0) {
+    printf("All stage metrics tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
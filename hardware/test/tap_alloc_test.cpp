@@ -0,0 +1,411 @@
+/*
+ * Host-side test that a tap never touches the heap
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -pthread -I. test/tap_alloc_test.cpp access_flow.cpp card_cache.cpp \
+ *       card_detect.cpp card_index.cpp log_ring.cpp reject_cache.cpp stage_metrics.cpp \
+ *       task_sync.cpp template_slots.cpp -o tap_alloc_test
+ *   ./tap_alloc_test
+ *
+ * Replaces malloc and operator new with counting versions, sets up the
+ * portable modules the RFID task uses, then runs taps through them the way
+ * rfidTask() and handleRFIDCard() do: card detect, UID to hex, cache hit or
+ * index lookup, the reject cache for unknown cards (a verdict from the
+ * server, one it gave recently, or none and the token bucket runs dry),
+ * access flow through grant or deny, template slot lookup, stage timings,
+ * the tap handed to the network task's queue, the journal record built
+ * from it and the log lines queued on the log ring and drained. After warm-up
+ * every tap must make zero allocations. The SPIFFS journal and index files
+ * stay open between taps on the device and are not part of this build;
+ * door_native counts the RFID task's allocations around the sketch itself.
+ * Also checks that a cache hit on a name too long for the cache comes
+ * back marked as shortened.
+ */
+
+#include "access_flow.h"
+#include "card_cache.h"
+#include "card_detect.h"
+#include "card_index.h"
+#include "log_ring.h"
+#include "reject_cache.h"
+#include "stage_metrics.h"
+#include "task_sync.h"
+#include "template_slots.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <string>
+#include <vector>
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+extern "C" void __libc_free(void* p);
+
+static bool tracking = false;
+static size_t allocations = 0;
+
+extern "C" void* malloc(size_t size) {
+  if (tracking) allocations++;
+  return __libc_malloc(size);
+}
+extern "C" void* calloc(size_t n, size_t size) {
+  if (tracking) allocations++;
+  return __libc_calloc(n, size);
+}
+extern "C" void* realloc(void* p, size_t size) {
+  if (tracking) allocations++;
+  return __libc_realloc(p, size);
+}
+extern "C" void free(void* p) {
+  __libc_free(p);
+}
+
+void* operator new(size_t size) {
+  void* p = malloc(size);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+#define CARDS        2000
+#define CACHE_SLOTS  1024  // Smaller than the card count: some taps miss to the index
+
+// Cards presented by the tap loop
+#define TAP_REGISTERED  0  // Stored locally
+#define TAP_UNKNOWN     1  // A different unknown card each time; the server says no
+#define TAP_BUS_PASS    2  // The same unknown card; the server said no before
+#define TAP_UNANSWERED  3  // The same unknown card; the server never answers
+
+// Same shape as the sketch's NetRequest
+struct TapRequest {
+  uint8_t type;
+  uint8_t uid[CARD_UID_MAX_LEN];
+  uint8_t uidLen;
+  uint8_t action;
+  uint16_t fingerSlot;
+  uint32_t timestamp;
+  char name[40];
+};
+
+// Same shape as JournalRecord
+struct TapRecord {
+  uint32_t seq;
+  uint32_t timestamp;
+  uint8_t uid[CARD_UID_MAX_LEN];
+  uint8_t uidLen;
+  uint8_t action;
+  uint32_t bootId;
+  char name[40];
+};
+
+// Serial stand-in for the log task
+class ConsoleSink : public LogSink {
+public:
+  size_t bytes = 0;
+  void write(const uint8_t*, size_t len) override { bytes += len; }
+};
+
+static ConsoleSink console;
+
+class MemoryIndex : public CardIndexSource, public CardIndexSink {
+public:
+  std::vector<uint8_t> data;
+
+  size_t size() override { return data.size(); }
+  bool readAt(size_t offset, void* buf, size_t len) override {
+    if (offset + len > data.size()) return false;
+    memcpy(buf, &data[offset], len);
+    return true;
+  }
+  bool write(const void* buf, size_t len) override {
+    const uint8_t* bytes = (const uint8_t*)buf;
+    data.insert(data.end(), bytes, bytes + len);
+    return true;
+  }
+};
+
+class MemorySlotStore : public TemplateSlotStore {
+public:
+  std::vector<uint8_t> data;
+
+  size_t size() override { return data.size(); }
+  bool readAt(size_t offset, void* buf, size_t len) override {
+    if (offset + len > data.size()) return false;
+    memcpy(buf, &data[offset], len);
+    return true;
+  }
+  bool writeAt(size_t offset, const void* buf, size_t len) override {
+    if (offset + len > data.size()) data.resize(offset + len);
+    memcpy(&data[offset], buf, len);
+    return true;
+  }
+};
+
+class NullSensor : public TemplateSensor {
+public:
+  bool storeTemplate(uint16_t, const uint8_t*, size_t) override { return true; }
+};
+
+// A card held to the reader on the next check
+class SimRadio : public CardDetectRadio {
+public:
+  bool present = false;
+  uint8_t uid[CARD_UID_MAX_LEN];
+  uint8_t uidLen = 0;
+
+  bool isNewCardPresent() override { return present; }
+  bool readCardSerial() override { present = false; return true; }
+  void armIrq() override {}
+  void clearIrq() override {}
+  bool irqPending() override { return false; }
+};
+
+class SimDoor : public AccessHardware {
+public:
+  uint32_t captureAt = 0;
+  uint32_t clock = 0;
+  TemplateSlots* slots = NULL;
+
+  void setOutput(uint8_t, bool) override {}
+  void display(const char*, const char*) override {}
+  bool captureFingerprint() override { return clock >= captureAt; }
+  int matchCaptured(uint16_t slot) override {
+    int32_t sensorSlot = slots->find(slot);
+    if (sensorSlot < 0) return 0;
+    slots->touch(slot);
+    LOG_DEBUG("Fingerprint matches template %u, score %u", slot, 120);
+    return 1;
+  }
+};
+
+static SimDoor* clockDoor = NULL;
+
+// Stage timings in simulated time: one "cycle" per us
+static uint32_t simCycles() { return clockDoor->clock * 1000; }
+static uint32_t simMs() { return clockDoor->clock; }
+
+static CardRecord makeCard(uint32_t n) {
+  uint8_t uid[4] = {0x04, (uint8_t)(n >> 16), (uint8_t)(n >> 8), (uint8_t)n};
+  char name[32];
+  char userId[32];
+  snprintf(name, sizeof(name), "Student %u", n);
+  snprintf(userId, sizeof(userId), "user_%06u", n);
+  CardRecord rec;
+  cardRecordSet(&rec, uid, sizeof(uid), name, userId, CARD_ROLE_STUDENT);
+  rec.fingerSlot = (uint16_t)(1 + n % 500);
+  return rec;
+}
+
+static CardCacheEntry cacheStorage[CACHE_SLOTS];
+static TemplateSlots templateSlots;
+static TapRecord journal[64];
+static uint32_t nextSeq = 1;
+static RejectCache rejectCache;
+
+// One tap, mirroring handleRFIDCard(), cardVerdict(), pollServerVerify(),
+// grantAccess() and journalTap(). Returns true if the door opened.
+static bool tap(uint32_t card, uint8_t kind, CardDetector& detector, SimRadio& radio,
+                SimDoor& door, AccessFlow& flow, CardCache& cache, MemoryIndex& index,
+                TaskQueue<TapRequest>& queue) {
+  CardRecord expected = makeCard(kind == TAP_BUS_PASS ? 1 : kind == TAP_UNANSWERED ? 2 : card);
+  if (kind != TAP_REGISTERED) expected.uid[0] = kind == TAP_UNKNOWN ? 0x99 : 0x98;
+  memcpy(radio.uid, expected.uid, expected.uidLen);
+  radio.uidLen = expected.uidLen;
+  radio.present = true;
+
+  if (!detector.check(door.clock, false)) return false;
+  StageStamp tapStartedAt = stageMetrics.now();
+
+  char cardHex[2 * CARD_UID_MAX_LEN + 1];
+  cardUidToHex(radio.uid, radio.uidLen, cardHex, sizeof(cardHex));
+  LOG_INFO("RFID Card detected: %s (%u bytes)", cardHex, radio.uidLen);
+  flow.cardDetected(cardHex, door.clock);
+
+  CardRecord current;
+  StageStamp start = stageMetrics.now();
+  bool found = cache.get(radio.uid, radio.uidLen, &current) ||
+               cardIndexFind(index, radio.uid, radio.uidLen, &current);
+  stageMetrics.record(STAGE_CARD_LOOKUP, start);
+  if (!found) {
+    const char* reason = "Invalid Card";
+    uint8_t decision = rejectCache.check(radio.uid, radio.uidLen, door.clock);
+    if (decision == REJECT_CACHED) {
+      LOG_INFO("Card rejected by the server recently, not asking again");
+    } else if (decision == REJECT_LIMITED) {
+      LOG_WARN("Card checked too often, not asking the server");
+      reason = "Try Again Later";
+    } else {
+      // The network task's round trip
+      StageStamp verifyStamp = stageMetrics.now();
+      door.clock += 200;
+      if (kind == TAP_UNANSWERED) {
+        LOG_WARN("HTTP request failed: %d", -1);
+      } else {
+        stageMetrics.record(STAGE_SERVER_VERIFY, verifyStamp);
+        rejectCache.rejected(radio.uid, radio.uidLen, door.clock);
+      }
+    }
+    flow.deny(reason, door.clock);
+    LOG_INFO("ACCESS DENIED: %s, card %s", reason, cardHex);
+  } else {
+    LOG_DEBUG("Card found in local cache: %s (%s)", current.name, cardRoleName(current.role));
+    door.captureAt = door.clock + 300;
+    flow.cardAccepted(current.fingerSlot, door.clock);
+  }
+
+  bool granted = false;
+  for (int i = 0; i < 2000 && !flow.ready(); i++) {
+    AccessEvent event = flow.tick(door.clock);
+    if (event == ACCESS_EVENT_GRANTED) {
+      granted = true;
+      stageMetrics.record(STAGE_TAP_TO_UNLOCK, tapStartedAt);
+      LOG_INFO("ACCESS GRANTED: %s, card %s, fingerprint slot %d", current.name, cardHex,
+               flow.fingerSlot());
+
+      TapRequest request;
+      memset(&request, 0, sizeof(request));
+      memcpy(request.uid, radio.uid, radio.uidLen);
+      request.uidLen = radio.uidLen;
+      request.timestamp = door.clock;
+      strncpy(request.name, current.name, sizeof(request.name) - 1);
+      CHECK(queue.send(request, 0));
+    }
+    door.clock += 10;
+  }
+
+  // Network task side
+  TapRequest request;
+  while (queue.receive(&request, 0)) {
+    TapRecord& rec = journal[nextSeq % 64];
+    memset(&rec, 0, sizeof(rec));
+    rec.seq = nextSeq++;
+    rec.timestamp = request.timestamp;
+    memcpy(rec.uid, request.uid, request.uidLen);
+    rec.uidLen = request.uidLen;
+    strncpy(rec.name, request.name, sizeof(rec.name) - 1);
+    LOG_INFO("Attendance logged locally: %s (seq %lu)", rec.name, (unsigned long)rec.seq);
+  }
+  // Log task side
+  logRing.drain(&console, LOG_RING_SLOTS);
+  door.clock += 3000;  // Past CARD_READ_DELAY and the door hold
+  return granted;
+}
+
+int main() {
+  // Setup may allocate, as setup() does on the device
+  MemoryIndex index;
+  std::vector<CardRecord> cards;
+  for (uint32_t i = 0; i < CARDS; i++) cards.push_back(makeCard(i));
+  cardRecordSort(cards.data(), cards.size());
+  cardIndexWrite(index, cards.data(), cards.size());
+
+  CardCache cache;
+  cache.begin(cacheStorage, sizeof(cacheStorage));
+  for (uint32_t i = 0; i < CARDS / 2; i++) cache.put(makeCard(i));
+
+  NullSensor sensor;
+  MemorySlotStore slotStore;
+  templateSlots.begin(&sensor, &slotStore, 1000);
+  uint8_t tpl[TEMPLATE_BYTES] = {0};
+  for (uint16_t slot = 1; slot <= 500; slot++) templateSlots.install(slot, 1, tpl, sizeof(tpl));
+
+  SimRadio radio;
+  SimDoor door;
+  door.slots = &templateSlots;
+  clockDoor = &door;
+  stageMetrics.begin(simCycles, 1, simMs);
+  CardDetector detector;
+  detector.begin(&radio, CARD_DETECT_POLL, 0);
+  AccessFlow flow;
+  flow.begin(&door, 0);
+  TaskQueue<TapRequest> queue;
+  queue.begin(32);
+
+  // Warm-up: first-use allocations in the C library (stdio locale and the like)
+  tap(1, TAP_REGISTERED, detector, radio, door, flow, cache, index, queue);
+  tap(2, TAP_UNKNOWN, detector, radio, door, flow, cache, index, queue);
+
+  // The hook sees the String concatenation the tap path used to do
+  allocations = 0;
+  tracking = true;
+  std::string line = std::string("Card found in local cache: ") + cards[0].name + " (student)";
+  tracking = false;
+  CHECK(allocations > 0);
+  printf("Allocator hook\n  one concatenated log line: %zu allocations\n", allocations);
+
+  const int taps = 1000;
+  int granted = 0, denied = 0;
+  size_t worst = 0;
+  for (int i = 0; i < taps; i++) {
+    // Cache hits, index lookups past the cache, and unknown cards: new
+    // ones, a bus pass tapped again and again, and a card tapped in bursts
+    // while the server is unreachable
+    uint32_t card = (uint32_t)(i * 7919) % CARDS;
+    uint8_t kind = TAP_REGISTERED;
+    if (i % 10 == 9) kind = TAP_UNKNOWN;
+    else if (i % 10 == 6) kind = TAP_BUS_PASS;
+    else if (i % 10 >= 3 && i % 10 <= 5) kind = TAP_UNANSWERED;
+    allocations = 0;
+    tracking = true;
+    bool opened = tap(card, kind, detector, radio, door, flow, cache, index, queue);
+    tracking = false;
+    if (allocations > worst) worst = allocations;
+    CHECK(allocations == 0);
+    CHECK(opened == (kind == TAP_REGISTERED));
+    if (opened) granted++; else denied++;
+  }
+  const RejectStats& rejects = rejectCache.stats();
+  CHECK(rejects.cached > 0);
+  CHECK(rejects.limited > 0);
+  CHECK(rejects.evictions > 0);
+  StageSummary unlock;
+  stageMetrics.read(STAGE_TAP_TO_UNLOCK, &unlock);
+  CHECK(unlock.count == (uint32_t)granted + 1);  // And the warm-up tap
+
+  printf("Tap path\n");
+  printf("  %d taps (%d granted, %d denied), cache holds %zu of %d cards\n",
+         taps, granted, denied, cache.count(), CARDS);
+  printf("  unknown cards: %u asked, %u rejected from the cache, %u rate limited\n",
+         rejects.asked, rejects.cached, rejects.limited);
+  printf("  most heap allocations in one tap: %zu\n", worst);
+  printf("  %zu bytes of log lines through the log ring, %u dropped\n", console.bytes,
+         logRing.stats().dropped);
+
+  // A hit on a card whose name or ID didn't fit comes back marked, so
+  // the journal reads the full record from the index instead
+  CardRecord shortName = makeCard(0);
+  CardRecord longName = makeCard(1);
+  snprintf(longName.name, sizeof(longName.name), "Maria-Magdalena Featherstonehaugh");
+  cache.put(shortName);
+  cache.put(longName);
+  CardRecord hit;
+  CHECK(cache.get(shortName.uid, shortName.uidLen, &hit));
+  CHECK(hit.flags == 0 && strcmp(hit.name, shortName.name) == 0);
+  CHECK(cache.get(longName.uid, longName.uidLen, &hit));
+  CHECK(hit.flags == CARD_FLAG_SHORTENED && hit.role == longName.role);
+  CHECK(strncmp(hit.name, longName.name, CARD_CACHE_NAME_LEN - 1) == 0);
+  CHECK(strlen(hit.name) == CARD_CACHE_NAME_LEN - 1);
+  cache.put(shortName);
+  CHECK(cache.get(shortName.uid, shortName.uidLen, &hit) && hit.flags == 0);
+
+  if (failures == 0) {
+    printf("All tap allocation tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
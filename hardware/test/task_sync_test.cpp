@@ -0,0 +1,211 @@
+/*
+ * Host-side test for the task queues and the RFID/network task split
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -pthread -I. test/task_sync_test.cpp task_sync.cpp -o task_sync_test
+ *   ./task_sync_test
+ *
+ * Checks queue semantics, then models the firmware tasks with threads: an
+ * RFID thread producing taps and a network thread journaling them while
+ * uploads and periodic syncs stall it. Reports queue depth, tap-to-journal
+ * latency and the longest RFID loop gap under that load.
+ */
+
+#include "task_sync.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+typedef std::chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Item {
+  uint32_t seq;
+  char tag[12];
+};
+
+static void testQueueBasics() {
+  TaskQueue<Item> queue;
+  CHECK(queue.begin(3));
+  CHECK(!queue.begin(3));  // Only once
+
+  Item item = {0, ""};
+  for (uint32_t i = 1; i <= 3; i++) {
+    item.seq = i;
+    CHECK(queue.send(item, 0));
+  }
+  item.seq = 4;
+  CHECK(!queue.send(item, 0));  // Full, don't wait
+  CHECK(queue.dropped() == 1);
+  CHECK(queue.waiting() == 3);
+  CHECK(queue.highWater() == 3);
+
+  Item out;
+  CHECK(queue.receive(&out, 0) && out.seq == 1);
+  item.seq = 99;
+  CHECK(queue.sendToFront(item, 0));
+  CHECK(queue.receive(&out, 0) && out.seq == 99);
+  CHECK(queue.receive(&out, 0) && out.seq == 2);
+  CHECK(queue.receive(&out, 0) && out.seq == 3);
+  CHECK(!queue.receive(&out, 0));
+
+  // Timed receive gives up after roughly the timeout
+  Clock::time_point start = Clock::now();
+  CHECK(!queue.receive(&out, 30));
+  double waited = msSince(start);
+  CHECK(waited >= 25 && waited < 500);
+
+  // Overwrite only on depth-1 queues; the latest item wins
+  CHECK(!queue.overwrite(item));
+  TaskQueue<Item> latest;
+  latest.begin(1);
+  for (uint32_t i = 1; i <= 5; i++) {
+    item.seq = i;
+    CHECK(latest.overwrite(item));
+  }
+  CHECK(latest.waiting() == 1);
+  CHECK(latest.receive(&out, 0) && out.seq == 5);
+
+  // A blocked receiver wakes when another thread sends
+  std::thread sender([&latest] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    Item late = {42, "late"};
+    latest.send(late, 0);
+  });
+  CHECK(latest.receive(&out, TASK_WAIT_FOREVER) && out.seq == 42);
+  sender.join();
+
+  TaskMutex mutex;
+  int counter = 0;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < 4; t++) {
+    workers.push_back(std::thread([&mutex, &counter] {
+      for (int i = 0; i < 10000; i++) {
+        TaskLock lock(mutex);
+        counter++;
+      }
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+  CHECK(counter == 40000);
+}
+
+// Mirrors NetRequest in the firmware
+struct Tap {
+  uint32_t seq;
+  uint8_t type;
+  Clock::time_point tappedAt;
+};
+
+#define MODEL_QUEUE_DEPTH  32
+#define MODEL_TAPS         300
+#define MODEL_TAP_EVERY_MS 15   // Far busier than a real door
+#define MODEL_LOOP_MS      2    // RFID task tick
+#define MODEL_POST_MS      8    // One upload round trip
+#define MODEL_SYNC_EVERY   60   // Taps between periodic syncs
+#define MODEL_SYNC_MS      200  // A periodic sync stalls the network task this long
+
+static double percentile(std::vector<double> values, double p) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  size_t i = (size_t)(p * (values.size() - 1) + 0.5);
+  return values[i];
+}
+
+static void testTaskModel() {
+  TaskQueue<Tap> netQueue;
+  netQueue.begin(MODEL_QUEUE_DEPTH);
+
+  std::atomic<bool> done(false);
+  std::vector<double> latencies;
+  std::vector<uint32_t> journaled;
+  double maxLoopGap = 0;
+
+  // Network task: journal each tap, upload it, and now and then run a long
+  // sync. Queued work preempts the upload, as in uploadJournal().
+  std::thread network([&] {
+    uint32_t handled = 0;
+    for (;;) {
+      Tap tap;
+      if (!netQueue.receive(&tap, 50)) {
+        if (done) break;
+        continue;
+      }
+      latencies.push_back(msSince(tap.tappedAt));
+      journaled.push_back(tap.seq);
+      handled++;
+
+      if (netQueue.waiting() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(MODEL_POST_MS));
+      }
+      if (handled % MODEL_SYNC_EVERY == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(MODEL_SYNC_MS));
+      }
+    }
+  });
+
+  // RFID task: tick every MODEL_LOOP_MS and hand off a tap on schedule
+  Clock::time_point start = Clock::now();
+  Clock::time_point lastTick = start;
+  uint32_t sent = 0;
+  while (sent < MODEL_TAPS) {
+    Clock::time_point now = Clock::now();
+    maxLoopGap = std::max(maxLoopGap, std::chrono::duration<double, std::milli>(now - lastTick).count());
+    lastTick = now;
+
+    if (msSince(start) >= (double)sent * MODEL_TAP_EVERY_MS) {
+      Tap tap = {sent + 1, 0, Clock::now()};
+      CHECK(netQueue.send(tap, 1000));
+      sent++;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(MODEL_LOOP_MS));
+  }
+  done = true;
+  network.join();
+
+  CHECK(journaled.size() == MODEL_TAPS);
+  for (size_t i = 0; i < journaled.size(); i++) {
+    CHECK(journaled[i] == i + 1);  // In order, none lost
+  }
+  CHECK(netQueue.dropped() == 0);
+  CHECK(netQueue.highWater() <= MODEL_QUEUE_DEPTH);
+  CHECK(netQueue.highWater() > 1);  // The syncs did back up the queue
+  // The RFID loop never waits on the network stalls
+  CHECK(maxLoopGap < MODEL_SYNC_MS / 2);
+
+  printf("  %d taps every %d ms, %d ms upload, %d ms sync every %d taps\n",
+         MODEL_TAPS, MODEL_TAP_EVERY_MS, MODEL_POST_MS, MODEL_SYNC_MS, MODEL_SYNC_EVERY);
+  printf("  queue high water %u/%d, dropped %u\n",
+         (unsigned)netQueue.highWater(), MODEL_QUEUE_DEPTH, (unsigned)netQueue.dropped());
+  printf("  tap->journal latency ms: p50 %.1f  p95 %.1f  p99 %.1f  max %.1f\n",
+         percentile(latencies, 0.50), percentile(latencies, 0.95),
+         percentile(latencies, 0.99), percentile(latencies, 1.0));
+  printf("  longest RFID loop gap %.1f ms\n", maxLoopGap);
+}
+
+int main() {
+  printf("Queue basics\n");
+  testQueueBasics();
+  printf("Task model\n");
+  testTaskModel();
+
+  if (failures == 0) {
+    printf("All task sync tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
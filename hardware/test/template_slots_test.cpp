@@ -0,0 +1,365 @@
+/*
+ * Host-side test for the fingerprint template slot table
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -I. test/template_slots_test.cpp template_slots.cpp -o template_slots_test
+ *   ./template_slots_test
+ *
+ * Runs the table against a simulated R307 library and an in-memory flash
+ * file. Checks LRU eviction, persistence and crash safety, then syncs a
+ * 5,000-user location into 1,000 sensor slots and replays taps against it.
+ * Reports sync throughput in sensor time (DownChar at 57600 baud plus the
+ * Store flash write), host CPU per operation and the tap hit rate.
+ */
+
+#include "template_slots.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+// R307 timings in milliseconds
+#define DOWNCHAR_MS  106  // 512 bytes in 8 data packets at 57600 baud
+#define STORE_MS     40   // Store: template to sensor flash
+
+// The template for (libSlot, version) carries both in its first bytes, so
+// the test can tell which template the sensor really holds
+static void makeTemplate(uint16_t libSlot, uint32_t version, uint8_t* tpl) {
+  memset(tpl, 0xA5, TEMPLATE_BYTES);
+  memcpy(tpl, &libSlot, sizeof(libSlot));
+  memcpy(tpl + 2, &version, sizeof(version));
+}
+
+class SimSensor : public TemplateSensor {
+public:
+  std::vector<uint16_t> libSlot;
+  std::vector<uint32_t> version;
+  uint64_t busyMs = 0;
+  uint32_t stores = 0;
+  bool failNext = false;
+
+  explicit SimSensor(uint16_t capacity) : libSlot(capacity, 0), version(capacity, 0) {}
+
+  bool storeTemplate(uint16_t sensorSlot, const uint8_t* tpl, size_t len) override {
+    busyMs += DOWNCHAR_MS;
+    if (failNext || len != TEMPLATE_BYTES || sensorSlot >= libSlot.size()) {
+      failNext = false;
+      libSlot[sensorSlot] = 0xFFFF;  // DownChar got partway: slot contents unknown
+      return false;
+    }
+    busyMs += STORE_MS;
+    memcpy(&libSlot[sensorSlot], tpl, sizeof(uint16_t));
+    memcpy(&version[sensorSlot], tpl + 2, sizeof(uint32_t));
+    stores++;
+    return true;
+  }
+};
+
+class MemStore : public TemplateSlotStore {
+public:
+  std::vector<uint8_t> data;
+  uint32_t writes = 0;
+  uint64_t bytesWritten = 0;
+
+  size_t size() override { return data.size(); }
+  bool readAt(size_t offset, void* buf, size_t len) override {
+    if (offset + len > data.size()) return false;
+    memcpy(buf, &data[offset], len);
+    return true;
+  }
+  bool writeAt(size_t offset, const void* buf, size_t len) override {
+    if (offset + len > data.size()) data.resize(offset + len);
+    memcpy(&data[offset], buf, len);
+    writes++;
+    bytesWritten += len;
+    return true;
+  }
+};
+
+static int32_t install(TemplateSlots& slots, uint16_t libSlot, uint32_t version) {
+  uint8_t tpl[TEMPLATE_BYTES];
+  makeTemplate(libSlot, version, tpl);
+  return slots.install(libSlot, version, tpl, sizeof(tpl));
+}
+
+// Every mapping in the table points at the template the sensor really holds
+static bool consistent(TemplateSlots& slots, const SimSensor& sensor, uint16_t maxLib) {
+  for (uint16_t lib = 1; lib <= maxLib; lib++) {
+    int32_t index = slots.find(lib);
+    if (index >= 0 && sensor.libSlot[index] != lib) return false;
+  }
+  return true;
+}
+
+static void testLru() {
+  SimSensor sensor(4);
+  MemStore store;
+  TemplateSlots* slots = new TemplateSlots();
+  CHECK(slots->begin(&sensor, &store, 4));
+  CHECK(slots->used() == 0);
+
+  for (uint16_t lib = 1; lib <= 4; lib++) CHECK(install(*slots, lib, 1) >= 0);
+  CHECK(slots->used() == 4);
+  int32_t slotOf2 = slots->find(2);
+  slots->touch(1);
+  slots->touch(3);
+  slots->touch(4);
+
+  // 2 is now the least recently used
+  CHECK(install(*slots, 5, 1) == slotOf2);
+  CHECK(slots->find(2) < 0);
+  CHECK(slots->stats().evictions == 1);
+  CHECK(sensor.libSlot[slotOf2] == 5);
+
+  // A new version replaces the template in place
+  int32_t slotOf4 = slots->find(4);
+  CHECK(!slots->current(4, 2));
+  CHECK(install(*slots, 4, 2) == slotOf4);
+  CHECK(slots->current(4, 2));
+  CHECK(sensor.version[slotOf4] == 2);
+  CHECK(slots->stats().evictions == 1);
+
+  // Reload from flash: same mapping, and the use clock carries on
+  slots->touch(5);
+  slots->flush();
+  delete slots;
+  slots = new TemplateSlots();
+  CHECK(slots->begin(&sensor, &store, 4));
+  CHECK(slots->used() == 4);
+  CHECK(slots->find(5) == slotOf2);
+  CHECK(slots->current(4, 2));
+  CHECK(consistent(*slots, sensor, 10));
+  slots->touch(1);
+  slots->touch(4);
+  CHECK(install(*slots, 6, 1) == slots->find(6));
+  CHECK(slots->find(3) < 0);  // Oldest use survived the reboot
+
+  // Another layout on flash starts empty rather than guessing
+  delete slots;
+  slots = new TemplateSlots();
+  CHECK(slots->begin(&sensor, &store, 3));
+  CHECK(slots->used() == 0);
+  delete slots;
+}
+
+static void testFailedInstall() {
+  SimSensor sensor(2);
+  MemStore store;
+  TemplateSlots slots;
+  slots.begin(&sensor, &store, 2);
+  install(slots, 1, 1);
+  install(slots, 2, 1);
+  slots.touch(2);
+
+  // The sensor write fails while replacing 1: neither 1 nor 3 may map there
+  sensor.failNext = true;
+  CHECK(install(slots, 3, 1) < 0);
+  CHECK(slots.find(1) < 0);
+  CHECK(slots.find(3) < 0);
+  CHECK(slots.used() == 1);
+  CHECK(slots.stats().failures == 1);
+
+  // Same after a reboot: the entry was freed on flash before the write
+  TemplateSlots reloaded;
+  reloaded.begin(&sensor, &store, 2);
+  CHECK(reloaded.find(1) < 0);
+  CHECK(reloaded.find(2) >= 0);
+  CHECK(consistent(reloaded, sensor, 3));
+
+  // The freed slot is reused first
+  CHECK(install(reloaded, 3, 1) >= 0);
+  CHECK(consistent(reloaded, sensor, 3));
+}
+
+static void testSyncKeepsWanted() {
+  SimSensor sensor(3);
+  MemStore store;
+  TemplateSlots slots;
+  slots.begin(&sensor, &store, 3);
+  install(slots, 10, 1);
+  install(slots, 11, 1);
+  install(slots, 12, 1);
+  slots.touch(10);
+  slots.touch(11);
+  slots.touch(12);
+
+  // The location now wants 12 (still current), 20 and 21. 12 was used
+  // most recently anyway; 20 must not evict 12 or later entries the pass
+  // has already kept or installed.
+  slots.beginSync();
+  CHECK(slots.keep(12, 1));
+  CHECK(!slots.keep(20, 1));
+  CHECK(install(slots, 20, 1) >= 0);
+  CHECK(!slots.keep(21, 1));
+  CHECK(install(slots, 21, 1) >= 0);
+  CHECK(!slots.keep(22, 1));
+  CHECK(install(slots, 22, 1) < 0);  // Full of wanted templates
+  slots.endSync();
+
+  CHECK(slots.find(12) >= 0);
+  CHECK(slots.find(20) >= 0);
+  CHECK(slots.find(21) >= 0);
+  CHECK(slots.find(10) < 0);
+  CHECK(slots.find(11) < 0);
+  CHECK(consistent(slots, sensor, 30));
+
+  // Outside a sync the LRU rule alone decides; synced templates were
+  // never used here, so a template fetched for a tap replaces one of them
+  slots.touch(20);
+  CHECK(install(slots, 22, 1) == slots.find(22));
+  CHECK(slots.find(20) >= 0);
+  CHECK(slots.find(21) < 0);
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double usSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+#define SCALE_USERS     5000
+#define SCALE_SLOTS     1000
+#define SCALE_TAPS      20000
+#define SCALE_BUMPS     50
+
+struct SyncReport {
+  uint32_t installs;
+  uint64_t sensorMs;
+  double hostUs;
+};
+
+// One sync pass over a manifest in priority order, as templateSync() runs it
+static SyncReport syncPass(TemplateSlots& slots, SimSensor& sensor,
+                           const std::vector<uint16_t>& manifest,
+                           const std::vector<uint32_t>& versions) {
+  SyncReport r = {0, 0, 0};
+  uint64_t sensorBefore = sensor.busyMs;
+  uint32_t installsBefore = slots.stats().installs;
+  uint8_t tpl[TEMPLATE_BYTES];
+
+  Clock::time_point start = Clock::now();
+  slots.beginSync();
+  for (size_t i = 0; i < manifest.size(); i++) {
+    uint16_t lib = manifest[i];
+    if (slots.keep(lib, versions[lib])) continue;
+    makeTemplate(lib, versions[lib], tpl);
+    slots.install(lib, versions[lib], tpl, sizeof(tpl));
+  }
+  slots.endSync();
+  r.hostUs = usSince(start);
+  r.installs = slots.stats().installs - installsBefore;
+  r.sensorMs = sensor.busyMs - sensorBefore;
+  return r;
+}
+
+static void printSync(const char* name, const SyncReport& r) {
+  printf("  %-26s %5u installs  sensor %7.1f s  (%.1f templates/s)  host %8.0f us\n",
+         name, (unsigned)r.installs, r.sensorMs / 1000.0,
+         r.sensorMs ? r.installs * 1000.0 / r.sensorMs : 0.0, r.hostUs);
+}
+
+static void testScale() {
+  SimSensor sensor(SCALE_SLOTS);
+  MemStore store;
+  TemplateSlots* slots = new TemplateSlots();
+  CHECK(slots->begin(&sensor, &store, SCALE_SLOTS));
+
+  // Users are ranked by how often they come through this door; the server
+  // sends the top SCALE_SLOTS in that order. Taps follow a Zipf curve.
+  std::vector<uint32_t> versions(SCALE_USERS + 1, 1);
+  std::vector<uint16_t> manifest;
+  for (uint16_t lib = 1; lib <= SCALE_SLOTS; lib++) manifest.push_back(lib);
+
+  printf("Sync: %d users, %d sensor slots\n", SCALE_USERS, SCALE_SLOTS);
+  SyncReport first = syncPass(*slots, sensor, manifest, versions);
+  printSync("initial", first);
+  CHECK(first.installs == SCALE_SLOTS);
+  CHECK(slots->used() == SCALE_SLOTS);
+
+  SyncReport idle = syncPass(*slots, sensor, manifest, versions);
+  printSync("unchanged", idle);
+  CHECK(idle.installs == 0);
+  CHECK(idle.sensorMs == 0);
+
+  srand(777);
+  for (int i = 0; i < SCALE_BUMPS; i++) versions[1 + rand() % SCALE_SLOTS]++;
+  SyncReport bumped = syncPass(*slots, sensor, manifest, versions);
+  printSync("re-enrolled users", bumped);
+  CHECK(bumped.installs > 0 && bumped.installs <= SCALE_BUMPS);
+  CHECK(slots->stats().evictions == 0);
+
+  // Zipf(1) over all users: cumulative weights for inverse sampling
+  std::vector<double> cdf(SCALE_USERS + 1, 0);
+  for (int u = 1; u <= SCALE_USERS; u++) cdf[u] = cdf[u - 1] + 1.0 / u;
+  for (int u = 1; u <= SCALE_USERS; u++) cdf[u] /= cdf[SCALE_USERS];
+
+  uint32_t hits = 0, fetches = 0;
+  uint64_t sensorBefore = sensor.busyMs;
+  uint64_t flashBefore = store.bytesWritten;
+  double lookupUs = 0;
+  for (int t = 0; t < SCALE_TAPS; t++) {
+    double r = (double)rand() / RAND_MAX;
+    uint16_t lib = (uint16_t)(std::lower_bound(cdf.begin() + 1, cdf.end(), r) - cdf.begin());
+
+    Clock::time_point start = Clock::now();
+    int32_t index = slots->find(lib);
+    lookupUs += usSince(start);
+    if (index >= 0) {
+      hits++;
+    } else {
+      // Fetched when the card is accepted, before the finger is matched
+      fetches++;
+      CHECK(install(*slots, lib, versions[lib]) >= 0);
+    }
+    slots->touch(lib);
+    if (t % 16 == 15) slots->flush();  // The network task flushes when idle
+  }
+  slots->flush();
+  double hitRate = (double)hits / SCALE_TAPS;
+  // The best any fixed set could do is hold the top SCALE_SLOTS users
+  double ideal = cdf[SCALE_SLOTS];
+  printf("  %d Zipf taps: hit rate %.1f%% (static top-%d %.1f%%), %u on-demand fetches (%.1f s sensor), "
+         "lookup %.2f us, %.1f flash bytes/tap\n",
+         SCALE_TAPS, hitRate * 100.0, SCALE_SLOTS, ideal * 100.0, (unsigned)fetches,
+         (sensor.busyMs - sensorBefore) / 1000.0, lookupUs / SCALE_TAPS,
+         (double)(store.bytesWritten - flashBefore) / SCALE_TAPS);
+  CHECK(hitRate > ideal - 0.10);
+  CHECK(slots->used() == SCALE_SLOTS);
+  CHECK(consistent(*slots, sensor, SCALE_USERS));
+
+  // Reboot: the table comes back and a sync only fills what taps evicted
+  delete slots;
+  slots = new TemplateSlots();
+  CHECK(slots->begin(&sensor, &store, SCALE_SLOTS));
+  CHECK(slots->used() == SCALE_SLOTS);
+  CHECK(consistent(*slots, sensor, SCALE_USERS));
+  SyncReport after = syncPass(*slots, sensor, manifest, versions);
+  printSync("after reboot", after);
+  CHECK(after.installs <= fetches);
+  CHECK(consistent(*slots, sensor, SCALE_USERS));
+  delete slots;
+}
+
+int main() {
+  printf("LRU and persistence\n");
+  testLru();
+  testFailedInstall();
+  testSyncKeepsWanted();
+
+  testScale();
+
+  if (failures == 0) {
+    printf("All template slot tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
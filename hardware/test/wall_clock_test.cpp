@@ -0,0 +1,231 @@
+/*
+ * Host-side test for the wall clock
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -I. test/wall_clock_test.cpp wall_clock.cpp -o wall_clock_test
+ *   ./wall_clock_test
+ *
+ * Plays a door through a month of reboots, SNTP outages and a millis()
+ * wrap against an in-memory store, checking that every journaled event
+ * resolves to its true time once its boot synced, to a lower bound before
+ * that, and that (boot id, seq) keys never repeat.
+ */
+
+#include "wall_clock.h"
+#include <stdio.h>
+#include <string.h>
+#include <set>
+#include <utility>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+// A file that survives reboots, or not
+class MemoryStore : public WallClockStore {
+public:
+  MemoryStore() : len(0), saves(0) {}
+  bool load(void* buf, size_t n) {
+    if (len != n) return false;
+    memcpy(buf, data, n);
+    return true;
+  }
+  bool save(const void* buf, size_t n) {
+    if (n > sizeof(data)) return false;
+    memcpy(data, buf, n);
+    len = n;
+    saves++;
+    return true;
+  }
+  void erase() { len = 0; }
+
+  uint8_t data[2048];
+  size_t len;
+  int saves;
+};
+
+static const int64_t T0 = 1760000000000LL;  // Unix ms when the test door first boots
+
+static void testFirstBootUnknownUntilSync() {
+  MemoryStore store;
+  WallClock clock;
+  CHECK(clock.begin(&store, 300, 41));
+  CHECK(clock.bootId() == 42);
+  CHECK(store.saves == 1);  // Boot id is on flash before the first event
+  CHECK(clock.source() == WALL_CLOCK_UNKNOWN);
+
+  // A tap before SNTP answers only has its uptime
+  uint32_t boot = clock.bootId();
+  int64_t unixMs = -1;
+  CHECK(clock.resolve(boot, 5000, &unixMs) == WALL_CLOCK_UNKNOWN);
+  CHECK(unixMs == 0);
+
+  // SNTP answers at uptime 20 s; the earlier tap resolves retroactively
+  clock.synced(T0 + 20000, 20000);
+  CHECK(clock.source() == WALL_CLOCK_SYNCED);
+  CHECK(clock.resolve(boot, 5000, &unixMs) == WALL_CLOCK_SYNCED);
+  CHECK(unixMs == T0 + 5000);
+
+  // Unknown and legacy boot ids stay unknown
+  CHECK(clock.resolve(0, 5000, &unixMs) == WALL_CLOCK_UNKNOWN);
+  CHECK(clock.resolve(boot + 1, 5000, &unixMs) == WALL_CLOCK_UNKNOWN);
+
+  // A bogus answer (epoch) is ignored
+  clock.synced(12345, 30000);
+  CHECK(clock.resolve(boot, 5000, &unixMs) == WALL_CLOCK_SYNCED && unixMs == T0 + 5000);
+}
+
+static void testRebootEstimateThenSync() {
+  MemoryStore store;
+  WallClock clock;
+  clock.begin(&store, 100, 0);
+  clock.synced(T0, 1000);
+  uint32_t first = clock.bootId();
+  clock.tick(1000 + WALL_CLOCK_SAVE_MS);  // Saves T0 + SAVE_MS - 1000 for the next boot
+
+  // Power cut 10 minutes after the last save; the next boot comes up offline
+  WallClock after;
+  after.begin(&store, 200, 0);
+  uint32_t second = after.bootId();
+  CHECK(second == first + 1);
+  CHECK(after.source() == WALL_CLOCK_ESTIMATED);
+
+  int64_t unixMs;
+  int64_t trueTime = T0 + WALL_CLOCK_SAVE_MS - 1000 + 600000 + 5000;  // Tap at uptime 5 s
+  CHECK(after.resolve(second, 5000, &unixMs) == WALL_CLOCK_ESTIMATED);
+  CHECK(unixMs <= trueTime);  // A lower bound, off by the outage
+  CHECK(trueTime - unixMs <= 600000);
+
+  // The previous boot's events still resolve after the reboot
+  CHECK(after.resolve(first, 2000, &unixMs) == WALL_CLOCK_SYNCED && unixMs == T0 + 1000);
+
+  // A running RTC beats the saved time, but never moves it backwards
+  after.estimated(trueTime - 5000 + 300 - 1000, 300);
+  CHECK(after.resolve(second, 5000, &unixMs) == WALL_CLOCK_ESTIMATED);
+  CHECK(unixMs == trueTime - 1000);
+  after.estimated(T0, 400);
+  CHECK(after.resolve(second, 5000, &unixMs) == WALL_CLOCK_ESTIMATED && unixMs == trueTime - 1000);
+
+  // SNTP corrects the boot's taps exactly
+  after.synced(trueTime - 5000 + 60000, 60000);
+  CHECK(after.resolve(second, 5000, &unixMs) == WALL_CLOCK_SYNCED && unixMs == trueTime);
+  after.estimated(trueTime + 999999, 61000);  // Ignored once synced
+  CHECK(after.resolve(second, 5000, &unixMs) == WALL_CLOCK_SYNCED && unixMs == trueTime);
+}
+
+static void testMillisWrap() {
+  MemoryStore store;
+  WallClock clock;
+  clock.begin(&store, 0, 7);
+  clock.synced(T0, 0);
+  uint32_t before = clock.bootId();
+
+  uint32_t now = 0;
+  for (int i = 0; i < 50 * 24; i++) {  // 50 days of hourly ticks
+    now += 3600000u;
+    clock.tick(now);
+  }
+  uint32_t afterWrap = clock.bootId();
+  CHECK(afterWrap == before + 1);
+
+  int64_t unixMs;
+  CHECK(clock.resolve(before, 4000000000u, &unixMs) == WALL_CLOCK_SYNCED);
+  CHECK(unixMs == T0 + 4000000000LL);
+  // 50 days of uptime is past the wrap; the new id carries 2^32 ms
+  CHECK(clock.resolve(afterWrap, now, &unixMs) == WALL_CLOCK_SYNCED);
+  CHECK(unixMs == T0 + 50LL * 24 * 3600000);
+}
+
+static void testErasedFlash() {
+  MemoryStore store;
+  WallClock clock;
+  clock.begin(&store, 0, 1000);
+  CHECK(clock.bootId() == 1001);
+  store.erase();
+  WallClock fresh;
+  fresh.begin(&store, 0, 0xFFFFFFFF);  // Skips 0, which marks legacy records
+  CHECK(fresh.bootId() == 1);
+
+  // A corrupt file is treated like a missing one
+  store.data[0] ^= 0xFF;
+  WallClock corrupt;
+  corrupt.begin(&store, 0, 500);
+  CHECK(corrupt.bootId() == 501);
+}
+
+// A month of 3 reboots a day with SNTP down a third of the time. Every
+// journaled event keeps a unique key and resolves no later than its true
+// time; events from synced boots resolve exactly.
+static void testSimulatedMonth() {
+  MemoryStore store;
+  std::set<std::pair<uint32_t, uint32_t> > keys;
+  int64_t trueNow = T0;
+  uint32_t seq = 1;
+  int exact = 0, estimated = 0, unknown = 0, stale = 0;
+  uint32_t rng = 12345;
+
+  struct Event { uint32_t bootId; uint32_t uptime; int64_t trueTime; };
+  static Event events[100000];
+  int count = 0;
+
+  WallClock clock;
+  for (int boot = 0; boot < 90; boot++) {
+    trueNow += 30000;  // Off for 30 s
+    clock = WallClock();
+    clock.begin(&store, 0, 99);
+    rng = rng * 1103515245 + 12345;
+    bool sntpUp = (rng >> 16) % 3 != 0;
+
+    // 8 hours of uptime, a tap every minute, SNTP after 90 s when it is up
+    for (uint32_t t = 60000; t <= 8u * 3600000u; t += 60000) {
+      if (sntpUp && t == 120000) clock.synced(trueNow + t, t);
+      clock.tick(t);
+      Event& e = events[count++];
+      e.bootId = clock.bootId();
+      e.uptime = t;
+      e.trueTime = trueNow + t;
+      CHECK(keys.insert(std::make_pair(e.bootId, seq++)).second);
+    }
+    trueNow += 8LL * 3600000;
+  }
+
+  // Uploads happen later, after further reboots: only the last 32 boots
+  // are still in the table, which is how long the journal keeps records
+  for (int i = 0; i < count; i++) {
+    int64_t unixMs;
+    uint8_t source = clock.resolve(events[i].bootId, events[i].uptime, &unixMs);
+    if (source == WALL_CLOCK_SYNCED) {
+      exact++;
+      CHECK(unixMs == events[i].trueTime);
+    } else if (source == WALL_CLOCK_ESTIMATED) {
+      estimated++;
+      CHECK(unixMs <= events[i].trueTime);
+    } else {
+      unknown++;
+    }
+    if (source != WALL_CLOCK_UNKNOWN && events[i].trueTime - unixMs > 3600000) stale++;
+  }
+  printf("  %d events over 90 boots: %d exact, %d estimated, %d unknown (boot forgotten)\n",
+         count, exact, estimated, unknown);
+  printf("  estimates more than an hour early: %d; store writes: %d\n", stale, store.saves);
+  CHECK(exact > 0 && estimated > 0);
+  CHECK(stale == 0);
+}
+
+int main() {
+  printf("Wall clock\n");
+  testFirstBootUnknownUntilSync();
+  testRebootEstimateThenSync();
+  testMillisWrap();
+  testErasedFlash();
+  testSimulatedMonth();
+
+  if (failures == 0) {
+    printf("All wall clock tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
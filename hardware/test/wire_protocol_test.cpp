@@ -0,0 +1,247 @@
+/*
+ * Host-side test for the binary wire protocol
+ *
+ * Build and run from the hardware/ directory:
+ *   g++ -O2 -std=c++11 -I. test/wire_protocol_test.cpp wire_protocol.cpp -o wire_protocol_test
+ *   ./wire_protocol_test
+ *
+ * Checks the encoders against byte strings produced by backend/wireProtocol.js
+ * and that short buffers and truncated replies are refused. Then reports body
+ * bytes for each request against the JSON the firmware sends, and encode
+ * CPU per event against printf-built JSON (a lower bound for ArduinoJson,
+ * which also builds a document tree first).
+ */
+
+#include "wire_protocol.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+  } while (0)
+
+static size_t fromHex(const char* hex, uint8_t* out, size_t cap) {
+  size_t n = 0;
+  for (; hex[0] && hex[1] && n < cap; hex += 2) {
+    unsigned int b;
+    sscanf(hex, "%2x", &b);
+    out[n++] = (uint8_t)b;
+  }
+  return n;
+}
+
+// An event from boot 3, SNTP-synced unless time is 0
+static WireEvent makeEvent(uint32_t seq, int64_t time, uint8_t action,
+                           const uint8_t* uid, uint8_t uidLen) {
+  WireEvent event;
+  memset(&event, 0, sizeof(event));
+  event.seq = seq;
+  event.bootId = 3;
+  event.time = time;
+  event.clock = time != 0 ? 2 : 0;  // WALL_CLOCK_SYNCED or UNKNOWN
+  event.action = action;
+  event.uidLen = uidLen;
+  memcpy(event.uid, uid, uidLen);
+  return event;
+}
+
+static const uint8_t UID4[] = {0x04, 0xA1, 0xB2, 0xC3};
+static const uint8_t UID7[] = {0x04, 0xA1, 0xB2, 0xC3, 0xD4, 0xE5, 0xF6};
+
+// Encoded by backend/wireProtocol.js
+static const char* BATCH_HEX =
+    "415701050d45535033325f444f4f525f30310d4d61696e20456e7472616e6365020007000000030000007b"
+    "c02cc89901000002010404a1b2c30800000003000000000000000000000000000704a1b2c3d4e5f6";
+static const char* VERIFY_REQUEST_HEX = "415701010404a1b2c3";
+static const char* VERIFY_REPLY_HEX = "4157010200022c010341646103752d31";
+
+static void testMatchesBackend() {
+  uint8_t expected[128], buf[128];
+  size_t expectedLen = fromHex(VERIFY_REQUEST_HEX, expected, sizeof(expected));
+  size_t len = wireEncodeVerifyRequest(UID4, 4, buf, sizeof(buf));
+  CHECK(len == expectedLen && memcmp(buf, expected, len) == 0);
+
+  WireBatch batch;
+  CHECK(wireBatchBegin(&batch, buf, sizeof(buf), "ESP32_DOOR_01", "Main Entrance"));
+  CHECK(wireBatchAdd(&batch, makeEvent(7, 1760000000123LL, 1, UID4, 4)));
+  CHECK(wireBatchAdd(&batch, makeEvent(8, 0, 0, UID7, 7)));
+  len = wireBatchEnd(&batch);
+  expectedLen = fromHex(BATCH_HEX, expected, sizeof(expected));
+  CHECK(len == expectedLen && memcmp(buf, expected, len) == 0);
+
+  len = fromHex(VERIFY_REPLY_HEX, buf, sizeof(buf));
+  WireVerifyReply reply;
+  CHECK(wireDecodeVerifyReply(buf, len, &reply));
+  CHECK(reply.status == WIRE_STATUS_OK);
+  CHECK(reply.role == CARD_ROLE_TEACHER);
+  CHECK(reply.fingerSlot == 300);
+  CHECK(strcmp(reply.name, "Ada") == 0);
+  CHECK(strcmp(reply.userId, "u-1") == 0);
+}
+
+static void testBatchFull() {
+  // Room for the header and two 4-byte-UID events (23 bytes each)
+  uint8_t buf[WIRE_HEADER_SIZE + 2 + 2 + 2 + 2 * 23];
+  WireBatch batch;
+  CHECK(wireBatchBegin(&batch, buf, sizeof(buf), "D", "L"));
+  CHECK(wireBatchAdd(&batch, makeEvent(1, 0, 0, UID4, 4)));
+  CHECK(wireBatchAdd(&batch, makeEvent(2, 0, 0, UID4, 4)));
+  CHECK(!wireBatchAdd(&batch, makeEvent(3, 0, 0, UID4, 4)));
+  CHECK(batch.count == 2);
+  CHECK(wireBatchEnd(&batch) == sizeof(buf));
+  CHECK(buf[8] == 2 && buf[9] == 0);  // Patched count
+
+  // A bad UID length is refused rather than encoded
+  WireBatch other;
+  uint8_t big[256];
+  CHECK(wireBatchBegin(&other, big, sizeof(big), "D", "L"));
+  CHECK(!wireBatchAdd(&other, makeEvent(1, 0, 0, UID4, 0)));
+  CHECK(wireBatchEnd(&other) == 0);  // Empty batches aren't sent
+
+  // Device fields that don't fit fail the batch up front
+  CHECK(!wireBatchBegin(&other, big, 8, "ESP32_DOOR_01", "Main Entrance"));
+  CHECK(!wireBatchAdd(&other, makeEvent(1, 0, 0, UID4, 4)));
+}
+
+static void testTruncatedReplies() {
+  uint8_t buf[64];
+  size_t len = fromHex(VERIFY_REPLY_HEX, buf, sizeof(buf));
+  WireVerifyReply verify;
+  for (size_t cut = 0; cut < len; cut++) {
+    CHECK(!wireDecodeVerifyReply(buf, cut, &verify));
+  }
+
+  // A JSON error body from a server that predates the format
+  const char* json = "{\"success\":false,\"error\":\"RFID UID is required\"}";
+  CHECK(!wireDecodeVerifyReply((const uint8_t*)json, strlen(json), &verify));
+
+  uint8_t reply[] = {'A', 'W', 1, WIRE_ATTENDANCE_REPLY, 0, 3, 0, 1, 0, 0x2A, 0, 0, 0};
+  WireAttendanceReply result;
+  CHECK(wireDecodeAttendanceReply(reply, sizeof(reply), &result));
+  CHECK(result.accepted == 3 && result.rejected == 1 && result.ackedSeq == 42);
+  CHECK(!wireDecodeAttendanceReply(reply, sizeof(reply) - 1, &result));
+  reply[2] = 2;  // Unknown version
+  CHECK(!wireDecodeAttendanceReply(reply, sizeof(reply), &result));
+}
+
+static void testLongNameTruncated() {
+  uint8_t buf[WIRE_HEADER_SIZE + 4 + 1 + 60 + 1 + 3];
+  size_t len = 0;
+  buf[len++] = 'A'; buf[len++] = 'W'; buf[len++] = 1; buf[len++] = WIRE_VERIFY_REPLY;
+  buf[len++] = WIRE_STATUS_OK; buf[len++] = CARD_ROLE_STUDENT; buf[len++] = 5; buf[len++] = 0;
+  buf[len++] = 60;
+  memset(buf + len, 'x', 60);
+  len += 60;
+  buf[len++] = 3; buf[len++] = 'u'; buf[len++] = '-'; buf[len++] = '2';
+
+  WireVerifyReply verify;
+  CHECK(wireDecodeVerifyReply(buf, len, &verify));
+  CHECK(strlen(verify.name) == CARD_NAME_LEN - 1);
+  CHECK(strcmp(verify.userId, "u-2") == 0);
+}
+
+// The body serializeJson() produces for a batch in sendAttendanceBatch()
+static std::string jsonBatch(int events, const char* name) {
+  std::string json = "{\"device_id\":\"ESP32_001\",\"location\":\"Main Entrance\",\"events\":[";
+  char event[192];
+  for (int i = 0; i < events; i++) {
+    snprintf(event, sizeof(event),
+             "%s{\"seq\":%d,\"boot_id\":3,\"rfid_uid\":\"04A1B2C3\",\"student_name\":\"%s\","
+             "\"timestamp\":\"%lld\",\"clock\":\"sntp\",\"action\":\"ENTRY\"}",
+             i > 0 ? "," : "", 100000 + i, name, 1760000000000LL + i * 997LL);
+    json += event;
+  }
+  return json + "]}";
+}
+
+static size_t wireBatchBytes(int events, uint8_t* buf, size_t cap) {
+  WireBatch batch;
+  wireBatchBegin(&batch, buf, cap, "ESP32_001", "Main Entrance");
+  for (int i = 0; i < events; i++) {
+    wireBatchAdd(&batch, makeEvent(100000 + i, 1760000000000LL + i * 997LL, 0, UID4, 4));
+  }
+  return wireBatchEnd(&batch);
+}
+
+static void testSizes() {
+  const char* name = "Adaeze Okonkwo-Bello";  // Typical name length
+  uint8_t buf[2048];
+
+  size_t jsonVerify = strlen("{\"rfid_uid\":\"04A1B2C3\"}");
+  size_t wireVerify = wireEncodeVerifyRequest(UID4, 4, buf, sizeof(buf));
+  // What routes/esp32.js sends back for a student with a UUID user id
+  size_t jsonReply = strlen("{\"success\":true,\"student_name\":\"\",\"user_id\":\"\","
+                            "\"matricNumber\":\"CSC/2021/001\",\"role\":\"student\","
+                            "\"fingerprint_slot\":12}") + strlen(name) + 36;
+  size_t wireReply = WIRE_HEADER_SIZE + 4 + 1 + strlen(name) + 1 + 36;
+
+  printf("  %-28s %8s %8s\n", "body bytes", "JSON", "binary");
+  printf("  %-28s %8zu %8zu\n", "verify-rfid request", jsonVerify, wireVerify);
+  printf("  %-28s %8zu %8zu\n", "verify-rfid reply", jsonReply, wireReply);
+  int sizes[] = {1, 4, 32};
+  for (int i = 0; i < 3; i++) {
+    size_t json = jsonBatch(sizes[i], name).size();
+    size_t wire = wireBatchBytes(sizes[i], buf, sizeof(buf));
+    char label[40];
+    snprintf(label, sizeof(label), "batch of %d", sizes[i]);
+    printf("  %-28s %8zu %8zu  (%.1f vs %.1f per event)\n", label, json, wire,
+           (double)json / sizes[i], (double)wire / sizes[i]);
+    CHECK(wire * 3 < json);
+  }
+  printf("  Content-Type header is %zu bytes longer each way\n",
+         strlen(WIRE_CONTENT_TYPE) - strlen("application/json"));
+  CHECK(wireVerify * 2 < jsonVerify);
+}
+
+static void testEncodeCost() {
+  const int batches = 20000;
+  const int events = 32;
+  uint8_t buf[2048];
+  volatile size_t sink = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int b = 0; b < batches; b++) sink += wireBatchBytes(events, buf, sizeof(buf));
+  double wireNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  for (int b = 0; b < batches; b++) sink += jsonBatch(events, "Adaeze Okonkwo-Bello").size();
+  double jsonNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  uint8_t reply[] = {'A', 'W', 1, WIRE_ATTENDANCE_REPLY, 0, 32, 0, 0, 0, 0x2A, 0, 0, 0};
+  WireAttendanceReply result;
+  start = std::chrono::steady_clock::now();
+  for (int b = 0; b < batches * events; b++) sink += wireDecodeAttendanceReply(reply, sizeof(reply), &result);
+  double decodeNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  double perEvent = (double)batches * events;
+  printf("  host encode per event: binary %.0f ns, printf JSON %.0f ns\n",
+         wireNs / perEvent, jsonNs / perEvent);
+  printf("  host reply decode: binary %.0f ns\n", decodeNs / perEvent);
+  CHECK(wireNs < jsonNs);
+  (void)sink;
+}
+
+int main() {
+  printf("Encoding\n");
+  testMatchesBackend();
+  testBatchFull();
+  testTruncatedReplies();
+  testLongNameTruncated();
+
+  printf("Size\n");
+  testSizes();
+
+  printf("CPU\n");
+  testEncodeCost();
+
+  if (failures == 0) {
+    printf("All wire protocol tests passed\n");
+    return 0;
+  }
+  printf("%d failures\n", failures);
+  return 1;
+}
@@ -0,0 +1,124 @@
+/*
+ * Wall Clock - Unix time for journaled events, across reboots
+ */
+
+#include "wall_clock.h"
+#include <string.h>
+
+#define WALL_CLOCK_MAGIC  0x57434C31  // "WCL1"
+
+WallClock::WallClock() : store_(NULL), lastSaveAt_(0), lastTickAt_(0) {
+  memset(&state_, 0, sizeof(state_));
+}
+
+bool WallClock::begin(WallClockStore* store, uint32_t nowMs, uint32_t seed) {
+  store_ = store;
+  if (!store_->load(&state_, sizeof(state_)) || state_.magic != WALL_CLOCK_MAGIC) {
+    memset(&state_, 0, sizeof(state_));
+    state_.magic = WALL_CLOCK_MAGIC;
+    state_.lastBootId = seed;
+  }
+
+  // The new boot takes the slot of the oldest one
+  state_.lastBootId++;
+  if (state_.lastBootId == 0) state_.lastBootId = 1;  // 0 marks records from before boot ids
+  WallClockBoot* boot = current();
+  memset(boot, 0, sizeof(*boot));
+  boot->bootId = state_.lastBootId;
+  boot->source = WALL_CLOCK_UNKNOWN;
+
+  // The device was off for some time after the saved wall time; events
+  // are at least this late
+  if (state_.savedUnixMs >= WALL_CLOCK_VALID_MS) {
+    boot->source = WALL_CLOCK_ESTIMATED;
+    boot->offsetMs = state_.savedUnixMs - (int64_t)nowMs;
+  }
+  lastTickAt_ = nowMs;
+  return save(nowMs);
+}
+
+// millis() wrapped after 49.7 days. Events from here on get a new boot id
+// whose offset carries the wrap, so uptime stays unambiguous per id.
+void WallClock::rollover(uint32_t nowMs) {
+  WallClockBoot previous = *current();
+  state_.lastBootId++;
+  if (state_.lastBootId == 0) state_.lastBootId = 1;
+  WallClockBoot* boot = current();
+  *boot = previous;
+  boot->bootId = state_.lastBootId;
+  boot->offsetMs = previous.offsetMs + ((int64_t)1 << 32);
+  save(nowMs);
+}
+
+WallClockBoot* WallClock::current() {
+  return &state_.boots[state_.lastBootId % WALL_CLOCK_BOOTS];
+}
+
+const WallClockBoot* WallClock::find(uint32_t bootId) const {
+  if (bootId == 0) return NULL;
+  const WallClockBoot* boot = &state_.boots[bootId % WALL_CLOCK_BOOTS];
+  return boot->bootId == bootId ? boot : NULL;
+}
+
+uint8_t WallClock::source() const {
+  const WallClockBoot* boot = find(state_.lastBootId);
+  return boot != NULL ? boot->source : WALL_CLOCK_UNKNOWN;
+}
+
+void WallClock::synced(int64_t unixMs, uint32_t nowMs) {
+  if (unixMs < WALL_CLOCK_VALID_MS) return;
+  WallClockBoot* boot = current();
+  bool first = boot->source != WALL_CLOCK_SYNCED;
+  boot->source = WALL_CLOCK_SYNCED;
+  boot->offsetMs = unixMs - (int64_t)nowMs;
+  state_.savedUnixMs = unixMs;
+  // Later syncs only correct drift; they are saved with the periodic tick
+  if (first) save(nowMs);
+}
+
+void WallClock::estimated(int64_t unixMs, uint32_t nowMs) {
+  if (unixMs < WALL_CLOCK_VALID_MS) return;
+  WallClockBoot* boot = current();
+  if (boot->source == WALL_CLOCK_SYNCED) return;
+  // A guess never moves the clock back from a later saved time
+  int64_t offsetMs = unixMs - (int64_t)nowMs;
+  if (boot->source == WALL_CLOCK_ESTIMATED && offsetMs <= boot->offsetMs) return;
+  boot->source = WALL_CLOCK_ESTIMATED;
+  boot->offsetMs = offsetMs;
+  state_.savedUnixMs = unixMs;
+  save(nowMs);
+}
+
+void WallClock::tick(uint32_t nowMs) {
+  if (nowMs < lastTickAt_) rollover(nowMs);
+  lastTickAt_ = nowMs;
+
+  WallClockBoot* boot = current();
+  if (boot->source == WALL_CLOCK_UNKNOWN) return;
+  if (nowMs - lastSaveAt_ < WALL_CLOCK_SAVE_MS) return;
+  state_.savedUnixMs = boot->offsetMs + nowMs;
+  save(nowMs);
+}
+
+uint8_t WallClock::resolve(uint32_t bootId, uint32_t uptimeMs, int64_t* unixMs) const {
+  const WallClockBoot* boot = find(bootId);
+  if (boot == NULL || boot->source == WALL_CLOCK_UNKNOWN) {
+    *unixMs = 0;
+    return WALL_CLOCK_UNKNOWN;
+  }
+  *unixMs = boot->offsetMs + uptimeMs;
+  return boot->source;
+}
+
+bool WallClock::save(uint32_t nowMs) {
+  lastSaveAt_ = nowMs;
+  return store_ != NULL && store_->save(&state_, sizeof(state_));
+}
+
+const char* wallClockSourceName(uint8_t source) {
+  switch (source) {
+    case WALL_CLOCK_SYNCED:    return "sntp";
+    case WALL_CLOCK_ESTIMATED: return "estimated";
+    default:                   return "uptime";
+  }
+}
@@ -0,0 +1,110 @@
+/*
+ * Wall Clock - Unix time for journaled events, across reboots
+ *
+ * Events are journaled with millis() and the id of the boot they happened
+ * in, since SNTP may not have answered yet, or ever, during that boot.
+ * Each boot's offset from uptime to Unix time is kept in a small table
+ * that is persisted, so an event gets its wall-clock time when it is
+ * uploaded: exact once SNTP synced during its boot, even if that was after
+ * the event or the upload is after a reboot.
+ *
+ * Until SNTP answers, a boot's offset is estimated from the last wall time
+ * the device saw before it restarted (saved every WALL_CLOCK_SAVE_MS), or
+ * from the RTC if it kept running through the restart. The estimate is a
+ * lower bound and is reported as such. Boot ids are persisted before the
+ * first event, and a fresh table starts from a random id, so (device,
+ * boot id, seq) doesn't repeat even after the flash is erased.
+ *
+ * This module has no Arduino dependencies so it can be tested on a host.
+ */
+
+#ifndef WALL_CLOCK_H
+#define WALL_CLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WALL_CLOCK_FILE      "/clock"
+
+#ifndef WALL_CLOCK_BOOTS
+#define WALL_CLOCK_BOOTS     32      // Boots whose offsets are remembered
+#endif
+#ifndef WALL_CLOCK_SAVE_MS
+#define WALL_CLOCK_SAVE_MS   600000  // Refresh the saved wall time this often
+#endif
+
+// How an event's wall-clock time is known
+#define WALL_CLOCK_UNKNOWN    0  // Uptime only
+#define WALL_CLOCK_ESTIMATED  1  // Lower bound from before the reboot
+#define WALL_CLOCK_SYNCED     2  // SNTP during the event's boot
+
+// Earliest plausible Unix time in ms (2020-01-01); anything earlier is
+// an unset clock or uptime
+#define WALL_CLOCK_VALID_MS  1577836800000LL
+
+struct WallClockBoot {
+  uint32_t bootId;
+  uint8_t source;      // WALL_CLOCK_*
+  uint8_t reserved[3];
+  int64_t offsetMs;    // Unix ms minus millis()
+};
+
+// Where the table lives: a file in SPIFFS on the device
+class WallClockStore {
+public:
+  virtual ~WallClockStore() {}
+  virtual bool load(void* buf, size_t len) = 0;
+  virtual bool save(const void* buf, size_t len) = 0;
+};
+
+class WallClock {
+public:
+  WallClock();
+
+  // Starts a new boot; persists its id before returning. seed is the
+  // first boot id when nothing was saved (esp_random() on the device).
+  bool begin(WallClockStore* store, uint32_t nowMs, uint32_t seed);
+
+  // SNTP answered: Unix time in ms at millis() == nowMs
+  void synced(int64_t unixMs, uint32_t nowMs);
+
+  // A better guess than the saved time, e.g. an RTC that kept running.
+  // Ignored once synced.
+  void estimated(int64_t unixMs, uint32_t nowMs);
+
+  // Call at least once a day; saves the current wall time for the next
+  // boot's estimate every WALL_CLOCK_SAVE_MS and notices millis() wrapping
+  void tick(uint32_t nowMs);
+
+  // Unix ms of an event journaled at millis() == uptimeMs during bootId.
+  // Returns the WALL_CLOCK_* source; *unixMs is 0 when UNKNOWN.
+  uint8_t resolve(uint32_t bootId, uint32_t uptimeMs, int64_t* unixMs) const;
+
+  // Id to journal events with; changes only in begin() and when millis()
+  // wraps
+  uint32_t bootId() const { return state_.lastBootId; }
+  uint8_t source() const;
+
+private:
+  struct State {
+    uint32_t magic;
+    uint32_t lastBootId;
+    int64_t savedUnixMs;  // Last wall time seen, for the next boot's estimate
+    WallClockBoot boots[WALL_CLOCK_BOOTS];
+  };
+
+  WallClockBoot* current();
+  const WallClockBoot* find(uint32_t bootId) const;
+  void rollover(uint32_t nowMs);
+  bool save(uint32_t nowMs);
+
+  WallClockStore* store_;
+  State state_;
+  uint32_t lastSaveAt_;
+  uint32_t lastTickAt_;
+};
+
+// Name of a WALL_CLOCK_* source as the server expects it
+const char* wallClockSourceName(uint8_t source);
+
+#endif // WALL_CLOCK_H
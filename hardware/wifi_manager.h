@@ -6,9 +6,10 @@
 #define WIFI_MANAGER_H
 
 #include <WiFi.h>
+#include <atomic>
 
 // Global variables
-extern bool networkAvailable;
+extern std::atomic<bool> networkAvailable;
 
 // Function declarations
 void connectToWiFi();
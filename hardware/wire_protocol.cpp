@@ -0,0 +1,187 @@
+/*
+ * Wire Protocol - compact binary encoding of the hot-path server requests
+ *
+ * Writers check the remaining space before every field and readers check
+ * the remaining length, so a short buffer or a truncated reply fails the
+ * call instead of reading or writing past the end.
+ */
+
+#include "wire_protocol.h"
+#include <string.h>
+
+struct WireWriter {
+  uint8_t* buf;
+  size_t cap;
+  size_t len;
+  bool ok;
+};
+
+struct WireReader {
+  const uint8_t* buf;
+  size_t len;
+  size_t pos;
+  bool ok;
+};
+
+static void putBytes(WireWriter* w, const void* data, size_t n) {
+  if (!w->ok || w->cap - w->len < n) {
+    w->ok = false;
+    return;
+  }
+  memcpy(w->buf + w->len, data, n);
+  w->len += n;
+}
+
+static void putU8(WireWriter* w, uint8_t v) {
+  putBytes(w, &v, 1);
+}
+
+static void putU16(WireWriter* w, uint16_t v) {
+  uint8_t b[2] = {(uint8_t)v, (uint8_t)(v >> 8)};
+  putBytes(w, b, 2);
+}
+
+static void putU32(WireWriter* w, uint32_t v) {
+  uint8_t b[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+  putBytes(w, b, 4);
+}
+
+static void putU64(WireWriter* w, uint64_t v) {
+  putU32(w, (uint32_t)v);
+  putU32(w, (uint32_t)(v >> 32));
+}
+
+static void putString(WireWriter* w, const char* s) {
+  size_t n = s != NULL ? strlen(s) : 0;
+  if (n > WIRE_STRING_MAX) n = WIRE_STRING_MAX;
+  putU8(w, (uint8_t)n);
+  putBytes(w, s, n);
+}
+
+static void putHeader(WireWriter* w, uint8_t type) {
+  uint8_t header[WIRE_HEADER_SIZE] = {WIRE_MAGIC_0, WIRE_MAGIC_1, WIRE_VERSION, type};
+  putBytes(w, header, sizeof(header));
+}
+
+static const uint8_t* getBytes(WireReader* r, size_t n) {
+  if (!r->ok || r->len - r->pos < n) {
+    r->ok = false;
+    return NULL;
+  }
+  const uint8_t* p = r->buf + r->pos;
+  r->pos += n;
+  return p;
+}
+
+static uint8_t getU8(WireReader* r) {
+  const uint8_t* p = getBytes(r, 1);
+  return p != NULL ? p[0] : 0;
+}
+
+static uint16_t getU16(WireReader* r) {
+  const uint8_t* p = getBytes(r, 2);
+  return p != NULL ? (uint16_t)(p[0] | (p[1] << 8)) : 0;
+}
+
+static uint32_t getU32(WireReader* r) {
+  const uint8_t* p = getBytes(r, 4);
+  return p != NULL ? (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                     ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24) : 0;
+}
+
+// Copy a string into out, truncated to fit and NUL terminated
+static void getString(WireReader* r, char* out, size_t outSize) {
+  uint8_t n = getU8(r);
+  const uint8_t* p = getBytes(r, n);
+  size_t copy = p != NULL ? n : 0;
+  if (copy > outSize - 1) copy = outSize - 1;
+  if (copy > 0) memcpy(out, p, copy);
+  out[copy] = '\0';
+}
+
+bool wireIsMessage(const uint8_t* buf, size_t len, uint8_t type) {
+  return len >= WIRE_HEADER_SIZE && buf[0] == WIRE_MAGIC_0 && buf[1] == WIRE_MAGIC_1 &&
+         buf[2] == WIRE_VERSION && buf[3] == type;
+}
+
+static bool beginRead(WireReader* r, const uint8_t* buf, size_t len, uint8_t type) {
+  r->buf = buf;
+  r->len = len;
+  r->pos = WIRE_HEADER_SIZE;
+  r->ok = wireIsMessage(buf, len, type);
+  return r->ok;
+}
+
+size_t wireEncodeVerifyRequest(const uint8_t* uid, uint8_t uidLen, uint8_t* buf, size_t cap) {
+  if (uidLen == 0 || uidLen > CARD_UID_MAX_LEN) return 0;
+  WireWriter w = {buf, cap, 0, true};
+  putHeader(&w, WIRE_VERIFY_REQUEST);
+  putU8(&w, uidLen);
+  putBytes(&w, uid, uidLen);
+  return w.ok ? w.len : 0;
+}
+
+bool wireDecodeVerifyReply(const uint8_t* buf, size_t len, WireVerifyReply* reply) {
+  WireReader r;
+  memset(reply, 0, sizeof(*reply));
+  if (!beginRead(&r, buf, len, WIRE_VERIFY_REPLY)) return false;
+  reply->status = getU8(&r);
+  reply->role = getU8(&r);
+  reply->fingerSlot = getU16(&r);
+  getString(&r, reply->name, sizeof(reply->name));
+  getString(&r, reply->userId, sizeof(reply->userId));
+  return r.ok;
+}
+
+bool wireBatchBegin(WireBatch* batch, uint8_t* buf, size_t cap,
+                    const char* deviceId, const char* location) {
+  WireWriter w = {buf, cap, 0, true};
+  putHeader(&w, WIRE_ATTENDANCE_KEYED);
+  putString(&w, deviceId);
+  putString(&w, location);
+  batch->countAt = w.len;
+  putU16(&w, 0);
+
+  batch->buf = buf;
+  batch->cap = cap;
+  batch->len = w.ok ? w.len : 0;
+  batch->count = 0;
+  return w.ok;
+}
+
+bool wireBatchAdd(WireBatch* batch, const WireEvent& event) {
+  if (batch->len == 0 || batch->count == 0xFFFF) return false;
+  if (event.uidLen == 0 || event.uidLen > CARD_UID_MAX_LEN) return false;
+
+  WireWriter w = {batch->buf, batch->cap, batch->len, true};
+  putU32(&w, event.seq);
+  putU32(&w, event.bootId);
+  putU64(&w, (uint64_t)event.time);
+  putU8(&w, event.clock);
+  putU8(&w, event.action);
+  putU8(&w, event.uidLen);
+  putBytes(&w, event.uid, event.uidLen);
+  if (!w.ok) return false;  // Batch is full; nothing partial was kept
+
+  batch->len = w.len;
+  batch->count++;
+  return true;
+}
+
+size_t wireBatchEnd(WireBatch* batch) {
+  if (batch->len == 0 || batch->count == 0) return 0;
+  batch->buf[batch->countAt] = (uint8_t)batch->count;
+  batch->buf[batch->countAt + 1] = (uint8_t)(batch->count >> 8);
+  return batch->len;
+}
+
+bool wireDecodeAttendanceReply(const uint8_t* buf, size_t len, WireAttendanceReply* reply) {
+  WireReader r;
+  memset(reply, 0, sizeof(*reply));
+  if (!beginRead(&r, buf, len, WIRE_ATTENDANCE_REPLY)) return false;
+  reply->status = getU8(&r);
+  reply->accepted = getU16(&r);
+  reply->rejected = getU16(&r);
+  reply->ackedSeq = getU32(&r);
+  return r.ok;
+}
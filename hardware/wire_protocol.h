@@ -0,0 +1,110 @@
+/*
+ * Wire Protocol - compact binary encoding of the hot-path server requests
+ *
+ * Card verification and attendance upload are the only requests a door
+ * makes per tap, and as JSON most of each body is key names, quotes and
+ * the hex-encoded UID. This encodes the same fields as fixed little-endian
+ * integers and length-prefixed strings. The server picks the format from
+ * Content-Type, so JSON devices keep working, and the device falls back to
+ * JSON when a server answers a binary request with something else.
+ *
+ * Every message starts with a 4-byte header: 'A' 'W' version type.
+ * Integers are little-endian; strings are a u8 length then the bytes.
+ *
+ *   VERIFY_REQUEST    uidLen u8, uid
+ *   VERIFY_REPLY      status u8, role u8, fingerSlot u16, name str, userId str
+ *   ATTENDANCE        deviceId str, location str, count u16, count x event
+ *     event           seq u32, timestamp u32, action u8, uidLen u8, uid
+ *   ATTENDANCE_REPLY  status u8, accepted u16, rejected u16, ackedSeq u32
+ *   ATTENDANCE_KEYED  deviceId str, location str, count u16, count x event
+ *     event           seq u32, bootId u32, time u64, clock u8, action u8,
+ *                     uidLen u8, uid
+ *
+ * ATTENDANCE_KEYED replaces ATTENDANCE on the device: time is Unix ms (0
+ * when the device doesn't know it) and (deviceId, bootId, seq) lets the
+ * server drop a retried event. Servers still accept ATTENDANCE from older
+ * firmware.
+ *
+ * This module has no Arduino dependencies so it can be tested on a host.
+ */
+
+#ifndef WIRE_PROTOCOL_H
+#define WIRE_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "card_index.h"
+
+#define WIRE_CONTENT_TYPE  "application/vnd.attendance.v1"
+
+#define WIRE_MAGIC_0       'A'
+#define WIRE_MAGIC_1       'W'
+#define WIRE_VERSION       1
+#define WIRE_HEADER_SIZE   4
+
+// Message types
+#define WIRE_VERIFY_REQUEST     1
+#define WIRE_VERIFY_REPLY       2
+#define WIRE_ATTENDANCE         3
+#define WIRE_ATTENDANCE_REPLY   4
+#define WIRE_ATTENDANCE_KEYED   5
+
+// Reply status
+#define WIRE_STATUS_OK          0
+#define WIRE_STATUS_NOT_FOUND   1
+#define WIRE_STATUS_BAD_REQUEST 2
+#define WIRE_STATUS_ERROR       3
+
+// Largest encoded event: seq, bootId, time, clock, action, uidLen and a
+// 10-byte UID
+#define WIRE_EVENT_MAX_SIZE     (4 + 4 + 8 + 1 + 1 + 1 + CARD_UID_MAX_LEN)
+#define WIRE_STRING_MAX         255
+
+struct WireVerifyReply {
+  uint8_t status;
+  uint8_t role;        // CARD_ROLE_*
+  uint16_t fingerSlot;
+  char name[CARD_NAME_LEN];
+  char userId[CARD_USER_ID_LEN];
+};
+
+struct WireEvent {
+  uint32_t seq;
+  uint32_t bootId;
+  int64_t time;        // Unix ms, 0 if unknown
+  uint8_t clock;       // WALL_CLOCK_*
+  uint8_t action;      // JOURNAL_ACTION_*
+  uint8_t uidLen;
+  uint8_t uid[CARD_UID_MAX_LEN];
+};
+
+struct WireAttendanceReply {
+  uint8_t status;
+  uint16_t accepted;
+  uint16_t rejected;
+  uint32_t ackedSeq;
+};
+
+// Attendance batch built in place in a caller's buffer
+struct WireBatch {
+  uint8_t* buf;
+  size_t cap;
+  size_t len;
+  size_t countAt;  // Offset of the event count, patched by wireBatchEnd()
+  uint16_t count;
+};
+
+// Function declarations
+size_t wireEncodeVerifyRequest(const uint8_t* uid, uint8_t uidLen, uint8_t* buf, size_t cap);
+bool wireDecodeVerifyReply(const uint8_t* buf, size_t len, WireVerifyReply* reply);
+
+bool wireBatchBegin(WireBatch* batch, uint8_t* buf, size_t cap,
+                    const char* deviceId, const char* location);
+bool wireBatchAdd(WireBatch* batch, const WireEvent& event);
+size_t wireBatchEnd(WireBatch* batch);
+bool wireDecodeAttendanceReply(const uint8_t* buf, size_t len, WireAttendanceReply* reply);
+
+// True if buf starts with a header of this version and type
+bool wireIsMessage(const uint8_t* buf, size_t len, uint8_t type);
+
+#endif // WIRE_PROTOCOL_H